@@ -1,6 +1,6 @@
 typedef int (*rs_mod_will_write_file)(const char *filename);
 typedef void * (*rs_mod_ctx_init)(const char *filename);
-typedef void (*rs_mod_finish_file)(void *ctx);
+typedef readstat_error_t (*rs_mod_finish_file)(void *ctx);
 
 typedef struct rs_module_s {
     rs_mod_will_write_file      accept;
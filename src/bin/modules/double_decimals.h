@@ -1,6 +0,0 @@
-#ifndef __DOUBLE_DECIMALS_H
-#define __DOUBLE_DECIMALS_H
-
-int double_decimals(double value);
-
-#endif
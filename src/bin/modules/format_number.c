@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "format_number.h"
+
+#define DOUBLE_EXACT_INTEGER_MAX    9007199254740992.0  /* 2^53 */
+#define FLOAT_EXACT_INTEGER_MAX     16777216.0          /* 2^24 */
+
+/* Every power of ten up to 1e22 is exact as a double */
+static const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int format_digits(char *buf, unsigned long long value) {
+    char digits[20];
+    int len = 0, i = 0;
+    do {
+        digits[len++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+
+    while (len) {
+        buf[i++] = digits[--len];
+    }
+    return i;
+}
+
+int format_number_integer(char *buf, long long value) {
+    if (value < 0) {
+        buf[0] = '-';
+        return 1 + format_digits(&buf[1], -(unsigned long long)value);
+    }
+    return format_digits(buf, value);
+}
+
+/* Lays out the significant digits d1 d2 ... dn of the value 0.d1d2...dn * 10^point,
+ * positionally when -7 < point <= 21 and with an exponent otherwise */
+static int format_decimal(char *buf, int negative, const char *digits, int digits_len, int point) {
+    int len = 0, i;
+
+    while (digits_len > 1 && digits[digits_len-1] == '0')
+        digits_len--;
+
+    if (negative)
+        buf[len++] = '-';
+
+    if (digits_len <= point && point <= 21) {
+        memcpy(&buf[len], digits, digits_len);
+        len += digits_len;
+        for (i=digits_len; i<point; i++)
+            buf[len++] = '0';
+    } else if (0 < point && point <= 21) {
+        memcpy(&buf[len], digits, point);
+        len += point;
+        buf[len++] = '.';
+        memcpy(&buf[len], &digits[point], digits_len - point);
+        len += digits_len - point;
+    } else if (-7 < point && point <= 0) {
+        buf[len++] = '0';
+        buf[len++] = '.';
+        for (i=point; i<0; i++)
+            buf[len++] = '0';
+        memcpy(&buf[len], digits, digits_len);
+        len += digits_len;
+    } else {
+        buf[len++] = digits[0];
+        if (digits_len > 1) {
+            buf[len++] = '.';
+            memcpy(&buf[len], &digits[1], digits_len - 1);
+            len += digits_len - 1;
+        }
+        buf[len++] = 'e';
+        buf[len++] = point > 0 ? '+' : '-';
+        len += format_digits(&buf[len], point > 0 ? point - 1 : 1 - point);
+    }
+    return len;
+}
+
+static int format_special(char *buf, double value) {
+    if (isnan(value)) {
+        memcpy(buf, "nan", 3);
+        return 3;
+    }
+    if (value > 0) {
+        memcpy(buf, "inf", 3);
+        return 3;
+    }
+    memcpy(buf, "-inf", 4);
+    return 4;
+}
+
+/* Reads the digits and exponent back out of printf's %e output */
+static int format_exponential(char *buf, int negative, const char *text) {
+    char digits[20];
+    int digits_len = 0;
+    const char *c = text;
+    for (; *c && *c != 'e'; c++) {
+        if (*c >= '0' && *c <= '9')
+            digits[digits_len++] = *c;
+    }
+    return format_decimal(buf, negative, digits, digits_len, atoi(c + 1) + 1);
+}
+
+/* Clinger's fast path: if n / 10^k is the value for some n < 2^precision and
+ * k <= 22, that division is correctly rounded, and so is reading "n * 10^-k"
+ * back. The smallest such k gives the shortest text. */
+static int format_scaled(char *buf, int negative, double magnitude, double exact_max, int is_float) {
+    int k;
+    for (k=0; k<sizeof(powers_of_ten)/sizeof(powers_of_ten[0]); k++) {
+        double scaled = magnitude * powers_of_ten[k];
+        if (scaled >= exact_max)
+            break;
+
+        double n = floor(scaled + 0.5);
+        double back = n / powers_of_ten[k];
+        if (is_float ? (float)back == (float)magnitude : back == magnitude) {
+            char digits[20];
+            int digits_len = format_digits(digits, (unsigned long long)n);
+            return format_decimal(buf, negative, digits, digits_len, digits_len - k);
+        }
+    }
+    return 0;
+}
+
+int format_number_double(char *buf, double value) {
+    char text[32];
+    int negative = signbit(value);
+    double magnitude = fabs(value);
+    int precision, len;
+
+    if (!isfinite(value))
+        return format_special(buf, value);
+
+    if (magnitude == 0.0)
+        return format_decimal(buf, negative, "0", 1, 1);
+
+    if ((len = format_scaled(buf, negative, magnitude, DOUBLE_EXACT_INTEGER_MAX, 0)))
+        return len;
+
+    /* Any decimal of up to DBL_DIG digits survives a round trip through a
+     * normal double, so shorter text would have been found at DBL_DIG */
+    for (precision=(magnitude < DBL_MIN ? 1 : DBL_DIG); precision<17; precision++) {
+        snprintf(text, sizeof(text), "%.*e", precision - 1, magnitude);
+        if (strtod(text, NULL) == magnitude)
+            break;
+    }
+    if (precision == 17)
+        snprintf(text, sizeof(text), "%.*e", precision - 1, magnitude);
+
+    return format_exponential(buf, negative, text);
+}
+
+int format_number_float(char *buf, float value) {
+    char text[32];
+    int negative = signbit(value);
+    float magnitude = fabsf(value);
+    int precision, len;
+
+    if (!isfinite(value))
+        return format_special(buf, value);
+
+    if (magnitude == 0.0f)
+        return format_decimal(buf, negative, "0", 1, 1);
+
+    if ((len = format_scaled(buf, negative, magnitude, FLOAT_EXACT_INTEGER_MAX, 1)))
+        return len;
+
+    for (precision=(magnitude < FLT_MIN ? 1 : FLT_DIG); precision<9; precision++) {
+        snprintf(text, sizeof(text), "%.*e", precision - 1, magnitude);
+        if (strtof(text, NULL) == magnitude)
+            break;
+    }
+    if (precision == 9)
+        snprintf(text, sizeof(text), "%.*e", precision - 1, magnitude);
+
+    return format_exponential(buf, negative, text);
+}
@@ -0,0 +1,18 @@
+#ifndef __FORMAT_NUMBER_H
+#define __FORMAT_NUMBER_H
+
+// Large enough for any value written by the functions below, without a
+// terminating NUL (which they don't write)
+#define FORMAT_NUMBER_MAX_LEN   32
+
+// Each function writes the value's text to buf and returns its length.
+//
+// Doubles and floats are written with the fewest significant digits that
+// read back (with strtod/strtof) as the same value. Magnitudes from 1e-7 up
+// to 1e21 are written in positional notation, others with an exponent, e.g.
+// 0.1, 1500, 1.5e-8 and 1e+21.
+int format_number_integer(char *buf, long long value);
+int format_number_double(char *buf, double value);
+int format_number_float(char *buf, float value);
+
+#endif
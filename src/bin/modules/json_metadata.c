@@ -7,6 +7,7 @@
 #include "json_metadata.h"
 #include "../../readstat.h"
 #include "../format.h"
+#include "../../CKHashTable.h"
 
 /* Function realloc_it() is a wrapper function for standart realloc()
  * with one difference - it frees old memory pointer in case of realloc
@@ -94,33 +95,82 @@ unsigned char get_separator(struct json_metadata* md) {
 	}
 }
 
-jsmntok_t* find_variable_property(const char *js, jsmntok_t *t, const char* varname, const char* property) {
-    if (t->type != JSMN_OBJECT) {
+static json_variable* find_variable(struct json_metadata* md, const char* varname) {
+    if (md->tok->type != JSMN_OBJECT) {
         fprintf(stderr, "expected root token to be OBJECT\n");
         return 0;
     }
-
-    jsmntok_t* variables = find_object_property(js, t, "variables");
-    if (!variables) {
+    if (!md->variables_tok) {
         fprintf(stderr, "Could not find variables property\n");
         return 0;
     }
+
+    json_variable* variable = (json_variable *)ck_str_hash_lookup(varname, md->variables_dict);
+    if (variable && match_token(md->js, variable->name, varname)) {
+        return variable;
+    }
+
+    /* Names too long for the dictionary's keys */
+    for (long i=0; i<md->variables_count; i++) {
+        variable = &md->variables[i];
+        if (variable->name && match_token(md->js, variable->name, varname)) {
+            return variable;
+        }
+    }
+    return 0;
+}
+
+jsmntok_t* find_variable_property(struct json_metadata* md, const char* varname, const char* property) {
+    json_variable* variable = find_variable(md, varname);
+    if (!variable) {
+        return 0;
+    }
+    return find_object_property(md->js, variable->object, property);
+}
+
+static int index_variables(struct json_metadata* md) {
+    char name[CK_HASH_KEY_SIZE];
+
+    if (md->tok->type != JSMN_OBJECT) {
+        return 0;
+    }
+    md->variables_tok = find_object_property(md->js, md->tok, "variables");
+    if (!md->variables_tok) {
+        return 0;
+    }
+
+    md->variables_dict = ck_hash_table_init(2 * md->variables_tok->size + 16);
+    md->variables = calloc(md->variables_tok->size + 1, sizeof(json_variable));
+    if (md->variables_dict == NULL || md->variables == NULL) {
+        fprintf(stderr, "%s: %d: malloc failed: %s\n", __FILE__, __LINE__, strerror(errno));
+        return -1;
+    }
+
     int j = 0;
-    for (int i=0; i<variables->size; i++) {
-        jsmntok_t* variable = variables+1+j;
-        jsmntok_t* name = find_object_property(js, variable, "name");
-        if (name && match_token(js, name, varname)) {
-            return find_object_property(js, variable, property);
-        } else if (name == 0) {
+    for (int i=0; i<md->variables_tok->size; i++) {
+        json_variable* variable = &md->variables[md->variables_count++];
+        variable->object = md->variables_tok+1+j;
+        variable->name = find_object_property(md->js, variable->object, "name");
+        j += slurp_object(variable->object);
+
+        if (variable->name == 0) {
             fprintf(stderr, "name property not found\n");
+            continue;
+        }
+        int len = variable->name->end - variable->name->start;
+        if (len >= sizeof(name)) {
+            continue;
+        }
+        /* The first variable of a given name wins, as it did with a scan */
+        snprintf(name, sizeof(name), "%.*s", len, md->js + variable->name->start);
+        if (ck_str_hash_lookup(name, md->variables_dict) == NULL) {
+            ck_str_hash_insert(name, variable, md->variables_dict);
         }
-        j += slurp_object(variable);
     }
     return 0;
 }
-
 char* copy_variable_property(struct json_metadata* md, const char* varname, const char* property, char* dest, size_t maxsize) {
-	jsmntok_t* tok = find_variable_property(md->js, md->tok, varname, property);
+	jsmntok_t* tok = find_variable_property(md, varname, property);
 	if (tok == NULL) {
 		return NULL;
 	}
@@ -133,7 +183,7 @@ char* copy_variable_property(struct json_metadata* md, const char* varname, cons
 }
 
 int missing_string_idx(struct json_metadata* md, const char* varname, char* v) {
-	jsmntok_t* missing = find_variable_property(md->js, md->tok, varname, "missing");
+	jsmntok_t* missing = find_variable_property(md, varname, "missing");
 	if (!missing) {
 		return 0;
 	}
@@ -157,15 +207,29 @@ int missing_string_idx(struct json_metadata* md, const char* varname, char* v) {
 	return 0;
 }
 
-int missing_double_idx(struct json_metadata* md, const char* varname, double v) {
-	jsmntok_t* missing = find_variable_property(md->js, md->tok, varname, "missing");
-	if (!missing) {
-		return 0;
+static int compare_missing_doubles(const void *elem1, const void *elem2) {
+    const json_missing_double *m1 = (const json_missing_double *)elem1;
+    const json_missing_double *m2 = (const json_missing_double *)elem2;
+    if (m1->value != m2->value)
+        return m1->value < m2->value ? -1 : 1;
+    return m1->index - m2->index;
+}
+
+/* Reads a variable's missing values the first time they're needed, since
+ * only numeric variables can be asked about them */
+static readstat_error_t parse_missing_doubles(struct json_metadata* md, json_variable* variable) {
+	jsmntok_t* missing = find_object_property(md->js, variable->object, "missing");
+	jsmntok_t* values = missing ? find_object_property(md->js, missing, "values") : NULL;
+
+	if (!values || values->size == 0) {
+		variable->missing_doubles_parsed = 1;
+		return READSTAT_OK;
 	}
 
-	jsmntok_t* values = find_object_property(md->js, missing, "values");
-	if (!values) {
-		return 0;
+	variable->missing_doubles = malloc(values->size * sizeof(json_missing_double));
+	if (variable->missing_doubles == NULL) {
+		fprintf(stderr, "%s: %d: malloc failed: %s\n", __FILE__, __LINE__, strerror(errno));
+		return READSTAT_ERROR_MALLOC;
 	}
 
 	int j = 1;
@@ -178,66 +242,102 @@ int missing_double_idx(struct json_metadata* md, const char* varname, double v)
 		double vv = strtod(tmp, &dest);
 		if (dest == tmp) {
 			fprintf(stderr, "Expected a number: %s\n", tmp);
-			exit(EXIT_FAILURE);
+			free(variable->missing_doubles);
+			variable->missing_doubles = NULL;
+			variable->missing_doubles_count = 0;
+			return READSTAT_ERROR_PARSE;
 		}
-		if (vv == v) {
-			return i+1;
+		if (vv == vv) { /* NaN never matches */
+			json_missing_double *m = &variable->missing_doubles[variable->missing_doubles_count++];
+			m->value = vv;
+			m->index = i+1;
 		}
 		j+= slurp_object(value);
 	}
+	qsort(variable->missing_doubles, variable->missing_doubles_count,
+			sizeof(json_missing_double), &compare_missing_doubles);
+	variable->missing_doubles_parsed = 1;
+	return READSTAT_OK;
+}
+
+int missing_double_idx(struct json_metadata* md, const char* varname, double v) {
+	json_variable* variable = find_variable(md, varname);
+	if (!variable) {
+		return 0;
+	}
+	if (!variable->missing_doubles_parsed && parse_missing_doubles(md, variable) != READSTAT_OK) {
+		return -1;
+	}
+
+	/* Leftmost match, so duplicates report their first position */
+	long lo = 0, hi = variable->missing_doubles_count;
+	while (lo < hi) {
+		long mid = lo + (hi - lo) / 2;
+		if (variable->missing_doubles[mid].value < v) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo < variable->missing_doubles_count && variable->missing_doubles[lo].value == v) {
+		return variable->missing_doubles[lo].index;
+	}
 	return 0;
 }
 
-int get_decimals(struct json_metadata* md, const char* varname) {
-	jsmntok_t* decimals_tok = find_variable_property(md->js, md->tok, varname, "decimals");
+readstat_error_t get_decimals(struct json_metadata* md, const char* varname, int *decimals) {
+	jsmntok_t* decimals_tok = find_variable_property(md, varname, "decimals");
 	if (!decimals_tok) {
-		return 0;
+		*decimals = 0;
 	} else {
 		char *dest;
 		char *buf = md->js + decimals_tok->start;
-		long int decimals = strtol(buf, &dest, 10);
+		long int value = strtol(buf, &dest, 10);
 		if (dest == buf) {
 			fprintf(stderr, "%s:%d not a number: %.*s\n", __FILE__, __LINE__, decimals_tok->end-decimals_tok->start, buf);
-			exit(EXIT_FAILURE);
+			return READSTAT_ERROR_PARSE;
 		}
-		return decimals;
+		*decimals = value;
 	}
+	return READSTAT_OK;
 }
 
-metadata_column_type_t column_type(struct json_metadata* md, const char* varname, int output_format) {
-	jsmntok_t* typ = find_variable_property(md->js, md->tok, varname, "type");
+readstat_error_t column_type(struct json_metadata* md, const char* varname, int output_format,
+		metadata_column_type_t *coltype) {
+	jsmntok_t* typ = find_variable_property(md, varname, "type");
 	if (!typ) {
 		fprintf(stderr, "Could not find type of variable %s in metadata\n", varname);
-		exit(EXIT_FAILURE);
+		return READSTAT_ERROR_PARSE;
 	}
 
 	if (match_token(md->js, typ, "NUMERIC")) {
-		return METADATA_COLUMN_TYPE_NUMERIC;
+		*coltype = METADATA_COLUMN_TYPE_NUMERIC;
 	} else if (match_token(md->js, typ, "STRING")) {
-		return METADATA_COLUMN_TYPE_STRING;
+		*coltype = METADATA_COLUMN_TYPE_STRING;
 	} else if (match_token(md->js, typ, "DATE")) {
-		return METADATA_COLUMN_TYPE_DATE;
+		*coltype = METADATA_COLUMN_TYPE_DATE;
 	} else {
 		fprintf(stderr, "%s: %d: Unknown metadata type for variable %s\n", __FILE__, __LINE__, varname);
-		exit(EXIT_FAILURE);
+		return READSTAT_ERROR_PARSE;
 	}
+	return READSTAT_OK;
 }
 
-double get_double_from_token(const char *js, jsmntok_t* token) {
+readstat_error_t get_double_from_token(const char *js, jsmntok_t* token, double *value) {
 	char buf[255];
     char *dest;
     int len = token->end - token->start;
     snprintf(buf, sizeof(buf), "%.*s", len, js + token->start);
-    double val = strtod(buf, &dest);
+    *value = strtod(buf, &dest);
     if (buf == dest) {
         fprintf(stderr, "%s:%d failed to parse double: %s\n", __FILE__, __LINE__, buf);
-        exit(EXIT_FAILURE);
+        return READSTAT_ERROR_PARSE;
     }
-    return val;
+    return READSTAT_OK;
 }
 
 struct json_metadata* get_json_metadata(const char* filename) {
-    struct json_metadata* result = malloc(sizeof(struct json_metadata));
+    struct json_metadata* result = calloc(1, sizeof(struct json_metadata));
     if (result == NULL) {
         fprintf(stderr, "%s: %d: malloc failed: %s\n", __FILE__, __LINE__, strerror(errno));
         return 0;
@@ -309,6 +409,10 @@ again:
     fclose(fd);
 	result->tok = tok;
 	result->js = js;
+	if (index_variables(result) != 0) {
+		free_json_metadata(result);
+		return NULL;
+	}
     return result;
 
 	errexit:
@@ -333,6 +437,12 @@ again:
 }
 
 void free_json_metadata(struct json_metadata* md) {
+	for (long i=0; i<md->variables_count; i++) {
+		free(md->variables[i].missing_doubles);
+	}
+	free(md->variables);
+	if (md->variables_dict)
+		ck_hash_table_free(md->variables_dict);
 	free(md->tok);
 	free(md->js);
 	free(md);
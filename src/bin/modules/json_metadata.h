@@ -4,9 +4,27 @@
 #ifndef __JSON_METADATA_H_
 #define __JSON_METADATA_H_
 
+typedef struct json_missing_double {
+    double value;
+    int index;
+} json_missing_double;
+
+// One entry of the "variables" array, located once when the metadata is read
+typedef struct json_variable {
+    jsmntok_t* object;
+    jsmntok_t* name;
+    int missing_doubles_parsed;
+    long missing_doubles_count;
+    json_missing_double* missing_doubles; // sorted by value, then index
+} json_variable;
+
 typedef struct json_metadata {
     char* js;
     jsmntok_t* tok;
+    jsmntok_t* variables_tok;
+    json_variable* variables;
+    long variables_count;
+    struct ck_hash_table_s* variables_dict; // name => json_variable
 } json_metadata;
 
 typedef enum metadata_column_type_e {
@@ -16,22 +34,25 @@ typedef enum metadata_column_type_e {
 } metadata_column_type_t;
 
 struct json_metadata* get_json_metadata(const char* filename);
-metadata_column_type_t column_type(struct json_metadata* md, const char* varname, int output_format);
+readstat_error_t column_type(struct json_metadata* md, const char* varname, int output_format,
+        metadata_column_type_t *coltype);
 void free_json_metadata(struct json_metadata*);
 
-int get_decimals(struct json_metadata* md, const char* varname);
+readstat_error_t get_decimals(struct json_metadata* md, const char* varname, int *decimals);
 
 unsigned char get_separator(struct json_metadata* md);
+// 1-based position of v among the variable's missing values, 0 if it isn't
+// one, or -1 if they can't be read
 int missing_double_idx(struct json_metadata* md, const char* varname, double v);
 int missing_string_idx(struct json_metadata* md, const char* varname, char* v);
 char* copy_variable_property(struct json_metadata* md, const char* varname, const char* property, char* dest, size_t maxsize);
 char* get_object_property(const char *js, jsmntok_t *t, const char* propname, char* dest, size_t size);
-jsmntok_t* find_variable_property(const char *js, jsmntok_t *t, const char* varname, const char* property);
+jsmntok_t* find_variable_property(struct json_metadata* md, const char* varname, const char* property);
 int slurp_object(jsmntok_t *t);
 jsmntok_t* find_object_property(const char *js, jsmntok_t *t, const char* propname);
 int match_token(const char *js, jsmntok_t *tok, const char* name);
 
-double get_double_from_token(const char *js, jsmntok_t* token);
+readstat_error_t get_double_from_token(const char *js, jsmntok_t* token, double *value);
 
 #endif /* __JSON_METADATA_H_ */
 
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
@@ -9,16 +10,22 @@
 #include "../module.h"
 #include "../../stata/readstat_dta_days.h"
 #include "../../spss/readstat_sav_date.h"
-#include "double_decimals.h"
+#include "format_number.h"
+
+#define CSV_BUFFER_LEN  (1 << 20)
 
 typedef struct mod_csv_ctx_s {
     FILE *out_file;
     long var_count;
+    char *buffer;
+    size_t buffer_len;
+    size_t buffer_used;
+    int write_error;
 } mod_csv_ctx_t;
 
 static int accept_file(const char *filename);
 static void *ctx_init(const char *filename);
-static void finish_file(void *ctx);
+static readstat_error_t finish_file(void *ctx);
 static int handle_info(int obs_count, int var_count, void *ctx);
 static int handle_variable(int index, readstat_variable_t *variable,
                            const char *val_labels, void *ctx);
@@ -42,21 +49,120 @@ static int accept_file(const char *filename) {
 }
 
 static void *ctx_init(const char *filename) {
-    mod_csv_ctx_t *mod_ctx = malloc(sizeof(mod_csv_ctx_t));
+    mod_csv_ctx_t *mod_ctx = calloc(1, sizeof(mod_csv_ctx_t));
     mod_ctx->out_file = fopen(filename, "w");
     if (mod_ctx->out_file == NULL) {
         fprintf(stderr, "Error opening %s for writing: %s\n", filename, strerror(errno));
+        free(mod_ctx);
+        return NULL;
+    }
+    mod_ctx->buffer_len = CSV_BUFFER_LEN;
+    mod_ctx->buffer = malloc(mod_ctx->buffer_len);
+    if (mod_ctx->buffer == NULL) {
+        fprintf(stderr, "Error allocating an output buffer for %s\n", filename);
+        fclose(mod_ctx->out_file);
+        free(mod_ctx);
         return NULL;
     }
     return mod_ctx;
 }
 
-static void finish_file(void *ctx) {
+static void flush_buffer(mod_csv_ctx_t *mod_ctx) {
+    if (mod_ctx->buffer_used && !mod_ctx->write_error &&
+            fwrite(mod_ctx->buffer, mod_ctx->buffer_used, 1, mod_ctx->out_file) != 1) {
+        fprintf(stderr, "Error writing CSV output: %s\n", strerror(errno));
+        mod_ctx->write_error = 1;
+    }
+    mod_ctx->buffer_used = 0;
+}
+
+/* Returns room for len more bytes at the end of the buffer, which is written
+ * out first if it's too full. Callers advance buffer_used themselves. */
+static char *reserve_buffer(mod_csv_ctx_t *mod_ctx, size_t len) {
+    if (mod_ctx->buffer_used + len > mod_ctx->buffer_len) {
+        flush_buffer(mod_ctx);
+        if (len > mod_ctx->buffer_len) {
+            char *buffer = realloc(mod_ctx->buffer, len);
+            if (buffer == NULL) {
+                fprintf(stderr, "Error allocating an output buffer of %zu bytes\n", len);
+                mod_ctx->write_error = 1;
+                return NULL;
+            }
+            mod_ctx->buffer = buffer;
+            mod_ctx->buffer_len = len;
+        }
+    }
+    return &mod_ctx->buffer[mod_ctx->buffer_used];
+}
+
+static void write_bytes(mod_csv_ctx_t *mod_ctx, const char *bytes, size_t len) {
+    char *out = reserve_buffer(mod_ctx, len);
+    if (out) {
+        memcpy(out, bytes, len);
+        mod_ctx->buffer_used += len;
+    }
+}
+
+static void write_char(mod_csv_ctx_t *mod_ctx, char c) {
+    if (mod_ctx->buffer_used < mod_ctx->buffer_len) {
+        mod_ctx->buffer[mod_ctx->buffer_used++] = c;
+    } else {
+        write_bytes(mod_ctx, &c, 1);
+    }
+}
+
+/* Quotes the string, doubling any quotes inside it (RFC 4180) */
+static void write_quoted(mod_csv_ctx_t *mod_ctx, const char *string) {
+    size_t len = strlen(string);
+    char *out = reserve_buffer(mod_ctx, 2 * len + 2);
+    size_t i, j = 0;
+    if (out == NULL)
+        return;
+
+    out[j++] = '"';
+    for (i=0; i<len; i++) {
+        if (string[i] == '"')
+            out[j++] = '"';
+        out[j++] = string[i];
+    }
+    out[j++] = '"';
+    mod_ctx->buffer_used += j;
+}
+
+static void write_double(mod_csv_ctx_t *mod_ctx, double value) {
+    char *out = reserve_buffer(mod_ctx, FORMAT_NUMBER_MAX_LEN);
+    if (out)
+        mod_ctx->buffer_used += format_number_double(out, value);
+}
+
+static void write_float(mod_csv_ctx_t *mod_ctx, float value) {
+    char *out = reserve_buffer(mod_ctx, FORMAT_NUMBER_MAX_LEN);
+    if (out)
+        mod_ctx->buffer_used += format_number_float(out, value);
+}
+
+static void write_integer(mod_csv_ctx_t *mod_ctx, long long value) {
+    char *out = reserve_buffer(mod_ctx, FORMAT_NUMBER_MAX_LEN);
+    if (out)
+        mod_ctx->buffer_used += format_number_integer(out, value);
+}
+
+static readstat_error_t finish_file(void *ctx) {
     mod_csv_ctx_t *mod_ctx = (mod_csv_ctx_t *)ctx;
+    readstat_error_t retval = READSTAT_OK;
     if (mod_ctx) {
-        if (mod_ctx->out_file != NULL)
-            fclose(mod_ctx->out_file);
+        flush_buffer(mod_ctx);
+        if (mod_ctx->out_file != NULL && fclose(mod_ctx->out_file) != 0) {
+            if (!mod_ctx->write_error)
+                fprintf(stderr, "Error writing CSV output: %s\n", strerror(errno));
+            mod_ctx->write_error = 1;
+        }
+        if (mod_ctx->write_error)
+            retval = READSTAT_ERROR_WRITE;
+        free(mod_ctx->buffer);
+        free(mod_ctx);
     }
+    return retval;
 }
 
 static int handle_info(int obs_count, int var_count, void *ctx) {
@@ -70,14 +176,13 @@ static int handle_variable(int index, readstat_variable_t *variable,
     mod_csv_ctx_t *mod_ctx = (mod_csv_ctx_t *)ctx;
     const char *name = readstat_variable_get_name(variable);
     if (index > 0) {
-        fprintf(mod_ctx->out_file, ",\"%s\"", name);
-    } else {
-        fprintf(mod_ctx->out_file, "\"%s\"", name);
+        write_char(mod_ctx, ',');
     }
+    write_quoted(mod_ctx, name);
     if (index == mod_ctx->var_count - 1) {
-        fprintf(mod_ctx->out_file, "\n");
+        write_char(mod_ctx, '\n');
     }
-    return 0;
+    return mod_ctx->write_error;
 }
 
 static int handle_value(int obs_index, readstat_variable_t *variable, readstat_value_t value, void *ctx) {
@@ -86,52 +191,41 @@ static int handle_value(int obs_index, readstat_variable_t *variable, readstat_v
     const char *format = readstat_variable_get_format(variable);
     int var_index = readstat_variable_get_index(variable);
     if (var_index > 0) {
-        fprintf(mod_ctx->out_file, ",");
+        write_char(mod_ctx, ',');
     }
     if (readstat_value_is_system_missing(value)) {
         /* void */
     } else if (readstat_value_is_tagged_missing(value)) {
         /* void */
     } else if (type == READSTAT_TYPE_STRING) {
-        /* TODO escape */
-        fprintf(mod_ctx->out_file, "\"%s\"", readstat_string_value(value));
+        write_quoted(mod_ctx, readstat_string_value(value));
     } else if (type == READSTAT_TYPE_INT8) {
-        #ifdef __MINGW32__
-        __mingw_fprintf(mod_ctx->out_file, "%hhd", readstat_int8_value(value));
-        #else
-        fprintf(mod_ctx->out_file, "%hhd", readstat_int8_value(value));
-        #endif
+        write_integer(mod_ctx, readstat_int8_value(value));
     } else if (type == READSTAT_TYPE_INT16) {
-        fprintf(mod_ctx->out_file, "%hd", readstat_int16_value(value));
+        write_integer(mod_ctx, readstat_int16_value(value));
     } else if (type == READSTAT_TYPE_INT32 && format && 0 == strncmp("%td", format, strlen("%td"))) {
         int days = readstat_int32_value(value);
         char days_str[255];
         readstat_dta_days_string(days, days_str, sizeof(days_str)-1);
-        fprintf(mod_ctx->out_file, "%s", days_str);
+        write_bytes(mod_ctx, days_str, strlen(days_str));
     } else if (type == READSTAT_TYPE_DOUBLE && format && 0 == strncmp("EDATE40", format, strlen("EDATE40"))) {
         double v = readstat_double_value(value);
         char date_str[255];
         char *s = readstat_sav_date_string(v, date_str, sizeof(date_str)-1);
         if (!s) {
             fprintf(stderr, "%s:%d Could not parse SPSS date double: %lf\n", __FILE__, __LINE__, v);
-            exit(EXIT_FAILURE);
+            return 1;
         }
-        fprintf(mod_ctx->out_file, "%s", s);
+        write_bytes(mod_ctx, s, strlen(s));
     } else if (type == READSTAT_TYPE_INT32) {
-        fprintf(mod_ctx->out_file, "%d", readstat_int32_value(value));
+        write_integer(mod_ctx, readstat_int32_value(value));
     } else if (type == READSTAT_TYPE_FLOAT) {
-        fprintf(mod_ctx->out_file, "%f", readstat_float_value(value));
+        write_float(mod_ctx, readstat_float_value(value));
     } else if (type == READSTAT_TYPE_DOUBLE) {
-        double v = readstat_double_value(value);
-        int decimals = double_decimals(v);
-        if (decimals <= 6) {
-            fprintf(mod_ctx->out_file, "%lf", v);
-        } else {
-            fprintf(mod_ctx->out_file, "%.14f", v);
-        }
+        write_double(mod_ctx, readstat_double_value(value));
     }
     if (var_index == mod_ctx->var_count - 1) {
-        fprintf(mod_ctx->out_file, "\n");
+        write_char(mod_ctx, '\n');
     }
-    return 0;
+    return mod_ctx->write_error;
 }
@@ -1,11 +1,14 @@
 #include <csv.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stdint.h>
 
 #include "../../readstat.h"
+#include "../../readstat_strings.h"
 
 #include "produce_csv_value.h"
 #include "produce_csv_column_header.h"
@@ -14,20 +17,78 @@
 
 #define UNUSED(x) (void)(x)
 
+#define CSV_READ_BUFFER_LEN (1 << 20)
+
+// The input is parsed once. Pass 1 measures the column widths and counts the
+// rows while spilling the cells to a temporary file, and pass 2 replays them
+// to deliver the variables and values, which need those widths and counts up
+// front. Each cell is spilled as a varint holding its length plus one,
+// followed by its bytes; a zero marks the end of a row.
+#define CSV_SPILL_VARINT_MAX_LEN 10
+
+static readstat_error_t csv_spill_flush(struct csv_metadata *c) {
+    if (c->spill_buffer_len &&
+            fwrite(c->spill_buffer, 1, c->spill_buffer_len, c->spill) != c->spill_buffer_len)
+        return READSTAT_ERROR_WRITE;
+    c->spill_buffer_len = 0;
+    return READSTAT_OK;
+}
+
+static readstat_error_t csv_spill(struct csv_metadata *c, const void *bytes, size_t len, int end_of_row) {
+    readstat_error_t retval = READSTAT_OK;
+    uint64_t tag = end_of_row ? 0 : (uint64_t)len + 1;
+
+    if (c->spill_buffer_len + CSV_SPILL_VARINT_MAX_LEN + len > c->spill_buffer_capacity &&
+            (retval = csv_spill_flush(c)) != READSTAT_OK)
+        return retval;
+
+    do {
+        unsigned char byte = tag & 0x7F;
+        tag >>= 7;
+        c->spill_buffer[c->spill_buffer_len++] = byte | (tag ? 0x80 : 0);
+    } while (tag);
+
+    if (c->spill_buffer_len + len > c->spill_buffer_capacity) {
+        if ((retval = csv_spill_flush(c)) != READSTAT_OK)
+            return retval;
+        if (fwrite(bytes, 1, len, c->spill) != len)
+            return READSTAT_ERROR_WRITE;
+    } else if (len) {
+        memcpy(&c->spill_buffer[c->spill_buffer_len], bytes, len);
+        c->spill_buffer_len += len;
+    }
+
+    return retval;
+}
+
 void csv_metadata_cell(void *s, size_t len, void *data)
 {
     struct csv_metadata *c = (struct csv_metadata *)data;
+    if (c->error != READSTAT_OK)
+        return;
     if (c->rows == 0) {
-        c->variables = realloc(c->variables, (c->columns+1) * sizeof(readstat_variable_t));
-        c->is_date = realloc(c->is_date, (c->columns+1) * sizeof(int));
-        produce_column_header(s, len, data);
-    } else if (c->rows >= 1 && c->parser->value_handler) {
-        produce_csv_column_value(s, len, data);
+        readstat_variable_t *variables = realloc(c->variables, (c->columns+1) * sizeof(readstat_variable_t));
+        int *is_date = realloc(c->is_date, (c->columns+1) * sizeof(int));
+        if (variables)
+            c->variables = variables;
+        if (is_date)
+            c->is_date = is_date;
+        if (variables == NULL || is_date == NULL) {
+            c->error = READSTAT_ERROR_MALLOC;
+            return;
+        }
+        c->error = produce_column_header(s, len, data);
+    } else if (c->rows >= 1 && c->pass == 2 && c->parser->value_handler) {
+        c->error = produce_csv_column_value(s, len, data);
     }
+    if (c->error != READSTAT_OK)
+        return;
     if (c->rows >= 1 && c->pass == 1) {
         size_t w = c->column_width[c->columns];
         c->column_width[c->columns] = (len>w) ? len : w;
     }
+    if (c->pass == 1 && (c->error = csv_spill(c, s, len, 0)) != READSTAT_OK)
+        return;
     c->open_row = 1;
     c->columns++;
 }
@@ -36,9 +97,16 @@ void csv_metadata_row(int cc, void *data)
 {
     UNUSED(cc);
     struct csv_metadata *c = (struct csv_metadata *)data;
+    if (c->error != READSTAT_OK)
+        return;
+    if (c->pass == 1 && (c->error = csv_spill(c, NULL, 0, 1)) != READSTAT_OK)
+        return;
     c->rows++;
     if (c->rows == 1 && c->pass == 1) {
-        c->column_width = malloc(c->columns * sizeof(size_t));
+        if ((c->column_width = malloc(c->columns * sizeof(size_t))) == NULL) {
+            c->error = READSTAT_ERROR_MALLOC;
+            return;
+        }
         for (int i=0; i<c->columns; i++) {
             c->column_width[i] = 1;
         }
@@ -48,23 +116,116 @@ void csv_metadata_row(int cc, void *data)
     c->open_row = 0;
 }
 
+/* Makes at least len bytes available at spill_buffer[*pos], unless the spill
+ * file ends first */
+static readstat_error_t csv_spill_fill(struct csv_metadata *md, size_t *pos, size_t len) {
+    size_t available = md->spill_buffer_len - *pos;
+    if (available >= len)
+        return READSTAT_OK;
+
+    memmove(md->spill_buffer, &md->spill_buffer[*pos], available);
+    md->spill_buffer_len = available;
+    *pos = 0;
+
+    if (len > md->spill_buffer_capacity) {
+        unsigned char *buffer = realloc(md->spill_buffer, len);
+        if (buffer == NULL)
+            return READSTAT_ERROR_MALLOC;
+        md->spill_buffer = buffer;
+        md->spill_buffer_capacity = len;
+    }
+
+    md->spill_buffer_len += fread(&md->spill_buffer[md->spill_buffer_len], 1,
+            md->spill_buffer_capacity - md->spill_buffer_len, md->spill);
+    if (ferror(md->spill))
+        return READSTAT_ERROR_READ;
+
+    return READSTAT_OK;
+}
+
+static readstat_error_t csv_replay_spill(struct csv_metadata *md) {
+    readstat_error_t retval = READSTAT_OK;
+    size_t pos = 0;
+
+    if ((retval = csv_spill_flush(md)) != READSTAT_OK)
+        goto cleanup;
+
+    if (fseek(md->spill, 0, SEEK_SET) == -1) {
+        retval = READSTAT_ERROR_SEEK;
+        goto cleanup;
+    }
+
+    while (1) {
+        uint64_t tag = 0;
+        int shift = 0;
+        unsigned char byte;
+
+        if ((retval = csv_spill_fill(md, &pos, CSV_SPILL_VARINT_MAX_LEN)) != READSTAT_OK)
+            goto cleanup;
+        if (pos == md->spill_buffer_len)
+            break;
+
+        do {
+            if (pos == md->spill_buffer_len || shift > 63) {
+                retval = READSTAT_ERROR_READ;
+                goto cleanup;
+            }
+            byte = md->spill_buffer[pos++];
+            tag |= (uint64_t)(byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+
+        if (tag == 0) {
+            csv_metadata_row(0, md);
+        } else {
+            size_t len = tag - 1;
+            /* One more byte, to terminate the cell in place */
+            if ((retval = csv_spill_fill(md, &pos, len + 1)) != READSTAT_OK)
+                goto cleanup;
+            if (md->spill_buffer_len - pos < len) {
+                retval = READSTAT_ERROR_READ;
+                goto cleanup;
+            }
+            unsigned char *cell = &md->spill_buffer[pos];
+            unsigned char next = cell[len];
+            cell[len] = '\0';
+            csv_metadata_cell(cell, len, md);
+            cell[len] = next;
+            pos += len;
+        }
+        if (md->error != READSTAT_OK) {
+            retval = md->error;
+            goto cleanup;
+        }
+    }
+
+cleanup:
+    return retval;
+}
+
 readstat_error_t readstat_parse_csv(readstat_parser_t *parser, const char *path, const char *jsonpath, struct csv_metadata* md, void *user_ctx) {
     readstat_error_t retval = READSTAT_OK;
     readstat_io_t *io = parser->io;
     size_t file_size = 0;
     size_t bytes_read;
-    struct csv_parser csvparser;
+    struct csv_parser csvparser = { 0 };
     struct csv_parser *p = &csvparser;
-    char buf[BUFSIZ];
-    size_t* column_width = md->column_width;
-    md->pass = column_width ? 2 : 1;
+    char *buf = NULL;
+    md->pass = 1;
     md->open_row = 0;
     md->columns = 0;
-    md->_rows = md->rows;
     md->rows = 0;
     md->parser = parser;
     md->user_ctx = user_ctx;
     md->json_md = NULL;
+    md->error = READSTAT_OK;
+    md->spill = NULL;
+    md->spill_buffer = NULL;
+
+    if ((md->strings = readstat_string_pool_init()) == NULL) {
+        retval = READSTAT_ERROR_MALLOC;
+        goto cleanup;
+    }
 
     if ((md->json_md = get_json_metadata(jsonpath)) == NULL) {
         fprintf(stderr, "Could not get JSON metadata\n");
@@ -93,10 +254,26 @@ readstat_error_t readstat_parse_csv(readstat_parser_t *parser, const char *path,
         retval = READSTAT_ERROR_OPEN;
         goto cleanup;
     }
+    if ((buf = malloc(CSV_READ_BUFFER_LEN)) == NULL) {
+        retval = READSTAT_ERROR_MALLOC;
+        goto cleanup;
+    }
+    if ((md->spill = tmpfile()) == NULL) {
+        retval = READSTAT_ERROR_OPEN;
+        goto cleanup;
+    }
+    setvbuf(md->spill, NULL, _IONBF, 0);
+    if ((md->spill_buffer = malloc(CSV_READ_BUFFER_LEN)) == NULL) {
+        retval = READSTAT_ERROR_MALLOC;
+        goto cleanup;
+    }
+    md->spill_buffer_len = 0;
+    md->spill_buffer_capacity = CSV_READ_BUFFER_LEN;
+
     unsigned char sep = get_separator(md->json_md);
     csv_set_delim(p, sep);
     
-    while ((bytes_read = io->read(buf, sizeof(buf), io->io_ctx)) > 0)
+    while ((bytes_read = io->read(buf, CSV_READ_BUFFER_LEN, io->io_ctx)) > 0)
     {
         if (csv_parse(p, buf, bytes_read, csv_metadata_cell, csv_metadata_row, md) != bytes_read)
         {
@@ -104,16 +281,38 @@ readstat_error_t readstat_parse_csv(readstat_parser_t *parser, const char *path,
             retval = READSTAT_ERROR_PARSE;
             goto cleanup;
         }
+        if (md->error != READSTAT_OK) {
+            retval = md->error;
+            goto cleanup;
+        }
     }
     csv_fini(p, csv_metadata_cell, csv_metadata_row, md);
+    if (md->error != READSTAT_OK) {
+        retval = md->error;
+        goto cleanup;
+    }
     if (!md->open_row) {
         md->rows--;
     }
-    if (parser->info_handler && md->pass == 1) {
-        parser->info_handler(md->rows, md->_columns, user_ctx);
+    if (parser->info_handler && parser->info_handler(md->rows, md->_columns, user_ctx)) {
+        retval = READSTAT_ERROR_USER_ABORT;
+        goto cleanup;
     }
 
+    free(md->variables);
+    md->variables = NULL;
+    free(md->is_date);
+    md->is_date = NULL;
+
+    md->pass = 2;
+    md->open_row = 0;
+    md->columns = 0;
+    md->_rows = md->rows;
+    md->rows = 0;
+    retval = csv_replay_spill(md);
+
 cleanup:
+    free(buf);
     if (md->variables) {
         free(md->variables);
         md->variables = NULL;
@@ -122,10 +321,20 @@ cleanup:
         free(md->is_date);
         md->is_date = NULL;
     }
+    if (md->strings) {
+        readstat_string_pool_free(md->strings);
+        md->strings = NULL;
+    }
     if (md->json_md) {
         free_json_metadata(md->json_md);
         md->json_md = NULL;
     }
+    if (md->spill) {
+        fclose(md->spill);
+        md->spill = NULL;
+    }
+    free(md->spill_buffer);
+    md->spill_buffer = NULL;
     csv_free(p);
     io->close(io->io_ctx);
     return retval;
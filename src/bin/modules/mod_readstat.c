@@ -27,10 +27,11 @@ typedef struct mod_readstat_ctx_s {
 } mod_readstat_ctx_t;
 
 static ssize_t write_data(const void *bytes, size_t len, void *ctx);
+static readstat_off_t seek_data(readstat_off_t offset, readstat_io_flags_t whence, void *ctx);
 
 static int accept_file(const char *filename);
 static void *ctx_init(const char *filename);
-static void finish_file(void *ctx);
+static readstat_error_t finish_file(void *ctx);
 
 static int handle_fweight(int var_index, void *ctx);
 static int handle_info(int obs_count, int var_count, void *ctx);
@@ -60,6 +61,25 @@ static ssize_t write_data(const void *bytes, size_t len, void *ctx) {
     return write(mod_ctx->out_fd, bytes, len);
 }
 
+static readstat_off_t seek_data(readstat_off_t offset, readstat_io_flags_t whence, void *ctx) {
+    mod_readstat_ctx_t *mod_ctx = (mod_readstat_ctx_t *)ctx;
+    int flag = 0;
+    switch (whence) {
+        case READSTAT_SEEK_SET:
+            flag = SEEK_SET;
+            break;
+        case READSTAT_SEEK_CUR:
+            flag = SEEK_CUR;
+            break;
+        case READSTAT_SEEK_END:
+            flag = SEEK_END;
+            break;
+        default:
+            return -1;
+    }
+    return lseek(mod_ctx->out_fd, offset, flag);
+}
+
 static int accept_file(const char *filename) {
     return (rs_ends_with(filename, ".dta") ||
             rs_ends_with(filename, ".sav") ||
@@ -79,27 +99,34 @@ static void *ctx_init(const char *filename) {
     mod_ctx->out_fd = open(filename, O_CREAT | O_WRONLY | O_EXCL, 0644);
     if (mod_ctx->out_fd == -1) {
         fprintf(stderr, "Error opening %s for writing: %s\n", filename, strerror(errno));
+        ck_hash_table_free(mod_ctx->label_set_dict);
+        free(mod_ctx);
         return NULL;
     }
 
     mod_ctx->writer = readstat_writer_init();
     readstat_writer_set_file_label(mod_ctx->writer, "Created by ReadStat <https://github.com/WizardMac/ReadStat>");
     readstat_set_data_writer(mod_ctx->writer, &write_data);
+    readstat_set_data_seeker(mod_ctx->writer, &seek_data);
 
     return mod_ctx;
 }
 
-void finish_file(void *ctx) {
+static readstat_error_t finish_file(void *ctx) {
     mod_readstat_ctx_t *mod_ctx = (mod_readstat_ctx_t *)ctx;
+    readstat_error_t retval = READSTAT_OK;
     if (mod_ctx) {
-        if (mod_ctx->out_fd != -1)
-            close(mod_ctx->out_fd);
+        if (mod_ctx->out_fd != -1 && close(mod_ctx->out_fd) == -1) {
+            fprintf(stderr, "Error closing output file: %s\n", strerror(errno));
+            retval = READSTAT_ERROR_WRITE;
+        }
         if (mod_ctx->label_set_dict)
             ck_hash_table_free(mod_ctx->label_set_dict);
         if (mod_ctx->writer)
             readstat_writer_free(mod_ctx->writer);
         free(mod_ctx);
     }
+    return retval;
 }
 
 static int handle_fweight(int var_index, void *ctx) {
@@ -185,10 +212,15 @@ static int handle_variable(int index, readstat_variable_t *variable,
         if (readstat_value_type(lo_val) == READSTAT_TYPE_DOUBLE) {
             double lo = readstat_double_value(lo_val);
             double hi = readstat_double_value(hi_val);
+            readstat_error_t error = READSTAT_OK;
             if (lo == hi) {
-                readstat_variable_add_missing_double_value(new_variable, lo);
+                error = readstat_variable_add_missing_double_value(new_variable, lo);
             } else {
-                readstat_variable_add_missing_double_range(new_variable, lo, hi);
+                error = readstat_variable_add_missing_double_range(new_variable, lo, hi);
+            }
+            if (error != READSTAT_OK) {
+                fprintf(stderr, "Error adding missing values for %s: %s\n", name, readstat_error_message(error));
+                return 1;
             }
         }
     }
@@ -200,7 +232,7 @@ static int handle_variable(int index, readstat_variable_t *variable,
     if (format && format[0] && mod_ctx->is_dta && format[0]!='%') {
         // TODO I suppose you would need some translation from SPSS to DTA
         fprintf(stderr, "%s:%d Unsupported format '%s' given for DTA, aborting...\n", __FILE__, __LINE__, format);
-        exit(EXIT_FAILURE);
+        return 1;
     }
     readstat_variable_set_format(new_variable, format);
 
@@ -21,7 +21,7 @@ typedef struct mod_xlsx_ctx_s {
 
 static int accept_file(const char *filename);
 static void *ctx_init(const char *filename);
-static void finish_file(void *ctx);
+static readstat_error_t finish_file(void *ctx);
 static int handle_variable(int index, readstat_variable_t *variable,
                            const char *val_labels, void *ctx);
 static int handle_value(int obs_index, readstat_variable_t *variable, readstat_value_t value, void *ctx);
@@ -58,15 +58,18 @@ static void *ctx_init(const char *filename) {
     return mod_ctx;
 }
 
-static void finish_file(void *ctx) {
+static readstat_error_t finish_file(void *ctx) {
     mod_xlsx_ctx_t *mod_ctx = (mod_xlsx_ctx_t *)ctx;
+    readstat_error_t retval = READSTAT_OK;
     if (mod_ctx) {
         if (mod_ctx->row_count > MIN_ROWS_TO_SPLIT) {
             worksheet_freeze_panes(mod_ctx->worksheet, 1, 0);
         }
-        workbook_close(mod_ctx->workbook);
+        if (workbook_close(mod_ctx->workbook) != LXW_NO_ERROR)
+            retval = READSTAT_ERROR_WRITE;
         free(mod_ctx);
     }
+    return retval;
 }
 
 static int handle_variable(int index, readstat_variable_t *variable,
@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "parse_number.h"
+
+#define MAX_EXACT_MANTISSA  9007199254740992ULL /* 2^53 */
+#define MAX_DIGITS          19
+
+/* Every power of ten up to 1e22 is exact as a double */
+static const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+double parse_number_double(const char *s, char **endptr) {
+    const char *c = s;
+    uint64_t mantissa = 0;
+    int digits = 0, any_digits = 0, negative = 0;
+    int exponent = 0, exponent_value = 0;
+
+    if (*c == '-' || *c == '+') {
+        negative = (*c == '-');
+        c++;
+    }
+
+    /* Hex input is left to strtod */
+    if (c[0] == '0' && (c[1] == 'x' || c[1] == 'X'))
+        goto fallback;
+
+    for (; *c >= '0' && *c <= '9'; c++) {
+        any_digits = 1;
+        if (mantissa == 0 && *c == '0')
+            continue;
+        if (++digits > MAX_DIGITS)
+            goto fallback;
+        mantissa = 10 * mantissa + (*c - '0');
+    }
+    if (*c == '.') {
+        c++;
+        for (; *c >= '0' && *c <= '9'; c++) {
+            any_digits = 1;
+            exponent--;
+            if (mantissa == 0 && *c == '0')
+                continue;
+            if (++digits > MAX_DIGITS)
+                goto fallback;
+            mantissa = 10 * mantissa + (*c - '0');
+        }
+    }
+    /* No digits at all, e.g. leading spaces, "nan" or "inf" */
+    if (!any_digits)
+        goto fallback;
+
+    if (*c == 'e' || *c == 'E') {
+        const char *e = c + 1;
+        int exponent_negative = 0;
+        if (*e == '-' || *e == '+') {
+            exponent_negative = (*e == '-');
+            e++;
+        }
+        /* Otherwise the 'e' isn't part of the number, as with strtod */
+        if (*e >= '0' && *e <= '9') {
+            for (; *e >= '0' && *e <= '9'; e++) {
+                if (exponent_value < 10000)
+                    exponent_value = 10 * exponent_value + (*e - '0');
+            }
+            exponent += exponent_negative ? -exponent_value : exponent_value;
+            c = e;
+        }
+    }
+
+    /* Both the mantissa and the power of ten are exact, so one correctly
+     * rounded multiply or divide gives the correctly rounded result */
+    if (mantissa > MAX_EXACT_MANTISSA || exponent < -22 || exponent > 22)
+        goto fallback;
+
+    double value = (double)mantissa;
+    if (exponent < 0) {
+        value /= powers_of_ten[-exponent];
+    } else {
+        value *= powers_of_ten[exponent];
+    }
+
+    if (endptr)
+        *endptr = (char *)c;
+
+    return negative ? -value : value;
+
+fallback:
+    return strtod(s, endptr);
+}
@@ -0,0 +1,9 @@
+#ifndef __PARSE_NUMBER_H
+#define __PARSE_NUMBER_H
+
+// A drop-in replacement for strtod. Plain decimals with up to 19 significant
+// digits and a small exponent, which is nearly everything in a CSV file, are
+// converted without calling strtod; anything else is passed on to it.
+double parse_number_double(const char *s, char **endptr);
+
+#endif
@@ -1,7 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 #include "../../readstat.h"
+#include "../../readstat_strings.h"
 #include "../format.h"
 #include "json_metadata.h"
 
@@ -9,8 +11,16 @@
 #include "produce_missingness.h"
 #include "produce_csv_column_header.h"
 
-void produce_column_header_csv(char *column, readstat_variable_t* var, struct csv_metadata *c) {
-    metadata_column_type_t coltype = column_type(c->json_md, column, c->output_format);
+static readstat_error_t intern_string(struct csv_metadata *c, const char *s, size_t len, const char **interned) {
+    if ((*interned = readstat_string_pool_intern(c->strings, s, len)) == NULL) {
+        fprintf(stderr, "%s:%d out of memory\n", __FILE__, __LINE__);
+        return READSTAT_ERROR_MALLOC;
+    }
+    return READSTAT_OK;
+}
+
+readstat_error_t produce_column_header_csv(char *column, readstat_variable_t* var,
+        metadata_column_type_t coltype, struct csv_metadata *c) {
     if (coltype == METADATA_COLUMN_TYPE_DATE) {
         var->type = READSTAT_TYPE_STRING;
     } else if (coltype == METADATA_COLUMN_TYPE_NUMERIC) {
@@ -18,40 +28,63 @@ void produce_column_header_csv(char *column, readstat_variable_t* var, struct cs
     } else if (coltype == METADATA_COLUMN_TYPE_STRING) {
         var->type = READSTAT_TYPE_STRING;
     }
+    return READSTAT_OK;
 }
 
-void produce_column_header_dta(char *column, readstat_variable_t* var, struct csv_metadata *c) {
-    metadata_column_type_t coltype = column_type(c->json_md, column, c->output_format);
+readstat_error_t produce_column_header_dta(char *column, readstat_variable_t* var,
+        metadata_column_type_t coltype, struct csv_metadata *c) {
+    char format[READSTAT_VARIABLE_FORMAT_LEN];
+    readstat_error_t error = READSTAT_OK;
+    int decimals = 0;
     if (coltype == METADATA_COLUMN_TYPE_DATE) {
-        snprintf(var->format, sizeof(var->format), "%s", "%td");
+        var->format = "%td";
         var->type = READSTAT_TYPE_INT32;
     } else if (coltype == METADATA_COLUMN_TYPE_NUMERIC) {
         var->type = READSTAT_TYPE_DOUBLE;
-        snprintf(var->format, sizeof(var->format), "%%9.%df", get_decimals(c->json_md, column));
+        if ((error = get_decimals(c->json_md, column, &decimals)) != READSTAT_OK)
+            return error;
+        snprintf(format, sizeof(format), "%%9.%df", decimals);
+        error = intern_string(c, format, sizeof(format), &var->format);
     } else if (coltype == METADATA_COLUMN_TYPE_STRING) {
         var->type = READSTAT_TYPE_STRING;
     }
+    return error;
 }
 
-void produce_column_header_sav(char *column, readstat_variable_t* var, struct csv_metadata *c) {
-    metadata_column_type_t coltype = column_type(c->json_md, column, c->output_format);
+readstat_error_t produce_column_header_sav(char *column, readstat_variable_t* var,
+        metadata_column_type_t coltype, struct csv_metadata *c) {
+    char format[READSTAT_VARIABLE_FORMAT_LEN];
+    readstat_error_t error = READSTAT_OK;
+    int decimals = 0;
     if (coltype == METADATA_COLUMN_TYPE_DATE) {
         var->type = READSTAT_TYPE_DOUBLE;
-        snprintf(var->format, sizeof(var->format), "%s", "EDATE40");
+        var->format = "EDATE40";
     } else if (coltype == METADATA_COLUMN_TYPE_NUMERIC) {
         var->type = READSTAT_TYPE_DOUBLE;
-        snprintf(var->format, sizeof(var->format), "F8.%d", get_decimals(c->json_md, column));
+        if ((error = get_decimals(c->json_md, column, &decimals)) != READSTAT_OK)
+            return error;
+        snprintf(format, sizeof(format), "F8.%d", decimals);
+        error = intern_string(c, format, sizeof(format), &var->format);
     } else if (coltype == METADATA_COLUMN_TYPE_STRING) {
         var->type = READSTAT_TYPE_STRING;
     }
+    return error;
 }
 
-void produce_column_header(void *s, size_t len, void *data) {
+readstat_error_t produce_column_header(void *s, size_t len, void *data) {
     struct csv_metadata *c = (struct csv_metadata *)data;
     char* column = (char*)s;
     readstat_variable_t* var = &c->variables[c->columns];
+    char label[READSTAT_VARIABLE_LABEL_LEN] = "";
+    metadata_column_type_t coltype;
+    readstat_error_t error = READSTAT_OK;
     memset(var, 0, sizeof(readstat_variable_t));
-    metadata_column_type_t coltype = column_type(c->json_md, column, c->output_format);
+    var->name = "";
+    var->format = "";
+    var->label = "";
+    var->strings = c->strings;
+    if ((error = column_type(c->json_md, column, c->output_format, &coltype)) != READSTAT_OK)
+        return error;
     c->is_date[c->columns] = coltype == METADATA_COLUMN_TYPE_DATE;
 
     
@@ -62,30 +95,40 @@ void produce_column_header(void *s, size_t len, void *data) {
     }
 
     if (c->output_format == RS_FORMAT_CSV) {
-        produce_column_header_csv(column, var, c);
+        error = produce_column_header_csv(column, var, coltype, c);
     } else if (c->output_format == RS_FORMAT_DTA) {
-        produce_column_header_dta(column, var, c);
+        error = produce_column_header_dta(column, var, coltype, c);
     } else if (c->output_format == RS_FORMAT_SAV) {
-        produce_column_header_sav(column, var, c);
+        error = produce_column_header_sav(column, var, coltype, c);
     } else {
         fprintf(stderr, "%s:%d unsupported output format %d\n", __FILE__, __LINE__, c->output_format);
-        exit(EXIT_FAILURE);
+        error = READSTAT_ERROR_UNSUPPORTED_FILE_FORMAT_VERSION;
     }
+    if (error != READSTAT_OK)
+        return error;
 
     if (c->pass == 2 && coltype == METADATA_COLUMN_TYPE_STRING) {
         var->storage_width = c->column_width[c->columns];
     }
     
     var->index = c->columns;
-    copy_variable_property(c->json_md, column, "label", var->label, sizeof(var->label));
-    snprintf(var->name, sizeof(var->name), "%.*s", (int)len, column);
+    copy_variable_property(c->json_md, column, "label", label, sizeof(label));
+    if ((error = intern_string(c, label, sizeof(label), &var->label)) != READSTAT_OK)
+        return error;
+    if ((error = intern_string(c, column, len < READSTAT_VARIABLE_NAME_LEN ? len : READSTAT_VARIABLE_NAME_LEN - 1,
+                    &var->name)) != READSTAT_OK)
+        return error;
 
-    produce_missingness(c, column);
-    if (c->parser->value_label_handler) {
-        produce_value_label(c, column);
+    if ((error = produce_missingness(c, column)) != READSTAT_OK)
+        return error;
+    if (c->parser->value_label_handler && c->pass == 1) {
+        if ((error = produce_value_label(c, column)) != READSTAT_OK)
+            return error;
     }
 
     if (c->parser->variable_handler && c->pass == 2) {
-        c->parser->variable_handler(c->columns, var, column, c->user_ctx);
+        if (c->parser->variable_handler(c->columns, var, column, c->user_ctx) != 0)
+            return READSTAT_ERROR_USER_ABORT;
     }
+    return READSTAT_OK;
 }
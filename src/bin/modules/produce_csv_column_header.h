@@ -1,9 +1,11 @@
 #ifndef __PRODUCE_CSV_COLUMN_HEADER_H
 #define __PRODUCE_CSV_COLUMN_HEADER_H
 
+#include <stdio.h>
+
 #include "../../readstat.h"
 
-void produce_column_header(void *s, size_t len, void *data);
+readstat_error_t produce_column_header(void *s, size_t len, void *data);
 
 typedef struct csv_metadata {
     int pass;
@@ -17,8 +19,14 @@ typedef struct csv_metadata {
     readstat_parser_t *parser;
     void *user_ctx;
     readstat_variable_t* variables;
+    struct readstat_string_pool_s* strings;
     int* is_date;
     struct json_metadata* json_md;
+    readstat_error_t error; // first error from a cell; later cells are skipped
+    FILE* spill; // cells parsed in pass 1, replayed in pass 2
+    unsigned char* spill_buffer;
+    size_t spill_buffer_len;
+    size_t spill_buffer_capacity;
 } csv_metadata;
 
 #endif
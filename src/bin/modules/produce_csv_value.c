@@ -8,20 +8,20 @@
 #include "produce_csv_value_csv.h"
 #include "produce_csv_value_dta.h"
 #include "produce_csv_value_sav.h"
+#include "parse_number.h"
 
-void produce_csv_column_value(void *s, size_t len, void *data) {
+readstat_error_t produce_csv_column_value(void *s, size_t len, void *data) {
     struct csv_metadata *c = (struct csv_metadata *)data;
     const char *ss = (const char*) s;
     if (c->output_format == RS_FORMAT_CSV) {
-        produce_csv_value_csv(ss, len, c);
+        return produce_csv_value_csv(ss, len, c);
     } else if (c->output_format == RS_FORMAT_DTA) {
-        produce_csv_value_dta(ss, len, c);
+        return produce_csv_value_dta(ss, len, c);
     } else if (c->output_format == RS_FORMAT_SAV) {
-        produce_csv_value_sav(ss, len, c);
-    } else {
-        fprintf(stderr, "%s:%d unsupported output format %d\n", __FILE__, __LINE__, c->output_format);
-        exit(EXIT_FAILURE);
+        return produce_csv_value_sav(ss, len, c);
     }
+    fprintf(stderr, "%s:%d unsupported output format %d\n", __FILE__, __LINE__, c->output_format);
+    return READSTAT_ERROR_UNSUPPORTED_FILE_FORMAT_VERSION;
 }
 
 readstat_value_t value_sysmiss(const char *s, size_t len, struct csv_metadata *c) {
@@ -44,16 +44,17 @@ readstat_value_t value_string(const char *s, size_t len, struct csv_metadata *c)
     return value;
 }
 
-readstat_value_t value_double(const char *s, size_t len, struct csv_metadata *c) {
+readstat_error_t value_double(const char *s, size_t len, struct csv_metadata *c, readstat_value_t *value) {
     char *dest;
-    double val = strtod(s, &dest);
+    double val = parse_number_double(s, &dest);
     if (dest == s) {
         fprintf(stderr, "%s:%d not a number: %s\n", __FILE__, __LINE__, (char*)s);
-        exit(EXIT_FAILURE);
+        return READSTAT_ERROR_PARSE;
     }
-    readstat_value_t value = {
+    readstat_value_t result = {
         .type = READSTAT_TYPE_DOUBLE,
         .v = { .double_value = val }
     };
-    return value;
+    *value = result;
+    return READSTAT_OK;
 }
@@ -5,7 +5,7 @@
 
 readstat_value_t value_sysmiss(const char *s, size_t len, struct csv_metadata *c);
 readstat_value_t value_string(const char *s, size_t len, struct csv_metadata *c);
-readstat_value_t value_double(const char *s, size_t len, struct csv_metadata *c);
-void produce_csv_column_value(void *s, size_t len, void *data);
+readstat_error_t value_double(const char *s, size_t len, struct csv_metadata *c, readstat_value_t *value);
+readstat_error_t produce_csv_column_value(void *s, size_t len, void *data);
 
 #endif
@@ -5,24 +5,30 @@
 #include "produce_csv_value_csv.h"
 #include "produce_csv_column_header.h"
 
-void produce_csv_value_csv(const char *s, size_t len, struct csv_metadata *c) {
+readstat_error_t produce_csv_value_csv(const char *s, size_t len, struct csv_metadata *c) {
     readstat_variable_t *var = &c->variables[c->columns];
     int is_date = c->is_date[c->columns];
     int obs_index = c->rows - 1; // TODO: ???
     readstat_value_t value;
+    readstat_error_t error = READSTAT_OK;
 
     if (len == 0) {
         value = value_sysmiss(s, len, c);
     } else if (is_date) {
         value = value_string(s, len, c);
     } else if (var->type == READSTAT_TYPE_DOUBLE) {
-        value = value_double(s, len, c);
+        error = value_double(s, len, c, &value);
     } else if (var->type == READSTAT_TYPE_STRING) {
         value = value_string(s, len, c);
     } else {
         fprintf(stderr, "%s:%d unsupported variable type %d\n", __FILE__, __LINE__, var->type);
-        exit(EXIT_FAILURE);
+        error = READSTAT_ERROR_VALUE_TYPE_MISMATCH;
     }
+    if (error != READSTAT_OK)
+        return error;
 
-    c->parser->value_handler(obs_index, var, value, c->user_ctx);
+    if (c->parser->value_handler(obs_index, var, value, c->user_ctx) != 0)
+        return READSTAT_ERROR_USER_ABORT;
+
+    return READSTAT_OK;
 }
@@ -4,6 +4,6 @@
 #include "../../readstat.h"
 #include "produce_csv_column_header.h"
 
-void produce_csv_value_dta(const char *s, size_t len, struct csv_metadata *c);
+readstat_error_t produce_csv_value_dta(const char *s, size_t len, struct csv_metadata *c);
 
 #endif
@@ -10,7 +10,7 @@
 #include "produce_csv_column_header.h"
 #include "produce_missingness_dta.h"
 
-double get_dta_days_from_token(const char *js, jsmntok_t* token) {
+readstat_error_t get_dta_days_from_token(const char *js, jsmntok_t* token, double *value) {
     char buf[255];
     int len = token->end - token->start;
     snprintf(buf, sizeof(buf), "%.*s", len, js + token->start);
@@ -18,17 +18,36 @@ double get_dta_days_from_token(const char *js, jsmntok_t* token) {
     int days = readstat_dta_num_days(buf, &dest);
     if (dest == buf) {
         fprintf(stderr, "%s:%d error parsing date %s\n", __FILE__, __LINE__, buf);
-        exit(EXIT_FAILURE);
+        return READSTAT_ERROR_PARSE;
     }
-    return days;
+    *value = days;
+    return READSTAT_OK;
 }
 
-char dta_add_missing_date(readstat_variable_t* var, double v) {
+static readstat_error_t get_value_from_token(const char *js, jsmntok_t* token, int is_date, double *value) {
+    if (is_date)
+        return get_dta_days_from_token(js, token, value);
+    return get_double_from_token(js, token, value);
+}
+
+static readstat_error_t add_missing_value(readstat_variable_t* var, readstat_value_t value) {
+    int idx = var->missingness.missing_ranges_count;
+    readstat_error_t error = readstat_variable_add_missing_double_value(var, 0.0);
+    if (error != READSTAT_OK) {
+        fprintf(stderr, "%s:%d could not add missing value %d, aborting ...\n", __FILE__, __LINE__, idx + 1);
+        return error;
+    }
+    var->missingness.missing_ranges[(idx*2)] = value;
+    var->missingness.missing_ranges[(idx*2)+1] = value;
+    return READSTAT_OK;
+}
+
+readstat_error_t dta_add_missing_date(readstat_variable_t* var, double v) {
     int idx = var->missingness.missing_ranges_count;
     char tagg = 'a' + idx;
     if (tagg > 'z') {
         fprintf(stderr, "%s:%d missing tag reached %c, aborting ...\n", __FILE__, __LINE__, tagg);
-        exit(EXIT_FAILURE);
+        return READSTAT_ERROR_TAGGED_VALUE_IS_OUT_OF_RANGE;
     }
     readstat_value_t value = {
         .type = READSTAT_TYPE_INT32,
@@ -39,18 +58,15 @@ char dta_add_missing_date(readstat_variable_t* var, double v) {
             .i32_value = v
         }
     };
-    var->missingness.missing_ranges[(idx*2)] = value;
-    var->missingness.missing_ranges[(idx*2)+1] = value;
-    var->missingness.missing_ranges_count++;
-    return tagg;
+    return add_missing_value(var, value);
 }
 
-char dta_add_missing_double(readstat_variable_t* var, double v) {
+readstat_error_t dta_add_missing_double(readstat_variable_t* var, double v) {
     int idx = var->missingness.missing_ranges_count;
     char tagg = 'a' + idx;
     if (tagg > 'z') {
         fprintf(stderr, "%s:%d missing tag reached %c, aborting ...\n", __FILE__, __LINE__, tagg);
-        exit(EXIT_FAILURE);
+        return READSTAT_ERROR_TAGGED_VALUE_IS_OUT_OF_RANGE;
     }
     readstat_value_t value = {
         .type = READSTAT_TYPE_DOUBLE,
@@ -61,35 +77,33 @@ char dta_add_missing_double(readstat_variable_t* var, double v) {
             .double_value = v
         }
     };
-    var->missingness.missing_ranges[(idx*2)] = value;
-    var->missingness.missing_ranges[(idx*2)+1] = value;
-    var->missingness.missing_ranges_count++;
-    return tagg;
+    return add_missing_value(var, value);
 }
 
-void produce_missingness_range_dta(struct csv_metadata *c, jsmntok_t* missing, const char* column) {
+readstat_error_t produce_missingness_range_dta(struct csv_metadata *c, jsmntok_t* missing, const char* column) {
     readstat_variable_t* var = &c->variables[c->columns];
     const char *js = c->json_md->js;
     int is_date = c->is_date[c->columns];
+    readstat_error_t error = READSTAT_OK;
 
     jsmntok_t* low = find_object_property(js, missing, "low");
     jsmntok_t* high = find_object_property(js, missing, "high");
     jsmntok_t* discrete = find_object_property(js, missing, "discrete-value");
 
-    jsmntok_t* categories = find_variable_property(js, c->json_md->tok, column, "categories");
+    jsmntok_t* categories = find_variable_property(c->json_md, column, "categories");
     if (!categories && (low || high || discrete)) {
         fprintf(stderr, "%s:%d expected to find categories for column %s\n", __FILE__, __LINE__, column);
-        exit(EXIT_FAILURE);
+        return READSTAT_ERROR_PARSE;
     } else if (!categories) {
-        return;
+        return READSTAT_OK;
     }
     if (low && !high) {
         fprintf(stderr, "%s:%d missing.low specified for column %s, but missing.high not specified\n", __FILE__, __LINE__, column);
-        exit(EXIT_FAILURE);
+        return READSTAT_ERROR_PARSE;
     }
     if (high && !low) {
         fprintf(stderr, "%s:%d missing.high specified for column %s, but missing.low not specified\n", __FILE__, __LINE__, column);
-        exit(EXIT_FAILURE);
+        return READSTAT_ERROR_PARSE;
     }
 
     char label_buf[1024];
@@ -100,78 +114,96 @@ void produce_missingness_range_dta(struct csv_metadata *c, jsmntok_t* missing, c
         char* label = get_object_property(c->json_md->js, tok, "label", label_buf, sizeof(label_buf));
         if (!code || !label) {
             fprintf(stderr, "%s:%d bogus JSON metadata input. Missing code/label for column %s\n", __FILE__, __LINE__, column);
-            exit(EXIT_FAILURE);
+            return READSTAT_ERROR_PARSE;
         }
 
-        double cod = is_date ? get_dta_days_from_token(js, code) : get_double_from_token(js, code);
+        double cod, lo, hi, v;
+        if ((error = get_value_from_token(js, code, is_date, &cod)) != READSTAT_OK)
+            return error;
 
         if (low && high) {
-            double lo = is_date ? get_dta_days_from_token(js, low) : get_double_from_token(js, low);
-            double hi = is_date ? get_dta_days_from_token(js, high) : get_double_from_token(js, high);
+            if ((error = get_value_from_token(js, low, is_date, &lo)) != READSTAT_OK)
+                return error;
+            if ((error = get_value_from_token(js, high, is_date, &hi)) != READSTAT_OK)
+                return error;
             if (cod >= lo && cod <= hi) {
-                is_date ? dta_add_missing_date(var, cod) : dta_add_missing_double(var, cod);
+                error = is_date ? dta_add_missing_date(var, cod) : dta_add_missing_double(var, cod);
+                if (error != READSTAT_OK)
+                    return error;
             }
         }
         if (discrete) {
-            double v = is_date ? get_dta_days_from_token(js, discrete) : get_double_from_token(js, discrete);
+            if ((error = get_value_from_token(js, discrete, is_date, &v)) != READSTAT_OK)
+                return error;
             if (cod == v) {
-                is_date ? dta_add_missing_date(var, cod) : dta_add_missing_double(var, cod);
+                error = is_date ? dta_add_missing_date(var, cod) : dta_add_missing_double(var, cod);
+                if (error != READSTAT_OK)
+                    return error;
             }
         }
         j += slurp_object(tok);
     }
+    return READSTAT_OK;
 }
 
-void produce_missingness_discrete_dta(struct csv_metadata *c, jsmntok_t* missing, const char* column) {
+readstat_error_t produce_missingness_discrete_dta(struct csv_metadata *c, jsmntok_t* missing, const char* column) {
     readstat_variable_t* var = &c->variables[c->columns];
     int is_date = c->is_date[c->columns];
     const char *js = c->json_md->js;
+    readstat_error_t error = READSTAT_OK;
 
     jsmntok_t* values = find_object_property(js, missing, "values");
     if (!values) {
         fprintf(stderr, "%s:%d Expected to find missing 'values' property\n", __FILE__, __LINE__);
-        exit(EXIT_FAILURE);
+        return READSTAT_ERROR_PARSE;
     }
 
     int j = 1;
     for (int i=0; i<values->size; i++) {
         jsmntok_t* missing_value_token = values + j;
+        double v;
         if (is_date) { 
-            dta_add_missing_date(var, get_dta_days_from_token(js, missing_value_token));
+            if ((error = get_dta_days_from_token(js, missing_value_token, &v)) != READSTAT_OK)
+                return error;
+            error = dta_add_missing_date(var, v);
         } else if (var->type == READSTAT_TYPE_DOUBLE) {
-            dta_add_missing_double(var, get_double_from_token(js, missing_value_token));
+            if ((error = get_double_from_token(js, missing_value_token, &v)) != READSTAT_OK)
+                return error;
+            error = dta_add_missing_double(var, v);
         } else if (var->type == READSTAT_TYPE_STRING) {
         } else {
             fprintf(stderr, "%s:%d Unsupported column type %d\n", __FILE__, __LINE__, var->type);
-            exit(EXIT_FAILURE);
+            error = READSTAT_ERROR_VALUE_TYPE_MISMATCH;
         }
+        if (error != READSTAT_OK)
+            return error;
         j += slurp_object(missing_value_token);
     }
+    return READSTAT_OK;
 }
 
 
-void produce_missingness_dta(struct csv_metadata *c, const char* column) {
+readstat_error_t produce_missingness_dta(struct csv_metadata *c, const char* column) {
     const char *js = c->json_md->js;
     readstat_variable_t* var = &c->variables[c->columns];
     var->missingness.missing_ranges_count = 0;
     
-    jsmntok_t* missing = find_variable_property(js, c->json_md->tok, column, "missing");
+    jsmntok_t* missing = find_variable_property(c->json_md, column, "missing");
     if (!missing) {
-        return;
+        return READSTAT_OK;
     }
 
     jsmntok_t* missing_type = find_object_property(js, missing, "type");
     if (!missing_type) {
         fprintf(stderr, "%s:%d expected to find missing.type for column %s\n", __FILE__, __LINE__, column);
-        exit(EXIT_FAILURE);
+        return READSTAT_ERROR_PARSE;
     }
 
     if (match_token(js, missing_type, "DISCRETE")) {
-        produce_missingness_discrete_dta(c, missing, column);
+        return produce_missingness_discrete_dta(c, missing, column);
     } else if (match_token(js, missing_type, "RANGE")) {
-        produce_missingness_range_dta(c, missing, column);
-    } else {
-        fprintf(stderr, "%s:%d unknown missing type %.*s\n", __FILE__, __LINE__, missing_type->end - missing_type->start, js+missing_type->start);
-        exit(EXIT_FAILURE);
+        return produce_missingness_range_dta(c, missing, column);
     }
+    fprintf(stderr, "%s:%d unknown missing type %.*s\n", __FILE__, __LINE__, missing_type->end - missing_type->start, js+missing_type->start);
+    return READSTAT_ERROR_PARSE;
 }
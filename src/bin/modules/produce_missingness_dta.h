@@ -4,6 +4,6 @@
 #include "produce_csv_column_header.h"
 #include "json_metadata.h"
 
-void produce_missingness_dta(struct csv_metadata *c, const char* column);
+readstat_error_t produce_missingness_dta(struct csv_metadata *c, const char* column);
 
 #endif
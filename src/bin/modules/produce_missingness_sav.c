@@ -10,53 +10,65 @@
 #include "produce_csv_column_header.h"
 #include "produce_missingness_sav.h"
 
-double get_double_date_missing_sav(const char *js, jsmntok_t* missing_value_token) {
+readstat_error_t get_double_date_missing_sav(const char *js, jsmntok_t* missing_value_token, double *value) {
     // SAV missing date
     char buf[255];
     char *dest;
     int len = missing_value_token->end - missing_value_token->start;
     snprintf(buf, sizeof(buf), "%.*s", len, js + missing_value_token->start);
-    double val = readstat_sav_date_parse(buf, &dest);
+    *value = readstat_sav_date_parse(buf, &dest);
     if (buf == dest) {
         fprintf(stderr, "%s:%d failed to parse double: %s\n", __FILE__, __LINE__, buf);
-        exit(EXIT_FAILURE);
+        return READSTAT_ERROR_PARSE;
     } else {
         fprintf(stdout, "added double date missing %s\n", buf);
     }
-    return val;
+    return READSTAT_OK;
 }
 
-void produce_missingness_discrete_sav(struct csv_metadata *c, jsmntok_t* missing, const char* column) {
+static readstat_error_t get_value_from_token(const char *js, jsmntok_t* token, int is_date, double *value) {
+    if (is_date)
+        return get_double_date_missing_sav(js, token, value);
+    return get_double_from_token(js, token, value);
+}
+
+readstat_error_t produce_missingness_discrete_sav(struct csv_metadata *c, jsmntok_t* missing, const char* column) {
     readstat_variable_t* var = &c->variables[c->columns];
     int is_date = c->is_date[c->columns];
     const char *js = c->json_md->js;
+    readstat_error_t error = READSTAT_OK;
 
     jsmntok_t* values = find_object_property(js, missing, "values");
     if (!values) {
         fprintf(stderr, "%s:%d Expected to find missing 'values' property\n", __FILE__, __LINE__);
-        exit(EXIT_FAILURE);
+        return READSTAT_ERROR_PARSE;
     }
 
     int j = 1;
     for (int i=0; i<values->size; i++) {
         jsmntok_t* missing_value_token = values + j;
-        if (is_date) { 
-            readstat_variable_add_missing_double_value(var, get_double_date_missing_sav(js, missing_value_token));
-        } else if (var->type == READSTAT_TYPE_DOUBLE) {
-            readstat_variable_add_missing_double_value(var, get_double_from_token(js, missing_value_token));
+        double v;
+        if (is_date || var->type == READSTAT_TYPE_DOUBLE) {
+            if ((error = get_value_from_token(js, missing_value_token, is_date, &v)) != READSTAT_OK)
+                return error;
+            error = readstat_variable_add_missing_double_value(var, v);
         } else if (var->type == READSTAT_TYPE_STRING) {
         } else {
             fprintf(stderr, "%s:%d Unsupported column type %d\n", __FILE__, __LINE__, var->type);
-            exit(EXIT_FAILURE);
+            error = READSTAT_ERROR_VALUE_TYPE_MISMATCH;
         }
+        if (error != READSTAT_OK)
+            return error;
         j += slurp_object(missing_value_token);
     }
+    return READSTAT_OK;
 }
 
-void produce_missingness_range_sav(struct csv_metadata *c, jsmntok_t* missing, const char* column) {
+readstat_error_t produce_missingness_range_sav(struct csv_metadata *c, jsmntok_t* missing, const char* column) {
     readstat_variable_t* var = &c->variables[c->columns];
     int is_date = c->is_date[c->columns];
     const char *js = c->json_md->js;
+    readstat_error_t error = READSTAT_OK;
 
     jsmntok_t* low = find_object_property(js, missing, "low");
     jsmntok_t* high = find_object_property(js, missing, "high");
@@ -64,47 +76,54 @@ void produce_missingness_range_sav(struct csv_metadata *c, jsmntok_t* missing, c
 
     if (low && !high) {
         fprintf(stderr, "%s:%d missing.low specified for column %s, but missing.high not specified\n", __FILE__, __LINE__, column);
-        exit(EXIT_FAILURE);
+        return READSTAT_ERROR_PARSE;
     }
     if (high && !low) {
         fprintf(stderr, "%s:%d missing.high specified for column %s, but missing.low not specified\n", __FILE__, __LINE__, column);
-        exit(EXIT_FAILURE);
+        return READSTAT_ERROR_PARSE;
     }
 
     if (low && high) {
-        double lo = is_date ? get_double_date_missing_sav(js, low) : get_double_from_token(js, low);
-        double hi = is_date ? get_double_date_missing_sav(js, high) :  get_double_from_token(js, high);
-        readstat_variable_add_missing_double_range(var, lo, hi);
+        double lo, hi;
+        if ((error = get_value_from_token(js, low, is_date, &lo)) != READSTAT_OK)
+            return error;
+        if ((error = get_value_from_token(js, high, is_date, &hi)) != READSTAT_OK)
+            return error;
+        if ((error = readstat_variable_add_missing_double_range(var, lo, hi)) != READSTAT_OK)
+            return error;
     }
 
     if (discrete) {
-        double v = is_date ? get_double_date_missing_sav(js, discrete) : get_double_from_token(js, discrete);
-        readstat_variable_add_missing_double_value(var, v);
+        double v;
+        if ((error = get_value_from_token(js, discrete, is_date, &v)) != READSTAT_OK)
+            return error;
+        if ((error = readstat_variable_add_missing_double_value(var, v)) != READSTAT_OK)
+            return error;
     }
+    return READSTAT_OK;
 }
 
-void produce_missingness_sav(struct csv_metadata *c, const char* column) {
+readstat_error_t produce_missingness_sav(struct csv_metadata *c, const char* column) {
     const char *js = c->json_md->js;
     readstat_variable_t* var = &c->variables[c->columns];
     var->missingness.missing_ranges_count = 0;
     
-    jsmntok_t* missing = find_variable_property(js, c->json_md->tok, column, "missing");
+    jsmntok_t* missing = find_variable_property(c->json_md, column, "missing");
     if (!missing) {
-        return;
+        return READSTAT_OK;
     }
 
     jsmntok_t* missing_type = find_object_property(js, missing, "type");
     if (!missing_type) {
         fprintf(stderr, "%s:%d expected to find missing.type for column %s\n", __FILE__, __LINE__, column);
-        exit(EXIT_FAILURE);
+        return READSTAT_ERROR_PARSE;
     }
 
     if (match_token(js, missing_type, "DISCRETE")) {
-        produce_missingness_discrete_sav(c, missing, column);
+        return produce_missingness_discrete_sav(c, missing, column);
     } else if (match_token(js, missing_type, "RANGE")) {
-        produce_missingness_range_sav(c, missing, column);
-    } else {
-        fprintf(stderr, "%s:%d unknown missing type %.*s\n", __FILE__, __LINE__, missing_type->end - missing_type->start, js+missing_type->start);
-        exit(EXIT_FAILURE);
+        return produce_missingness_range_sav(c, missing, column);
     }
+    fprintf(stderr, "%s:%d unknown missing type %.*s\n", __FILE__, __LINE__, missing_type->end - missing_type->start, js+missing_type->start);
+    return READSTAT_ERROR_PARSE;
 }
@@ -9,15 +9,14 @@
 #include "produce_value_label_dta.h"
 #include "produce_value_label_sav.h"
 
-void produce_value_label(struct csv_metadata *c, const char* column) {
+readstat_error_t produce_value_label(struct csv_metadata *c, const char* column) {
     if (c->output_format == RS_FORMAT_CSV) {
-        // ignore
+        return READSTAT_OK;
     } else if (c->output_format == RS_FORMAT_DTA) {
-        produce_value_label_dta(c, column);
+        return produce_value_label_dta(c, column);
     } else if (c->output_format == RS_FORMAT_SAV) {
-        produce_value_label_sav(c, column);
-    } else {
-        fprintf(stderr, "%s:%d unsupported output format %d\n", __FILE__, __LINE__, c->output_format);
-        exit(EXIT_FAILURE);
+        return produce_value_label_sav(c, column);
     }
+    fprintf(stderr, "%s:%d unsupported output format %d\n", __FILE__, __LINE__, c->output_format);
+    return READSTAT_ERROR_UNSUPPORTED_FILE_FORMAT_VERSION;
 }
@@ -3,6 +3,6 @@
 
 #include "produce_csv_column_header.h"
 
-void produce_value_label(struct csv_metadata *c, const char* column);
+readstat_error_t produce_value_label(struct csv_metadata *c, const char* column);
 
 #endif
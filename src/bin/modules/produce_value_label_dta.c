@@ -8,13 +8,13 @@
 #include "../../stata/readstat_dta_days.h"
 #include "produce_csv_column_header.h"
 
-void produce_value_label_int32_date_dta(const char* column, struct csv_metadata *c, char *code, char *label) {
+readstat_error_t produce_value_label_int32_date_dta(const char* column, struct csv_metadata *c, char *code, char *label) {
     readstat_variable_t* variable = &c->variables[c->columns];
     char *dest;
     int days = readstat_dta_num_days(code, &dest);
     if (dest == code) {
         fprintf(stderr, "%s:%d not a valid date: %s\n", __FILE__, __LINE__, code);
-        exit(EXIT_FAILURE);
+        return READSTAT_ERROR_PARSE;
     }
     readstat_value_t value = {
         .v = { .i32_value = days },
@@ -34,16 +34,18 @@ void produce_value_label_int32_date_dta(const char* column, struct csv_metadata
             }
         }
     }
-    c->parser->value_label_handler(column, value, label, c->user_ctx);
+    if (c->parser->value_label_handler(column, value, label, c->user_ctx) != 0)
+        return READSTAT_ERROR_USER_ABORT;
+    return READSTAT_OK;
 }
 
-void produce_value_label_double_dta(const char* column, struct csv_metadata *c, const char *code, const char *label) {
+readstat_error_t produce_value_label_double_dta(const char* column, struct csv_metadata *c, const char *code, const char *label) {
     readstat_variable_t* variable = &c->variables[c->columns];
     char *endptr;
     double v = strtod(code, &endptr);
     if (endptr == code) {
         fprintf(stderr, "%s:%d not a number: %s\n", __FILE__, __LINE__, code);
-        exit(EXIT_FAILURE);
+        return READSTAT_ERROR_PARSE;
     }
     readstat_value_t value = {
         .v = { .double_value = v },
@@ -62,13 +64,16 @@ void produce_value_label_double_dta(const char* column, struct csv_metadata *c,
             }
         }
     }
-    c->parser->value_label_handler(column, value, label, c->user_ctx);
+    if (c->parser->value_label_handler(column, value, label, c->user_ctx) != 0)
+        return READSTAT_ERROR_USER_ABORT;
+    return READSTAT_OK;
 }
 
-void produce_value_label_dta(struct csv_metadata *c, const char* column) {
-    jsmntok_t* categories = find_variable_property(c->json_md->js, c->json_md->tok, column, "categories");
+readstat_error_t produce_value_label_dta(struct csv_metadata *c, const char* column) {
+    jsmntok_t* categories = find_variable_property(c->json_md, column, "categories");
+    readstat_error_t error = READSTAT_OK;
     if (categories==NULL) {
-        return;
+        return READSTAT_OK;
     }
     readstat_variable_t* variable = &c->variables[c->columns];
     readstat_type_t coltype = variable->type;
@@ -83,18 +88,21 @@ void produce_value_label_dta(struct csv_metadata *c, const char* column) {
         char* label = get_object_property(c->json_md->js, tok, "label", label_buf, sizeof(label_buf));
         if (!code || !label) {
             fprintf(stderr, "%s:%d bogus JSON metadata input. Missing code/label for column %s\n", __FILE__, __LINE__, column);
-            exit(EXIT_FAILURE);
+            return READSTAT_ERROR_PARSE;
         }
 
         if (is_date) {
-            produce_value_label_int32_date_dta(column, c, code, label);
+            error = produce_value_label_int32_date_dta(column, c, code, label);
         } else if (coltype == READSTAT_TYPE_DOUBLE) {
-            produce_value_label_double_dta(column, c, code, label);
+            error = produce_value_label_double_dta(column, c, code, label);
         } else if (coltype == READSTAT_TYPE_STRING) {
         } else {
             fprintf(stderr, "%s:%d unsupported column type %d for value label for column %s\n", __FILE__, __LINE__, coltype, column);
-            exit(EXIT_FAILURE);
+            error = READSTAT_ERROR_VALUE_TYPE_MISMATCH;
         }
+        if (error != READSTAT_OK)
+            return error;
         j += slurp_object(tok);
     }
+    return READSTAT_OK;
 }
@@ -1,10 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
 #include <time.h>
 #include <sys/time.h>
+#if HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #include "../readstat.h"
 #include "module.h"
@@ -26,6 +30,8 @@
 
 #define RS_FORMAT_CAN_WRITE     (RS_FORMAT_DTA | RS_FORMAT_SAV)
 
+#define RS_MANIFEST_LINE_LEN    8192
+
 typedef struct rs_ctx_s {
     rs_module_t *module;
     void        *module_ctx;
@@ -33,6 +39,30 @@ typedef struct rs_ctx_s {
     long         var_count;
 } rs_ctx_t;
 
+typedef struct rs_job_s {
+    char        *input_filename;
+    char        *catalog_filename;
+    char        *output_filename;
+    int          use_mmap;
+    long         row_count;
+    long         var_count;
+    double       seconds;
+    int          status;
+} rs_job_t;
+
+typedef struct rs_batch_s {
+    rs_job_t        *jobs;
+    long             jobs_count;
+    long             jobs_capacity;
+    long             next_job;
+#if HAVE_LIBPTHREAD
+    pthread_mutex_t  lock;
+#endif
+    rs_module_t     *modules;
+    long             modules_count;
+    int              use_mmap;
+} rs_batch_t;
+
 const char *format_name(int format) {
     if (format == RS_FORMAT_DTA)
         return "Stata binary file (DTA)";
@@ -194,11 +224,20 @@ static void print_usage(const char *cmd) {
 #if HAVE_XLSXWRITER
             "|xlsx"
 #endif
-            ")\n\n", cmd);
+            ")\n", cmd);
+    fprintf(stderr, "\n  Convert many files in parallel, one job per line of a manifest (- for stdin):\n");
+    fprintf(stderr, "\n     %s --batch manifest.txt [--jobs N]\n", cmd);
+    fprintf(stderr, "\n     where each line is \"input [catalog] output\", separated by tabs or spaces\n");
+    fprintf(stderr, "\n  Conversions can read their inputs through mmap(2), which is faster for large\n"
+                    "  files but crashes if an input is truncated while it's being read:\n");
+    fprintf(stderr, "\n     %s --mmap input output\n", cmd);
+    fprintf(stderr, "\n     %s --mmap --batch manifest.txt [--jobs N]\n\n", cmd);
 }
 
-static int convert_file(const char *input_filename, const char *catalog_filename, const char *output_filename,
-        rs_module_t *modules, int modules_count) {
+static int convert_file(rs_job_t *job, rs_module_t *modules, long modules_count) {
+    const char *input_filename = job->input_filename;
+    const char *catalog_filename = job->catalog_filename;
+    const char *output_filename = job->output_filename;
     readstat_error_t error = READSTAT_OK;
     const char *error_filename = NULL;
     struct timeval start_time, end_time;
@@ -212,44 +251,44 @@ static int convert_file(const char *input_filename, const char *catalog_filename
 
     gettimeofday(&start_time, NULL);
 
-    readstat_parser_t *pass1_parser = readstat_parser_init();
+    readstat_parser_t *pass1_parser = NULL;
     readstat_parser_t *pass2_parser = readstat_parser_init();
 
+    if (job->use_mmap)
+        readstat_io_mmap_init(pass2_parser);
+
     rs_ctx_t *rs_ctx = calloc(1, sizeof(rs_ctx_t));
 
     void *module_ctx = module->init(output_filename);
 
     if (module_ctx == NULL) {
         error = READSTAT_ERROR_OPEN;
+        error_filename = output_filename;
         goto cleanup;
     }
 
     rs_ctx->module = module;
     rs_ctx->module_ctx = module_ctx;
 
-    // Pass 1 - Collect fweight and value labels
-    readstat_set_error_handler(pass1_parser, &handle_error);
-    readstat_set_info_handler(pass1_parser, &handle_info);
-    readstat_set_value_label_handler(pass1_parser, &handle_value_label);
-    readstat_set_fweight_handler(pass1_parser, &handle_fweight);
-    
+    // Pass 1 - Collect fweight and value labels from the catalog. Without a
+    // catalog, the input's own value labels are prefetched during pass 2, so
+    // the input only needs to be read once. CSV input takes its value labels
+    // from the JSON metadata, and is also read once.
     if (catalog_filename && input_format != RS_FORMAT_CSV) {
+        pass1_parser = readstat_parser_init();
+        if (job->use_mmap)
+            readstat_io_mmap_init(pass1_parser);
+
+        readstat_set_error_handler(pass1_parser, &handle_error);
+        readstat_set_info_handler(pass1_parser, &handle_info);
+        readstat_set_value_label_handler(pass1_parser, &handle_value_label);
+        readstat_set_fweight_handler(pass1_parser, &handle_fweight);
+
         error = parse_file(pass1_parser, catalog_filename, RS_FORMAT_SAS_CATALOG, rs_ctx);
         error_filename = catalog_filename;
-    } else if (catalog_filename && input_format == RS_FORMAT_CSV) {
-        #if HAVE_CSVREADER
-            error = readstat_parse_csv(pass1_parser, input_filename, catalog_filename, &csv_meta, rs_ctx);
-            error_filename = input_filename;
-        #else
-            fprintf(stderr, "Should never happen... Fix macros\n");
-            exit(EXIT_FAILURE);
-        #endif
-    } else {
-        error = parse_file(pass1_parser, input_filename, input_format, rs_ctx);
-        error_filename = input_filename;
+        if (error != READSTAT_OK)
+            goto cleanup;
     }
-    if (error != READSTAT_OK)
-        goto cleanup;
     
     // Pass 2 - Parse full file
     readstat_set_error_handler(pass2_parser, &handle_error);
@@ -259,12 +298,18 @@ static int convert_file(const char *input_filename, const char *catalog_filename
     readstat_set_variable_handler(pass2_parser, &handle_variable);
     readstat_set_value_handler(pass2_parser, &handle_value);
 
+    if (!pass1_parser) {
+        readstat_set_metadata_prefetch(pass2_parser, 1);
+        readstat_set_value_label_handler(pass2_parser, &handle_value_label);
+        readstat_set_fweight_handler(pass2_parser, &handle_fweight);
+    }
+
     if (catalog_filename && input_format == RS_FORMAT_CSV) {
         #if HAVE_CSVREADER
             error = readstat_parse_csv(pass2_parser, input_filename, catalog_filename, &csv_meta, rs_ctx);
         #else
-            fprintf(stderr, "Should never happen... Fix macros\n");
-            exit(EXIT_FAILURE);
+            fprintf(stderr, "This build of ReadStat can't read CSV files\n");
+            error = READSTAT_ERROR_UNSUPPORTED_FILE_FORMAT_VERSION;
         #endif
     } else {
         error = parse_file(pass2_parser, input_filename, input_format, rs_ctx);
@@ -275,10 +320,10 @@ static int convert_file(const char *input_filename, const char *catalog_filename
 
     gettimeofday(&end_time, NULL);
 
-    fprintf(stderr, "Converted %ld variables and %ld rows in %.2lf seconds\n",
-            rs_ctx->var_count, rs_ctx->row_count, 
-            (end_time.tv_sec + 1e-6 * end_time.tv_usec) -
-            (start_time.tv_sec + 1e-6 * start_time.tv_usec));
+    job->var_count = rs_ctx->var_count;
+    job->row_count = rs_ctx->row_count;
+    job->seconds = (end_time.tv_sec + 1e-6 * end_time.tv_usec) -
+        (start_time.tv_sec + 1e-6 * start_time.tv_usec);
 
 cleanup:
     #if HAVE_CSVREADER
@@ -287,21 +332,30 @@ cleanup:
         csv_meta.column_width = NULL;
     }
     #endif
-    readstat_parser_free(pass1_parser);
+    if (pass1_parser)
+        readstat_parser_free(pass1_parser);
     readstat_parser_free(pass2_parser);
 
     if (module->finish) {
-        module->finish(rs_ctx->module_ctx);
+        readstat_error_t finish_error = module->finish(rs_ctx->module_ctx);
+        if (error == READSTAT_OK && finish_error != READSTAT_OK) {
+            error = finish_error;
+            error_filename = output_filename;
+        }
     }
 
     free(rs_ctx);
 
     if (error != READSTAT_OK) {
         fprintf(stderr, "Error processing %s: %s\n", error_filename, readstat_error_message(error));
-        unlink(output_filename);
+        /* Only remove an output file that this job created */
+        if (module_ctx)
+            unlink(output_filename);
+        job->status = 1;
         return 1;
     }
 
+    job->status = 0;
     return 0;
 }
 
@@ -349,10 +403,224 @@ static int dump_file(const char *input_filename) {
     return 0;
 }
 
+static char *copy_string(const char *string) {
+    size_t len = strlen(string) + 1;
+    char *copy = malloc(len);
+    if (copy)
+        memcpy(copy, string, len);
+    return copy;
+}
+
+static int can_convert(rs_module_t *modules, long modules_count,
+        char *input_filename, char *catalog_filename, char *output_filename) {
+    if (!can_read(input_filename) || !can_write(modules, modules_count, output_filename))
+        return 0;
+    if (catalog_filename && !is_catalog(catalog_filename) && !is_json(catalog_filename))
+        return 0;
+    return 1;
+}
+
+static int add_job(rs_batch_t *batch, char *input_filename, char *catalog_filename, char *output_filename) {
+    if (batch->jobs_count == batch->jobs_capacity) {
+        long capacity = batch->jobs_capacity ? 2 * batch->jobs_capacity : 64;
+        rs_job_t *jobs = realloc(batch->jobs, capacity * sizeof(rs_job_t));
+        if (jobs == NULL)
+            return -1;
+        batch->jobs = jobs;
+        batch->jobs_capacity = capacity;
+    }
+
+    rs_job_t *job = &batch->jobs[batch->jobs_count++];
+    memset(job, 0, sizeof(rs_job_t));
+    job->use_mmap = batch->use_mmap;
+    job->input_filename = copy_string(input_filename);
+    job->output_filename = copy_string(output_filename);
+    if (catalog_filename)
+        job->catalog_filename = copy_string(catalog_filename);
+
+    if (job->input_filename == NULL || job->output_filename == NULL ||
+            (catalog_filename && job->catalog_filename == NULL))
+        return -1;
+
+    return 0;
+}
+
+static void free_jobs(rs_batch_t *batch) {
+    long i;
+    for (i=0; i<batch->jobs_count; i++) {
+        free(batch->jobs[i].input_filename);
+        free(batch->jobs[i].catalog_filename);
+        free(batch->jobs[i].output_filename);
+    }
+    free(batch->jobs);
+}
+
+// Reads one job per line: "input output" or "input catalog output". Blank
+// lines and lines starting with # are skipped.
+static int read_manifest(rs_batch_t *batch, const char *manifest_filename) {
+    char line[RS_MANIFEST_LINE_LEN];
+    long line_number = 0;
+    int retval = 0;
+    FILE *file = stdin;
+
+    if (strcmp(manifest_filename, "-") != 0 && (file = fopen(manifest_filename, "r")) == NULL) {
+        fprintf(stderr, "Error opening %s: %s\n", manifest_filename, strerror(errno));
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+        char *fields[4] = { NULL };
+        int fields_count = 0;
+        char *field = NULL;
+
+        line_number++;
+        if (strchr(line, '\n') == NULL && !feof(file)) {
+            fprintf(stderr, "%s:%ld: Line is too long\n", manifest_filename, line_number);
+            retval = 1;
+            goto cleanup;
+        }
+
+        for (field = strtok(line, " \t\r\n"); field && fields_count < 4; field = strtok(NULL, " \t\r\n")) {
+            fields[fields_count++] = field;
+        }
+
+        if (fields_count == 0 || fields[0][0] == '#')
+            continue;
+
+        if (fields_count == 2 && can_convert(batch->modules, batch->modules_count, fields[0], NULL, fields[1])) {
+            retval = add_job(batch, fields[0], NULL, fields[1]);
+        } else if (fields_count == 3 && can_convert(batch->modules, batch->modules_count, fields[0], fields[1], fields[2])) {
+            retval = add_job(batch, fields[0], fields[1], fields[2]);
+        } else {
+            fprintf(stderr, "%s:%ld: Expected \"input [catalog] output\" with supported file types\n",
+                    manifest_filename, line_number);
+            retval = 1;
+            goto cleanup;
+        }
+        if (retval != 0) {
+            fprintf(stderr, "Error reading %s: %s\n", manifest_filename, strerror(ENOMEM));
+            retval = 1;
+            goto cleanup;
+        }
+    }
+    if (ferror(file)) {
+        fprintf(stderr, "Error reading %s: %s\n", manifest_filename, strerror(errno));
+        retval = 1;
+    }
+
+cleanup:
+    if (file != stdin)
+        fclose(file);
+
+    return retval;
+}
+
+static void *batch_worker_main(void *arg) {
+    rs_batch_t *batch = (rs_batch_t *)arg;
+    while (1) {
+#if HAVE_LIBPTHREAD
+        pthread_mutex_lock(&batch->lock);
+#endif
+        long job_index = batch->next_job++;
+#if HAVE_LIBPTHREAD
+        pthread_mutex_unlock(&batch->lock);
+#endif
+
+        if (job_index >= batch->jobs_count)
+            break;
+
+        convert_file(&batch->jobs[job_index], batch->modules, batch->modules_count);
+    }
+    return NULL;
+}
+
+static int convert_batch(const char *manifest_filename, long threads_count,
+        rs_module_t *modules, long modules_count, int use_mmap) {
+    struct timeval start_time, end_time;
+    rs_batch_t batch = { .modules = modules, .modules_count = modules_count, .use_mmap = use_mmap };
+#if HAVE_LIBPTHREAD
+    pthread_t *threads = NULL;
+#endif
+    long threads_started = 0;
+    long failed_count = 0, var_count = 0, row_count = 0;
+    long i;
+    int retval = 0;
+
+    gettimeofday(&start_time, NULL);
+
+    if ((retval = read_manifest(&batch, manifest_filename)) != 0)
+        goto cleanup;
+
+    if (threads_count > batch.jobs_count)
+        threads_count = batch.jobs_count;
+
+#if HAVE_LIBPTHREAD
+    pthread_mutex_init(&batch.lock, NULL);
+
+    /* The calling thread is the first worker, so a failure to start more
+     * threads only reduces parallelism */
+    if (threads_count > 1) {
+        threads = calloc(threads_count - 1, sizeof(pthread_t));
+        for (i=0; threads && i<threads_count-1; i++) {
+            if (pthread_create(&threads[i], NULL, &batch_worker_main, &batch) != 0)
+                break;
+            threads_started++;
+        }
+    }
+
+#endif
+
+    batch_worker_main(&batch);
+
+#if HAVE_LIBPTHREAD
+    for (i=0; i<threads_started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&batch.lock);
+#endif
+
+    gettimeofday(&end_time, NULL);
+
+    for (i=0; i<batch.jobs_count; i++) {
+        if (batch.jobs[i].status != 0) {
+            failed_count++;
+        } else {
+            var_count += batch.jobs[i].var_count;
+            row_count += batch.jobs[i].row_count;
+        }
+    }
+
+    fprintf(stderr, "Converted %ld of %ld files (%ld variables and %ld rows) in %.2lf seconds using %ld threads\n",
+            batch.jobs_count - failed_count, batch.jobs_count, var_count, row_count,
+            (end_time.tv_sec + 1e-6 * end_time.tv_usec) -
+            (start_time.tv_sec + 1e-6 * start_time.tv_usec), threads_started + 1);
+
+    if (failed_count) {
+        fprintf(stderr, "Failed to convert %ld files:\n", failed_count);
+        for (i=0; i<batch.jobs_count; i++) {
+            if (batch.jobs[i].status != 0)
+                fprintf(stderr, "  %s\n", batch.jobs[i].input_filename);
+        }
+        retval = 1;
+    }
+
+cleanup:
+#if HAVE_LIBPTHREAD
+    free(threads);
+#endif
+    free_jobs(&batch);
+
+    return retval;
+}
+
 int main(int argc, char** argv) {
     char *input_filename = NULL;
     char *catalog_filename = NULL;
     char *output_filename = NULL;
+    char *manifest_filename = NULL;
+    long threads_count = sysconf(_SC_NPROCESSORS_ONLN);
+    int use_mmap = 0;
 
     rs_module_t *modules = NULL;
     long modules_count = 2;
@@ -370,12 +638,31 @@ int main(int argc, char** argv) {
 #if HAVE_XLSXWRITER
     modules[module_index++] = rs_mod_xlsx;
 #endif
+    if (argc > 2 && strcmp(argv[1], "--mmap") == 0) {
+        use_mmap = 1;
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
+
     if (argc == 2 && (strcmp(argv[1], "-v") == 0 || strcmp(argv[1], "--version") == 0)) {
         print_version();
         return 0;
     } else if (argc == 2 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
         print_usage(argv[0]);
         return 0;
+    } else if ((argc == 3 || argc == 5) && (strcmp(argv[1], "-b") == 0 || strcmp(argv[1], "--batch") == 0)) {
+        manifest_filename = argv[2];
+        if (argc == 5) {
+            if (strcmp(argv[3], "-j") != 0 && strcmp(argv[3], "--jobs") != 0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            threads_count = atol(argv[4]);
+        }
+        if (threads_count < 1) {
+            threads_count = 1;
+        }
     } else if (argc == 2) {
         if (!can_read(argv[1])) {
             print_usage(argv[0]);
@@ -407,8 +694,16 @@ int main(int argc, char** argv) {
     }
 
     int ret;
-    if (output_filename) {
-        ret = convert_file(input_filename, catalog_filename, output_filename, modules, modules_count);
+    if (manifest_filename) {
+        ret = convert_batch(manifest_filename, threads_count, modules, modules_count, use_mmap);
+    } else if (output_filename) {
+        rs_job_t job = { .input_filename = input_filename, .catalog_filename = catalog_filename,
+            .output_filename = output_filename, .use_mmap = use_mmap };
+        ret = convert_file(&job, modules, modules_count);
+        if (ret == 0) {
+            fprintf(stderr, "Converted %ld variables and %ld rows in %.2lf seconds\n",
+                    job.var_count, job.row_count, job.seconds);
+        }
     } else {
         ret = dump_file(input_filename); 
     }
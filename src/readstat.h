@@ -48,7 +48,8 @@ typedef enum readstat_alignment_e {
 
 typedef enum readstat_compress_e {
     READSTAT_COMPRESS_NONE,
-    READSTAT_COMPRESS_ROWS
+    READSTAT_COMPRESS_ROWS,
+    READSTAT_COMPRESS_BINARY
 } readstat_compress_t;
 
 typedef enum readstat_error_e {
@@ -132,26 +133,36 @@ typedef struct readstat_label_set_s {
     long                        variables_capacity;
 } readstat_label_set_t;
 
+/* The ranges are stored as lo/hi pairs, so a discrete missing value v appears
+ * as the range (v, v). */
 typedef struct readstat_missingness_s {
-    readstat_value_t missing_ranges[32];
-    long             missing_ranges_count;
+    readstat_value_t   *missing_ranges;
+    long                missing_ranges_count;
+    long                missing_ranges_capacity;
 } readstat_missingness_t;
 
+/* The fields read for every value come first; the strings are interned and
+ * shared by all of the variables in a file, and are never NULL. Since 0.2.0
+ * name, format and label are pointers rather than arrays, and missing ranges
+ * are stored out of line; use the accessors below rather than the fields. */
 typedef struct readstat_variable_s {
     readstat_type_t         type;
     int                     index;
-    char                    name[256];
-    char                    format[256];
-    char                    label[1024];
-    readstat_label_set_t   *label_set;
+    int                     skip;
     off_t                   offset;
     size_t                  storage_width;
     size_t                  user_width;
+    readstat_label_set_t   *label_set;
+
+    const char             *name;
+    const char             *format;
+    const char             *label;
     readstat_missingness_t  missingness;
     readstat_measure_t      measure;
     readstat_alignment_t    alignment;
     int                     display_width;
     int                     decimals;
+    struct readstat_string_pool_s  *strings;
 } readstat_variable_t;
 
 /* Value accessors */
@@ -226,6 +237,44 @@ typedef int (*readstat_value_label_handler)(const char *val_labels,
 typedef void (*readstat_error_handler)(const char *error_message, void *ctx);
 typedef int (*readstat_progress_handler)(double progress, void *ctx);
 
+/* Return non-zero to read the variable's values, zero to skip them. Called once
+ * per variable, before the variable handler. Skipped variables still reach the
+ * variable handler, but their values are not decoded, converted, or passed to
+ * the value handler. */
+typedef int (*readstat_column_filter)(int index, readstat_variable_t *variable, void *ctx);
+
+/* Columnar alternative to the value handler. Values for up to batch_size rows
+ * are collected per variable and delivered in one call:
+ *
+ * - READSTAT_TYPE_INT8, INT16 and INT32 values are widened into i32_values
+ * - READSTAT_TYPE_FLOAT and DOUBLE values are widened into double_values
+ * - READSTAT_TYPE_STRING values are copied end-to-end into string_data, with
+ *   row i at string_data + string_offsets[i], string_lengths[i] bytes long
+ *   (not NUL-terminated)
+ *
+ * Bit (i % 8) of missing[i / 8] is set when row i is system missing or tagged
+ * missing; tags[i] holds the tag, or 0. Defined missing values (SPSS) are
+ * delivered as regular numbers, as with the value handler.
+ *
+ * The arrays belong to the parser and are only valid for the duration of the
+ * call. variable may be NULL when the format only creates variables for
+ * variable handlers, and is always NULL for columns rejected by the column
+ * filter. */
+typedef struct readstat_column_s {
+    readstat_variable_t    *variable;
+    readstat_type_t         type;
+    double                 *double_values;
+    int32_t                *i32_values;
+    char                   *string_data;
+    size_t                 *string_offsets;
+    size_t                 *string_lengths;
+    unsigned char          *missing;
+    char                   *tags;
+} readstat_column_t;
+
+typedef int (*readstat_batch_handler)(int obs_index, int obs_count,
+        readstat_column_t *columns, int columns_count, void *ctx);
+
 #if defined _WIN32 || defined __CYGWIN__
 typedef _off64_t readstat_off_t;
 #elif defined _AIX
@@ -266,14 +315,27 @@ typedef struct readstat_parser_s {
     readstat_value_label_handler   value_label_handler;
     readstat_error_handler         error_handler;
     readstat_progress_handler      progress_handler;
+    readstat_batch_handler         batch_handler;
+    readstat_column_filter         column_filter;
     readstat_io_t                 *io;
     const char                    *input_encoding;
     const char                    *output_encoding;
     long                           row_limit;
+    long                           row_offset;
+    long                           batch_size;
+    int                            thread_count;
+    int                            metadata_prefetch;
+    long                           strl_memory_limit;
+    struct readstat_pool_s        *pool;
 } readstat_parser_t;
 
 readstat_parser_t *readstat_parser_init();
 void readstat_parser_free(readstat_parser_t *parser);
+
+// Restores the handlers and options to their defaults while keeping the I/O
+// handlers, scratch buffers and character set converters, so that one parser
+// can read many small files without paying the setup cost for each of them.
+void readstat_parser_reset(readstat_parser_t *parser);
 void readstat_io_free(readstat_io_t *io);
 
 readstat_error_t readstat_set_info_handler(readstat_parser_t *parser, readstat_info_handler info_handler);
@@ -285,6 +347,12 @@ readstat_error_t readstat_set_value_handler(readstat_parser_t *parser, readstat_
 readstat_error_t readstat_set_value_label_handler(readstat_parser_t *parser, readstat_value_label_handler value_label_handler);
 readstat_error_t readstat_set_error_handler(readstat_parser_t *parser, readstat_error_handler error_handler);
 readstat_error_t readstat_set_progress_handler(readstat_parser_t *parser, readstat_progress_handler progress_handler);
+readstat_error_t readstat_set_column_filter(readstat_parser_t *parser, readstat_column_filter column_filter);
+
+// When a batch handler is set, it receives the data instead of the value handler.
+readstat_error_t readstat_set_batch_handler(readstat_parser_t *parser, readstat_batch_handler batch_handler);
+// Maximum number of rows per batch; defaults to 1024.
+readstat_error_t readstat_set_batch_size(readstat_parser_t *parser, long batch_size);
 
 readstat_error_t readstat_set_open_handler(readstat_parser_t *parser, readstat_open_handler open_handler);
 readstat_error_t readstat_set_close_handler(readstat_parser_t *parser, readstat_close_handler close_handler);
@@ -293,6 +361,14 @@ readstat_error_t readstat_set_read_handler(readstat_parser_t *parser, readstat_r
 readstat_error_t readstat_set_update_handler(readstat_parser_t *parser, readstat_update_handler update_handler);
 readstat_error_t readstat_set_io_ctx(readstat_parser_t *parser, void *io_ctx);
 
+// Replace the default read(2)-based I/O with one that maps the input file into
+// memory. Reads become memcpy's out of the page cache instead of system calls,
+// which helps with large files. Inputs that can't be mapped (pipes, devices,
+// empty files, or where mmap(2) is unavailable or fails) are read with read(2)
+// instead. Note that if a mapped file is truncated while it is being read, the
+// process receives SIGBUS rather than a read error.
+readstat_error_t readstat_io_mmap_init(readstat_parser_t *parser);
+
 // Usually inferred from the file, but sometimes a manual override is desirable.
 // In particular, pre-14 Stata uses the system encoding, which is usually Win 1252
 // but could be anything. `encoding' should be an iconv-compatible name.
@@ -303,6 +379,27 @@ readstat_error_t readstat_set_handler_character_encoding(readstat_parser_t *pars
 
 readstat_error_t readstat_set_row_limit(readstat_parser_t *parser, long row_limit);
 
+// Start reading at this row (default 0). Row indexes passed to the value and
+// batch handlers, and the row count passed to the info handler, are relative
+// to the offset. Fixed-width formats seek straight to the row; compressed
+// files are skipped over without decoding values.
+readstat_error_t readstat_set_row_offset(readstat_parser_t *parser, long row_offset);
+
+// Decode SAS7BDAT data pages on this many threads (default 1). Rows are still
+// delivered in order, on the calling thread. Other formats, and builds without
+// pthreads, ignore this setting.
+readstat_error_t readstat_set_thread_count(readstat_parser_t *parser, int thread_count);
+
+// Deliver all value labels before the first variable, seeking ahead in the file
+// if necessary, so that a single pass sees the labels before any rows. SAV and
+// POR files already store their labels up front; DTA stores them after the data.
+readstat_error_t readstat_set_metadata_prefetch(readstat_parser_t *parser, int prefetch);
+
+// Keep at most this many bytes of Stata strL contents in memory (default 64 MiB).
+// Past the limit, only the position of each strL is recorded, and its contents
+// are read from the file when a row refers to it.
+readstat_error_t readstat_set_strl_memory_limit(readstat_parser_t *parser, long limit);
+
 readstat_error_t readstat_parse_dta(readstat_parser_t *parser, const char *path, void *user_ctx);
 readstat_error_t readstat_parse_sav(readstat_parser_t *parser, const char *path, void *user_ctx);
 readstat_error_t readstat_parse_por(readstat_parser_t *parser, const char *path, void *user_ctx);
@@ -334,6 +431,7 @@ typedef readstat_error_t (*readstat_write_tagged_callback)(void *row_data, const
 typedef readstat_error_t (*readstat_begin_data_callback)(void *writer);
 typedef readstat_error_t (*readstat_write_row_callback)(void *writer, void *row_data, size_t row_len);
 typedef readstat_error_t (*readstat_end_data_callback)(void *writer);
+typedef void (*readstat_module_ctx_free_callback)(void *module_ctx);
 
 typedef struct readstat_writer_callbacks_s {
     readstat_variable_width_callback    variable_width;
@@ -350,14 +448,21 @@ typedef struct readstat_writer_callbacks_s {
     readstat_begin_data_callback        begin_data;
     readstat_write_row_callback         write_row;
     readstat_end_data_callback          end_data;
+    readstat_module_ctx_free_callback   module_ctx_free;
 } readstat_writer_callbacks_t;
 
 /* You'll need to define one of these to get going. Should return # bytes written,
  * or -1 on error, a la write(2) */
 typedef ssize_t (*readstat_data_writer)(const void *data, size_t len, void *ctx);
 
+/* Optional. Should return the new offset, or -1 on error, a la lseek(2). With
+ * a seeker in place, SAS7BDAT row compression streams pages to the output and
+ * patches the header at the end instead of holding the whole file in memory. */
+typedef readstat_off_t (*readstat_data_seeker)(readstat_off_t offset, readstat_io_flags_t whence, void *ctx);
+
 typedef struct readstat_writer_s {
     readstat_data_writer        data_writer;
+    readstat_data_seeker        data_seeker;
     size_t                      bytes_written;
     long                        version;
     int                         is_64bit; // SAS only
@@ -380,6 +485,8 @@ typedef struct readstat_writer_s {
     long                       string_refs_count;
     long                       string_refs_capacity;
 
+    struct readstat_string_pool_s  *strings;
+
     unsigned char              *row;
     size_t                      row_len;
 
@@ -406,6 +513,9 @@ readstat_writer_t *readstat_writer_init();
 // Then specify a function that will handle the output bytes...
 readstat_error_t readstat_set_data_writer(readstat_writer_t *writer, readstat_data_writer data_writer);
 
+// ...and, optionally, a function that can seek within the output
+readstat_error_t readstat_set_data_seeker(readstat_writer_t *writer, readstat_data_seeker data_seeker);
+
 // Next define your value labels, if any. Create as many named sets as you'd like.
 readstat_label_set_t *readstat_add_label_set(readstat_writer_t *writer, readstat_type_t type, const char *name);
 void readstat_label_double_value(readstat_label_set_t *label_set, double value, const char *label);
@@ -424,8 +534,11 @@ void readstat_variable_set_label_set(readstat_variable_t *variable, readstat_lab
 void readstat_variable_set_measure(readstat_variable_t *variable, readstat_measure_t measure);
 void readstat_variable_set_alignment(readstat_variable_t *variable, readstat_alignment_t alignment);
 void readstat_variable_set_display_width(readstat_variable_t *variable, int display_width);
-void readstat_variable_add_missing_double_value(readstat_variable_t *variable, double value);
-void readstat_variable_add_missing_double_range(readstat_variable_t *variable, double lo, double hi);
+/* The variable must come from readstat_add_variable or a parser, whose string
+ * pool holds the ranges. Returns READSTAT_ERROR_MALLOC if there's no pool, and
+ * READSTAT_ERROR_TOO_MANY_MISSING_VALUE_DEFINITIONS after 16 ranges. */
+readstat_error_t readstat_variable_add_missing_double_value(readstat_variable_t *variable, double value);
+readstat_error_t readstat_variable_add_missing_double_range(readstat_variable_t *variable, double lo, double hi);
 readstat_variable_t *readstat_get_variable(readstat_writer_t *writer, int index);
 
 // "Notes" appear in the file metadata. In SPSS these are stored as
@@ -451,7 +564,7 @@ readstat_error_t readstat_writer_set_file_format_version(readstat_writer_t *writ
 readstat_error_t readstat_writer_set_file_format_is_64bit(readstat_writer_t *writer,
         int is_64bit); // applies only to SAS files; defaults to 1=true
 readstat_error_t readstat_writer_set_compression(readstat_writer_t *writer,
-        readstat_compress_t compression); // applies only to SAS and SAV files
+        readstat_compress_t compression); // applies only to SAS and SAV files; BINARY is SAS7BDAT-only
 
 // Optional error handler
 readstat_error_t readstat_writer_set_error_handler(readstat_writer_t *writer, 
@@ -0,0 +1,143 @@
+
+#include <stdlib.h>
+#include "readstat.h"
+#include "readstat_batch.h"
+
+readstat_batch_t *readstat_batch_init(readstat_batch_handler handler, long batch_size,
+        int columns_count, void *user_ctx) {
+    readstat_batch_t *batch = calloc(1, sizeof(readstat_batch_t));
+    if (batch == NULL)
+        return NULL;
+
+    batch->handler = handler;
+    batch->user_ctx = user_ctx;
+    batch->capacity = batch_size > 0 ? batch_size : READSTAT_BATCH_DEFAULT_SIZE;
+    batch->columns_count = columns_count;
+
+    if (columns_count > 0) {
+        batch->columns = calloc(columns_count, sizeof(readstat_column_t));
+        batch->string_data_len = calloc(columns_count, sizeof(size_t));
+        batch->string_data_capacity = calloc(columns_count, sizeof(size_t));
+        if (batch->columns == NULL || batch->string_data_len == NULL || batch->string_data_capacity == NULL)
+            goto error;
+    }
+
+    int i;
+    for (i=0; i<columns_count; i++) {
+        readstat_column_t *column = &batch->columns[i];
+        if ((column->missing = calloc((batch->capacity + 7) / 8, 1)) == NULL)
+            goto error;
+        if ((column->tags = calloc(batch->capacity, 1)) == NULL)
+            goto error;
+    }
+
+    return batch;
+
+error:
+    readstat_batch_free(batch);
+    return NULL;
+}
+
+void readstat_batch_free(readstat_batch_t *batch) {
+    if (batch == NULL)
+        return;
+
+    if (batch->columns) {
+        int i;
+        for (i=0; i<batch->columns_count; i++) {
+            readstat_column_t *column = &batch->columns[i];
+            free(column->double_values);
+            free(column->i32_values);
+            free(column->string_data);
+            free(column->string_offsets);
+            free(column->string_lengths);
+            free(column->missing);
+            free(column->tags);
+        }
+        free(batch->columns);
+    }
+    free(batch->string_data_len);
+    free(batch->string_data_capacity);
+    free(batch);
+}
+
+readstat_error_t readstat_batch_set_column(readstat_batch_t *batch, int index,
+        readstat_variable_t *variable, readstat_type_t type) {
+    readstat_column_t *column = &batch->columns[index];
+
+    column->variable = variable;
+    column->type = type == READSTAT_TYPE_STRING_REF ? READSTAT_TYPE_STRING : type;
+
+    switch (column->type) {
+        case READSTAT_TYPE_STRING:
+            if (column->string_offsets == NULL &&
+                    (column->string_offsets = malloc(batch->capacity * sizeof(size_t))) == NULL)
+                return READSTAT_ERROR_MALLOC;
+            if (column->string_lengths == NULL &&
+                    (column->string_lengths = malloc(batch->capacity * sizeof(size_t))) == NULL)
+                return READSTAT_ERROR_MALLOC;
+            break;
+        case READSTAT_TYPE_INT8:
+        case READSTAT_TYPE_INT16:
+        case READSTAT_TYPE_INT32:
+            if (column->i32_values == NULL &&
+                    (column->i32_values = malloc(batch->capacity * sizeof(int32_t))) == NULL)
+                return READSTAT_ERROR_MALLOC;
+            break;
+        default:
+            if (column->double_values == NULL &&
+                    (column->double_values = malloc(batch->capacity * sizeof(double))) == NULL)
+                return READSTAT_ERROR_MALLOC;
+            break;
+    }
+
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_batch_grow_string_data(readstat_batch_t *batch, int index, size_t len) {
+    readstat_column_t *column = &batch->columns[index];
+    size_t capacity = batch->string_data_capacity[index];
+
+    if (capacity == 0)
+        capacity = 1024;
+    while (capacity < len)
+        capacity *= 2;
+
+    char *string_data = realloc(column->string_data, capacity);
+    if (string_data == NULL)
+        return READSTAT_ERROR_MALLOC;
+
+    column->string_data = string_data;
+    batch->string_data_capacity[index] = capacity;
+
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_batch_end_row(readstat_batch_t *batch) {
+    if (++batch->rows_count == batch->capacity)
+        return readstat_batch_flush(batch);
+
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_batch_flush(readstat_batch_t *batch) {
+    readstat_error_t retval = READSTAT_OK;
+    if (batch->rows_count == 0)
+        return READSTAT_OK;
+
+    if (batch->handler(batch->obs_index, batch->rows_count,
+                batch->columns, batch->columns_count, batch->user_ctx)) {
+        retval = READSTAT_ERROR_USER_ABORT;
+    }
+
+    int i;
+    for (i=0; i<batch->columns_count; i++) {
+        memset(batch->columns[i].missing, 0, (batch->rows_count + 7) / 8);
+        memset(batch->columns[i].tags, 0, batch->rows_count);
+        batch->string_data_len[i] = 0;
+    }
+    batch->obs_index += batch->rows_count;
+    batch->rows_count = 0;
+
+    return retval;
+}
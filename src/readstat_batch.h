@@ -0,0 +1,106 @@
+//
+//  readstat_batch.h - Accumulate values into columns for the batch handler
+//
+
+#include <string.h>
+
+#define READSTAT_BATCH_DEFAULT_SIZE 1024
+
+typedef struct readstat_batch_s {
+    readstat_batch_handler  handler;
+    void                   *user_ctx;
+    long                    capacity;
+    long                    rows_count;
+    int                     obs_index;
+    int                     columns_count;
+    readstat_column_t      *columns;
+    size_t                 *string_data_len;
+    size_t                 *string_data_capacity;
+} readstat_batch_t;
+
+readstat_batch_t *readstat_batch_init(readstat_batch_handler handler, long batch_size,
+        int columns_count, void *user_ctx);
+void readstat_batch_free(readstat_batch_t *batch);
+
+// Sets the variable and value type of a column before the first row, and
+// allocates its value arrays. Values may only be pushed into columns that
+// have been set up; the others are delivered with variable == NULL.
+readstat_error_t readstat_batch_set_column(readstat_batch_t *batch, int index,
+        readstat_variable_t *variable, readstat_type_t type);
+
+readstat_error_t readstat_batch_grow_string_data(readstat_batch_t *batch, int index, size_t len);
+readstat_error_t readstat_batch_end_row(readstat_batch_t *batch);
+readstat_error_t readstat_batch_flush(readstat_batch_t *batch);
+
+// The push functions fill in the current row of a column, with the type it
+// was set up with. readstat_batch_push_missing marks the value just pushed
+// as system missing (tag 0) or tagged missing.
+static inline void readstat_batch_push_double(readstat_batch_t *batch, int index, double value) {
+    batch->columns[index].double_values[batch->rows_count] = value;
+}
+
+static inline void readstat_batch_push_int32(readstat_batch_t *batch, int index, int32_t value) {
+    batch->columns[index].i32_values[batch->rows_count] = value;
+}
+
+static inline readstat_error_t readstat_batch_push_string(readstat_batch_t *batch, int index,
+        const char *string, size_t len) {
+    readstat_column_t *column = &batch->columns[index];
+    size_t offset = batch->string_data_len[index];
+    readstat_error_t retval = READSTAT_OK;
+
+    if (offset + len > batch->string_data_capacity[index] &&
+            (retval = readstat_batch_grow_string_data(batch, index, offset + len)) != READSTAT_OK)
+        return retval;
+
+    if (len)
+        memcpy(&column->string_data[offset], string, len);
+
+    column->string_offsets[batch->rows_count] = offset;
+    column->string_lengths[batch->rows_count] = len;
+    batch->string_data_len[index] = offset + len;
+
+    return READSTAT_OK;
+}
+
+static inline void readstat_batch_push_missing(readstat_batch_t *batch, int index, char tag) {
+    readstat_column_t *column = &batch->columns[index];
+    long row = batch->rows_count;
+
+    column->missing[row / 8] |= (1 << (row % 8));
+    column->tags[row] = tag;
+}
+
+// For readers whose values come out of a type-generic decoder
+static inline readstat_error_t readstat_batch_push_value(readstat_batch_t *batch, int index,
+        readstat_value_t value) {
+    readstat_error_t retval = READSTAT_OK;
+
+    switch (value.type) {
+        case READSTAT_TYPE_STRING:
+        case READSTAT_TYPE_STRING_REF:
+            retval = readstat_batch_push_string(batch, index, value.v.string_value,
+                    value.v.string_value ? strlen(value.v.string_value) : 0);
+            break;
+        case READSTAT_TYPE_INT8:
+            readstat_batch_push_int32(batch, index, value.v.i8_value);
+            break;
+        case READSTAT_TYPE_INT16:
+            readstat_batch_push_int32(batch, index, value.v.i16_value);
+            break;
+        case READSTAT_TYPE_INT32:
+            readstat_batch_push_int32(batch, index, value.v.i32_value);
+            break;
+        case READSTAT_TYPE_FLOAT:
+            readstat_batch_push_double(batch, index, value.v.float_value);
+            break;
+        case READSTAT_TYPE_DOUBLE:
+            readstat_batch_push_double(batch, index, value.v.double_value);
+            break;
+    }
+
+    if (value.is_system_missing || value.is_tagged_missing)
+        readstat_batch_push_missing(batch, index, value.is_tagged_missing ? value.tag : 0);
+
+    return retval;
+}
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "readstat_calendar.h"
+
+static int is_leap(int year) {
+    return ((year % 4 == 0 && year % 100 != 0) || year % 400 == 0);
+}
+
+int readstat_days_in_month(int year, int month) {
+    static const int days_per_month[] = {31,28,31,30,31,30,31,31,30,31,30,31};
+    if (month == 2 && is_leap(year))
+        return 29;
+    return days_per_month[month-1];
+}
+
+/* Counts 400-year eras from March 1st of year 0, so that the leap day falls at
+ * the end of each computational year. See Howard Hinnant, "chrono-Compatible
+ * Low-Level Date Algorithms". */
+long readstat_days_from_civil(int year, int month, int day) {
+    long y = year - (month <= 2);
+    long era = (y >= 0 ? y : y - 399) / 400;
+    long year_of_era = y - era * 400;
+    long day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    long day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+void readstat_civil_from_days(long days, int *year, int *month, int *day) {
+    long z = days + 719468;
+    long era = (z >= 0 ? z : z - 146096) / 146097;
+    long day_of_era = z - era * 146097;
+    long year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    long day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    long mp = (5 * day_of_year + 2) / 153;
+
+    *day = day_of_year - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = year_of_era + era * 400 + (*month <= 2);
+}
+
+/* Reads an integer the way %d in scanf does: optional whitespace, then an
+ * optional sign, then digits */
+static const char *parse_int(const char *s, int *out) {
+    int negative = 0;
+    int value = 0;
+    int count = 0;
+
+    while (*s == ' ' || (*s >= '\t' && *s <= '\r'))
+        s++;
+    if (*s == '-' || *s == '+')
+        negative = (*s++ == '-');
+
+    while (*s >= '0' && *s <= '9') {
+        if (++count > 9)
+            return NULL;
+        value = 10 * value + (*s++ - '0');
+    }
+    if (count == 0)
+        return NULL;
+
+    *out = negative ? -value : value;
+    return s;
+}
+
+const char *readstat_parse_iso_date(const char *s, int *out_year, int *out_month, int *out_day) {
+    const char *p = s;
+    int year, month, day;
+
+    if ((p = parse_int(p, &year)) == NULL || *p++ != '-')
+        return s;
+    if ((p = parse_int(p, &month)) == NULL || *p++ != '-')
+        return s;
+    if ((p = parse_int(p, &day)) == NULL)
+        return s;
+
+    if (year < -READSTAT_CALENDAR_MAX_YEAR || year > READSTAT_CALENDAR_MAX_YEAR)
+        return s;
+    if (month < 1 || month > 12)
+        return s;
+    if (day < 1 || day > readstat_days_in_month(year, month))
+        return s;
+
+    *out_year = year;
+    *out_month = month;
+    *out_day = day;
+    return p;
+}
+
+int readstat_format_iso_date(char *dest, size_t size, int year, int month, int day) {
+    if (year < 0 || year > 9999 || size < sizeof("YYYY-MM-DD"))
+        return snprintf(dest, size, "%04d-%02d-%02d", year, month, day);
+
+    dest[0] = '0' + year / 1000;
+    dest[1] = '0' + year / 100 % 10;
+    dest[2] = '0' + year / 10 % 10;
+    dest[3] = '0' + year % 10;
+    dest[4] = '-';
+    dest[5] = '0' + month / 10;
+    dest[6] = '0' + month % 10;
+    dest[7] = '-';
+    dest[8] = '0' + day / 10;
+    dest[9] = '0' + day % 10;
+    dest[10] = '\0';
+    return 10;
+}
@@ -0,0 +1,21 @@
+//
+//  readstat_calendar.h - Closed-form conversions between proleptic Gregorian
+//  dates and day numbers, and ISO 8601 (YYYY-MM-DD) parsing and formatting
+//
+
+#define READSTAT_CALENDAR_MAX_YEAR  999999
+
+// Days since 1970-01-01 (negative before it)
+long readstat_days_from_civil(int year, int month, int day);
+void readstat_civil_from_days(long days, int *year, int *month, int *day);
+
+int readstat_days_in_month(int year, int month);
+
+// Parses a date written as year-month-day, e.g. 2016-1-31 or 2016-01-31,
+// accepting the same input as sscanf(s, "%d-%d-%d", ...): each number may be
+// preceded by whitespace and a sign. Returns a pointer past the date, or s if
+// it isn't a valid calendar date.
+const char *readstat_parse_iso_date(const char *s, int *year, int *month, int *day);
+
+// Writes the date as YYYY-MM-DD, like snprintf with "%04d-%02d-%02d"
+int readstat_format_iso_date(char *dest, size_t size, int year, int month, int day);
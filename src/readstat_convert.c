@@ -1,9 +1,12 @@
-
 #include <errno.h>
+#include <stdint.h>
 #include "readstat.h"
 #include "readstat_iconv.h"
 #include "readstat_convert.h"
 
+#define READSTAT_ASCII_HIGH_BITS    0x8080808080808080ULL
+#define READSTAT_EIGHT_SPACES       0x2020202020202020ULL
+
 static void unpad(char *string, size_t len) {
     string[len] = '\0';
     /* remove space padding */
@@ -17,6 +20,33 @@ static void unpad(char *string, size_t len) {
     }
 }
 
+/* Length of string without its trailing spaces, checked a word at a time */
+static size_t padded_len(const char *string, size_t len) {
+    uint64_t word;
+    while (len >= 8) {
+        memcpy(&word, &string[len-8], sizeof(uint64_t));
+        if (word != READSTAT_EIGHT_SPACES)
+            break;
+        len -= 8;
+    }
+    while (len > 0 && string[len-1] == ' ')
+        len--;
+    return len;
+}
+
+static int is_ascii(const char *string, size_t len) {
+    uint64_t word, high_bits = 0;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        memcpy(&word, &string[i], sizeof(uint64_t));
+        high_bits |= word;
+    }
+    for (; i < len; i++) {
+        high_bits |= (unsigned char)string[i];
+    }
+    return (high_bits & READSTAT_ASCII_HIGH_BITS) == 0;
+}
+
 readstat_error_t readstat_convert(char *dst, size_t dst_len, const char *src, size_t src_len, iconv_t converter) {
     if (converter) {
         size_t dst_left = dst_len;
@@ -39,3 +69,43 @@ readstat_error_t readstat_convert(char *dst, size_t dst_len, const char *src, si
     }
     return READSTAT_OK;
 }
+
+readstat_error_t readstat_convert_fast(char *dst, size_t dst_len, const char *src, size_t src_len,
+        iconv_t converter, int converter_preserves_ascii) {
+    if (!converter_preserves_ascii)
+        return readstat_convert(dst, dst_len, src, src_len, converter);
+
+    /* Padding is plain ASCII spaces, so it can be dropped before converting */
+    src_len = padded_len(src, src_len);
+
+    if (converter && !is_ascii(src, src_len))
+        return readstat_convert(dst, dst_len, src, src_len, converter);
+
+    if (src_len >= dst_len)
+        return READSTAT_ERROR_CONVERT_LONG_STRING;
+
+    memcpy(dst, src, src_len);
+    dst[src_len] = '\0';
+    return READSTAT_OK;
+}
+
+int readstat_converter_preserves_ascii(iconv_t converter) {
+    char src[128], dst[128];
+    char *src_ptr = src, *dst_ptr = dst;
+    size_t src_left = sizeof(src), dst_left = sizeof(dst);
+    int i;
+
+    if (!converter)
+        return 1;
+
+    for (i=0; i<sizeof(src); i++) {
+        src[i] = i;
+    }
+
+    iconv(converter, NULL, NULL, NULL, NULL);
+    size_t status = iconv(converter, (readstat_iconv_inbuf_t)&src_ptr, &src_left, &dst_ptr, &dst_left);
+    iconv(converter, NULL, NULL, NULL, NULL);
+
+    return (status != (size_t)-1 && src_left == 0 && dst_left == 0 &&
+            memcmp(src, dst, sizeof(src)) == 0);
+}
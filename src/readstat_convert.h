@@ -1,2 +1,11 @@
-
 readstat_error_t readstat_convert(char *dst, size_t dst_len, const char *src, size_t src_len, iconv_t converter);
+
+/* Like readstat_convert, but when the converter is known to leave ASCII
+ * unchanged, trailing padding is trimmed first and ASCII-only strings are
+ * copied without calling iconv. */
+readstat_error_t readstat_convert_fast(char *dst, size_t dst_len, const char *src, size_t src_len,
+        iconv_t converter, int converter_preserves_ascii);
+
+/* Returns 1 if every byte below 0x80 converts to itself (always true for a
+ * NULL converter). */
+int readstat_converter_preserves_ascii(iconv_t converter);
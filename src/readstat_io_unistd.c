@@ -1,7 +1,13 @@
 
 #include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
+
+#if !defined _WIN32
+#include <sys/mman.h>
+#endif
 
 #include "readstat.h"
 #include "readstat_io_unistd.h"
@@ -77,6 +83,16 @@ readstat_error_t unistd_update_handler(long file_size,
     return READSTAT_OK;
 }
 
+/* Installs a context owned by the parser, freeing the one it replaces unless
+ * that came from the caller */
+static void set_internal_io_ctx(readstat_parser_t *parser, void *io_ctx) {
+    if (!parser->io->external_io)
+        free(parser->io->io_ctx);
+
+    parser->io->io_ctx = io_ctx;
+    parser->io->external_io = 0;
+}
+
 void unistd_io_init(readstat_parser_t *parser) {
     readstat_set_open_handler(parser, unistd_open_handler);
     readstat_set_close_handler(parser, unistd_close_handler);
@@ -86,5 +102,139 @@ void unistd_io_init(readstat_parser_t *parser) {
 
     unistd_io_ctx_t *io_ctx = calloc(1, sizeof(unistd_io_ctx_t));
     io_ctx->fd = -1;
-    readstat_set_io_ctx(parser, (void*) io_ctx);
+    set_internal_io_ctx(parser, io_ctx);
+}
+
+#if !defined _WIN32
+
+/* Pipes, devices and anything else that can't be mapped (including empty
+ * files) are read with read(2) instead, through the unistd handlers */
+int mmap_open_handler(const char *path, void *io_ctx) {
+    mmap_io_ctx_t *ctx = (mmap_io_ctx_t *)io_ctx;
+    struct stat st;
+    int fd = open(path, UNISTD_OPEN_OPTIONS);
+    if (fd == -1)
+        return -1;
+
+    ctx->unistd_ctx.fd = fd;
+    ctx->data = NULL;
+    ctx->size = 0;
+    ctx->pos = 0;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+#if defined POSIX_MADV_SEQUENTIAL
+            posix_madvise(data, st.st_size, POSIX_MADV_SEQUENTIAL);
+            posix_madvise(data, st.st_size, POSIX_MADV_WILLNEED);
+#endif
+            ctx->data = data;
+            ctx->size = st.st_size;
+        }
+    }
+
+    return fd;
+}
+
+int mmap_close_handler(void *io_ctx) {
+    mmap_io_ctx_t *ctx = (mmap_io_ctx_t *)io_ctx;
+    int retval = 0;
+    if (ctx->data) {
+        munmap((void *)ctx->data, ctx->size);
+        ctx->data = NULL;
+    }
+    if (ctx->unistd_ctx.fd != -1) {
+        retval = close(ctx->unistd_ctx.fd);
+        ctx->unistd_ctx.fd = -1;
+    }
+    ctx->size = 0;
+    ctx->pos = 0;
+    return retval;
+}
+
+readstat_off_t mmap_seek_handler(readstat_off_t offset,
+        readstat_io_flags_t whence, void *io_ctx) {
+    mmap_io_ctx_t *ctx = (mmap_io_ctx_t *)io_ctx;
+    readstat_off_t newpos = -1;
+    if (ctx->data == NULL)
+        return unistd_seek_handler(offset, whence, &ctx->unistd_ctx);
+
+    switch(whence) {
+        case READSTAT_SEEK_SET:
+            newpos = offset;
+            break;
+        case READSTAT_SEEK_CUR:
+            newpos = ctx->pos + offset;
+            break;
+        case READSTAT_SEEK_END:
+            newpos = ctx->size + offset;
+            break;
+        default:
+            return -1;
+    }
+    if (newpos < 0 || newpos > ctx->size)
+        return -1;
+
+    ctx->pos = newpos;
+    return newpos;
+}
+
+ssize_t mmap_read_handler(void *buf, size_t nbyte, void *io_ctx) {
+    mmap_io_ctx_t *ctx = (mmap_io_ctx_t *)io_ctx;
+    if (ctx->data == NULL)
+        return unistd_read_handler(buf, nbyte, &ctx->unistd_ctx);
+
+    size_t bytes_left = ctx->size - ctx->pos;
+    if (nbyte > bytes_left)
+        nbyte = bytes_left;
+
+    if (nbyte) {
+        memcpy(buf, ctx->data + ctx->pos, nbyte);
+        ctx->pos += nbyte;
+    }
+    return nbyte;
 }
+
+readstat_error_t mmap_update_handler(long file_size, 
+        readstat_progress_handler progress_handler, void *user_ctx,
+        void *io_ctx) {
+    if (!progress_handler)
+        return READSTAT_OK;
+
+    mmap_io_ctx_t *ctx = (mmap_io_ctx_t *)io_ctx;
+    if (ctx->data == NULL)
+        return unistd_update_handler(file_size, progress_handler, user_ctx, &ctx->unistd_ctx);
+
+    if (progress_handler(1.0 * ctx->pos / file_size, user_ctx))
+        return READSTAT_ERROR_USER_ABORT;
+
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_io_mmap_init(readstat_parser_t *parser) {
+    mmap_io_ctx_t *io_ctx = calloc(1, sizeof(mmap_io_ctx_t));
+    if (io_ctx == NULL)
+        return READSTAT_ERROR_MALLOC;
+
+    io_ctx->unistd_ctx.fd = -1;
+
+    readstat_set_open_handler(parser, mmap_open_handler);
+    readstat_set_close_handler(parser, mmap_close_handler);
+    readstat_set_seek_handler(parser, mmap_seek_handler);
+    readstat_set_read_handler(parser, mmap_read_handler);
+    readstat_set_update_handler(parser, mmap_update_handler);
+
+    set_internal_io_ctx(parser, io_ctx);
+
+    return READSTAT_OK;
+}
+
+#else
+
+/* No mmap(2) on Windows; fall back to plain file descriptor I/O */
+readstat_error_t readstat_io_mmap_init(readstat_parser_t *parser) {
+    unistd_io_init(parser);
+    return READSTAT_OK;
+}
+
+#endif
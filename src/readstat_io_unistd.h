@@ -9,3 +9,16 @@ readstat_off_t unistd_seek_handler(readstat_off_t offset, readstat_io_flags_t wh
 ssize_t unistd_read_handler(void *buf, size_t nbytes, void *io_ctx);
 readstat_error_t unistd_update_handler(long file_size, readstat_progress_handler progress_handler, void *user_ctx, void *io_ctx);
 void unistd_io_init(readstat_parser_t *parser);
+
+typedef struct mmap_io_ctx_s {
+    unistd_io_ctx_t   unistd_ctx;
+    const char       *data;
+    size_t            size;
+    readstat_off_t    pos;
+} mmap_io_ctx_t;
+
+int mmap_open_handler(const char *path, void *io_ctx);
+int mmap_close_handler(void *io_ctx);
+readstat_off_t mmap_seek_handler(readstat_off_t offset, readstat_io_flags_t whence, void *io_ctx);
+ssize_t mmap_read_handler(void *buf, size_t nbytes, void *io_ctx);
+readstat_error_t mmap_update_handler(long file_size, readstat_progress_handler progress_handler, void *user_ctx, void *io_ctx);
@@ -1,24 +1,42 @@
 
 #include <stdlib.h>
+#include <string.h>
 #include "readstat.h"
+#include "readstat_iconv.h"
 #include "readstat_io_unistd.h"
+#include "readstat_pool.h"
 
 readstat_parser_t *readstat_parser_init() {
     readstat_parser_t *parser = calloc(1, sizeof(readstat_parser_t));
     parser->io = calloc(1, sizeof(readstat_io_t));
     unistd_io_init(parser);
     parser->output_encoding = "UTF-8";
+    parser->pool = readstat_pool_init();
     return parser;
 }
 
 void readstat_parser_free(readstat_parser_t *parser) {
     if (parser) {
-        if (parser->io)
+        if (parser->io) {
+            if (!parser->io->external_io)
+                free(parser->io->io_ctx);
             free(parser->io);
+        }
+        readstat_pool_free(parser->pool);
         free(parser);
     }
 }
 
+void readstat_parser_reset(readstat_parser_t *parser) {
+    readstat_io_t *io = parser->io;
+    struct readstat_pool_s *pool = parser->pool;
+
+    memset(parser, 0, sizeof(readstat_parser_t));
+    parser->io = io;
+    parser->pool = pool;
+    parser->output_encoding = "UTF-8";
+}
+
 readstat_error_t readstat_set_info_handler(readstat_parser_t *parser, readstat_info_handler info_handler) {
     parser->info_handler = info_handler;
     return READSTAT_OK;
@@ -59,6 +77,21 @@ readstat_error_t readstat_set_progress_handler(readstat_parser_t *parser, readst
     return READSTAT_OK;
 }
 
+readstat_error_t readstat_set_column_filter(readstat_parser_t *parser, readstat_column_filter column_filter) {
+    parser->column_filter = column_filter;
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_set_batch_handler(readstat_parser_t *parser, readstat_batch_handler batch_handler) {
+    parser->batch_handler = batch_handler;
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_set_batch_size(readstat_parser_t *parser, long batch_size) {
+    parser->batch_size = batch_size;
+    return READSTAT_OK;
+}
+
 readstat_error_t readstat_set_fweight_handler(readstat_parser_t *parser, readstat_fweight_handler fweight_handler) {
     parser->fweight_handler = fweight_handler;
     return READSTAT_OK;
@@ -113,3 +146,23 @@ readstat_error_t readstat_set_row_limit(readstat_parser_t *parser, long row_limi
     parser->row_limit = row_limit;
     return READSTAT_OK;
 }
+
+readstat_error_t readstat_set_row_offset(readstat_parser_t *parser, long row_offset) {
+    parser->row_offset = row_offset;
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_set_thread_count(readstat_parser_t *parser, int thread_count) {
+    parser->thread_count = thread_count;
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_set_metadata_prefetch(readstat_parser_t *parser, int prefetch) {
+    parser->metadata_prefetch = prefetch;
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_set_strl_memory_limit(readstat_parser_t *parser, long limit) {
+    parser->strl_memory_limit = limit;
+    return READSTAT_OK;
+}
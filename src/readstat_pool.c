@@ -0,0 +1,105 @@
+#include <stdlib.h>
+#include <string.h>
+#include "readstat.h"
+#include "readstat_iconv.h"
+#include "readstat_pool.h"
+#include "readstat_strings.h"
+
+readstat_pool_t *readstat_pool_init(void) {
+    readstat_pool_t *pool = calloc(1, sizeof(readstat_pool_t));
+    if (pool == NULL)
+        return NULL;
+
+    if ((pool->strings = readstat_string_pool_init()) == NULL) {
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+static void readstat_pool_converter_free(readstat_pool_converter_t *entry) {
+    iconv_close(entry->converter);
+    free(entry->to_encoding);
+    free(entry->from_encoding);
+    memset(entry, 0, sizeof(readstat_pool_converter_t));
+}
+
+void readstat_pool_free(readstat_pool_t *pool) {
+    int i;
+    if (pool == NULL)
+        return;
+
+    for (i=0; i<READSTAT_POOL_SLOT_COUNT; i++) {
+        free(pool->buffers[i]);
+    }
+    for (i=0; i<pool->converters_count; i++) {
+        readstat_pool_converter_free(&pool->converters[i]);
+    }
+    readstat_string_pool_free(pool->strings);
+    free(pool);
+}
+
+void *readstat_pool_get(readstat_pool_t *pool, readstat_pool_slot_t slot, size_t len) {
+    if (len == 0)
+        len = 1;
+
+    if (len > pool->lengths[slot]) {
+        void *buffer = realloc(pool->buffers[slot], len);
+        if (buffer == NULL)
+            return NULL;
+
+        pool->buffers[slot] = buffer;
+        pool->lengths[slot] = len;
+        pool->allocations++;
+    }
+    return pool->buffers[slot];
+}
+
+static char *readstat_pool_strdup(const char *string) {
+    size_t len = strlen(string) + 1;
+    char *copy = malloc(len);
+    if (copy)
+        memcpy(copy, string, len);
+    return copy;
+}
+
+iconv_t readstat_pool_converter(readstat_pool_t *pool, const char *to_encoding,
+        const char *from_encoding) {
+    readstat_pool_converter_t *entry = NULL;
+    int i;
+    for (i=0; i<pool->converters_count; i++) {
+        entry = &pool->converters[i];
+        if (strcmp(entry->to_encoding, to_encoding) == 0 &&
+                strcmp(entry->from_encoding, from_encoding) == 0) {
+            iconv(entry->converter, NULL, NULL, NULL, NULL);
+            return entry->converter;
+        }
+    }
+
+    char *to_copy = readstat_pool_strdup(to_encoding);
+    char *from_copy = readstat_pool_strdup(from_encoding);
+    iconv_t converter = (iconv_t)-1;
+    if (to_copy && from_copy)
+        converter = iconv_open(to_encoding, from_encoding);
+    if (converter == (iconv_t)-1) {
+        free(to_copy);
+        free(from_copy);
+        return converter;
+    }
+
+    /* A full cache recycles its slots in turn; a single parse holds at most
+     * a couple of converters, so the one evicted is never still in use */
+    if (pool->converters_count < READSTAT_POOL_MAX_CONVERTERS) {
+        entry = &pool->converters[pool->converters_count++];
+    } else {
+        entry = &pool->converters[pool->next_eviction];
+        pool->next_eviction = (pool->next_eviction + 1) % READSTAT_POOL_MAX_CONVERTERS;
+        readstat_pool_converter_free(entry);
+    }
+
+    entry->to_encoding = to_copy;
+    entry->from_encoding = from_copy;
+    entry->converter = converter;
+
+    return converter;
+}
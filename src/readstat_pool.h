@@ -0,0 +1,50 @@
+//
+//  readstat_pool.h - Scratch buffers and character set converters owned by the
+//  parser and reused by every format reader, so that decoding rows doesn't
+//  touch the heap and a parser reused across files doesn't reopen converters
+//
+
+#define READSTAT_POOL_MAX_CONVERTERS    8
+
+typedef enum readstat_pool_slot_e {
+    READSTAT_POOL_ROW,          // one record, or one decompressed row
+    READSTAT_POOL_ROW_AUX,      // a second row-sized buffer
+    READSTAT_POOL_PAGE,         // one page or block of the file
+    READSTAT_POOL_STRING,       // a string value as stored in the file
+    READSTAT_POOL_STRING_UTF8,  // a string value after conversion
+    READSTAT_POOL_SLOT_COUNT
+} readstat_pool_slot_t;
+
+typedef struct readstat_pool_converter_s {
+    char       *to_encoding;
+    char       *from_encoding;
+    iconv_t     converter;
+} readstat_pool_converter_t;
+
+typedef struct readstat_pool_s {
+    void       *buffers[READSTAT_POOL_SLOT_COUNT];
+    size_t      lengths[READSTAT_POOL_SLOT_COUNT];
+    long        allocations;
+
+    readstat_pool_converter_t   converters[READSTAT_POOL_MAX_CONVERTERS];
+    int                         converters_count;
+    int                         next_eviction;
+
+    // Variable names, labels, formats and missing ranges; readers clear it
+    // when they start on a file
+    struct readstat_string_pool_s  *strings;
+} readstat_pool_t;
+
+readstat_pool_t *readstat_pool_init(void);
+void readstat_pool_free(readstat_pool_t *pool);
+
+// Returns the slot's buffer, growing it to at least len bytes if needed. The
+// buffer belongs to the pool and stays valid until the slot is grown again.
+void *readstat_pool_get(readstat_pool_t *pool, readstat_pool_slot_t slot, size_t len);
+
+// Returns a converter for the encoding pair in its initial shift state,
+// calling iconv_open only the first time the pair is seen. The pool owns the
+// converter, so callers must not close it. Returns (iconv_t)-1 if iconv
+// doesn't support the pair.
+iconv_t readstat_pool_converter(readstat_pool_t *pool, const char *to_encoding,
+        const char *from_encoding);
@@ -0,0 +1,146 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "readstat_strings.h"
+
+#define READSTAT_STRING_POOL_CHUNK_LEN          65536
+#define READSTAT_STRING_POOL_ALIGNMENT          8
+#define READSTAT_STRING_POOL_INITIAL_ENTRIES    256
+
+readstat_string_pool_t *readstat_string_pool_init(void) {
+    return calloc(1, sizeof(readstat_string_pool_t));
+}
+
+void readstat_string_pool_free(readstat_string_pool_t *pool) {
+    long i;
+    if (pool == NULL)
+        return;
+
+    for (i=0; i<pool->chunks_count; i++) {
+        free(pool->chunks[i]);
+    }
+    free(pool->chunks);
+    free(pool->chunk_lengths);
+    free(pool->entries);
+    free(pool);
+}
+
+void readstat_string_pool_clear(readstat_string_pool_t *pool) {
+    pool->chunk_index = 0;
+    pool->chunk_used = 0;
+    if (pool->entries)
+        memset(pool->entries, 0, pool->entries_capacity * sizeof(readstat_string_pool_entry_t));
+    pool->entries_count = 0;
+}
+
+static void *readstat_string_pool_take(readstat_string_pool_t *pool, size_t len, size_t alignment) {
+    while (pool->chunk_index < pool->chunks_count) {
+        size_t offset = (pool->chunk_used + alignment - 1) / alignment * alignment;
+        if (offset + len <= pool->chunk_lengths[pool->chunk_index]) {
+            pool->chunk_used = offset + len;
+            return pool->chunks[pool->chunk_index] + offset;
+        }
+        pool->chunk_index++;
+        pool->chunk_used = 0;
+    }
+
+    if (pool->chunks_count == pool->chunks_capacity) {
+        long capacity = pool->chunks_capacity ? 2 * pool->chunks_capacity : 8;
+        char **chunks = realloc(pool->chunks, capacity * sizeof(char *));
+        if (chunks == NULL)
+            return NULL;
+        pool->chunks = chunks;
+
+        size_t *chunk_lengths = realloc(pool->chunk_lengths, capacity * sizeof(size_t));
+        if (chunk_lengths == NULL)
+            return NULL;
+        pool->chunk_lengths = chunk_lengths;
+
+        pool->chunks_capacity = capacity;
+    }
+
+    size_t chunk_len = len > READSTAT_STRING_POOL_CHUNK_LEN ? len : READSTAT_STRING_POOL_CHUNK_LEN;
+    char *chunk = malloc(chunk_len);
+    if (chunk == NULL)
+        return NULL;
+
+    pool->chunk_index = pool->chunks_count;
+    pool->chunks[pool->chunks_count] = chunk;
+    pool->chunk_lengths[pool->chunks_count] = chunk_len;
+    pool->chunks_count++;
+    pool->chunk_used = len;
+    return chunk;
+}
+
+void *readstat_string_pool_alloc(readstat_string_pool_t *pool, size_t len) {
+    return readstat_string_pool_take(pool, len ? len : 1, READSTAT_STRING_POOL_ALIGNMENT);
+}
+
+static uint32_t readstat_string_pool_hash(const char *string, size_t len) {
+    uint32_t hash = 2166136261U;
+    size_t i;
+    for (i=0; i<len; i++) {
+        hash ^= (unsigned char)string[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+static int readstat_string_pool_grow(readstat_string_pool_t *pool) {
+    size_t capacity = pool->entries_capacity ? 2 * pool->entries_capacity : READSTAT_STRING_POOL_INITIAL_ENTRIES;
+    readstat_string_pool_entry_t *entries = calloc(capacity, sizeof(readstat_string_pool_entry_t));
+    size_t i;
+    if (entries == NULL)
+        return -1;
+
+    for (i=0; i<pool->entries_capacity; i++) {
+        readstat_string_pool_entry_t *entry = &pool->entries[i];
+        if (entry->string == NULL)
+            continue;
+
+        size_t slot = entry->hash & (capacity - 1);
+        while (entries[slot].string)
+            slot = (slot + 1) & (capacity - 1);
+        entries[slot] = *entry;
+    }
+    free(pool->entries);
+    pool->entries = entries;
+    pool->entries_capacity = capacity;
+    return 0;
+}
+
+const char *readstat_string_pool_intern(readstat_string_pool_t *pool, const char *string, size_t len) {
+    size_t i = 0;
+    while (i < len && string[i])
+        i++;
+    len = i;
+    if (len == 0)
+        return "";
+
+    if (2 * (pool->entries_count + 1) > pool->entries_capacity) {
+        if (readstat_string_pool_grow(pool) == -1)
+            return NULL;
+    }
+
+    uint32_t hash = readstat_string_pool_hash(string, len);
+    size_t slot = hash & (pool->entries_capacity - 1);
+    while (pool->entries[slot].string) {
+        readstat_string_pool_entry_t *entry = &pool->entries[slot];
+        if (entry->hash == hash && entry->len == len && memcmp(entry->string, string, len) == 0)
+            return entry->string;
+        slot = (slot + 1) & (pool->entries_capacity - 1);
+    }
+
+    char *copy = readstat_string_pool_take(pool, len + 1, 1);
+    if (copy == NULL)
+        return NULL;
+
+    memcpy(copy, string, len);
+    copy[len] = '\0';
+
+    pool->entries[slot].string = copy;
+    pool->entries[slot].len = len;
+    pool->entries[slot].hash = hash;
+    pool->entries_count++;
+    return copy;
+}
@@ -0,0 +1,46 @@
+//
+//  readstat_strings.h - An arena of interned strings for variable names,
+//  labels and formats, so that very wide files don't carry fixed-size
+//  buffers (or duplicate copies of the same label) for every column
+//
+
+// The longest name, format and label kept for a variable, counting the NUL
+#define READSTAT_VARIABLE_NAME_LEN      256
+#define READSTAT_VARIABLE_FORMAT_LEN    256
+#define READSTAT_VARIABLE_LABEL_LEN    1024
+
+typedef struct readstat_string_pool_entry_s {
+    const char *string;
+    size_t      len;
+    uint32_t    hash;
+} readstat_string_pool_entry_t;
+
+typedef struct readstat_string_pool_s {
+    char      **chunks;
+    size_t     *chunk_lengths;
+    long        chunks_count;
+    long        chunks_capacity;
+    long        chunk_index;
+    size_t      chunk_used;
+
+    readstat_string_pool_entry_t   *entries;
+    size_t                          entries_count;
+    size_t                          entries_capacity;
+} readstat_string_pool_t;
+
+readstat_string_pool_t *readstat_string_pool_init(void);
+void readstat_string_pool_free(readstat_string_pool_t *pool);
+
+// Forgets every string while keeping the memory for the next file. Pointers
+// handed out before the call must not be used afterwards.
+void readstat_string_pool_clear(readstat_string_pool_t *pool);
+
+// Returns a NUL-terminated copy of the first len bytes of string (stopping
+// early at a NUL), shared with every other caller that interned the same
+// bytes. The copy lives until the pool is cleared or freed. Returns NULL if
+// memory runs out.
+const char *readstat_string_pool_intern(readstat_string_pool_t *pool, const char *string, size_t len);
+
+// Returns len bytes of uninitialized, suitably aligned memory that lives as
+// long as the interned strings. Returns NULL if memory runs out.
+void *readstat_string_pool_alloc(readstat_string_pool_t *pool, size_t len);
@@ -1,6 +1,10 @@
 
 #include <stdlib.h>
+#include <string.h>
 #include "readstat.h"
+#include "readstat_strings.h"
+
+#define READSTAT_MAX_MISSING_RANGES 16
 
 static readstat_value_t make_blank_value();
 static readstat_value_t make_double_value(double dval);
@@ -16,21 +20,21 @@ static readstat_value_t make_double_value(double dval) {
 }
 
 const char *readstat_variable_get_name(const readstat_variable_t *variable) {
-    if (variable->name[0])
+    if (variable->name && variable->name[0])
         return variable->name;
 
     return NULL;
 }
 
 const char *readstat_variable_get_label(const readstat_variable_t *variable) {
-    if (variable->label[0])
+    if (variable->label && variable->label[0])
         return variable->label;
 
     return NULL;
 }
 
 const char *readstat_variable_get_format(const readstat_variable_t *variable) {
-    if (variable->format[0])
+    if (variable->format && variable->format[0])
         return variable->format;
 
     return NULL;
@@ -69,8 +73,7 @@ int readstat_variable_get_missing_ranges_count(const readstat_variable_t *variab
 }
 
 readstat_value_t readstat_variable_get_missing_range_lo(const readstat_variable_t *variable, int i) {
-    if (i < variable->missingness.missing_ranges_count &&
-            2*i+1 < sizeof(variable->missingness.missing_ranges)/sizeof(variable->missingness.missing_ranges[0])) {
+    if (i >= 0 && i < variable->missingness.missing_ranges_count) {
         return variable->missingness.missing_ranges[2*i];
     }
 
@@ -78,24 +81,44 @@ readstat_value_t readstat_variable_get_missing_range_lo(const readstat_variable_
 }
 
 readstat_value_t readstat_variable_get_missing_range_hi(const readstat_variable_t *variable, int i) {
-    if (i < variable->missingness.missing_ranges_count &&
-            2*i+1 < sizeof(variable->missingness.missing_ranges)/sizeof(variable->missingness.missing_ranges[0])) {
+    if (i >= 0 && i < variable->missingness.missing_ranges_count) {
         return variable->missingness.missing_ranges[2*i+1];
     }
 
     return make_blank_value();
 }
 
-void readstat_variable_add_missing_double_value(readstat_variable_t *variable, double value) {
-    readstat_variable_add_missing_double_range(variable, value, value);
-}
-
-void readstat_variable_add_missing_double_range(readstat_variable_t *variable, double lo, double hi) {
-    int i = readstat_variable_get_missing_ranges_count(variable);
-    if (2*i < sizeof(variable->missingness.missing_ranges)/sizeof(variable->missingness.missing_ranges[0])) {
-        variable->missingness.missing_ranges[2*i] = make_double_value(lo);
-        variable->missingness.missing_ranges[2*i+1] = make_double_value(hi);
-        variable->missingness.missing_ranges_count++;
+readstat_error_t readstat_variable_add_missing_double_value(readstat_variable_t *variable, double value) {
+    return readstat_variable_add_missing_double_range(variable, value, value);
+}
+
+readstat_error_t readstat_variable_add_missing_double_range(readstat_variable_t *variable, double lo, double hi) {
+    readstat_missingness_t *missingness = &variable->missingness;
+    long i = missingness->missing_ranges_count;
+    if (i == READSTAT_MAX_MISSING_RANGES)
+        return READSTAT_ERROR_TOO_MANY_MISSING_VALUE_DEFINITIONS;
+
+    if (i == missingness->missing_ranges_capacity) {
+        long capacity = i ? 2 * i : 2;
+        if (capacity > READSTAT_MAX_MISSING_RANGES)
+            capacity = READSTAT_MAX_MISSING_RANGES;
+        /* The ranges live in the pool that owns the variable's strings;
+         * there is nowhere to put them without one */
+        if (variable->strings == NULL)
+            return READSTAT_ERROR_MALLOC;
+
+        readstat_value_t *ranges = readstat_string_pool_alloc(variable->strings,
+                2 * capacity * sizeof(readstat_value_t));
+        if (ranges == NULL)
+            return READSTAT_ERROR_MALLOC;
+        if (i)
+            memcpy(ranges, missingness->missing_ranges, 2 * i * sizeof(readstat_value_t));
+        missingness->missing_ranges = ranges;
+        missingness->missing_ranges_capacity = capacity;
     }
-}
 
+    missingness->missing_ranges[2*i] = make_double_value(lo);
+    missingness->missing_ranges[2*i+1] = make_double_value(hi);
+    missingness->missing_ranges_count++;
+    return READSTAT_OK;
+}
@@ -1,8 +1,12 @@
 
+/* For localtime_r */
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdlib.h>
 #include <time.h>
 #include "readstat.h"
 #include "readstat_writer.h"
+#include "readstat_strings.h"
 
 #define VARIABLES_INITIAL_CAPACITY    50
 #define LABEL_SETS_INITIAL_CAPACITY   50
@@ -15,6 +19,16 @@ static readstat_error_t readstat_write_row_default_callback(void *writer_ctx, vo
     return readstat_write_bytes((readstat_writer_t *)writer_ctx, bytes, len);
 }
 
+/* localtime() shares its result between threads, which may be writing other
+ * files at the same time */
+readstat_error_t readstat_writer_local_time(readstat_writer_t *writer, struct tm *local_time) {
+    time_t timestamp = writer->timestamp;
+    if (localtime_r(&timestamp, local_time) == NULL)
+        return READSTAT_ERROR_BAD_TIMESTAMP;
+
+    return READSTAT_OK;
+}
+
 static int readstat_compare_string_refs(const void *elem1, const void *elem2) {
     readstat_string_ref_t *ref1 = *(readstat_string_ref_t **)elem1;
     readstat_string_ref_t *ref2 = *(readstat_string_ref_t **)elem2;
@@ -50,6 +64,8 @@ readstat_writer_t *readstat_writer_init() {
     writer->string_refs = calloc(STRING_REFS_INITIAL_CAPACITY, sizeof(readstat_string_ref_t *));
     writer->string_refs_capacity = STRING_REFS_INITIAL_CAPACITY;
 
+    writer->strings = readstat_string_pool_init();
+
     writer->timestamp = time(NULL);
     writer->is_64bit = 1;
     writer->callbacks.write_row = &readstat_write_row_default_callback;
@@ -145,6 +161,11 @@ void readstat_writer_free(readstat_writer_t *writer) {
         if (writer->row) {
             free(writer->row);
         }
+        /* Writing stopped between begin_data and end_data */
+        if (writer->module_ctx && writer->callbacks.module_ctx_free) {
+            writer->callbacks.module_ctx_free(writer->module_ctx);
+        }
+        readstat_string_pool_free(writer->strings);
         free(writer);
     }
 }
@@ -154,6 +175,11 @@ readstat_error_t readstat_set_data_writer(readstat_writer_t *writer, readstat_da
     return READSTAT_OK;
 }
 
+readstat_error_t readstat_set_data_seeker(readstat_writer_t *writer, readstat_data_seeker data_seeker) {
+    writer->data_seeker = data_seeker;
+    return READSTAT_OK;
+}
+
 readstat_error_t readstat_write_bytes(readstat_writer_t *writer, const void *bytes, size_t len) {
     size_t bytes_written = writer->data_writer(bytes, len, writer->user_ctx);
     if (bytes_written < len) {
@@ -163,6 +189,31 @@ readstat_error_t readstat_write_bytes(readstat_writer_t *writer, const void *byt
     return READSTAT_OK;
 }
 
+/* Overwrite bytes that were already written, then return to the end of the
+ * output. Seeks are relative so that the output needn't begin at offset 0. */
+readstat_error_t readstat_write_bytes_at(readstat_writer_t *writer, size_t offset,
+        const void *bytes, size_t len) {
+    if (writer->data_seeker == NULL)
+        return READSTAT_ERROR_SEEK;
+
+    if (offset + len > writer->bytes_written)
+        return READSTAT_ERROR_SEEK;
+
+    readstat_off_t rewind = -(readstat_off_t)(writer->bytes_written - offset);
+    if (writer->data_seeker(rewind, READSTAT_SEEK_CUR, writer->user_ctx) == -1)
+        return READSTAT_ERROR_SEEK;
+
+    ssize_t bytes_written = writer->data_writer(bytes, len, writer->user_ctx);
+    if (bytes_written < 0 || (size_t)bytes_written < len)
+        return READSTAT_ERROR_WRITE;
+
+    readstat_off_t forward = writer->bytes_written - (offset + len);
+    if (writer->data_seeker(forward, READSTAT_SEEK_CUR, writer->user_ctx) == -1)
+        return READSTAT_ERROR_SEEK;
+
+    return READSTAT_OK;
+}
+
 readstat_error_t readstat_write_bytes_as_lines(readstat_writer_t *writer,
         const void *bytes, size_t len, size_t line_len, const char *line_sep) {
     size_t line_sep_len = strlen(line_sep);
@@ -304,6 +355,14 @@ void readstat_label_tagged_value(readstat_label_set_t *label_set, char tag, cons
     new_value_label->tag = tag;
 }
 
+static const char *readstat_variable_intern(readstat_variable_t *variable, const char *string, size_t len) {
+    const char *interned = NULL;
+    if (string && variable->strings)
+        interned = readstat_string_pool_intern(variable->strings, string, len - 1);
+
+    return interned ? interned : "";
+}
+
 readstat_variable_t *readstat_add_variable(readstat_writer_t *writer, const char *name, readstat_type_t type, size_t width) {
     if (writer->variables_count == writer->variables_capacity) {
         writer->variables_capacity *= 2;
@@ -326,9 +385,10 @@ readstat_variable_t *readstat_add_variable(readstat_writer_t *writer, const char
     }
     new_variable->measure = READSTAT_MEASURE_UNKNOWN;
 
-    if (name) {
-        snprintf(new_variable->name, sizeof(new_variable->name), "%s", name);
-    }
+    new_variable->strings = writer->strings;
+    new_variable->name = readstat_variable_intern(new_variable, name, READSTAT_VARIABLE_NAME_LEN);
+    new_variable->format = "";
+    new_variable->label = "";
 
     return new_variable;
 }
@@ -360,19 +420,11 @@ void readstat_add_note(readstat_writer_t *writer, const char *note) {
 }
 
 void readstat_variable_set_label(readstat_variable_t *variable, const char *label) {
-    if (label) {
-        snprintf(variable->label, sizeof(variable->label), "%s", label);
-    } else {
-        memset(variable->label, '\0', sizeof(variable->label));
-    }
+    variable->label = readstat_variable_intern(variable, label, READSTAT_VARIABLE_LABEL_LEN);
 }
 
 void readstat_variable_set_format(readstat_variable_t *variable, const char *format) {
-    if (format) {
-        snprintf(variable->format, sizeof(variable->format), "%s", format);
-    } else {
-        memset(variable->format, '\0', sizeof(variable->format));
-    }
+    variable->format = readstat_variable_intern(variable, format, READSTAT_VARIABLE_FORMAT_LEN);
 }
 
 void readstat_variable_set_measure(readstat_variable_t *variable, readstat_measure_t measure) {
@@ -114,27 +114,39 @@ int get_native() {
     return(-1);
 }
 
-void xpt2ieee(unsigned char *xport, unsigned char *ieee) {
-    char temp[8];
-    register int shift;
-    register int nib;
-    uint32_t ieee1,ieee2;
-    uint32_t xport1 = 0;
-    uint32_t xport2 = 0;
-
-    memcpy(temp,xport,8);
-    memset(ieee,0,8);
+static uint64_t read_be64(const unsigned char *bytes) {
+    uint64_t value = 0;
+    int i;
+    for (i=0; i<8; i++) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
 
-    if (*temp && memcmp(temp+1,ieee,7) == 0) {
-        ieee[0] = ieee[1] = 0xff;
-        ieee[2] = ~(*temp);
-        return;
+static void write_be64(unsigned char *bytes, uint64_t value) {
+    int i;
+    for (i=7; i>=0; i--) {
+        bytes[i] = value & 0xFF;
+        value >>= 8;
     }
+}
 
-    memcpy(&xport1,temp,sizeof(uint32_t));
-    memreverse(&xport1,sizeof(uint32_t));
-    memcpy(&xport2,temp+4,sizeof(uint32_t));
-    memreverse(&xport2,sizeof(uint32_t));
+/* How far the high-order nibble of an IBM fraction must be shifted down to
+ * leave the implicit "1" bit, indexed by the nibble's top three bits */
+static const int xpt_fraction_shift[8] = { 0, 1, 2, 2, 3, 3, 3, 3 };
+
+/* Both conversions work on the 64-bit patterns read as big-endian integers,
+ * so they need no knowledge of the machine's byte order. */
+static uint64_t xpt2ieee_bits(uint64_t xport) {
+    int shift;
+    uint32_t ieee1,ieee2;
+    uint32_t xport1 = xport >> 32;
+    uint32_t xport2 = xport & 0xFFFFFFFF;
+    unsigned char first_byte = xport >> 56;
+
+    if (first_byte && (xport & 0x00FFFFFFFFFFFFFFULL) == 0) {
+        return 0xFFFF000000000000ULL | ((uint64_t)(unsigned char)~first_byte << 40);
+    }
 
     /***************************************************************/
     /* Translate IBM format floating point numbers into IEEE */
@@ -183,8 +195,7 @@ void xpt2ieee(unsigned char *xport, unsigned char *ieee) {
 
     if ((xport1 & 0x7fffffff) == 0x7fffffff && xport2 == 0xffffffff) {
         ieee1 = (xport1 & 0x80000000) | 0x7ff00000;
-        ieee2 = 0;
-        goto doret;
+        return (uint64_t)ieee1 << 32;
     }
 
     /* Get the first half of the ibm number without the exponent */
@@ -195,7 +206,7 @@ void xpt2ieee(unsigned char *xport, unsigned char *ieee) {
     /* of the ieee number . If both halves were 0. then just */
     /* return since the ieee number is zero. */
     if ((!(ieee2 = xport2)) && !xport1)
-        return;
+        return 0;
 
     /* The fraction bit to the left of the binary point in the */
     /* ieee format was set and the number was shifted 0, 1, 2, or */
@@ -203,15 +214,7 @@ void xpt2ieee(unsigned char *xport, unsigned char *ieee) {
     /* to be a power of 2 ieee exponent and how to shift the */
     /* fraction bits to restore the correct magnitude. */
 
-    if ((nib = (int)xport1) & 0x00800000) {
-        shift = 3;
-    } else if (nib & 0x00400000) {
-        shift = 2;
-    } else if (nib & 0x00200000) {
-        shift = 1;
-    } else {
-        shift = 0;
-    }
+    shift = xpt_fraction_shift[(xport1 >> 21) & 0x07];
 
     if (shift) {
         /* shift the ieee number down the correct number of places */
@@ -236,50 +239,24 @@ void xpt2ieee(unsigned char *xport, unsigned char *ieee) {
     /* format the exponent is incremented by 1 and the fraction */
     /* bits left 4 positions to the right of the radix point. */
     ieee1 |=
-        (((((int32_t)(*temp & 0x7f) - 65) << 2) + shift + 1023) << 20) |
+        ((uint32_t)(((int32_t)(first_byte & 0x7f) - 65) * 4 + shift + 1023) << 20) |
         (xport1 & 0x80000000);
 
-doret:
-    memreverse(&ieee1,sizeof(uint32_t));
-    memcpy(ieee,&ieee1,sizeof(uint32_t));
-    memreverse(&ieee2,sizeof(uint32_t));
-    memcpy(ieee+4,&ieee2,sizeof(uint32_t));
-    return;
+    return ((uint64_t)ieee1 << 32) | ieee2;
 }
 
-/*-------------------------------------------------------------*/
-/* Name: ieee2xpt */
-/* Purpose: converts IEEE to transport */
-/* Usage: rc = ieee2xpt(to_ieee,p_data); */
-/* Notes: this routine is an adaptation of the wzctdbl routine */
-/* from the Apollo. */
-/*-------------------------------------------------------------*/
-
-void ieee2xpt(unsigned char *ieee, unsigned char *xport) {
-    register int shift;
+static uint64_t ieee2xpt_bits(uint64_t ieee) {
+    int shift;
     unsigned char misschar;
     int ieee_exp;
     uint32_t xport1,xport2;
-    uint32_t ieee1 = 0;
-    uint32_t ieee2 = 0;
-
-    char ieee8[8];
-
-    memcpy(ieee8,ieee,8);
-
-    /*------get 2 longs for shifting------------------------------*/
-    memcpy(&ieee1,ieee8,sizeof(uint32_t));
-    memreverse(&ieee1,sizeof(uint32_t));
-    memcpy(&ieee2,ieee8+4,sizeof(uint32_t));
-    memreverse(&ieee2,sizeof(uint32_t));
-
-    memset(xport,0,8);
+    uint32_t ieee1 = ieee >> 32;
+    uint32_t ieee2 = ieee & 0xFFFFFFFF;
 
     /*-----if IEEE value is missing (1st 2 bytes are FFFF)-----*/
-    if (*ieee8 == (char)0xff && ieee8[1] == (char)0xff) {
-        misschar = ~ieee8[2];
-        *xport = (misschar == 0xD2) ? 0x6D : misschar;
-        return;
+    if ((ieee >> 48) == 0xFFFF) {
+        misschar = ~(unsigned char)(ieee >> 40);
+        return (uint64_t)((misschar == 0xD2) ? 0x6D : misschar) << 56;
     }
 
     /**************************************************************/
@@ -352,10 +329,8 @@ void ieee2xpt(unsigned char *ieee, unsigned char *xport) {
     /* the ibm number and see if both halves are 0. If so, ibm is */
     /* also 0 and we just return */
 
-    if ((!(xport2 = ieee2)) && !ieee1) {
-        ieee_exp = 0;
-        goto doret;
-    }
+    if ((!(xport2 = ieee2)) && !ieee1)
+        return 0;
 
     /* get the actual exponent value out of the ieee number. The */
     /* ibm fraction is a power of 16 and the ieee fraction a power*/
@@ -366,6 +341,16 @@ void ieee2xpt(unsigned char *ieee, unsigned char *xport) {
     shift = (int)
         (ieee_exp = (int)(((ieee1 >> 16) & 0x7ff0) >> 4) - 1023)
         & 3;
+
+    /* If the ieee exponent is greater than 248 or less than -260, */
+    /* then it cannot fit in the ibm exponent field. Send back the */
+    /* appropriate flag. */
+    if (ieee_exp < -260)
+        return 0;
+
+    if (ieee_exp > 248)
+        return ((uint64_t)(0x7F | ((ieee1 >> 24) & 0x80)) << 56) | 0x00FFFFFFFFFFFFFFULL;
+
     /* the ieee format has an implied "1" immdeiately to the left */
     /* of the binary point. Show it in here. */
     xport1 |= 0x00100000;
@@ -397,24 +382,32 @@ void ieee2xpt(unsigned char *ieee, unsigned char *xport) {
 
     xport1 |=
 
-        (((ieee_exp >>2) + 65) | ((ieee1 >> 24) & 0x80)) << 24;
-    /* If the ieee exponent is greater than 248 or less than -260, */
-    /* then it cannot fit in the ibm exponent field. Send back the */
-    /* appropriate flag. */
+        (uint32_t)(((ieee_exp >>2) + 65) | ((ieee1 >> 24) & 0x80)) << 24;
+
+    return ((uint64_t)xport1 << 32) | xport2;
+}
+
+static void xpt2ieee(unsigned char *xport, unsigned char *ieee) {
+    write_be64(ieee, xpt2ieee_bits(read_be64(xport)));
+}
 
-doret:
-    if (ieee_exp < -260) {
-        memset(xport,0x00,8);
-    } else if (ieee_exp > 248) {
-        memset(xport+1,0xFF,7);
-
-        *xport = 0x7F | ((ieee1 >> 24) & 0x80);
-    } else {
-        memreverse(&xport1,sizeof(uint32_t));
-        memcpy(xport,&xport1,sizeof(uint32_t));
-        memreverse(&xport2,sizeof(uint32_t));
-        memcpy(xport+4,&xport2,sizeof(uint32_t));
+static void ieee2xpt(unsigned char *ieee, unsigned char *xport) {
+    write_be64(xport, ieee2xpt_bits(read_be64(ieee)));
+}
+
+void xpt2ieee_n(const unsigned char *xport, double *ieee, size_t count) {
+    size_t i;
+    for (i=0; i<count; i++) {
+        uint64_t bits = xpt2ieee_bits(read_be64(&xport[8*i]));
+        memcpy(&ieee[i], &bits, sizeof(double));
     }
-    return;
 }
 
+void ieee2xpt_n(const double *ieee, unsigned char *xport, size_t count) {
+    size_t i;
+    for (i=0; i<count; i++) {
+        uint64_t bits;
+        memcpy(&bits, &ieee[i], sizeof(double));
+        write_be64(&xport[8*i], ieee2xpt_bits(bits));
+    }
+}
@@ -1,6 +1,14 @@
+#include <stddef.h>
+
 #define CN_TYPE_NATIVE 0
 #define CN_TYPE_XPORT 1
 #define CN_TYPE_IEEEB 2
 #define CN_TYPE_IEEEL 3
 
 int cnxptiee(const void *from_bytes, int fromtype, void *to_bytes, int totype);
+
+/* Convert arrays of 8-byte transport values to native doubles and back.
+ * Native doubles are assumed to be IEEE with the machine's integer byte
+ * order, which is true on every platform we build for. */
+void xpt2ieee_n(const unsigned char *xport, double *ieee, size_t count);
+void ieee2xpt_n(const double *ieee, unsigned char *xport, size_t count);
@@ -286,6 +286,8 @@ readstat_error_t sas_write_header(readstat_writer_t *writer, sas_header_info_t *
     if (retval != READSTAT_OK)
         goto cleanup;
 
+    hinfo->page_count_offset = writer->bytes_written;
+
     if (hinfo->u64) {
         uint64_t page_count = hinfo->page_count;
         retval = readstat_write_bytes(writer, &page_count, sizeof(uint64_t));
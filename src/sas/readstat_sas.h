@@ -44,6 +44,7 @@ typedef struct sas_header_info_s {
     int64_t  page_header_size;
     int64_t  subheader_pointer_size;
     int64_t  page_count;
+    int64_t  page_count_offset;
     int64_t  header_size;
     time_t   creation_time;
     time_t   modification_time;
@@ -103,6 +104,9 @@ typedef struct sas_text_ref_s {
 #define SAS_COMPRESSION_TRUNC  0x01
 #define SAS_COMPRESSION_ROW    0x04
 
+#define SAS_COMPRESSION_SIGNATURE_RLE  "SASYZCRL"
+#define SAS_COMPRESSION_SIGNATURE_RDC  "SASYZCR2"
+
 #define SAS_DEFAULT_FILE_VERSION  90101
 
 extern unsigned char sas7bdat_magic_number[32];
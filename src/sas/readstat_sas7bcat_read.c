@@ -6,6 +6,7 @@
 #include "readstat_sas.h"
 #include "../readstat_iconv.h"
 #include "../readstat_convert.h"
+#include "../readstat_pool.h"
 
 #define SAS_CATALOG_FIRST_INDEX_PAGE 1
 #define SAS_CATALOG_USELESS_PAGES    3
@@ -15,6 +16,7 @@ typedef struct sas7bcat_ctx_s {
     readstat_value_label_handler   value_label_handler;
     void          *user_ctx;
     readstat_io_t *io;
+    struct readstat_pool_s *pool;
     int            u64;
     int            pad1;
     int            bswap;
@@ -30,8 +32,6 @@ typedef struct sas7bcat_ctx_s {
 } sas7bcat_ctx_t;
 
 static void sas7bcat_ctx_free(sas7bcat_ctx_t *ctx) {
-    if (ctx->converter)
-        iconv_close(ctx->converter);
     if (ctx->block_pointers)
         free(ctx->block_pointers);
 
@@ -292,6 +292,7 @@ readstat_error_t readstat_parse_sas7bcat(readstat_parser_t *parser, const char *
     ctx->output_encoding = parser->output_encoding;
     ctx->user_ctx = user_ctx;
     ctx->io = io;
+    ctx->pool = parser->pool;
 
     if (io->open(path, io->io_ctx) == -1) {
         retval = READSTAT_ERROR_OPEN;
@@ -318,7 +319,7 @@ readstat_error_t readstat_parse_sas7bcat(readstat_parser_t *parser, const char *
     }
 
     if (ctx->input_encoding && ctx->output_encoding && strcmp(ctx->input_encoding, ctx->output_encoding) != 0) {
-        iconv_t converter = iconv_open(ctx->output_encoding, ctx->input_encoding);
+        iconv_t converter = readstat_pool_converter(ctx->pool, ctx->output_encoding, ctx->input_encoding);
         if (converter == (iconv_t)-1) {
             retval = READSTAT_ERROR_UNSUPPORTED_CHARSET;
             goto cleanup;
@@ -5,15 +5,22 @@
 #include <string.h>
 #include <math.h>
 #include <inttypes.h>
+#if HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 #include "readstat_sas.h"
+#include "readstat_sas_rdc.h"
 #include "readstat_sas_rle.h"
 #include "../readstat_iconv.h"
 #include "../readstat_convert.h"
+#include "../readstat_batch.h"
+#include "../readstat_pool.h"
+#include "../readstat_strings.h"
 
 #define ERROR_BUF_SIZE 1024
 
-#define SAS_COMPRESSION_SIGNATURE_RLE  "SASYZCRL"
-#define SAS_COMPRESSION_SIGNATURE_RDC  "SASYZCR2"
+/* Returns the bit pattern of a numeric cell, widened to 8 bytes */
+typedef uint64_t (*sas7bdat_decode_fn)(const char *data, int width);
 
 typedef struct col_info_s {
     sas_text_ref_t  name_ref;
@@ -24,6 +31,8 @@ typedef struct col_info_s {
     int    offset;
     int    width;
     int    type;
+
+    sas7bdat_decode_fn  decode;
 } col_info_t;
 
 typedef struct sas7bdat_ctx_s {
@@ -33,6 +42,10 @@ typedef struct sas7bdat_ctx_s {
     readstat_value_handler      value_handler;
     readstat_error_handler      error_handler;
     readstat_progress_handler   progress_handler;
+    readstat_batch_handler      batch_handler;
+    readstat_column_filter      column_filter;
+    long                        batch_size;
+    readstat_batch_t           *batch;
     int64_t                     file_size;
 
     int            little_endian;
@@ -48,6 +61,9 @@ typedef struct sas7bdat_ctx_s {
     int32_t        parsed_row_count;
     int32_t        column_count;
     int32_t        row_limit;
+    int32_t        row_offset;
+    int32_t        skipped_row_count;
+    int            thread_count;
 
     int64_t        header_size;
     int64_t        page_count;
@@ -66,6 +82,9 @@ typedef struct sas7bdat_ctx_s {
     int            max_col_width;
     char          *scratch_buffer;
     size_t         scratch_buffer_len;
+    int            rdc_compression;
+    char          *row_buffer;
+    readstat_pool_t *pool;
 
     int            col_info_count;
     col_info_t    *col_info;
@@ -75,6 +94,7 @@ typedef struct sas7bdat_ctx_s {
     const char    *input_encoding;
     const char    *output_encoding;
     iconv_t        converter;
+    int            converter_preserves_ascii;
 
     time_t         timestamp;
     int            version;
@@ -100,11 +120,8 @@ static void sas7bdat_ctx_free(sas7bdat_ctx_t *ctx) {
     if (ctx->col_info)
         free(ctx->col_info);
 
-    if (ctx->scratch_buffer)
-        free(ctx->scratch_buffer);
-
-    if (ctx->converter)
-        iconv_close(ctx->converter);
+    if (ctx->batch)
+        readstat_batch_free(ctx->batch);
 
     free(ctx);
 }
@@ -139,8 +156,7 @@ static readstat_error_t sas7bdat_parse_column_text_subheader(const char *subhead
     /* another bit of a hack */
     if (len-signature_len > 12 + sizeof(SAS_COMPRESSION_SIGNATURE_RDC)-1 &&
             strncmp(blob + 12, SAS_COMPRESSION_SIGNATURE_RDC, sizeof(SAS_COMPRESSION_SIGNATURE_RDC)-1) == 0) {
-        retval = READSTAT_ERROR_UNSUPPORTED_COMPRESSION;
-        goto cleanup;
+        ctx->rdc_compression = 1;
     }
 
 cleanup:
@@ -180,6 +196,9 @@ static readstat_error_t sas7bdat_parse_row_size_subheader(const char *subheader,
 
     ctx->row_length = row_length;
     ctx->page_row_count = page_row_count;
+    if (ctx->row_offset > total_row_count)
+        ctx->row_offset = total_row_count;
+    total_row_count -= ctx->row_offset;
     if (ctx->row_limit == 0 || total_row_count < ctx->row_limit)
         ctx->row_limit = total_row_count;
 
@@ -310,6 +329,44 @@ static readstat_error_t sas7bdat_parse_column_format_subheader(const char *subhe
     return retval;
 }
 
+static uint64_t sas7bdat_decode_double_native(const char *data, int width) {
+    uint64_t val;
+    memcpy(&val, data, sizeof(uint64_t));
+    return val;
+}
+
+static uint64_t sas7bdat_decode_double_swapped(const char *data, int width) {
+    uint64_t val;
+    memcpy(&val, data, sizeof(uint64_t));
+    return byteswap8(val);
+}
+
+static uint64_t sas7bdat_decode_truncated_le(const char *data, int width) {
+    uint64_t val = 0;
+    int k;
+    for (k=0; k<width; k++) {
+        val = (val << 8) | (unsigned char)data[width-1-k];
+    }
+    return val << (8-width)*8;
+}
+
+static uint64_t sas7bdat_decode_truncated_be(const char *data, int width) {
+    uint64_t val = 0;
+    int k;
+    for (k=0; k<width; k++) {
+        val = (val << 8) | (unsigned char)data[k];
+    }
+    return val << (8-width)*8;
+}
+
+static sas7bdat_decode_fn sas7bdat_decoder(col_info_t *col_info, sas7bdat_ctx_t *ctx) {
+    if (col_info->width == 8)
+        return ctx->bswap ? &sas7bdat_decode_double_swapped : &sas7bdat_decode_double_native;
+    if (ctx->little_endian)
+        return &sas7bdat_decode_truncated_le;
+    return &sas7bdat_decode_truncated_be;
+}
+
 static readstat_error_t sas7bdat_handle_data_value(const char *col_data, col_info_t *col_info, sas7bdat_ctx_t *ctx) {
     readstat_error_t retval = READSTAT_OK;
     char error_buf[ERROR_BUF_SIZE];
@@ -320,8 +377,8 @@ static readstat_error_t sas7bdat_handle_data_value(const char *col_data, col_inf
     value.type = col_info->type;
 
     if (col_info->type == READSTAT_TYPE_STRING) {
-        retval = readstat_convert(ctx->scratch_buffer, ctx->scratch_buffer_len,
-                col_data, col_info->width, ctx->converter);
+        retval = readstat_convert_fast(ctx->scratch_buffer, ctx->scratch_buffer_len,
+                col_data, col_info->width, ctx->converter, ctx->converter_preserves_ascii);
         if (retval != READSTAT_OK) {
             if (ctx->error_handler) {
                 snprintf(error_buf, sizeof(error_buf),
@@ -332,22 +389,16 @@ static readstat_error_t sas7bdat_handle_data_value(const char *col_data, col_inf
             goto cleanup;
         }
 
+        if (ctx->batch) {
+            retval = readstat_batch_push_string(ctx->batch, col_info->index,
+                    ctx->scratch_buffer, strlen(ctx->scratch_buffer));
+            goto cleanup;
+        }
+
         value.v.string_value = ctx->scratch_buffer;
     } else if (col_info->type == READSTAT_TYPE_DOUBLE) {
-        uint64_t  val = 0;
+        uint64_t  val = col_info->decode(col_data, col_info->width);
         double dval = NAN;
-        if (ctx->little_endian) {
-            int k;
-            for (k=0; k<col_info->width; k++) {
-                val = (val << 8) | (unsigned char)col_data[col_info->width-1-k];
-            }
-        } else {
-            int k;
-            for (k=0; k<col_info->width; k++) {
-                val = (val << 8) | (unsigned char)col_data[k];
-            }
-        }
-        val <<= (8-col_info->width)*8;
 
         memcpy(&dval, &val, 8);
 
@@ -362,7 +413,15 @@ static readstat_error_t sas7bdat_handle_data_value(const char *col_data, col_inf
         } else {
             value.v.double_value = dval;
         }
+
+        if (ctx->batch) {
+            readstat_batch_push_double(ctx->batch, col_info->index, value.v.double_value);
+            if (value.is_system_missing || value.is_tagged_missing)
+                readstat_batch_push_missing(ctx->batch, col_info->index, value.tag);
+            goto cleanup;
+        }
     }
+
     cb_retval = ctx->value_handler(ctx->parsed_row_count, ctx->variables[col_info->index], 
             value, ctx->user_ctx);
 
@@ -373,22 +432,37 @@ cleanup:
     return retval;
 }
 
+/* Returns 1 if the next row comes before the row offset and should be
+ * passed over without decoding */
+static int sas7bdat_skip_row(sas7bdat_ctx_t *ctx) {
+    if (ctx->skipped_row_count < ctx->row_offset) {
+        ctx->skipped_row_count++;
+        return 1;
+    }
+    return 0;
+}
+
 static readstat_error_t sas7bdat_parse_single_row(const char *data, sas7bdat_ctx_t *ctx) {
     if (ctx->parsed_row_count == ctx->row_limit)
         return READSTAT_OK;
+    if (sas7bdat_skip_row(ctx))
+        return READSTAT_OK;
 
     readstat_error_t retval = READSTAT_OK;
     int j;
-    if (ctx->value_handler) {
-        ctx->scratch_buffer_len = 4*ctx->max_col_width+1;
-        ctx->scratch_buffer = realloc(ctx->scratch_buffer, ctx->scratch_buffer_len);
+    if (ctx->value_handler || ctx->batch) {
         for (j=0; j<ctx->column_count; j++) {
             col_info_t *col_info = &ctx->col_info[j];
+            if (ctx->variables[col_info->index]->skip)
+                continue;
             retval = sas7bdat_handle_data_value(&data[col_info->offset], col_info, ctx);
             if (retval != READSTAT_OK) {
                 goto cleanup;
             }
         }
+        if (ctx->batch && (retval = readstat_batch_end_row(ctx->batch)) != READSTAT_OK) {
+            goto cleanup;
+        }
     }
     ctx->parsed_row_count++;
 
@@ -400,7 +474,11 @@ static readstat_error_t sas7bdat_parse_rows(const char *data, sas7bdat_ctx_t *ct
     readstat_error_t retval = READSTAT_OK;
     int i;
     size_t row_offset=0;
-    for (i=0; i<ctx->page_row_count && ctx->parsed_row_count < ctx->row_limit; i++) {
+    for (i=0; i<ctx->page_row_count && ctx->skipped_row_count < ctx->row_offset; i++) {
+        ctx->skipped_row_count++;
+        row_offset += ctx->row_length;
+    }
+    for (; i<ctx->page_row_count && ctx->parsed_row_count < ctx->row_limit; i++) {
         if ((retval = sas7bdat_parse_single_row(&data[row_offset], ctx)) != READSTAT_OK)
             goto cleanup;
 
@@ -411,36 +489,43 @@ cleanup:
     return retval;
 }
 
-static readstat_error_t sas7bdat_parse_subheader_rle(const char *subheader, size_t len, sas7bdat_ctx_t *ctx) {
-    if (ctx->row_limit == ctx->parsed_row_count)
-        return READSTAT_OK;
+static size_t sas7bdat_decompress_row(char *row, const char *data, size_t len, const sas7bdat_ctx_t *ctx) {
+    if (ctx->rdc_compression)
+        return sas_rdc_decompress(row, ctx->row_length, data, len);
 
-    readstat_error_t retval = READSTAT_OK;
+    return sas_rle_decompress(row, ctx->row_length, data, len);
+}
+
+static void sas7bdat_report_decompression_error(size_t bytes_decompressed, sas7bdat_ctx_t *ctx) {
     char error_buf[ERROR_BUF_SIZE];
-    char *buffer = malloc(ctx->row_length);
-    if (buffer == NULL) {
-        retval = READSTAT_ERROR_MALLOC;
-        goto cleanup;
+    if (!ctx->error_handler)
+        return;
+
+    if (bytes_decompressed > ctx->row_length) {
+        snprintf(error_buf, sizeof(error_buf), 
+                "ReadStat: Row #%d is truncated or decompresses to more than %d bytes\n",
+                ctx->parsed_row_count, ctx->row_length);
+    } else {
+        snprintf(error_buf, sizeof(error_buf), 
+                "ReadStat: Row #%d decompressed to %ld bytes (expected %d bytes)\n",
+                ctx->parsed_row_count, (long)(bytes_decompressed), ctx->row_length);
     }
-    size_t bytes_decompressed = sas_rle_decompress(
-            buffer, ctx->row_length, subheader, len);
+    ctx->error_handler(error_buf, ctx->user_ctx);
+}
+
+static readstat_error_t sas7bdat_parse_compressed_row(const char *subheader, size_t len, sas7bdat_ctx_t *ctx) {
+    if (ctx->row_limit == ctx->parsed_row_count)
+        return READSTAT_OK;
+    if (sas7bdat_skip_row(ctx))
+        return READSTAT_OK;
+
+    size_t bytes_decompressed = sas7bdat_decompress_row(ctx->row_buffer, subheader, len, ctx);
 
     if (bytes_decompressed != ctx->row_length) {
-        retval = READSTAT_ERROR_ROW_WIDTH_MISMATCH;
-        if (ctx->error_handler) {
-            snprintf(error_buf, sizeof(error_buf), 
-                    "ReadStat: Row #%d decompressed to %ld bytes (expected %d bytes)\n",
-                    ctx->parsed_row_count, (long)(bytes_decompressed), ctx->row_length);
-            ctx->error_handler(error_buf, ctx->user_ctx);
-        }
-        goto cleanup;
+        sas7bdat_report_decompression_error(bytes_decompressed, ctx);
+        return READSTAT_ERROR_ROW_WIDTH_MISMATCH;
     }
-    retval = sas7bdat_parse_single_row(buffer, ctx);
-cleanup:
-    if (buffer)
-        free(buffer);
-
-    return retval;
+    return sas7bdat_parse_single_row(ctx->row_buffer, ctx);
 }
 
 static readstat_error_t sas7bdat_parse_subheader(uint32_t signature, const char *subheader, size_t len, sas7bdat_ctx_t *ctx) {
@@ -479,25 +564,42 @@ cleanup:
 
 static readstat_variable_t *sas7bdat_init_variable(sas7bdat_ctx_t *ctx, int i, readstat_error_t *out_retval) {
     readstat_error_t retval = READSTAT_OK;
+    readstat_string_pool_t *strings = ctx->pool->strings;
+    char name[READSTAT_VARIABLE_NAME_LEN] = "";
+    char format[READSTAT_VARIABLE_FORMAT_LEN] = "";
+    char label[READSTAT_VARIABLE_LABEL_LEN] = "";
     readstat_variable_t *variable = calloc(1, sizeof(readstat_variable_t));
+    if (variable == NULL) {
+        retval = READSTAT_ERROR_MALLOC;
+        goto cleanup;
+    }
 
     variable->index = i;
     variable->type = ctx->col_info[i].type;
     variable->storage_width = ctx->col_info[i].width;
+    variable->strings = strings;
 
-    if ((retval = sas7bdat_copy_text_ref(variable->name, sizeof(variable->name), 
+    if ((retval = sas7bdat_copy_text_ref(name, sizeof(name), 
                     ctx->col_info[i].name_ref, ctx)) != READSTAT_OK) {
         goto cleanup;
     }
-    if ((retval = sas7bdat_copy_text_ref(variable->format, sizeof(variable->format), 
+    if ((retval = sas7bdat_copy_text_ref(format, sizeof(format), 
                     ctx->col_info[i].format_ref, ctx)) != READSTAT_OK) {
         goto cleanup;
     }
-    if ((retval = sas7bdat_copy_text_ref(variable->label, sizeof(variable->label), 
+    if ((retval = sas7bdat_copy_text_ref(label, sizeof(label), 
                     ctx->col_info[i].label_ref, ctx)) != READSTAT_OK) {
         goto cleanup;
     }
 
+    variable->name = readstat_string_pool_intern(strings, name, sizeof(name));
+    variable->format = readstat_string_pool_intern(strings, format, sizeof(format));
+    variable->label = readstat_string_pool_intern(strings, label, sizeof(label));
+    if (!variable->name || !variable->format || !variable->label) {
+        retval = READSTAT_ERROR_MALLOC;
+        goto cleanup;
+    }
+
 cleanup:
     if (retval != READSTAT_OK) {
         free(variable);
@@ -509,7 +611,7 @@ cleanup:
                 char error_buf[ERROR_BUF_SIZE];
                 snprintf(error_buf, sizeof(error_buf),
                         "ReadStat: Error converting variable #%d info to specified encoding: %s %s (%s)\n",
-                        i, variable->name, variable->format, variable->label);
+                        i, name, format, label);
                 ctx->error_handler(error_buf, ctx->user_ctx);
             }
         }
@@ -539,7 +641,13 @@ static readstat_error_t sas7bdat_submit_columns(sas7bdat_ctx_t *ctx) {
     for (i=0; i<ctx->column_count; i++) {
         ctx->variables[i] = sas7bdat_init_variable(ctx, i, &retval);
         if (ctx->variables[i] == NULL)
-            break;
+            goto cleanup;
+
+        if (ctx->column_filter) {
+            ctx->variables[i]->skip = !ctx->column_filter(i, ctx->variables[i], ctx->user_ctx);
+        }
+
+        ctx->col_info[i].decode = sas7bdat_decoder(&ctx->col_info[i], ctx);
 
         if (ctx->variable_handler) {
             if (ctx->variable_handler(i, ctx->variables[i], ctx->variables[i]->format, ctx->user_ctx)) {
@@ -548,6 +656,30 @@ static readstat_error_t sas7bdat_submit_columns(sas7bdat_ctx_t *ctx) {
             }
         }
     }
+    if (ctx->batch_handler) {
+        ctx->batch = readstat_batch_init(ctx->batch_handler, ctx->batch_size,
+                ctx->column_count, ctx->user_ctx);
+        if (ctx->batch == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+        for (i=0; i<ctx->column_count; i++) {
+            col_info_t *col_info = &ctx->col_info[i];
+            readstat_variable_t *variable = ctx->variables[col_info->index];
+            if (variable->skip)
+                continue;
+            retval = readstat_batch_set_column(ctx->batch, col_info->index, variable, col_info->type);
+            if (retval != READSTAT_OK)
+                goto cleanup;
+        }
+    }
+    ctx->scratch_buffer_len = 4*ctx->max_col_width+1;
+    ctx->scratch_buffer = readstat_pool_get(ctx->pool, READSTAT_POOL_STRING_UTF8, ctx->scratch_buffer_len);
+    ctx->row_buffer = readstat_pool_get(ctx->pool, READSTAT_POOL_ROW, ctx->row_length + 1);
+    if (ctx->scratch_buffer == NULL || ctx->row_buffer == NULL) {
+        retval = READSTAT_ERROR_MALLOC;
+        goto cleanup;
+    }
 cleanup:
     return retval;
 }
@@ -696,7 +828,7 @@ static readstat_error_t sas7bdat_parse_page_pass2(const char *page, size_t page_
                     if ((retval = sas7bdat_submit_columns_if_needed(ctx)) != READSTAT_OK) {
                         goto cleanup;
                     }
-                    if ((retval = sas7bdat_parse_subheader_rle(page + offset, len, ctx)) != READSTAT_OK) {
+                    if ((retval = sas7bdat_parse_compressed_row(page + offset, len, ctx)) != READSTAT_OK) {
                         goto cleanup;
                     }
                 } else {
@@ -727,7 +859,7 @@ static readstat_error_t sas7bdat_parse_page_pass2(const char *page, size_t page_
         if ((retval = sas7bdat_submit_columns_if_needed(ctx)) != READSTAT_OK) {
             goto cleanup;
         }
-        if (ctx->value_handler) {
+        if (ctx->value_handler || ctx->batch) {
             retval = sas7bdat_parse_rows(data, ctx);
         }
     } 
@@ -741,7 +873,9 @@ static readstat_error_t sas7bdat_parse_meta_pages_pass1(sas7bdat_ctx_t *ctx, int
     readstat_io_t *io = ctx->io;
     int64_t i;
     char error_buf[ERROR_BUF_SIZE];
-    char *page = malloc(ctx->page_size);
+    char *page = readstat_pool_get(ctx->pool, READSTAT_POOL_PAGE, ctx->page_size);
+    if (page == NULL)
+        return READSTAT_ERROR_MALLOC;
 
     /* look for META and MIX pages at beginning... */
     for (i=0; i<ctx->page_count; i++) {
@@ -793,8 +927,6 @@ static readstat_error_t sas7bdat_parse_meta_pages_pass1(sas7bdat_ctx_t *ctx, int
     }
 
 cleanup:
-    if (page)
-        free(page);
     if (outLastExaminedPage)
         *outLastExaminedPage = i;
 
@@ -806,8 +938,10 @@ static readstat_error_t sas7bdat_parse_amd_pages_pass1(int64_t last_examined_pag
     readstat_io_t *io = ctx->io;
     int64_t i;
     char error_buf[ERROR_BUF_SIZE];
-    char *page = malloc(ctx->page_size);
     int64_t amd_page_count = 0;
+    char *page = readstat_pool_get(ctx->pool, READSTAT_POOL_PAGE, ctx->page_size);
+    if (page == NULL)
+        return READSTAT_ERROR_MALLOC;
 
     /* ...then AMD pages at the end */
     for (i=ctx->page_count-1; i>last_examined_page_pass1; i--) {
@@ -865,20 +999,369 @@ static readstat_error_t sas7bdat_parse_amd_pages_pass1(int64_t last_examined_pag
     }
 
 cleanup:
-    if (page)
-        free(page);
 
     return retval;
 }
 
+#if HAVE_LIBPTHREAD
+
+#define SAS7BDAT_PAGES_PER_THREAD   4
+
+/* Rows found on one page by a worker thread, in file order. Rows point either
+ * into the page itself or into row_buffer (for compressed rows). */
+typedef struct sas7bdat_page_rows_s {
+    const char        **rows;
+    int                 rows_count;
+    int                 rows_capacity;
+    char               *row_buffer;
+    size_t              row_buffer_len;
+    int                 page_row_count;
+    int                 needs_serial;
+    readstat_error_t    error;
+    int                 error_is_decompression;
+    size_t              bytes_decompressed;
+} sas7bdat_page_rows_t;
+
+typedef struct sas7bdat_worker_s {
+    pthread_t                   thread;
+    const sas7bdat_ctx_t       *ctx;
+    const char                 *pages;
+    sas7bdat_page_rows_t       *results;
+    int                         pages_count;
+    int                         first_page;
+    int                         stride;
+} sas7bdat_worker_t;
+
+static int sas7bdat_page_rows_reserve(sas7bdat_page_rows_t *result, int rows_count) {
+    if (rows_count > result->rows_capacity) {
+        const char **rows = realloc(result->rows, rows_count * sizeof(const char *));
+        if (rows == NULL)
+            return -1;
+        result->rows = rows;
+        result->rows_capacity = rows_count;
+    }
+    return 0;
+}
+
+/* Worker-side counterpart of sas7bdat_parse_page_pass2: locates and
+ * decompresses the rows on a page without touching the parser state. Pages
+ * that carry metadata (or mix metadata with data) are left to the main
+ * thread. */
+static void sas7bdat_decode_page(const char *page, size_t page_size,
+        const sas7bdat_ctx_t *ctx, sas7bdat_page_rows_t *result) {
+    uint16_t page_type = sas_read2(&page[ctx->page_header_size-8], ctx->bswap);
+    int i;
+
+    result->rows_count = 0;
+    result->page_row_count = -1;
+    result->needs_serial = 0;
+    result->error = READSTAT_OK;
+    result->error_is_decompression = 0;
+
+    if ((page_type & SAS_PAGE_TYPE_MASK) == SAS_PAGE_TYPE_DATA) {
+        int page_row_count = sas_read2(&page[ctx->page_header_size-6], ctx->bswap);
+        const char *data = &page[ctx->page_header_size];
+        if (ctx->page_header_size + (int64_t)page_row_count * ctx->row_length > page_size) {
+            result->needs_serial = 1;
+            return;
+        }
+        if (sas7bdat_page_rows_reserve(result, page_row_count) == -1) {
+            result->error = READSTAT_ERROR_MALLOC;
+            return;
+        }
+        for (i=0; i<page_row_count; i++) {
+            result->rows[i] = &data[i * ctx->row_length];
+        }
+        result->rows_count = page_row_count;
+        result->page_row_count = page_row_count;
+        return;
+    }
+
+    if ((page_type & SAS_PAGE_TYPE_COMP))
+        return;
+
+    if ((page_type & SAS_PAGE_TYPE_MASK) == SAS_PAGE_TYPE_MIX) {
+        result->needs_serial = 1;
+        return;
+    }
+
+    uint16_t subheader_count = sas_read2(&page[ctx->page_header_size-4], ctx->bswap);
+    size_t row_buffer_len = (size_t)subheader_count * ctx->row_length;
+
+    if (sas7bdat_page_rows_reserve(result, subheader_count) == -1) {
+        result->error = READSTAT_ERROR_MALLOC;
+        return;
+    }
+    if (row_buffer_len > result->row_buffer_len) {
+        char *row_buffer = realloc(result->row_buffer, row_buffer_len);
+        if (row_buffer == NULL) {
+            result->error = READSTAT_ERROR_MALLOC;
+            return;
+        }
+        result->row_buffer = row_buffer;
+        result->row_buffer_len = row_buffer_len;
+    }
+
+    const char *shp = &page[ctx->page_header_size];
+    int lshp = ctx->subheader_pointer_size;
+    for (i=0; i<subheader_count; i++, shp += lshp) {
+        uint64_t offset = 0, len = 0;
+        uint32_t signature = 0;
+        unsigned char compression = 0;
+        unsigned char is_compressed_data = 0;
+        if (ctx->u64) {
+            offset = sas_read8(&shp[0], ctx->bswap);
+            len = sas_read8(&shp[8], ctx->bswap);
+            compression = shp[16];
+            is_compressed_data = shp[17];
+        } else {
+            offset = sas_read4(&shp[0], ctx->bswap);
+            len = sas_read4(&shp[4], ctx->bswap);
+            compression = shp[8];
+            is_compressed_data = shp[9];
+        }
+
+        if (len == 0 || compression == SAS_COMPRESSION_TRUNC)
+            continue;
+
+        if (offset > page_size || offset + len > page_size ||
+                offset < ctx->page_header_size+subheader_count*lshp) {
+            result->error = READSTAT_ERROR_PARSE;
+            return;
+        }
+        if (compression == SAS_COMPRESSION_NONE) {
+            signature = sas_read4(page + offset, ctx->bswap);
+            if (!ctx->little_endian && signature == -1 && ctx->u64) {
+                signature = sas_read4(page + offset + 4, ctx->bswap);
+            }
+            if (is_compressed_data && !sas7bdat_signature_is_recognized(signature)) {
+                if (len != ctx->row_length) {
+                    result->error = READSTAT_ERROR_ROW_WIDTH_MISMATCH;
+                    return;
+                }
+                result->rows[result->rows_count++] = page + offset;
+            } else if (signature != SAS_SUBHEADER_SIGNATURE_COLUMN_TEXT) {
+                result->rows_count = 0;
+                result->needs_serial = 1;
+                return;
+            }
+        } else if (compression == SAS_COMPRESSION_ROW) {
+            char *row = &result->row_buffer[(size_t)result->rows_count * ctx->row_length];
+            size_t bytes_decompressed = sas7bdat_decompress_row(row, page + offset, len, ctx);
+            if (bytes_decompressed != ctx->row_length) {
+                result->error = READSTAT_ERROR_ROW_WIDTH_MISMATCH;
+                result->error_is_decompression = 1;
+                result->bytes_decompressed = bytes_decompressed;
+                return;
+            }
+            result->rows[result->rows_count++] = row;
+        } else {
+            result->error = READSTAT_ERROR_UNSUPPORTED_COMPRESSION;
+            return;
+        }
+    }
+}
+
+static void *sas7bdat_worker_main(void *arg) {
+    sas7bdat_worker_t *worker = (sas7bdat_worker_t *)arg;
+    int i;
+    for (i=worker->first_page; i<worker->pages_count; i+=worker->stride) {
+        sas7bdat_decode_page(&worker->pages[i * worker->ctx->page_size], worker->ctx->page_size,
+                worker->ctx, &worker->results[i]);
+    }
+    return NULL;
+}
+
+static readstat_error_t sas7bdat_emit_page_rows(const char *page, sas7bdat_page_rows_t *result,
+        sas7bdat_ctx_t *ctx) {
+    readstat_error_t retval = READSTAT_OK;
+    int i;
+
+    if (result->needs_serial)
+        return sas7bdat_parse_page_pass2(page, ctx->page_size, ctx);
+
+    if (result->page_row_count != -1)
+        ctx->page_row_count = result->page_row_count;
+
+    for (i=0; i<result->rows_count && ctx->parsed_row_count < ctx->row_limit; i++) {
+        if ((retval = sas7bdat_parse_single_row(result->rows[i], ctx)) != READSTAT_OK)
+            goto cleanup;
+    }
+
+    if (result->error == READSTAT_OK)
+        goto cleanup;
+
+    if (result->error_is_decompression) {
+        if (ctx->parsed_row_count == ctx->row_limit)
+            goto cleanup;
+
+        sas7bdat_report_decompression_error(result->bytes_decompressed, ctx);
+    }
+    retval = result->error;
+
+cleanup:
+    return retval;
+}
+
+/* Decode the remaining pages on ctx->thread_count threads, a chunk at a
+ * time. Pages are read and rows are handed to the value handler on the
+ * calling thread, in file order; the workers only locate and decompress rows. */
+static readstat_error_t sas7bdat_parse_pages_pass2_parallel(sas7bdat_ctx_t *ctx, int64_t first_page) {
+    readstat_error_t retval = READSTAT_OK;
+    readstat_io_t *io = ctx->io;
+    char error_buf[ERROR_BUF_SIZE];
+    int thread_count = ctx->thread_count;
+    int chunk_capacity = thread_count * SAS7BDAT_PAGES_PER_THREAD;
+    char *pages = NULL;
+    sas7bdat_page_rows_t *results = NULL;
+    sas7bdat_worker_t *workers = NULL;
+    int64_t i = first_page;
+    int j;
+
+    if ((pages = malloc(chunk_capacity * ctx->page_size)) == NULL ||
+            (results = calloc(chunk_capacity, sizeof(sas7bdat_page_rows_t))) == NULL ||
+            (workers = calloc(thread_count, sizeof(sas7bdat_worker_t))) == NULL) {
+        retval = READSTAT_ERROR_MALLOC;
+        goto cleanup;
+    }
+
+    while (i < ctx->page_count && ctx->parsed_row_count < ctx->row_limit) {
+        int pages_count = 0;
+        readstat_error_t read_retval = READSTAT_OK;
+
+        while (pages_count < chunk_capacity && i + pages_count < ctx->page_count) {
+            if ((read_retval = sas7bdat_update_progress(ctx)) != READSTAT_OK)
+                break;
+            if (io->read(&pages[pages_count * ctx->page_size], ctx->page_size, io->io_ctx) < ctx->page_size) {
+                read_retval = READSTAT_ERROR_READ;
+                break;
+            }
+            pages_count++;
+        }
+
+        int workers_count = thread_count < pages_count ? thread_count : pages_count;
+        for (j=0; j<workers_count; j++) {
+            sas7bdat_worker_t *worker = &workers[j];
+            worker->ctx = ctx;
+            worker->pages = pages;
+            worker->results = results;
+            worker->pages_count = pages_count;
+            worker->first_page = j;
+            worker->stride = workers_count;
+            if (j > 0 && pthread_create(&worker->thread, NULL, &sas7bdat_worker_main, worker) != 0) {
+                worker->stride = 0;
+            }
+        }
+        /* The calling thread takes the first share, plus any share whose
+         * thread could not be started */
+        sas7bdat_worker_main(&workers[0]);
+        for (j=1; j<workers_count; j++) {
+            if (workers[j].stride) {
+                pthread_join(workers[j].thread, NULL);
+            } else {
+                workers[j].stride = workers_count;
+                sas7bdat_worker_main(&workers[j]);
+            }
+        }
+
+        for (j=0; j<pages_count && ctx->parsed_row_count < ctx->row_limit; j++, i++) {
+            retval = sas7bdat_emit_page_rows(&pages[j * ctx->page_size], &results[j], ctx);
+            if (retval != READSTAT_OK) {
+                if (ctx->error_handler && retval != READSTAT_ERROR_USER_ABORT) {
+                    int64_t pos = ctx->header_size + (i + 1) * ctx->page_size;
+                    snprintf(error_buf, sizeof(error_buf), 
+                            "ReadStat: Error parsing page %" PRId64 ", bytes %" PRId64 "-%" PRId64 "\n", 
+                            i, pos - ctx->page_size, pos-1);
+                    ctx->error_handler(error_buf, ctx->user_ctx);
+                }
+                goto cleanup;
+            }
+        }
+
+        if (read_retval != READSTAT_OK) {
+            retval = read_retval;
+            goto cleanup;
+        }
+    }
+
+cleanup:
+    if (results) {
+        for (j=0; j<chunk_capacity; j++) {
+            free(results[j].rows);
+            free(results[j].row_buffer);
+        }
+        free(results);
+    }
+    free(workers);
+    free(pages);
+
+    return retval;
+}
+
+#endif
+
+/* Reads only the header of the next page. If it is a data page whose rows
+ * all come before the row offset, the rest of the page is skipped and
+ * *did_skip is set; otherwise the file is left at the start of the page. */
+static readstat_error_t sas7bdat_skip_data_page(sas7bdat_ctx_t *ctx, char *page, int *did_skip) {
+    readstat_error_t retval = READSTAT_OK;
+    readstat_io_t *io = ctx->io;
+    uint16_t page_type, page_row_count;
+
+    *did_skip = 0;
+
+    if (io->read(page, ctx->page_header_size, io->io_ctx) < ctx->page_header_size) {
+        retval = READSTAT_ERROR_READ;
+        goto cleanup;
+    }
+
+    page_type = sas_read2(&page[ctx->page_header_size-8], ctx->bswap);
+    page_row_count = sas_read2(&page[ctx->page_header_size-6], ctx->bswap);
+
+    if ((page_type & SAS_PAGE_TYPE_MASK) == SAS_PAGE_TYPE_DATA &&
+            page_row_count <= ctx->row_offset - ctx->skipped_row_count) {
+        if ((retval = sas7bdat_submit_columns_if_needed(ctx)) != READSTAT_OK)
+            goto cleanup;
+
+        if (io->seek(ctx->page_size - ctx->page_header_size, READSTAT_SEEK_CUR, io->io_ctx) == -1) {
+            retval = READSTAT_ERROR_SEEK;
+            goto cleanup;
+        }
+        ctx->skipped_row_count += page_row_count;
+        *did_skip = 1;
+    } else if (io->seek(-ctx->page_header_size, READSTAT_SEEK_CUR, io->io_ctx) == -1) {
+        retval = READSTAT_ERROR_SEEK;
+        goto cleanup;
+    }
+
+cleanup:
+    return retval;
+}
+
 static readstat_error_t sas7bdat_parse_all_pages_pass2(sas7bdat_ctx_t *ctx) {
     readstat_error_t retval = READSTAT_OK;
     readstat_io_t *io = ctx->io;
     int64_t i;
     char error_buf[ERROR_BUF_SIZE];
-    char *page = malloc(ctx->page_size);
+    char *page = readstat_pool_get(ctx->pool, READSTAT_POOL_PAGE, ctx->page_size);
+    if (page == NULL)
+        return READSTAT_ERROR_MALLOC;
 
     for (i=0; i<ctx->page_count; i++) {
+        if (ctx->skipped_row_count < ctx->row_offset) {
+            int did_skip = 0;
+            if ((retval = sas7bdat_skip_data_page(ctx, page, &did_skip)) != READSTAT_OK)
+                goto cleanup;
+            if (did_skip)
+                continue;
+        }
+#if HAVE_LIBPTHREAD
+        /* Once the columns are known, the remaining pages can be decoded concurrently */
+        if (ctx->thread_count > 1 && ctx->did_submit_columns && (ctx->value_handler || ctx->batch)) {
+            retval = sas7bdat_parse_pages_pass2_parallel(ctx, i);
+            goto cleanup;
+        }
+#endif
         if ((retval = sas7bdat_update_progress(ctx)) != READSTAT_OK) {
             goto cleanup;
         }
@@ -901,8 +1384,6 @@ static readstat_error_t sas7bdat_parse_all_pages_pass2(sas7bdat_ctx_t *ctx) {
             break;
     }
 cleanup:
-    if (page)
-        free(page);
 
     return retval;
 }
@@ -920,6 +1401,9 @@ readstat_error_t readstat_parse_sas7bdat(readstat_parser_t *parser, const char *
     ctx->metadata_handler = parser->metadata_handler;
     ctx->variable_handler = parser->variable_handler;
     ctx->value_handler = parser->value_handler;
+    ctx->batch_handler = parser->batch_handler;
+    ctx->column_filter = parser->column_filter;
+    ctx->batch_size = parser->batch_size;
     ctx->error_handler = parser->error_handler;
     ctx->progress_handler = parser->progress_handler;
     ctx->input_encoding = parser->input_encoding;
@@ -927,6 +1411,10 @@ readstat_error_t readstat_parse_sas7bdat(readstat_parser_t *parser, const char *
     ctx->user_ctx = user_ctx;
     ctx->io = parser->io;
     ctx->row_limit = parser->row_limit;
+    ctx->row_offset = parser->row_offset > 0 ? parser->row_offset : 0;
+    ctx->thread_count = parser->thread_count;
+    ctx->pool = parser->pool;
+    readstat_string_pool_clear(ctx->pool->strings);
 
     if (io->open(path, io->io_ctx) == -1) {
         retval = READSTAT_ERROR_OPEN;
@@ -971,13 +1459,14 @@ readstat_error_t readstat_parse_sas7bdat(readstat_parser_t *parser, const char *
     }
 
     if (ctx->input_encoding && ctx->output_encoding && strcmp(ctx->input_encoding, ctx->output_encoding) != 0) {
-        iconv_t converter = iconv_open(ctx->output_encoding, ctx->input_encoding);
+        iconv_t converter = readstat_pool_converter(ctx->pool, ctx->output_encoding, ctx->input_encoding);
         if (converter == (iconv_t)-1) {
             retval = READSTAT_ERROR_UNSUPPORTED_CHARSET;
             goto cleanup;
         }
         ctx->converter = converter;
     }
+    ctx->converter_preserves_ascii = readstat_converter_preserves_ascii(ctx->converter);
 
     if ((retval = readstat_convert(ctx->file_label, sizeof(ctx->file_label),
                 hinfo->file_label, sizeof(hinfo->file_label), ctx->converter)) != READSTAT_OK) {
@@ -1010,7 +1499,11 @@ readstat_error_t readstat_parse_sas7bdat(readstat_parser_t *parser, const char *
         goto cleanup;
     }
 
-    if (ctx->value_handler && ctx->parsed_row_count != ctx->row_limit) {
+    if (ctx->batch && (retval = readstat_batch_flush(ctx->batch)) != READSTAT_OK) {
+        goto cleanup;
+    }
+
+    if ((ctx->value_handler || ctx->batch) && ctx->parsed_row_count != ctx->row_limit) {
         retval = READSTAT_ERROR_ROW_COUNT_MISMATCH;
         if (ctx->error_handler) {
             snprintf(error_buf, sizeof(error_buf), "ReadStat: Expected %d rows in file, found %d\n",
@@ -7,6 +7,7 @@
 #include "../readstat.h"
 #include "../readstat_writer.h"
 #include "readstat_sas.h"
+#include "readstat_sas_rdc.h"
 #include "readstat_sas_rle.h"
 
 typedef struct sas7bdat_subheader_s {
@@ -38,10 +39,20 @@ typedef struct sas7bdat_column_text_array_s {
 typedef struct sas7bdat_write_ctx_s {
     sas_header_info_t       *hinfo;
     sas7bdat_subheader_array_t   *sarray;
+
+    char                    *page;
+    int16_t                  page_shp_count;
+    size_t                   page_shp_ptr_offset;
+    size_t                   page_shp_data_offset;
+    int64_t                  pages_written;
+
+    int                      stream_rows;
+    char                    *row_buffer;
 } sas7bdat_write_ctx_t;
 
 static size_t sas7bdat_variable_width(readstat_type_t type, size_t user_width);
 
+/* Must agree with the packing done by sas7bdat_emit_subheader_bytes */
 static int32_t sas7bdat_count_meta_pages(readstat_writer_t *writer) {
     sas7bdat_write_ctx_t *ctx = (sas7bdat_write_ctx_t *)writer->module_ctx;
     sas_header_info_t *hinfo = ctx->hinfo;
@@ -50,9 +61,9 @@ static int32_t sas7bdat_count_meta_pages(readstat_writer_t *writer) {
     int pages = 1;
     size_t bytes_left = hinfo->page_size - hinfo->page_header_size;
     size_t shp_ptr_size = hinfo->subheader_pointer_size;
-    for (i=sarray->count-1; i>=0; i--) {
+    for (i=0; i<sarray->count; i++) {
         sas7bdat_subheader_t *subheader = sarray->subheaders[i];
-        if (subheader->len + shp_ptr_size > bytes_left) {
+        if (subheader->len + shp_ptr_size >= bytes_left) {
             bytes_left = hinfo->page_size - hinfo->page_header_size;
             pages++;
         }
@@ -78,7 +89,7 @@ static int32_t sas7bdat_rows_per_page(readstat_writer_t *writer, sas_header_info
 }
 
 static int32_t sas7bdat_count_data_pages(readstat_writer_t *writer, sas_header_info_t *hinfo) {
-    if (writer->compression == READSTAT_COMPRESS_ROWS)
+    if (writer->compression != READSTAT_COMPRESS_NONE)
         return 0;
 
     int32_t rows_per_page = sas7bdat_rows_per_page(writer, hinfo);
@@ -314,6 +325,9 @@ static sas7bdat_subheader_t *sas7bdat_col_text_subheader_init(readstat_writer_t
     uint16_t used = len - (4+2*signature_len);
     memcpy(&subheader->data[signature_len], &used, sizeof(uint16_t));
     memset(&subheader->data[signature_len+12], ' ', 8);
+    /* Readers tell RDC apart from RLE by the name in the first text blob */
+    if (column_text->index == 0 && writer->compression == READSTAT_COMPRESS_BINARY)
+        memcpy(&subheader->data[signature_len+12], SAS_COMPRESSION_SIGNATURE_RDC, 8);
     memcpy(&subheader->data[signature_len+28], column_text->data, column_text->used);
     return subheader;
 }
@@ -362,7 +376,7 @@ static sas7bdat_subheader_array_t *sas7bdat_subheader_array_init(readstat_writer
 
     sarray->capacity = sarray->count;
 
-    if (writer->compression == READSTAT_COMPRESS_ROWS) {
+    if (writer->compression != READSTAT_COMPRESS_NONE && !writer->data_seeker) {
         sarray->capacity = (sarray->count + writer->row_count);
         sarray->subheaders = realloc(sarray->subheaders, 
                 sarray->capacity * sizeof(sas7bdat_subheader_t *));
@@ -395,94 +409,122 @@ static int sas7bdat_subheader_type(uint32_t signature) {
             signature == SAS_SUBHEADER_SIGNATURE_COLUMN_LIST);
 }
 
-static readstat_error_t sas7bdat_emit_meta_pages(readstat_writer_t *writer) {
-    sas7bdat_write_ctx_t *ctx = (sas7bdat_write_ctx_t *)writer->module_ctx;
+static void sas7bdat_page_reset(sas7bdat_write_ctx_t *ctx) {
     sas_header_info_t *hinfo = ctx->hinfo;
-    sas7bdat_subheader_array_t *sarray = ctx->sarray;
-    readstat_error_t retval = READSTAT_OK;
     int16_t page_type = SAS_PAGE_TYPE_META;
-    char *page = malloc(hinfo->page_size);
-    int64_t shp_written = 0;
-
-    while (sarray->count > shp_written) {
-        memset(page, 0, hinfo->page_size);
-        int16_t shp_count = 0;
-        size_t shp_data_offset = hinfo->page_size;
-        size_t shp_ptr_offset = hinfo->page_header_size;
-        size_t shp_ptr_size = hinfo->subheader_pointer_size;
-
-        memcpy(&page[hinfo->page_header_size-8], &page_type, sizeof(int16_t));
-
-        while (sarray->count > shp_written && 
-                sarray->subheaders[shp_written]->len + shp_ptr_size <
-                shp_data_offset - shp_ptr_offset) {
-            sas7bdat_subheader_t *subheader = sarray->subheaders[shp_written];
-            uint32_t signature32 = subheader->signature;
-
-            /* copy ptr */
-            if (hinfo->u64) {
-                uint64_t offset = shp_data_offset - subheader->len;
-                uint64_t len = subheader->len;
-                memcpy(&page[shp_ptr_offset], &offset, sizeof(uint64_t));
-                memcpy(&page[shp_ptr_offset+8], &len, sizeof(uint64_t));
-                if (subheader->is_row_data) {
-                    if (subheader->is_row_data_compressed) {
-                        page[shp_ptr_offset+16] = SAS_COMPRESSION_ROW;
-                    } else {
-                        page[shp_ptr_offset+16] = SAS_COMPRESSION_NONE;
-                    }
-                    page[shp_ptr_offset+17] = 1;
-                } else {
-                    page[shp_ptr_offset+17] = sas7bdat_subheader_type(subheader->signature);
-                    if (signature32 >= 0xFF000000) {
-                        int64_t signature64 = (int32_t)signature32;
-                        memcpy(&subheader->data[0], &signature64, sizeof(int64_t));
-                    } else {
-                        memcpy(&subheader->data[0], &signature32, sizeof(int32_t));
-                    }
-                }
-            } else {
-                uint32_t offset = shp_data_offset - subheader->len;
-                uint32_t len = subheader->len;
-                memcpy(&page[shp_ptr_offset], &offset, sizeof(uint32_t));
-                memcpy(&page[shp_ptr_offset+4], &len, sizeof(uint32_t));
-                if (subheader->is_row_data) {
-                    if (subheader->is_row_data_compressed) {
-                        page[shp_ptr_offset+8] = SAS_COMPRESSION_ROW;
-                    } else {
-                        page[shp_ptr_offset+8] = SAS_COMPRESSION_NONE;
-                    }
-                    page[shp_ptr_offset+9] = 1;
-                } else {
-                    page[shp_ptr_offset+9] = sas7bdat_subheader_type(subheader->signature);
-                    memcpy(&subheader->data[0], &signature32, sizeof(int32_t));
-                }
-            }
-            shp_ptr_offset += shp_ptr_size;
-
-            /* copy data */
-            shp_data_offset -= subheader->len;
-            memcpy(&page[shp_data_offset], subheader->data, subheader->len);
-
-            shp_written++;
-            shp_count++;
-        }
-        if (hinfo->u64) {
-            memcpy(&page[34], &shp_count, sizeof(int16_t));
-            memcpy(&page[36], &shp_count, sizeof(int16_t));
-        } else {
-            memcpy(&page[18], &shp_count, sizeof(int16_t));
-            memcpy(&page[20], &shp_count, sizeof(int16_t));
-        }
 
-        retval = readstat_write_bytes(writer, page, hinfo->page_size);
+    memset(ctx->page, 0, hinfo->page_size);
+    memcpy(&ctx->page[hinfo->page_header_size-8], &page_type, sizeof(int16_t));
+
+    ctx->page_shp_count = 0;
+    ctx->page_shp_ptr_offset = hinfo->page_header_size;
+    ctx->page_shp_data_offset = hinfo->page_size;
+}
+
+static readstat_error_t sas7bdat_flush_page(readstat_writer_t *writer, sas7bdat_write_ctx_t *ctx) {
+    sas_header_info_t *hinfo = ctx->hinfo;
+    readstat_error_t retval = READSTAT_OK;
+
+    if (ctx->page_shp_count == 0)
+        goto cleanup;
+
+    if (hinfo->u64) {
+        memcpy(&ctx->page[34], &ctx->page_shp_count, sizeof(int16_t));
+        memcpy(&ctx->page[36], &ctx->page_shp_count, sizeof(int16_t));
+    } else {
+        memcpy(&ctx->page[18], &ctx->page_shp_count, sizeof(int16_t));
+        memcpy(&ctx->page[20], &ctx->page_shp_count, sizeof(int16_t));
+    }
+
+    retval = readstat_write_bytes(writer, ctx->page, hinfo->page_size);
+    if (retval != READSTAT_OK)
+        goto cleanup;
+
+    ctx->pages_written++;
+    sas7bdat_page_reset(ctx);
+
+cleanup:
+    return retval;
+}
+
+/* Append a subheader to the current page, writing the page out first if the
+ * subheader won't fit */
+static readstat_error_t sas7bdat_emit_subheader_bytes(readstat_writer_t *writer, sas7bdat_write_ctx_t *ctx,
+        const char *data, size_t len, unsigned char compression, unsigned char is_compressed_data) {
+    sas_header_info_t *hinfo = ctx->hinfo;
+    readstat_error_t retval = READSTAT_OK;
+    size_t shp_ptr_size = hinfo->subheader_pointer_size;
+
+    if (len + shp_ptr_size >= ctx->page_shp_data_offset - ctx->page_shp_ptr_offset) {
+        if (ctx->page_shp_count == 0) {
+            retval = READSTAT_ERROR_ROW_WIDTH_MISMATCH;
+            goto cleanup;
+        }
+        retval = sas7bdat_flush_page(writer, ctx);
         if (retval != READSTAT_OK)
             goto cleanup;
     }
 
+    char *ptr = &ctx->page[ctx->page_shp_ptr_offset];
+    if (hinfo->u64) {
+        uint64_t offset = ctx->page_shp_data_offset - len;
+        uint64_t len64 = len;
+        memcpy(&ptr[0], &offset, sizeof(uint64_t));
+        memcpy(&ptr[8], &len64, sizeof(uint64_t));
+        ptr[16] = compression;
+        ptr[17] = is_compressed_data;
+    } else {
+        uint32_t offset = ctx->page_shp_data_offset - len;
+        uint32_t len32 = len;
+        memcpy(&ptr[0], &offset, sizeof(uint32_t));
+        memcpy(&ptr[4], &len32, sizeof(uint32_t));
+        ptr[8] = compression;
+        ptr[9] = is_compressed_data;
+    }
+    ctx->page_shp_ptr_offset += shp_ptr_size;
+
+    ctx->page_shp_data_offset -= len;
+    memcpy(&ctx->page[ctx->page_shp_data_offset], data, len);
+
+    ctx->page_shp_count++;
+
 cleanup:
-    free(page);
+    return retval;
+}
+
+static readstat_error_t sas7bdat_emit_subheader(readstat_writer_t *writer, sas7bdat_write_ctx_t *ctx,
+        sas7bdat_subheader_t *subheader) {
+    uint32_t signature32 = subheader->signature;
+
+    if (subheader->is_row_data) {
+        return sas7bdat_emit_subheader_bytes(writer, ctx, subheader->data, subheader->len,
+                subheader->is_row_data_compressed ? SAS_COMPRESSION_ROW : SAS_COMPRESSION_NONE, 1);
+    }
+
+    if (ctx->hinfo->u64 && signature32 >= 0xFF000000) {
+        int64_t signature64 = (int32_t)signature32;
+        memcpy(&subheader->data[0], &signature64, sizeof(int64_t));
+    } else {
+        memcpy(&subheader->data[0], &signature32, sizeof(int32_t));
+    }
+
+    return sas7bdat_emit_subheader_bytes(writer, ctx, subheader->data, subheader->len,
+            SAS_COMPRESSION_NONE, sas7bdat_subheader_type(subheader->signature));
+}
+
+static readstat_error_t sas7bdat_emit_meta_subheaders(readstat_writer_t *writer) {
+    sas7bdat_write_ctx_t *ctx = (sas7bdat_write_ctx_t *)writer->module_ctx;
+    sas7bdat_subheader_array_t *sarray = ctx->sarray;
+    readstat_error_t retval = READSTAT_OK;
+    int64_t i;
+
+    for (i=0; i<sarray->count; i++) {
+        retval = sas7bdat_emit_subheader(writer, ctx, sarray->subheaders[i]);
+        if (retval != READSTAT_OK)
+            goto cleanup;
+    }
 
+cleanup:
     return retval;
 }
 
@@ -492,15 +534,29 @@ static sas7bdat_write_ctx_t *sas7bdat_write_ctx_init(readstat_writer_t *writer)
     ctx->hinfo = sas_header_info_init(writer, writer->is_64bit);
     ctx->sarray = sas7bdat_subheader_array_init(writer, ctx->hinfo);
 
+    ctx->page = malloc(ctx->hinfo->page_size);
+    sas7bdat_page_reset(ctx);
+
+    if (writer->compression != READSTAT_COMPRESS_NONE) {
+        ctx->stream_rows = (writer->data_seeker != NULL);
+        ctx->row_buffer = malloc(sas7bdat_row_length(writer));
+    }
+
     return ctx;
 }
 
 static void sas7bdat_write_ctx_free(sas7bdat_write_ctx_t *ctx) {
     free(ctx->hinfo);
     sas7bdat_subheader_array_free(ctx->sarray);
+    free(ctx->page);
+    free(ctx->row_buffer);
     free(ctx);
 }
 
+static void sas7bdat_module_ctx_free(void *module_ctx) {
+    sas7bdat_write_ctx_free((sas7bdat_write_ctx_t *)module_ctx);
+}
+
 static readstat_error_t sas7bdat_emit_header_and_meta_pages(readstat_writer_t *writer) {
     sas7bdat_write_ctx_t *ctx = (sas7bdat_write_ctx_t *)writer->module_ctx;
     readstat_error_t retval = READSTAT_OK;
@@ -511,14 +567,39 @@ static readstat_error_t sas7bdat_emit_header_and_meta_pages(readstat_writer_t *w
     if (retval != READSTAT_OK)
         goto cleanup;
 
-    retval = sas7bdat_emit_meta_pages(writer);
+    retval = sas7bdat_emit_meta_subheaders(writer);
     if (retval != READSTAT_OK)
         goto cleanup;
 
+    /* When streaming, compressed rows keep filling the last meta page */
+    if (!ctx->stream_rows) {
+        retval = sas7bdat_flush_page(writer, ctx);
+        if (retval != READSTAT_OK)
+            goto cleanup;
+    }
+
 cleanup:
     return retval;
 }
 
+/* The page count in the header is only a guess until the last compressed row
+ * has been written, so go back and fix it */
+static readstat_error_t sas7bdat_patch_page_count(readstat_writer_t *writer, sas7bdat_write_ctx_t *ctx) {
+    sas_header_info_t *hinfo = ctx->hinfo;
+
+    hinfo->page_count = ctx->pages_written;
+
+    if (hinfo->u64) {
+        uint64_t page_count = hinfo->page_count;
+        return readstat_write_bytes_at(writer, hinfo->page_count_offset,
+                &page_count, sizeof(uint64_t));
+    }
+
+    uint32_t page_count = hinfo->page_count;
+    return readstat_write_bytes_at(writer, hinfo->page_count_offset,
+            &page_count, sizeof(uint32_t));
+}
+
 static readstat_error_t sas7bdat_begin_data(void *writer_ctx) {
     readstat_writer_t *writer = (readstat_writer_t *)writer_ctx;
     readstat_error_t retval = READSTAT_OK;
@@ -529,7 +610,8 @@ static readstat_error_t sas7bdat_begin_data(void *writer_ctx) {
 
     writer->module_ctx = sas7bdat_write_ctx_init(writer);
 
-    if (writer->compression == READSTAT_COMPRESS_NONE) {
+    if (writer->compression == READSTAT_COMPRESS_NONE ||
+            ((sas7bdat_write_ctx_t *)writer->module_ctx)->stream_rows) {
         retval = sas7bdat_emit_header_and_meta_pages(writer);
         if (retval != READSTAT_OK)
             goto cleanup;
@@ -551,13 +633,18 @@ static readstat_error_t sas7bdat_end_data(void *writer_ctx) {
     readstat_writer_t *writer = (readstat_writer_t *)writer_ctx;
     sas7bdat_write_ctx_t *ctx = (sas7bdat_write_ctx_t *)writer->module_ctx;
 
-    if (writer->compression == READSTAT_COMPRESS_ROWS) {
+    if (ctx->stream_rows) {
+        retval = sas7bdat_flush_page(writer, ctx);
+        if (retval == READSTAT_OK)
+            retval = sas7bdat_patch_page_count(writer, ctx);
+    } else if (writer->compression != READSTAT_COMPRESS_NONE) {
         retval = sas7bdat_emit_header_and_meta_pages(writer);
     } else {
         retval = sas_fill_page(writer, ctx->hinfo);
     }
 
     sas7bdat_write_ctx_free(ctx);
+    writer->module_ctx = NULL;
     return retval;
 }
 
@@ -659,26 +746,64 @@ cleanup:
     return retval;
 }
 
-/* We don't actually write compressed data out at this point; the file header
- * requires a page count, so instead we collect the compressed subheaders in
- * memory and write the entire file at the end, once the page count can be
- * determined.
+/* Compresses a row into ctx->row_buffer; *compressed_len is left at zero if
+ * compression wouldn't make the row any shorter */
+static readstat_error_t sas7bdat_compress_row(readstat_writer_t *writer, sas7bdat_write_ctx_t *ctx,
+        const void *bytes, size_t len, size_t *compressed_len) {
+    *compressed_len = 0;
+
+    if (writer->compression == READSTAT_COMPRESS_BINARY) {
+        *compressed_len = sas_rdc_compress(ctx->row_buffer, len - 1, bytes, len);
+        return READSTAT_OK;
+    }
+
+    size_t rle_len = sas_rle_compressed_len(bytes, len);
+    if (rle_len < len) {
+        if (sas_rle_compress(ctx->row_buffer, rle_len, bytes, len) != rle_len)
+            return READSTAT_ERROR_ROW_WIDTH_MISMATCH;
+
+        *compressed_len = rle_len;
+    }
+    return READSTAT_OK;
+}
+
+/* With a data seeker, compressed rows go straight onto the current page, and
+ * full pages are written out as we go; the page count in the header is
+ * patched in sas7bdat_end_data.
+ */
+static readstat_error_t sas7bdat_stream_row_compressed(readstat_writer_t *writer, sas7bdat_write_ctx_t *ctx,
+        void *bytes, size_t len) {
+    size_t compressed_len = 0;
+    readstat_error_t retval = sas7bdat_compress_row(writer, ctx, bytes, len, &compressed_len);
+    if (retval != READSTAT_OK)
+        return retval;
+
+    if (compressed_len) {
+        return sas7bdat_emit_subheader_bytes(writer, ctx, ctx->row_buffer, compressed_len,
+                SAS_COMPRESSION_ROW, 1);
+    }
+
+    return sas7bdat_emit_subheader_bytes(writer, ctx, bytes, len, SAS_COMPRESSION_NONE, 1);
+}
+
+/* Without a data seeker, we don't actually write compressed data out at this
+ * point; the file header requires a page count, so instead we collect the
+ * compressed subheaders in memory and write the entire file at the end, once
+ * the page count can be determined.
  */
 static readstat_error_t sas7bdat_write_row_compressed(readstat_writer_t *writer, sas7bdat_write_ctx_t *ctx,
         void *bytes, size_t len) {
-    readstat_error_t retval = READSTAT_OK;
-    size_t compressed_len = sas_rle_compressed_len(bytes, len);
+    size_t compressed_len = 0;
+    readstat_error_t retval = sas7bdat_compress_row(writer, ctx, bytes, len, &compressed_len);
+    if (retval != READSTAT_OK)
+        return retval;
 
     sas7bdat_subheader_t *subheader = NULL;
-    if (compressed_len < len) {
+    if (compressed_len) {
         subheader = sas7bdat_subheader_init(0, compressed_len);
         subheader->is_row_data = 1;
         subheader->is_row_data_compressed = 1;
-        size_t actual_len = sas_rle_compress(subheader->data, subheader->len, bytes, len);
-        if (actual_len != compressed_len) {
-            retval = READSTAT_ERROR_ROW_WIDTH_MISMATCH;
-            goto cleanup;
-        }
+        memcpy(subheader->data, ctx->row_buffer, compressed_len);
     } else {
         subheader = sas7bdat_subheader_init(0, len);
         subheader->is_row_data = 1;
@@ -687,11 +812,7 @@ static readstat_error_t sas7bdat_write_row_compressed(readstat_writer_t *writer,
 
     ctx->sarray->subheaders[ctx->sarray->count++] = subheader;
 
-cleanup:
-    if (retval != READSTAT_OK)
-        sas7bdat_subheader_free(subheader);
-
-    return retval;
+    return READSTAT_OK;
 }
 
 static readstat_error_t sas7bdat_write_row(void *writer_ctx, void *bytes, size_t len) {
@@ -701,7 +822,9 @@ static readstat_error_t sas7bdat_write_row(void *writer_ctx, void *bytes, size_t
 
     if (writer->compression == READSTAT_COMPRESS_NONE) {
         retval = sas7bdat_write_row_uncompressed(writer, ctx, bytes, len);
-    } else if (writer->compression == READSTAT_COMPRESS_ROWS) {
+    } else if (ctx->stream_rows) {
+        retval = sas7bdat_stream_row_compressed(writer, ctx, bytes, len);
+    } else {
         retval = sas7bdat_write_row_compressed(writer, ctx, bytes, len);
     }
 
@@ -711,7 +834,8 @@ static readstat_error_t sas7bdat_write_row(void *writer_ctx, void *bytes, size_t
 readstat_error_t readstat_begin_writing_sas7bdat(readstat_writer_t *writer, void *user_ctx, long row_count) {
 
     if (writer->compression != READSTAT_COMPRESS_NONE &&
-            writer->compression != READSTAT_COMPRESS_ROWS)
+            writer->compression != READSTAT_COMPRESS_ROWS &&
+            writer->compression != READSTAT_COMPRESS_BINARY)
         return READSTAT_ERROR_UNSUPPORTED_COMPRESSION;
 
     if (writer->version == 0)
@@ -732,6 +856,7 @@ readstat_error_t readstat_begin_writing_sas7bdat(readstat_writer_t *writer, void
 
     writer->callbacks.begin_data = &sas7bdat_begin_data;
     writer->callbacks.end_data = &sas7bdat_end_data;
+    writer->callbacks.module_ctx_free = &sas7bdat_module_ctx_free;
 
     writer->callbacks.write_row = &sas7bdat_write_row;
 
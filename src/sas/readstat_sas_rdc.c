@@ -0,0 +1,198 @@
+#include <sys/types.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "readstat_sas_rdc.h"
+
+/* Ross Data Compression, used by SAS for COMPRESS=BINARY. Each group of up to
+ * sixteen items is preceded by a big-endian control word; a clear bit is a
+ * literal byte, a set bit is one of the commands below. */
+
+#define SAS_RDC_COMMAND_SHORT_RLE       0
+#define SAS_RDC_COMMAND_LONG_RLE        1
+#define SAS_RDC_COMMAND_LONG_PATTERN    2
+/* 3-15: short pattern of that many bytes */
+
+#define SAS_RDC_MIN_RUN                 3
+#define SAS_RDC_MAX_SHORT_RLE          (3 + 0x0F)
+#define SAS_RDC_MAX_LONG_RLE          (19 + 0xFFF)
+#define SAS_RDC_MAX_SHORT_PATTERN      15
+#define SAS_RDC_MAX_LONG_PATTERN      (16 + 0xFF)
+#define SAS_RDC_MIN_OFFSET              3
+#define SAS_RDC_MAX_OFFSET             (3 + 0xFFF)
+
+#define SAS_RDC_HASH_SIZE            4096
+#define SAS_RDC_HASH_EMPTY           ((size_t)-1)
+
+size_t sas_rdc_decompress(void *output_buf, size_t output_len, 
+        const void *input_buf, size_t input_len) {
+    unsigned char *output = (unsigned char *)output_buf;
+    const unsigned char *input = (const unsigned char *)input_buf;
+    size_t out_pos = 0, in_pos = 0;
+    uint16_t ctrl_bits = 0, ctrl_mask = 0;
+
+    while (in_pos < input_len) {
+        ctrl_mask >>= 1;
+        if (ctrl_mask == 0) {
+            if (input_len - in_pos < 2)
+                return SAS_RDC_ERROR;
+            ctrl_bits = (input[in_pos] << 8) | input[in_pos+1];
+            ctrl_mask = 0x8000;
+            in_pos += 2;
+            if (in_pos == input_len)
+                break;
+        }
+
+        if (!(ctrl_bits & ctrl_mask)) {
+            if (out_pos == output_len)
+                return SAS_RDC_ERROR;
+            output[out_pos++] = input[in_pos++];
+            continue;
+        }
+
+        unsigned char command = input[in_pos] >> 4;
+        size_t count = input[in_pos] & 0x0F;
+        size_t offset = 0;
+        unsigned char insert_byte = '\0';
+        in_pos++;
+
+        size_t operand_len = (command == SAS_RDC_COMMAND_LONG_RLE ||
+                command == SAS_RDC_COMMAND_LONG_PATTERN) ? 2 : 1;
+        if (input_len - in_pos < operand_len)
+            return SAS_RDC_ERROR;
+
+        if (command == SAS_RDC_COMMAND_SHORT_RLE) {
+            count += 3;
+            insert_byte = input[in_pos++];
+        } else if (command == SAS_RDC_COMMAND_LONG_RLE) {
+            count += (input[in_pos++] << 4) + 19;
+            insert_byte = input[in_pos++];
+        } else if (command == SAS_RDC_COMMAND_LONG_PATTERN) {
+            offset = count + 3 + (input[in_pos++] << 4);
+            count = input[in_pos++] + 16;
+        } else {
+            offset = count + 3 + (input[in_pos++] << 4);
+            count = command;
+        }
+
+        if (count > output_len - out_pos)
+            return SAS_RDC_ERROR;
+
+        if (offset == 0) {
+            memset(&output[out_pos], insert_byte, count);
+        } else if (offset > out_pos) {
+            return SAS_RDC_ERROR;
+        } else if (offset >= count) {
+            memcpy(&output[out_pos], &output[out_pos - offset], count);
+        } else {
+            /* Overlapping patterns repeat the bytes just written */
+            size_t i;
+            for (i=0; i<count; i++) {
+                output[out_pos + i] = output[out_pos - offset + i];
+            }
+        }
+        out_pos += count;
+    }
+
+    return out_pos;
+}
+
+static size_t sas_rdc_hash(const unsigned char *bytes) {
+    return ((bytes[0] << 8) ^ (bytes[1] << 4) ^ bytes[2]) * 2654435761U >> 4;
+}
+
+/* Returns the compressed length, or 0 if the output buffer is too small */
+size_t sas_rdc_compress(void *output_buf, size_t output_len,
+        const void *input_buf, size_t input_len) {
+    unsigned char *output = (unsigned char *)output_buf;
+    const unsigned char *input = (const unsigned char *)input_buf;
+    size_t out_pos = 0, in_pos = 0;
+    size_t ctrl_pos = 0;
+    uint16_t ctrl_bits = 0;
+    int ctrl_count = 16;
+
+    /* Keep the table no larger than the row, so short rows stay cheap */
+    size_t hash[SAS_RDC_HASH_SIZE];
+    size_t hash_size = 16;
+    while (hash_size < input_len && hash_size < SAS_RDC_HASH_SIZE)
+        hash_size <<= 1;
+    memset(hash, 0xFF, hash_size * sizeof(size_t));
+
+    while (in_pos < input_len) {
+        if (ctrl_count == 16) {
+            if (out_pos) {
+                output[ctrl_pos] = ctrl_bits >> 8;
+                output[ctrl_pos+1] = ctrl_bits & 0xFF;
+            }
+            if (output_len - out_pos < 2)
+                return 0;
+            ctrl_pos = out_pos;
+            out_pos += 2;
+            ctrl_bits = 0;
+            ctrl_count = 0;
+        }
+
+        size_t max_len = input_len - in_pos;
+        size_t run = 1;
+        while (run < max_len && run < SAS_RDC_MAX_LONG_RLE && input[in_pos + run] == input[in_pos])
+            run++;
+
+        size_t match_offset = 0, match_len = 0;
+        if (run < SAS_RDC_MIN_RUN && max_len >= SAS_RDC_MIN_RUN) {
+            size_t h = sas_rdc_hash(&input[in_pos]) & (hash_size - 1);
+            size_t candidate = hash[h];
+            hash[h] = in_pos;
+            if (candidate != SAS_RDC_HASH_EMPTY &&
+                    in_pos - candidate >= SAS_RDC_MIN_OFFSET &&
+                    in_pos - candidate <= SAS_RDC_MAX_OFFSET) {
+                while (match_len < max_len && match_len < SAS_RDC_MAX_LONG_PATTERN &&
+                        input[candidate + match_len] == input[in_pos + match_len])
+                    match_len++;
+                match_offset = in_pos - candidate - SAS_RDC_MIN_OFFSET;
+            }
+        }
+
+        if (run >= SAS_RDC_MIN_RUN) {
+            if (run <= SAS_RDC_MAX_SHORT_RLE) {
+                if (output_len - out_pos < 2)
+                    return 0;
+                output[out_pos++] = (SAS_RDC_COMMAND_SHORT_RLE << 4) | (run - 3);
+            } else {
+                if (output_len - out_pos < 3)
+                    return 0;
+                output[out_pos++] = (SAS_RDC_COMMAND_LONG_RLE << 4) | ((run - 19) & 0x0F);
+                output[out_pos++] = (run - 19) >> 4;
+            }
+            output[out_pos++] = input[in_pos];
+            ctrl_bits |= 0x8000 >> ctrl_count;
+            in_pos += run;
+        } else if (match_len >= SAS_RDC_MIN_RUN) {
+            if (match_len <= SAS_RDC_MAX_SHORT_PATTERN) {
+                if (output_len - out_pos < 2)
+                    return 0;
+                output[out_pos++] = (match_len << 4) | (match_offset & 0x0F);
+                output[out_pos++] = match_offset >> 4;
+            } else {
+                if (output_len - out_pos < 3)
+                    return 0;
+                output[out_pos++] = (SAS_RDC_COMMAND_LONG_PATTERN << 4) | (match_offset & 0x0F);
+                output[out_pos++] = match_offset >> 4;
+                output[out_pos++] = match_len - 16;
+            }
+            ctrl_bits |= 0x8000 >> ctrl_count;
+            in_pos += match_len;
+        } else {
+            if (output_len - out_pos < 1)
+                return 0;
+            output[out_pos++] = input[in_pos++];
+        }
+        ctrl_count++;
+    }
+
+    if (out_pos) {
+        output[ctrl_pos] = ctrl_bits >> 8;
+        output[ctrl_pos+1] = ctrl_bits & 0xFF;
+    }
+
+    return out_pos;
+}
@@ -0,0 +1,6 @@
+
+#define SAS_RDC_ERROR ((size_t)-1)
+
+size_t sas_rdc_decompress(void *output_buf, size_t output_len, const void *input_buf, size_t input_len);
+size_t sas_rdc_compress(void *output_buf, size_t output_len,
+        const void *input_buf, size_t input_len);
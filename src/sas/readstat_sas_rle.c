@@ -2,6 +2,7 @@
 #include <sys/types.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
 
 #include "readstat_sas_rle.h"
 
@@ -19,21 +20,68 @@
 #define SAS_RLE_COMMAND_INSERT_BLANK2  14
 #define SAS_RLE_COMMAND_INSERT_ZERO2   15
 
+/* Number of operand bytes following the control byte, indexed by command */
+static const unsigned char sas_rle_operand_len[16] = {
+    [SAS_RLE_COMMAND_COPY64] = 1,
+    [SAS_RLE_COMMAND_INSERT_BYTE18] = 2,
+    [SAS_RLE_COMMAND_INSERT_AT17] = 1,
+    [SAS_RLE_COMMAND_INSERT_BLANK17] = 1,
+    [SAS_RLE_COMMAND_INSERT_ZERO17] = 1,
+    [SAS_RLE_COMMAND_INSERT_BYTE3] = 1
+};
+
+#define SAS_RLE_WORD_LEN    8
+#define SAS_RLE_SHORT_RUN  32
+
+/* Short runs are written a whole word at a time when the buffers have enough
+ * slack; the extra bytes land inside the output and are overwritten by the
+ * runs that follow. */
+static void sas_rle_copy(unsigned char *output, size_t output_left,
+        const unsigned char *input, size_t input_left, size_t copy_len) {
+    if (copy_len <= SAS_RLE_SHORT_RUN &&
+            output_left >= SAS_RLE_SHORT_RUN && input_left >= SAS_RLE_SHORT_RUN) {
+        size_t i;
+        for (i=0; i<copy_len; i+=SAS_RLE_WORD_LEN) {
+            memcpy(&output[i], &input[i], SAS_RLE_WORD_LEN);
+        }
+    } else {
+        memcpy(output, input, copy_len);
+    }
+}
+
+static void sas_rle_insert(unsigned char *output, size_t output_left,
+        unsigned char insert_byte, size_t insert_len) {
+    if (insert_len <= SAS_RLE_SHORT_RUN && output_left >= SAS_RLE_SHORT_RUN) {
+        uint64_t pattern = insert_byte * 0x0101010101010101ULL;
+        size_t i;
+        for (i=0; i<insert_len; i+=SAS_RLE_WORD_LEN) {
+            memcpy(&output[i], &pattern, SAS_RLE_WORD_LEN);
+        }
+    } else {
+        memset(output, insert_byte, insert_len);
+    }
+}
+
+/* Returns the number of bytes written, or SAS_RLE_ERROR if the input is
+ * truncated or would overflow the output buffer */
 size_t sas_rle_decompress(void *output_buf, size_t output_len, 
         const void *input_buf, size_t input_len) {
-    /* TODO bounds checking */
     unsigned char *buffer = (unsigned char *)output_buf;
     unsigned char *output = buffer;
+    unsigned char *output_end = buffer + output_len;
 
     const unsigned char *input = (const unsigned char *)input_buf;
+    const unsigned char *input_end = input + input_len;
 
-    while (input < (const unsigned char *)input_buf + input_len) {
+    while (input < input_end) {
         unsigned char control = *input++;
         unsigned char command = (control & 0xF0) >> 4;
         unsigned char length = (control & 0x0F);
-        int copy_len = 0;
-        int insert_len = 0;
+        size_t copy_len = 0;
+        size_t insert_len = 0;
         unsigned char insert_byte = '\0';
+        if (input_end - input < sas_rle_operand_len[command])
+            return SAS_RLE_ERROR;
         switch (command) {
             case SAS_RLE_COMMAND_COPY64:
                 copy_len = (*input++) + 64 + length * 256;
@@ -79,12 +127,16 @@ size_t sas_rle_decompress(void *output_buf, size_t output_len,
                 break;
         }
         if (copy_len) {
-            memcpy(output, input, copy_len);
+            if (copy_len > input_end - input || copy_len > output_end - output)
+                return SAS_RLE_ERROR;
+            sas_rle_copy(output, output_end - output, input, input_end - input, copy_len);
             input += copy_len;
             output += copy_len;
         }
         if (insert_len) {
-            memset(output, insert_byte, insert_len);
+            if (insert_len > output_end - output)
+                return SAS_RLE_ERROR;
+            sas_rle_insert(output, output_end - output, insert_byte, insert_len);
             output += insert_len;
         }
     }
@@ -127,7 +179,7 @@ size_t sas_rle_compressed_len(const void *bytes, size_t len) {
     const unsigned char *pe = (const unsigned char *)bytes + len;
     size_t copy_run = 0;
     size_t insert_run = 0;
-    char last_byte = 0;
+    unsigned char last_byte = 0;
     size_t rle_len = 0;
     while (p < pe) {
         unsigned char c = *p;
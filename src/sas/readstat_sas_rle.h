@@ -1,4 +1,6 @@
 
+#define SAS_RLE_ERROR ((size_t)-1)
+
 size_t sas_rle_decompress(void *output_buf, size_t output_len, const void *input_buf, size_t input_len);
 size_t sas_rle_compress(void *output_buf, size_t output_len,
         const void *input_buf, size_t input_len);
@@ -8,6 +8,9 @@
 #include "../readstat.h"
 #include "../readstat_iconv.h"
 #include "../readstat_convert.h"
+#include "../readstat_batch.h"
+#include "../readstat_pool.h"
+#include "../readstat_strings.h"
 #include "readstat_sas.h"
 #include "readstat_xport.h"
 #include "ieee.h"
@@ -19,23 +22,30 @@ typedef struct xport_ctx_s {
     readstat_metadata_handler       metadata_handler;
     readstat_note_handler           note_handler;
     readstat_variable_handler       variable_handler;
+    readstat_column_filter          column_filter;
     readstat_fweight_handler        fweight_handler;
     readstat_value_handler          value_handler;
     readstat_value_label_handler    value_label_handler;
     readstat_error_handler          error_handler;
     readstat_progress_handler       progress_handler;
+    readstat_batch_t               *batch;
     size_t                          file_size;
     void                           *user_ctx;
 
     readstat_io_t *io;
+    readstat_pool_t *pool;
     time_t         timestamp;
 
     int            obs_count;
     int            var_count;
     int            row_limit;
+    int            row_offset;
     size_t         row_length;
     int            parsed_row_count;
 
+    char          *string_buffer;
+    size_t         string_buffer_len;
+
     readstat_variable_t **variables;
 
     int            version;
@@ -60,6 +70,8 @@ static void xport_ctx_free(xport_ctx_t *ctx) {
         }
         free(ctx->variables);
     }
+    if (ctx->batch)
+        readstat_batch_free(ctx->batch);
 
     free(ctx);
 }
@@ -271,6 +283,37 @@ static readstat_error_t xport_construct_format(char *dst, size_t dst_len,
     return retval;
 }
 
+static readstat_error_t xport_intern_string(xport_ctx_t *ctx, const char **dst,
+        const char *string, size_t len) {
+    const char *interned = readstat_string_pool_intern(ctx->pool->strings, string, len);
+    if (interned == NULL)
+        return READSTAT_ERROR_MALLOC;
+
+    *dst = interned;
+    return READSTAT_OK;
+}
+
+static readstat_error_t xport_convert_string(xport_ctx_t *ctx, const char **dst, size_t dst_len,
+        const char *src, size_t src_len) {
+    char buffer[dst_len];
+    readstat_error_t retval = readstat_convert(buffer, sizeof(buffer), src, src_len, NULL);
+    if (retval != READSTAT_OK)
+        return retval;
+
+    return xport_intern_string(ctx, dst, buffer, sizeof(buffer));
+}
+
+static readstat_error_t xport_convert_format(xport_ctx_t *ctx, readstat_variable_t *variable,
+        const char *src, size_t src_len) {
+    char buffer[READSTAT_VARIABLE_FORMAT_LEN];
+    readstat_error_t retval = xport_construct_format(buffer, sizeof(buffer),
+            src, src_len, variable->display_width, variable->decimals);
+    if (retval != READSTAT_OK)
+        return retval;
+
+    return xport_intern_string(ctx, &variable->format, buffer, sizeof(buffer));
+}
+
 static readstat_error_t xport_read_labels_v8(xport_ctx_t *ctx, int label_count) {
     readstat_error_t retval = READSTAT_OK;
     uint16_t labeldef[3];
@@ -307,13 +350,13 @@ static readstat_error_t xport_read_labels_v8(xport_ctx_t *ctx, int label_count)
             goto cleanup;
         }
 
-        retval = readstat_convert(variable->name, sizeof(variable->name),
-                name, name_len,  NULL);
+        retval = xport_convert_string(ctx, &variable->name, READSTAT_VARIABLE_NAME_LEN,
+                name, name_len);
         if (retval != READSTAT_OK)
             goto cleanup;
 
-        retval = readstat_convert(variable->label, sizeof(variable->label),
-                label, label_len,  NULL);
+        retval = xport_convert_string(ctx, &variable->label, READSTAT_VARIABLE_LABEL_LEN,
+                label, label_len);
         if (retval != READSTAT_OK)
             goto cleanup;
     }
@@ -375,18 +418,17 @@ static readstat_error_t xport_read_labels_v9(xport_ctx_t *ctx, int label_count)
             goto cleanup;
         }
 
-        retval = readstat_convert(variable->name, sizeof(variable->name),
-                name, name_len,  NULL);
+        retval = xport_convert_string(ctx, &variable->name, READSTAT_VARIABLE_NAME_LEN,
+                name, name_len);
         if (retval != READSTAT_OK)
             goto cleanup;
 
-        retval = readstat_convert(variable->label, sizeof(variable->label),
-                label, label_len,  NULL);
+        retval = xport_convert_string(ctx, &variable->label, READSTAT_VARIABLE_LABEL_LEN,
+                label, label_len);
         if (retval != READSTAT_OK)
             goto cleanup;
 
-        retval = xport_construct_format(variable->format, sizeof(variable->format),
-                format, format_len, variable->display_width, variable->decimals);
+        retval = xport_convert_format(ctx, variable, format, format_len);
         if (retval != READSTAT_OK)
             goto cleanup;
     }
@@ -416,6 +458,11 @@ static readstat_error_t xport_read_variables(xport_ctx_t *ctx) {
         xport_namestr_bswap(&namestr);
 
         readstat_variable_t *variable = calloc(1, sizeof(readstat_variable_t));
+        if (variable == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+        ctx->variables[i] = variable;
 
         variable->index = i;
         variable->type = namestr.ntype == SAS_COLUMN_TYPE_CHR ? READSTAT_TYPE_STRING : READSTAT_TYPE_DOUBLE;
@@ -423,24 +470,21 @@ static readstat_error_t xport_read_variables(xport_ctx_t *ctx) {
         variable->display_width = namestr.nfl;
         variable->decimals = namestr.nfd;
         variable->alignment = namestr.nfj ? READSTAT_ALIGNMENT_RIGHT : READSTAT_ALIGNMENT_LEFT;
+        variable->strings = ctx->pool->strings;
 
-        readstat_convert(variable->name, sizeof(variable->name),
-                namestr.nname, sizeof(namestr.nname), NULL);
+        retval = xport_convert_string(ctx, &variable->name, READSTAT_VARIABLE_NAME_LEN,
+                namestr.nname, sizeof(namestr.nname));
         if (retval != READSTAT_OK)
             goto cleanup;
 
-        readstat_convert(variable->label, sizeof(variable->label),
-                namestr.nlabel, sizeof(namestr.nlabel), NULL);
+        retval = xport_convert_string(ctx, &variable->label, READSTAT_VARIABLE_LABEL_LEN,
+                namestr.nlabel, sizeof(namestr.nlabel));
         if (retval != READSTAT_OK)
             goto cleanup;
 
-        xport_construct_format(variable->format, sizeof(variable->format),
-                namestr.nform, sizeof(namestr.nform),
-                variable->display_width, variable->decimals);
+        retval = xport_convert_format(ctx, variable, namestr.nform, sizeof(namestr.nform));
         if (retval != READSTAT_OK)
             goto cleanup;
-
-        ctx->variables[i] = variable;
     }
 
     retval = xport_skip_rest_of_record(ctx);
@@ -472,6 +516,9 @@ static readstat_error_t xport_read_variables(xport_ctx_t *ctx) {
 
     for (i=0; i<ctx->var_count; i++) {
         readstat_variable_t *variable = ctx->variables[i];
+        if (ctx->column_filter) {
+            variable->skip = !ctx->column_filter(i, variable, ctx->user_ctx);
+        }
         if (ctx->variable_handler) {
             if (ctx->variable_handler(i, variable, variable->format, ctx->user_ctx)) {
                 retval = READSTAT_ERROR_USER_ABORT;
@@ -490,19 +537,22 @@ static readstat_error_t xport_process_row(xport_ctx_t *ctx, const char *row, siz
     readstat_error_t retval = READSTAT_OK;
     int i;
     off_t pos = 0;
-    char *string = NULL;
     for (i=0; i<ctx->var_count; i++) {
         readstat_variable_t *variable = ctx->variables[i];
         readstat_value_t value = { .type = variable->type };
 
+        if (variable->skip) {
+            pos += variable->storage_width;
+            continue;
+        }
+
         if (variable->type == READSTAT_TYPE_STRING) {
-            string = realloc(string, 4*variable->storage_width+1);
-            retval = readstat_convert(string, 4*variable->storage_width+1,
+            retval = readstat_convert(ctx->string_buffer, ctx->string_buffer_len,
                     &row[pos], variable->storage_width, NULL);
             if (retval != READSTAT_OK)
                 goto cleanup;
 
-            value.v.string_value = string;
+            value.v.string_value = ctx->string_buffer;
         } else {
             double dval = NAN;
             if (variable->storage_width <= XPORT_MAX_DOUBLE_SIZE &&
@@ -518,11 +568,7 @@ static readstat_error_t xport_process_row(xport_ctx_t *ctx, const char *row, siz
                     }
                 } else {
                     memcpy(full_value, &row[pos], variable->storage_width);
-                    int rc = cnxptiee(full_value, CN_TYPE_XPORT, &dval, CN_TYPE_NATIVE);
-                    if (rc != 0) {
-                        retval = READSTAT_ERROR_CONVERT;
-                        goto cleanup;
-                    }
+                    xpt2ieee_n((unsigned char *)full_value, &dval, 1);
                 }
             }
 
@@ -530,14 +576,19 @@ static readstat_error_t xport_process_row(xport_ctx_t *ctx, const char *row, siz
         }
         pos += variable->storage_width;
 
-        if (ctx->value_handler(ctx->parsed_row_count, variable, value, ctx->user_ctx)) {
+        if (ctx->batch) {
+            if ((retval = readstat_batch_push_value(ctx->batch, i, value)) != READSTAT_OK)
+                goto cleanup;
+        } else if (ctx->value_handler(ctx->parsed_row_count, variable, value, ctx->user_ctx)) {
             retval = READSTAT_ERROR_USER_ABORT;
             goto cleanup;
         }
     }
 
+    if (ctx->batch)
+        retval = readstat_batch_end_row(ctx->batch);
+
 cleanup:
-    free(string);
     return retval;
 }
 
@@ -545,14 +596,45 @@ static readstat_error_t xport_read_data(xport_ctx_t *ctx) {
     if (!ctx->row_length)
         return READSTAT_OK;
 
-    if (!ctx->value_handler)
+    if (!ctx->value_handler && !ctx->batch)
         return READSTAT_OK;
 
     readstat_error_t retval = READSTAT_OK;
-    char *row = malloc(ctx->row_length);
-    char *blank_row = malloc(ctx->row_length);
-    memset(blank_row, ' ', ctx->row_length);
+    size_t max_width = 0;
     int num_blank_rows = 0;
+    int i;
+
+    for (i=0; i<ctx->var_count; i++) {
+        if (ctx->variables[i]->storage_width > max_width)
+            max_width = ctx->variables[i]->storage_width;
+    }
+
+    ctx->string_buffer_len = 4*max_width+1;
+    ctx->string_buffer = readstat_pool_get(ctx->pool, READSTAT_POOL_STRING_UTF8, ctx->string_buffer_len);
+    char *row = readstat_pool_get(ctx->pool, READSTAT_POOL_ROW, ctx->row_length);
+    char *blank_row = readstat_pool_get(ctx->pool, READSTAT_POOL_ROW_AUX, ctx->row_length);
+    if (ctx->string_buffer == NULL || row == NULL || blank_row == NULL)
+        return READSTAT_ERROR_MALLOC;
+
+    memset(blank_row, ' ', ctx->row_length);
+
+    if (ctx->row_offset) {
+        readstat_io_t *io = ctx->io;
+        readstat_off_t pos = io->seek(0, READSTAT_SEEK_CUR, io->io_ctx);
+        if (pos == -1) {
+            retval = READSTAT_ERROR_SEEK;
+            goto cleanup;
+        }
+        /* The row count isn't stored, so an offset past the last row is
+         * only noticed here */
+        if (pos + (readstat_off_t)ctx->row_length * ctx->row_offset >= ctx->file_size)
+            goto cleanup;
+        if (io->seek(ctx->row_length * ctx->row_offset, READSTAT_SEEK_CUR, io->io_ctx) == -1) {
+            retval = READSTAT_ERROR_SEEK;
+            goto cleanup;
+        }
+    }
+
     while (1) {
         ssize_t bytes_read = read_bytes(ctx, row, ctx->row_length);
         if (bytes_read == -1) {
@@ -602,7 +684,6 @@ static readstat_error_t xport_read_data(xport_ctx_t *ctx) {
     }
 
 cleanup:
-    free(row);
     return retval;
 }
 
@@ -615,13 +696,17 @@ readstat_error_t readstat_parse_xport(readstat_parser_t *parser, const char *pat
     ctx->metadata_handler = parser->metadata_handler;
     ctx->note_handler = parser->note_handler;
     ctx->variable_handler = parser->variable_handler;
+    ctx->column_filter = parser->column_filter;
     ctx->value_handler = parser->value_handler;
     ctx->value_label_handler = parser->value_label_handler;
     ctx->error_handler = parser->error_handler;
     ctx->progress_handler = parser->progress_handler;
     ctx->user_ctx = user_ctx;
     ctx->io = io;
+    ctx->pool = parser->pool;
+    readstat_string_pool_clear(ctx->pool->strings);
     ctx->row_limit = parser->row_limit;
+    ctx->row_offset = parser->row_offset > 0 ? parser->row_offset : 0;
 
     if (io->open(path, io->io_ctx) == -1) {
         retval = READSTAT_ERROR_OPEN;
@@ -674,12 +759,35 @@ readstat_error_t readstat_parse_xport(readstat_parser_t *parser, const char *pat
     if (retval != READSTAT_OK)
         goto cleanup;
 
+    if (parser->batch_handler) {
+        if ((ctx->batch = readstat_batch_init(parser->batch_handler, parser->batch_size,
+                        ctx->var_count, user_ctx)) == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+        int i;
+        for (i=0; i<ctx->var_count; i++) {
+            readstat_variable_t *variable = ctx->variables[i];
+            if (variable->skip)
+                continue;
+            retval = readstat_batch_set_column(ctx->batch, i, variable, variable->type);
+            if (retval != READSTAT_OK)
+                goto cleanup;
+        }
+    }
+
     if (ctx->row_length) {
         retval = xport_read_data(ctx);
         if (retval != READSTAT_OK)
             goto cleanup;
     }
 
+    if (ctx->batch) {
+        retval = readstat_batch_flush(ctx->batch);
+        if (retval != READSTAT_OK)
+            goto cleanup;
+    }
+
 cleanup:
     io->close(io->io_ctx);
     xport_ctx_free(ctx);
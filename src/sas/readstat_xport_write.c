@@ -332,9 +332,14 @@ static readstat_error_t xport_write_obs_header_record(readstat_writer_t *writer)
 
 static readstat_error_t xport_begin_data(void *writer_ctx) {
     readstat_writer_t *writer = (readstat_writer_t *)writer_ctx;
-    struct tm *ts = localtime(&writer->timestamp);
+    struct tm local_time;
+    struct tm *ts = &local_time;
     readstat_error_t retval = READSTAT_OK;
     char timestamp[17];
+
+    if ((retval = readstat_writer_local_time(writer, &local_time)) != READSTAT_OK)
+        return retval;
+
     snprintf(timestamp, sizeof(timestamp),
             "%02d"       "%3s"              "%02d"             ":%02d:%02d:%02d",
             ts->tm_mday, _xport_months[ts->tm_mon], ts->tm_year % 100, ts->tm_hour, ts->tm_min, ts->tm_sec);
@@ -402,11 +407,9 @@ static readstat_error_t xport_write_row(void *writer_ctx, void *row, size_t row_
 }
 
 static readstat_error_t xport_write_double(void *row, const readstat_variable_t *var, double value) {
-    char full_value[8];
-    int rc = cnxptiee(&value, CN_TYPE_NATIVE, full_value, CN_TYPE_XPORT);
+    unsigned char full_value[8];
 
-    if (rc)
-        return READSTAT_ERROR_CONVERT;
+    ieee2xpt_n(&value, full_value, 1);
 
     memcpy(row, full_value, var->storage_width);
 
@@ -4,6 +4,7 @@
 #include "../readstat.h"
 #include "../CKHashTable.h"
 #include "../readstat_convert.h"
+#include "../readstat_batch.h"
 
 #include "readstat_spss.h"
 #include "readstat_por.h"
@@ -74,8 +75,6 @@ por_ctx_t *por_ctx_init() {
 }
 
 void por_ctx_free(por_ctx_t *ctx) {
-    if (ctx->string_buffer)
-        free(ctx->string_buffer);
     if (ctx->varinfo) {
         int i;
         for (i=0; i<ctx->var_count; i++) {
@@ -94,8 +93,8 @@ void por_ctx_free(por_ctx_t *ctx) {
     }
     if (ctx->var_dict)
         ck_hash_table_free(ctx->var_dict);
-    if (ctx->converter)
-        iconv_close(ctx->converter);
+    if (ctx->batch)
+        readstat_batch_free(ctx->batch);
     free(ctx);
 }
 
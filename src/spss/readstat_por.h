@@ -1,4 +1,6 @@
 
+#define POR_BUFFER_SIZE 65536
+
 extern int8_t   por_ascii_lookup[256];
 extern uint16_t por_unicode_lookup[256];
 
@@ -6,17 +8,23 @@ typedef struct por_ctx_s {
     readstat_info_handler           info_handler;
     readstat_metadata_handler       metadata_handler;
     readstat_variable_handler       variable_handler;
+    readstat_column_filter          column_filter;
     readstat_note_handler           note_handler;
     readstat_fweight_handler        fweight_handler;
     readstat_value_handler          value_handler;
     readstat_value_label_handler    value_label_handler;
     readstat_error_handler          error_handler;
     readstat_progress_handler       progress_handler;
+    struct readstat_batch_s        *batch;
+    struct readstat_pool_s         *pool;
     size_t                          file_size;
     void                           *user_ctx;
 
     int            pos;
     readstat_io_t *io;
+    size_t         buf_used;
+    size_t         buf_pos;
+    char           buf[POR_BUFFER_SIZE];
     char           space;
     long           num_spaces;
     time_t         timestamp;
@@ -25,6 +33,7 @@ typedef struct por_ctx_s {
     uint16_t       byte2unicode[256];
     size_t         base30_precision;
     iconv_t        converter;
+    int            converter_preserves_ascii;
     unsigned char *string_buffer;
     size_t         string_buffer_len;
     int            labels_offset;
@@ -32,6 +41,8 @@ typedef struct por_ctx_s {
     int            var_count;
     int            var_offset;
     int            row_limit;
+    int            row_offset;
+    int            skipped_row_count;
     readstat_variable_t **variables;
     spss_varinfo_t *varinfo;
     ck_hash_table_t *var_dict;
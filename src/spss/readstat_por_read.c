@@ -13,6 +13,9 @@
 #include "../readstat.h"
 #include "../readstat_iconv.h"
 #include "../readstat_convert.h"
+#include "../readstat_batch.h"
+#include "../readstat_pool.h"
+#include "../readstat_strings.h"
 #include "../CKHashTable.h"
 
 #include "readstat_por_parse.h"
@@ -30,38 +33,85 @@ static readstat_error_t por_update_progress(por_ctx_t *ctx) {
     return io->update(ctx->file_size, ctx->progress_handler, ctx->user_ctx, io->io_ctx);
 }
 
+static ssize_t por_fill_buffer(por_ctx_t *ctx) {
+    readstat_io_t *io = ctx->io;
+    ssize_t bytes_read = io->read(ctx->buf, sizeof(ctx->buf), io->io_ctx);
+    if (bytes_read > 0) {
+        ctx->buf_used = bytes_read;
+        ctx->buf_pos = 0;
+    }
+    return bytes_read;
+}
+
+static ssize_t por_read_raw_byte(por_ctx_t *ctx, char *byte) {
+    if (ctx->buf_pos == ctx->buf_used) {
+        ssize_t bytes_read = por_fill_buffer(ctx);
+        if (bytes_read <= 0)
+            return bytes_read;
+    }
+    *byte = ctx->buf[ctx->buf_pos++];
+    return 1;
+}
+
+/* Reads len bytes of logical content, i.e. with the line breaks removed and
+ * short lines padded with spaces out to POR_LINE_LENGTH. The file is read in
+ * POR_BUFFER_SIZE blocks, and runs of bytes between line breaks are copied
+ * out at once. */
 static ssize_t read_bytes(por_ctx_t *ctx, void *dst, size_t len) {
     char *dst_pos = (char *)dst;
-    readstat_io_t *io = ctx->io;
-    char byte;
+    char *dst_end = (char *)dst + len;
 
-    while (dst_pos < (char *)dst + len) {
+    while (dst_pos < dst_end) {
         if (ctx->num_spaces) {
-            *dst_pos++ = ctx->space;
-            ctx->num_spaces--;
+            size_t count = dst_end - dst_pos;
+            if (count > ctx->num_spaces)
+                count = ctx->num_spaces;
+            memset(dst_pos, ctx->space, count);
+            dst_pos += count;
+            ctx->num_spaces -= count;
             continue;
         }
-        ssize_t bytes_read = io->read(&byte, 1, io->io_ctx);
-        if (bytes_read == 0) {
-            break;
+        if (ctx->buf_pos == ctx->buf_used) {
+            ssize_t bytes_read = por_fill_buffer(ctx);
+            if (bytes_read == 0) {
+                break;
+            }
+            if (bytes_read == -1) {
+                return -1;
+            }
         }
-        if (bytes_read == -1) {
+        const char *src = &ctx->buf[ctx->buf_pos];
+        size_t count = ctx->buf_used - ctx->buf_pos;
+        size_t run = 0;
+        if (count > dst_end - dst_pos)
+            count = dst_end - dst_pos;
+
+        while (run < count && src[run] != '\r' && src[run] != '\n')
+            run++;
+
+        if (run > POR_LINE_LENGTH - ctx->pos) {
+            size_t line_left = POR_LINE_LENGTH - ctx->pos;
+            memcpy(dst_pos, src, line_left);
+            ctx->buf_pos += line_left;
+            ctx->pos = POR_LINE_LENGTH;
             return -1;
         }
-        if (byte == '\r' || byte == '\n') {
+
+        memcpy(dst_pos, src, run);
+        dst_pos += run;
+        ctx->buf_pos += run;
+        ctx->pos += run;
+
+        if (run < count) {
+            char byte = ctx->buf[ctx->buf_pos++];
             if (byte == '\r') {
-                bytes_read = io->read(&byte, 1, io->io_ctx);
+                ssize_t bytes_read = por_read_raw_byte(ctx, &byte);
                 if (bytes_read == 0 || bytes_read == -1 || byte != '\n')
                     return -1;
             }
             ctx->num_spaces = POR_LINE_LENGTH - ctx->pos;
             ctx->pos = 0;
-            continue;
-        } else if (ctx->pos == POR_LINE_LENGTH) {
-            return -1;
         }
-        *dst_pos++ = byte;
-        ctx->pos++;
     }
     
     return (int)(dst_pos - (char *)dst);
@@ -187,7 +237,11 @@ static readstat_error_t maybe_read_string(por_ctx_t *ctx, char *data, size_t len
     
     if (string_length > ctx->string_buffer_len) {
         ctx->string_buffer_len = string_length;
-        ctx->string_buffer = realloc(ctx->string_buffer, ctx->string_buffer_len);
+        ctx->string_buffer = readstat_pool_get(ctx->pool, READSTAT_POOL_STRING, ctx->string_buffer_len);
+        if (ctx->string_buffer == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
     }
     
     if (read_bytes(ctx, ctx->string_buffer, string_length) == -1) {
@@ -477,7 +531,12 @@ static readstat_error_t read_value_label_record(por_ctx_t *ctx) {
             }
             value.v.double_value = dval;
         }
-        ctx->value_label_handler(label_name_buf, value, label_buf, ctx->user_ctx);
+        if (ctx->value_label_handler) {
+            if (ctx->value_label_handler(label_name_buf, value, label_buf, ctx->user_ctx)) {
+                retval = READSTAT_ERROR_USER_ABORT;
+                goto cleanup;
+            }
+        }
     }
     ctx->labels_offset++;
 
@@ -495,11 +554,21 @@ static readstat_error_t read_por_file_data(por_ctx_t *ctx) {
     if (ctx->var_count == 0)
         return READSTAT_OK;
 
+    /* Size the string buffer for data values up front, so rows don't grow it */
+    if (ctx->string_buffer_len < sizeof(input_string)) {
+        ctx->string_buffer_len = sizeof(input_string);
+        ctx->string_buffer = readstat_pool_get(ctx->pool, READSTAT_POOL_STRING, ctx->string_buffer_len);
+        if (ctx->string_buffer == NULL)
+            return READSTAT_ERROR_MALLOC;
+    }
+
     while (1) {
         int finished = 0;
+        int skip_row = (ctx->skipped_row_count < ctx->row_offset);
         for (i=0; i<ctx->var_count; i++) {
             spss_varinfo_t *info = &ctx->varinfo[i];
             readstat_value_t value = { .type = info->type };
+            int skip = skip_row || ctx->variables[i]->skip;
 
             if (info->type == READSTAT_TYPE_STRING) {
                 rs_retval = maybe_read_string(ctx, input_string, sizeof(input_string), &finished);
@@ -515,8 +584,10 @@ static readstat_error_t read_por_file_data(por_ctx_t *ctx) {
                         rs_retval = READSTAT_ERROR_PARSE;
                     goto cleanup;
                 }
-                rs_retval = readstat_convert(output_string, sizeof(output_string),
-                        input_string, strlen(input_string), ctx->converter);
+                if (skip)
+                    continue;
+                rs_retval = readstat_convert_fast(output_string, sizeof(output_string),
+                        input_string, strlen(input_string), ctx->converter, ctx->converter_preserves_ascii);
                 if (rs_retval != READSTAT_OK) {
                     goto cleanup;
                 }
@@ -537,7 +608,13 @@ static readstat_error_t read_por_file_data(por_ctx_t *ctx) {
                 }
                 value.is_system_missing = isnan(value.v.double_value);
             }
-            if (ctx->value_handler) {
+            if (skip)
+                continue;
+            if (ctx->batch) {
+                rs_retval = readstat_batch_push_value(ctx->batch, i, value);
+                if (rs_retval != READSTAT_OK)
+                    goto cleanup;
+            } else if (ctx->value_handler) {
                 if (ctx->value_handler(ctx->obs_count, ctx->variables[i], value, ctx->user_ctx)) {
                     rs_retval = READSTAT_ERROR_USER_ABORT;
                     goto cleanup;
@@ -545,6 +622,15 @@ static readstat_error_t read_por_file_data(por_ctx_t *ctx) {
             }
 
         }
+        if (skip_row) {
+            ctx->skipped_row_count++;
+            continue;
+        }
+        if (ctx->batch) {
+            rs_retval = readstat_batch_end_row(ctx->batch);
+            if (rs_retval != READSTAT_OK)
+                goto cleanup;
+        }
         ctx->obs_count++;
 
         rs_retval = por_update_progress(ctx);
@@ -593,6 +679,20 @@ cleanup:
     return retval;
 }
 
+static readstat_error_t set_batch_columns(por_ctx_t *ctx) {
+    readstat_error_t retval = READSTAT_OK;
+    int i;
+    for (i=0; i<ctx->var_count; i++) {
+        readstat_variable_t *variable = ctx->variables[i];
+        if (variable->skip)
+            continue;
+        retval = readstat_batch_set_column(ctx->batch, i, variable, ctx->varinfo[i].type);
+        if (retval != READSTAT_OK)
+            break;
+    }
+    return retval;
+}
+
 readstat_error_t handle_variables(por_ctx_t *ctx) {
     readstat_error_t retval = READSTAT_OK;
     int i;
@@ -601,7 +701,13 @@ readstat_error_t handle_variables(por_ctx_t *ctx) {
         spss_varinfo_t *info = &ctx->varinfo[i];
         info->index = i;
 
-        ctx->variables[i] = spss_init_variable_for_info(info);
+        if ((ctx->variables[i] = spss_init_variable_for_info(info, ctx->pool->strings)) == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+
+        if (ctx->column_filter)
+            ctx->variables[i]->skip = !ctx->column_filter(i, ctx->variables[i], ctx->user_ctx);
 
         snprintf(label_name_buf, sizeof(label_name_buf), POR_LABEL_NAME_PREFIX "%d", info->labels_index);
 
@@ -649,17 +755,21 @@ readstat_error_t readstat_parse_por(readstat_parser_t *parser, const char *path,
     ctx->note_handler = parser->note_handler;
     ctx->fweight_handler = parser->fweight_handler;
     ctx->variable_handler = parser->variable_handler;
+    ctx->column_filter = parser->column_filter;
     ctx->value_handler = parser->value_handler;
     ctx->value_label_handler = parser->value_label_handler;
     ctx->error_handler = parser->error_handler;
     ctx->progress_handler = parser->progress_handler;
     ctx->user_ctx = user_ctx;
     ctx->io = io;
+    ctx->pool = parser->pool;
+    readstat_string_pool_clear(ctx->pool->strings);
     ctx->row_limit = parser->row_limit;
+    ctx->row_offset = parser->row_offset > 0 ? parser->row_offset : 0;
 
     if (parser->output_encoding) {
         if (strcmp(parser->output_encoding, "UTF-8") != 0)
-            ctx->converter = iconv_open(parser->output_encoding, "UTF-8");
+            ctx->converter = readstat_pool_converter(ctx->pool, parser->output_encoding, "UTF-8");
 
         if (ctx->converter == (iconv_t)-1) {
             ctx->converter = NULL;
@@ -667,6 +777,7 @@ readstat_error_t readstat_parse_por(readstat_parser_t *parser, const char *path,
             goto cleanup;
         }
     }
+    ctx->converter_preserves_ascii = readstat_converter_preserves_ascii(ctx->converter);
     
     if (io->open(path, io->io_ctx) == -1) {
         retval = READSTAT_ERROR_OPEN;
@@ -797,7 +908,17 @@ readstat_error_t readstat_parse_por(readstat_parser_t *parser, const char *path,
                 if (retval != READSTAT_OK)
                     goto cleanup;
 
-                if (ctx->value_handler) {
+                if (parser->batch_handler) {
+                    if ((ctx->batch = readstat_batch_init(parser->batch_handler, parser->batch_size,
+                        ctx->var_count, user_ctx)) == NULL) {
+                        retval = READSTAT_ERROR_MALLOC;
+                        goto cleanup;
+                    }
+                    if ((retval = set_batch_columns(ctx)) != READSTAT_OK)
+                        goto cleanup;
+                    if ((retval = read_por_file_data(ctx)) == READSTAT_OK)
+                        retval = readstat_batch_flush(ctx->batch);
+                } else if (ctx->value_handler) {
                     retval = read_por_file_data(ctx);
                 }
                 goto cleanup;
@@ -183,6 +183,10 @@ static void por_write_ctx_free(por_write_ctx_t *ctx) {
     free(ctx);
 }
 
+static void por_module_ctx_free(void *module_ctx) {
+    por_write_ctx_free((por_write_ctx_t *)module_ctx);
+}
+
 static readstat_error_t por_emit_header(readstat_writer_t *writer, por_write_ctx_t *ctx) {
     readstat_error_t retval = READSTAT_OK;
 
@@ -218,7 +222,11 @@ cleanup:
 static readstat_error_t por_emit_version_and_timestamp(readstat_writer_t *writer,
         por_write_ctx_t *ctx) {
     readstat_error_t retval = READSTAT_OK;
-    struct tm *timestamp = localtime(&writer->timestamp);
+    struct tm local_time;
+    struct tm *timestamp = &local_time;
+
+    if ((retval = readstat_writer_local_time(writer, &local_time)) != READSTAT_OK)
+        goto cleanup;
 
     if ((retval = por_write_tag(writer, ctx, 'A')) != READSTAT_OK)
         goto cleanup;
@@ -609,6 +617,7 @@ static readstat_error_t por_end_data(void *writer_ctx) {
 
 cleanup:
     por_write_ctx_free(writer->module_ctx);
+    writer->module_ctx = NULL;
     return error;
 }
 
@@ -702,6 +711,7 @@ readstat_error_t readstat_begin_writing_por(readstat_writer_t *writer, void *use
     writer->callbacks.begin_data = &por_begin_data;
     writer->callbacks.write_row = &por_write_row;
     writer->callbacks.end_data = &por_end_data;
+    writer->callbacks.module_ctx_free = &por_module_ctx_free;
 
     return readstat_begin_writing_file(writer, user_ctx, row_count);
 
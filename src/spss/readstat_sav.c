@@ -14,6 +14,7 @@
 #include "../readstat.h"
 #include "../readstat_bits.h"
 #include "../readstat_iconv.h"
+#include "../readstat_batch.h"
 
 #include "readstat_sav.h"
 
@@ -72,16 +73,11 @@ void sav_ctx_free(sav_ctx_t *ctx) {
         }
         free(ctx->variables);
     }
-    if (ctx->raw_string)
-        free(ctx->raw_string);
-    if (ctx->utf8_string)
-        free(ctx->utf8_string);
-    if (ctx->converter) {
-        iconv_close(ctx->converter);
-    }
     if (ctx->variable_display_values) {
         free(ctx->variable_display_values);
     }
+    if (ctx->batch)
+        readstat_batch_free(ctx->batch);
     free(ctx);
 }
 
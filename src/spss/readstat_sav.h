@@ -69,6 +69,8 @@ typedef struct sav_ctx_s {
     readstat_note_handler           note_handler;
     readstat_value_handler          value_handler;
     readstat_value_label_handler    value_label_handler;
+    struct readstat_batch_s        *batch;
+    struct readstat_pool_s         *pool;
     size_t                          file_size;
     readstat_io_t                  *io;
     void                           *user_ctx;
@@ -84,11 +86,13 @@ typedef struct sav_ctx_s {
     int32_t       *variable_display_values;
     int            variable_display_values_count;
     iconv_t        converter;
+    int            converter_preserves_ascii;
     int            var_index;
     int            var_offset;
     int            var_count;
     int            record_count;
     int            row_limit;
+    int            row_offset;
     int            current_row;
     int            value_labels_count;
     int            fweight_index;
@@ -3,79 +3,53 @@
 #include <string.h>
 #include <math.h>
 
-static inline int is_leap(int year) {
-    return ((year % 4 == 0 && year % 100 != 0) || year % 400 ==0);
-}
+#include "../readstat_calendar.h"
+#include "readstat_sav_date.h"
+
+// A SPSS date stored as the number of seconds since the start of the Gregorian calendar (midnight, Oct 14, 1582)
+// Through the C interface in savReaderWriter I've verifed that leap seconds is ignored
+#define SAV_EPOCH_DAYS  (-141428) // 1582-10-14, counted from 1970-01-01
 
 double readstat_sav_date_parse(const char *s, char **dest) {
-    // A SPSS date stored as the number of seconds since the start of the Gregorian calendar (midnight, Oct 14, 1582)
-    // Through the C interface in savReaderWriter I've verifed that leap seconds is ignored
-    int daysPerMonth[] =     {31,28,31,30,31,30,31,31,30,31,30,31};
-    int daysPerMonthLeap[] = {31,29,31,30,31,30,31,31,30,31,30,31};
     int year, month, day;
-    if (strlen(s) == 0) {
-        *dest = (char*) s;
-        return 0;
-    }
-    int ret = sscanf(s, "%d-%d-%d", &year, &month, &day);
-    month--;
-    if (month < 0 || month > 11 || ret!=3) {
-        *dest = (char*)s;
+    const char *end = readstat_parse_iso_date(s, &year, &month, &day);
+    *dest = (char *)end;
+    if (end == s)
         return 0;
-    }
-    int maxdays = (is_leap(year) ? daysPerMonthLeap : daysPerMonth)[month]; 
-    if (day < 1 || day > maxdays) {
-        *dest =(char*)s;
-        return 0;
-    } else {
-        int days = 0;
 
-        for (int i=1582; i<year; i++) {
-            days += is_leap(i) ? 366 : 365;
-        }
-       
-        for (int m=0; m<month; m++) {
-            days += is_leap(year) ? daysPerMonthLeap[m] : daysPerMonth[m];
-        }
-
-        days += day-1;
-        char buf[1024];
-        *dest = (char*)s + snprintf(buf, sizeof(buf), "%d-%d-%d", year, month+1, day); 
-        return (days * 86400.0) - 24710400; // 24710400 is the number of seconds in 1582 before Oct 14
-    }
+    return (readstat_days_from_civil(year, month, day) - SAV_EPOCH_DAYS) * 86400.0;
 }
 
 char* readstat_sav_date_string(double seconds, char* dest, int size) {
-    int yr = 1582;
-    int month = 0;
-    int day = 1;
-    int daysPerMonth[] =     {31,28,31,30,31,30,31,31,30,31,30,31};
-    int daysPerMonthLeap[] = {31,29,31,30,31,30,31,31,30,31,30,31};
-    double secs = seconds;
-    secs += 24710400.0;
-    double days = secs / 86400.0;
+    double days = seconds / 86400.0;
     double err = ceil(days) - days;
-    if (err != 0.0) {
+    if (err != 0.0 || fabs(days) > 366.0 * READSTAT_CALENDAR_MAX_YEAR) {
         fprintf(stderr, "%s:%d time not supported. seconds was %lf, err was %lf\n", __FILE__, __LINE__, seconds, err);
         return NULL;
     }
 
-    while (days > 0) {
-        int days_in_year = is_leap(yr) ? 366 : 365;
-        if (days >= days_in_year) {
-            yr+=1;
-            days-=days_in_year;
-            continue;
-        }
-        int days_in_month = is_leap(yr) ? daysPerMonthLeap[month] : daysPerMonth[month];
-        if (days >= days_in_month) {
-            month+=1;
-            days-=days_in_month;
-            continue;
-        }
-        day+= days;
-        days = 0;
-    }
-    snprintf(dest, size, "%04d-%02d-%02d", yr, month+1, day);
+    int year, month, day;
+    readstat_civil_from_days((long)days + SAV_EPOCH_DAYS, &year, &month, &day);
+    readstat_format_iso_date(dest, size, year, month, day);
     return dest;
 }
+
+size_t readstat_sav_date_parse_batch(const char **strings, size_t count, double *seconds) {
+    size_t i;
+    for (i=0; i<count; i++) {
+        char *dest;
+        seconds[i] = readstat_sav_date_parse(strings[i], &dest);
+        if (dest == strings[i])
+            break;
+    }
+    return i;
+}
+
+size_t readstat_sav_date_string_batch(const double *seconds, size_t count, char *dest, size_t stride) {
+    size_t i;
+    for (i=0; i<count; i++) {
+        if (readstat_sav_date_string(seconds[i], &dest[i*stride], stride) == NULL)
+            break;
+    }
+    return i;
+}
@@ -4,4 +4,10 @@
 double readstat_sav_date_parse(const char *s, char **dest);
 char* readstat_sav_date_string(double seconds, char* dest, int size);
 
+// Column versions of the above. Each returns the number of values converted,
+// which is less than count if a value fails. Strings are written to dest
+// every stride bytes.
+size_t readstat_sav_date_parse_batch(const char **strings, size_t count, double *seconds);
+size_t readstat_sav_date_string_batch(const double *seconds, size_t count, char *dest, size_t stride);
+
 #endif
@@ -12,6 +12,9 @@
 #include "../readstat_bits.h"
 #include "../readstat_iconv.h"
 #include "../readstat_convert.h"
+#include "../readstat_batch.h"
+#include "../readstat_pool.h"
+#include "../readstat_strings.h"
 
 #include "readstat_sav.h"
 #include "readstat_sav_parse.h"
@@ -574,10 +577,15 @@ static readstat_error_t sav_read_data(sav_ctx_t *ctx) {
     }
 
     ctx->raw_string_len = longest_string;
-    ctx->raw_string = malloc(ctx->raw_string_len);
+    ctx->raw_string = readstat_pool_get(ctx->pool, READSTAT_POOL_STRING, ctx->raw_string_len);
 
     ctx->utf8_string_len = 4*longest_string+1;
-    ctx->utf8_string = malloc(ctx->utf8_string_len);
+    ctx->utf8_string = readstat_pool_get(ctx->pool, READSTAT_POOL_STRING_UTF8, ctx->utf8_string_len);
+
+    if (ctx->raw_string == NULL || ctx->utf8_string == NULL)
+        return READSTAT_ERROR_MALLOC;
+
+    ctx->converter_preserves_ascii = readstat_converter_preserves_ascii(ctx->converter);
 
     if (ctx->data_is_compressed) {
         retval = sav_read_compressed_data(ctx);
@@ -587,6 +595,9 @@ static readstat_error_t sav_read_data(sav_ctx_t *ctx) {
     if (retval != READSTAT_OK)
         goto done;
 
+    if (ctx->batch && (retval = readstat_batch_flush(ctx->batch)) != READSTAT_OK)
+        goto done;
+
     if (ctx->record_count != -1 && ctx->current_row != ctx->row_limit) {
         retval = READSTAT_ERROR_ROW_COUNT_MISMATCH;
     }
@@ -607,30 +618,40 @@ static readstat_error_t sav_process_row(unsigned char *buffer, size_t buffer_len
     while (data_offset < buffer_len && col < ctx->var_index) {
         spss_varinfo_t *col_info = &ctx->varinfo[col];
         spss_varinfo_t *var_info = &ctx->varinfo[var_index];
+        readstat_variable_t *variable = ctx->variables[var_info->index];
+        int skip = (variable && variable->skip);
         readstat_value_t value = { .type = var_info->type };
         if (offset > 31) {
             retval = READSTAT_ERROR_PARSE;
             goto done;
         }
         if (var_info->type == READSTAT_TYPE_STRING) {
-            if (raw_str_used + 8 <= ctx->raw_string_len) {
+            if (!skip && raw_str_used + 8 <= ctx->raw_string_len) {
                 memcpy(ctx->raw_string + raw_str_used, &buffer[data_offset], 8);
                 raw_str_used += 8;
             }
             if (++offset == col_info->width) {
-                if (++segment_offset < var_info->n_segments) {
+                if (++segment_offset < var_info->n_segments && !skip) {
                     raw_str_used--;
                 }
                 offset = 0;
                 col++;
             }
-            if (segment_offset == var_info->n_segments) {
-                retval = readstat_convert(ctx->utf8_string, ctx->utf8_string_len, 
-                        ctx->raw_string, raw_str_used, ctx->converter);
+            if (segment_offset == var_info->n_segments && skip) {
+                segment_offset = 0;
+                var_index += var_info->n_segments;
+            } else if (segment_offset == var_info->n_segments) {
+                retval = readstat_convert_fast(ctx->utf8_string, ctx->utf8_string_len, 
+                        ctx->raw_string, raw_str_used, ctx->converter, ctx->converter_preserves_ascii);
                 if (retval != READSTAT_OK)
                     goto done;
                 value.v.string_value = ctx->utf8_string;
-                if (ctx->value_handler(ctx->current_row, ctx->variables[var_info->index],
+                if (ctx->batch) {
+                    retval = readstat_batch_push_string(ctx->batch, var_info->index,
+                            ctx->utf8_string, strlen(ctx->utf8_string));
+                    if (retval != READSTAT_OK)
+                        goto done;
+                } else if (ctx->value_handler(ctx->current_row, ctx->variables[var_info->index],
                             value, ctx->user_ctx)) {
                     retval = READSTAT_ERROR_USER_ABORT;
                     goto done;
@@ -639,6 +660,9 @@ static readstat_error_t sav_process_row(unsigned char *buffer, size_t buffer_len
                 segment_offset = 0;
                 var_index += var_info->n_segments;
             }
+        } else if (var_info->type == READSTAT_TYPE_DOUBLE && skip) {
+            var_index += var_info->n_segments;
+            col++;
         } else if (var_info->type == READSTAT_TYPE_DOUBLE) {
             memcpy(&fp_value, &buffer[data_offset], 8);
             if (ctx->bswap) {
@@ -646,7 +670,11 @@ static readstat_error_t sav_process_row(unsigned char *buffer, size_t buffer_len
             }
             value.v.double_value = fp_value;
             sav_tag_missing_double(&value, ctx);
-            if (ctx->value_handler(ctx->current_row, ctx->variables[var_info->index],
+            if (ctx->batch) {
+                readstat_batch_push_double(ctx->batch, var_info->index, fp_value);
+                if (value.is_system_missing)
+                    readstat_batch_push_missing(ctx->batch, var_info->index, 0);
+            } else if (ctx->value_handler(ctx->current_row, ctx->variables[var_info->index],
                         value, ctx->user_ctx)) {
                 retval = READSTAT_ERROR_USER_ABORT;
                 goto done;
@@ -656,6 +684,8 @@ static readstat_error_t sav_process_row(unsigned char *buffer, size_t buffer_len
         }
         data_offset += 8;
     }
+    if (ctx->batch && (retval = readstat_batch_end_row(ctx->batch)) != READSTAT_OK)
+        goto done;
     ctx->current_row++;
 done:
     return retval;
@@ -668,7 +698,15 @@ static readstat_error_t sav_read_uncompressed_data(sav_ctx_t *ctx) {
     size_t bytes_read = 0;
     size_t buffer_len = ctx->var_offset * 8;
 
-    buffer = malloc(buffer_len);
+    if ((buffer = readstat_pool_get(ctx->pool, READSTAT_POOL_ROW, buffer_len)) == NULL)
+        return READSTAT_ERROR_MALLOC;
+
+    if (ctx->row_offset) {
+        if (io->seek(buffer_len * ctx->row_offset, READSTAT_SEEK_CUR, io->io_ctx) == -1) {
+            retval = READSTAT_ERROR_SEEK;
+            goto done;
+        }
+    }
 
     while (ctx->current_row < ctx->row_limit) {
         retval = sav_update_progress(ctx);
@@ -683,12 +721,20 @@ static readstat_error_t sav_read_uncompressed_data(sav_ctx_t *ctx) {
             goto done;
     }
 done:
-    if (buffer)
-        free(buffer);
-
     return retval;
 }
 
+/* Returns 1 if none of the 8 control bytes needs special handling, i.e. each
+ * one expands to a fixed 8-byte value without consuming any input data */
+static int sav_control_block_is_self_contained(const unsigned char *chunk) {
+    int i;
+    for (i=0; i<8; i++) {
+        if (chunk[i] == 0 || chunk[i] == 252 || chunk[i] == 253)
+            return 0;
+    }
+    return 1;
+}
+
 static readstat_error_t sav_read_compressed_data(sav_ctx_t *ctx) {
     readstat_error_t retval = READSTAT_OK;
     readstat_io_t *io = ctx->io;
@@ -699,10 +745,25 @@ static readstat_error_t sav_read_compressed_data(sav_ctx_t *ctx) {
     readstat_off_t data_offset = 0;
     unsigned char buffer[DATA_BUFFER_SIZE];
     int buffer_used = 0;
+    int skip_rows = ctx->row_offset;
 
     size_t uncompressed_row_len = ctx->var_offset * 8;
     readstat_off_t uncompressed_offset = 0;
-    unsigned char *uncompressed_row = malloc(uncompressed_row_len);
+    unsigned char *uncompressed_row = readstat_pool_get(ctx->pool, READSTAT_POOL_ROW, uncompressed_row_len);
+    if (uncompressed_row == NULL)
+        return READSTAT_ERROR_MALLOC;
+
+    /* The 8 bytes each control code expands to, for the codes that don't
+     * read any data */
+    unsigned char expansions[256][8];
+
+    memset(expansions, 0, sizeof(expansions));
+    for (i=1; i<252; i++) {
+        fp_value = i - 100.0;
+        memcpy(expansions[i], &fp_value, sizeof(double));
+    }
+    memcpy(expansions[254], SAV_EIGHT_SPACES, 8);
+    memcpy(expansions[255], &missing_value, sizeof(uint64_t));
 
     int bswap = ctx->bswap;
     ctx->bswap = 0;
@@ -722,7 +783,46 @@ static readstat_error_t sav_read_compressed_data(sav_ctx_t *ctx) {
 
         memcpy(chunk, &buffer[data_offset], 8);
         data_offset += 8;
-        
+
+        /* Fast paths for a block that fits in the current row: eight literal
+         * data slots already in the buffer, or eight codes that don't need
+         * any data at all */
+        int fast_path = 0;
+        if (uncompressed_row_len - uncompressed_offset >= 64) {
+            if (memcmp(chunk, "\xFD\xFD\xFD\xFD\xFD\xFD\xFD\xFD", 8) == 0 &&
+                    buffer_used - data_offset >= 64) {
+                if (!skip_rows)
+                    memcpy(&uncompressed_row[uncompressed_offset], &buffer[data_offset], 64);
+                uncompressed_offset += 64;
+                data_offset += 64;
+                fast_path = 1;
+            } else if (sav_control_block_is_self_contained(chunk)) {
+                if (!skip_rows) {
+                    for (i=0; i<8; i++) {
+                        memcpy(&uncompressed_row[uncompressed_offset + 8*i], expansions[chunk[i]], 8);
+                    }
+                }
+                uncompressed_offset += 64;
+                fast_path = 1;
+            }
+        }
+        if (fast_path) {
+            if (uncompressed_offset == uncompressed_row_len && skip_rows) {
+                skip_rows--;
+                uncompressed_offset = 0;
+            } else if (uncompressed_offset == uncompressed_row_len) {
+                retval = sav_process_row(uncompressed_row, uncompressed_row_len, ctx);
+                if (retval != READSTAT_OK)
+                    goto done;
+
+                uncompressed_offset = 0;
+
+                if (ctx->current_row == ctx->row_limit)
+                    goto done;
+            }
+            continue;
+        }
+
         for (i=0; i<8; i++) {
             switch (chunk[i]) {
                 case 0:
@@ -737,25 +837,21 @@ static readstat_error_t sav_read_compressed_data(sav_ctx_t *ctx) {
 
                         data_offset = 0;
                     }
-                    memcpy(&uncompressed_row[uncompressed_offset], &buffer[data_offset], 8);
+                    if (!skip_rows)
+                        memcpy(&uncompressed_row[uncompressed_offset], &buffer[data_offset], 8);
                     uncompressed_offset += 8;
                     data_offset += 8;
                     break;
-                case 254:
-                    memcpy(&uncompressed_row[uncompressed_offset], SAV_EIGHT_SPACES, 8);
-                    uncompressed_offset += 8;
-                    break;
-                case 255:
-                    memcpy(&uncompressed_row[uncompressed_offset], &missing_value, sizeof(uint64_t));
-                    uncompressed_offset += 8;
-                    break;
                 default:
-                    fp_value = chunk[i] - 100.0;
-                    memcpy(&uncompressed_row[uncompressed_offset], &fp_value, sizeof(double));
+                    if (!skip_rows)
+                        memcpy(&uncompressed_row[uncompressed_offset], expansions[chunk[i]], 8);
                     uncompressed_offset += 8;
                     break;
             }
-            if (uncompressed_offset == uncompressed_row_len) {
+            if (uncompressed_offset == uncompressed_row_len && skip_rows) {
+                skip_rows--;
+                uncompressed_offset = 0;
+            } else if (uncompressed_offset == uncompressed_row_len) {
                 retval = sav_process_row(uncompressed_row, uncompressed_row_len, ctx);
                 if (retval != READSTAT_OK)
                     goto done;
@@ -767,9 +863,6 @@ static readstat_error_t sav_read_compressed_data(sav_ctx_t *ctx) {
         }
     }
 done:
-    if (uncompressed_row)
-        free(uncompressed_row);
-
     ctx->bswap = bswap;
 
     return retval;
@@ -808,7 +901,7 @@ static readstat_error_t sav_parse_machine_integer_info_record(const void *data,
         }
     }
     if (src_charset && dst_charset && strcmp(src_charset, dst_charset) != 0) {
-        iconv_t converter = iconv_open(dst_charset, src_charset);
+        iconv_t converter = readstat_pool_converter(ctx->pool, dst_charset, src_charset);
         if (converter == (iconv_t)-1) {
             return READSTAT_ERROR_UNSUPPORTED_CHARSET;
         }
@@ -1231,23 +1324,33 @@ static readstat_error_t sav_handle_variables(readstat_parser_t *parser, sav_ctx_
     int i;
     readstat_error_t retval = READSTAT_OK;
 
-    if (!parser->variable_handler)
+    if (!parser->variable_handler && !parser->column_filter)
         return retval;
 
     for (i=0; i<ctx->var_index;) {
         char label_name_buf[256];
         spss_varinfo_t *info = &ctx->varinfo[i];
-        ctx->variables[info->index] = spss_init_variable_for_info(info);
+        readstat_variable_t *variable = spss_init_variable_for_info(info, ctx->pool->strings);
+        if (variable == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+        ctx->variables[info->index] = variable;
+
+        if (parser->column_filter)
+            variable->skip = !parser->column_filter(info->index, variable, ctx->user_ctx);
 
         snprintf(label_name_buf, sizeof(label_name_buf), SAV_LABEL_NAME_PREFIX "%d", info->labels_index);
 
-        int cb_retval = parser->variable_handler(info->index, ctx->variables[info->index],
-                info->labels_index == -1 ? NULL : label_name_buf,
-                ctx->user_ctx);
+        if (parser->variable_handler) {
+            int cb_retval = parser->variable_handler(info->index, variable,
+                    info->labels_index == -1 ? NULL : label_name_buf,
+                    ctx->user_ctx);
 
-        if (cb_retval) {
-            retval = READSTAT_ERROR_USER_ABORT;
-            goto cleanup;
+            if (cb_retval) {
+                retval = READSTAT_ERROR_USER_ABORT;
+                goto cleanup;
+            }
         }
         i += info->n_segments;
     }
@@ -1255,6 +1358,24 @@ cleanup:
     return retval;
 }
 
+static readstat_error_t sav_set_batch_columns(sav_ctx_t *ctx) {
+    readstat_error_t retval = READSTAT_OK;
+    int i;
+
+    for (i=0; i<ctx->var_index;) {
+        spss_varinfo_t *info = &ctx->varinfo[i];
+        readstat_variable_t *variable = ctx->variables[info->index];
+        if (!variable || !variable->skip) {
+            retval = readstat_batch_set_column(ctx->batch, info->index, variable, info->type);
+            if (retval != READSTAT_OK)
+                break;
+        }
+        i += info->n_segments;
+    }
+
+    return retval;
+}
+
 static readstat_error_t sav_handle_fweight(readstat_parser_t *parser, sav_ctx_t *ctx) {
     readstat_error_t retval = READSTAT_OK;
     int i;
@@ -1326,6 +1447,8 @@ readstat_error_t readstat_parse_sav(readstat_parser_t *parser, const char *path,
         goto cleanup;
     }
 
+    ctx->pool = parser->pool;
+    readstat_string_pool_clear(ctx->pool->strings);
     ctx->progress_handler = parser->progress_handler;
     ctx->error_handler = parser->error_handler;
     ctx->note_handler = parser->note_handler;
@@ -1335,6 +1458,12 @@ readstat_error_t readstat_parse_sav(readstat_parser_t *parser, const char *path,
     ctx->output_encoding = parser->output_encoding;
     ctx->user_ctx = user_ctx;
     ctx->file_size = file_size;
+    ctx->row_offset = parser->row_offset > 0 ? parser->row_offset : 0;
+    if (ctx->record_count != -1) {
+        if (ctx->row_offset > ctx->record_count)
+            ctx->row_offset = ctx->record_count;
+        ctx->record_count -= ctx->row_offset;
+    }
     if (ctx->record_count == -1 ||
             (parser->row_limit > 0 && parser->row_limit < ctx->record_count)) {
         ctx->row_limit = parser->row_limit;
@@ -1388,7 +1517,17 @@ readstat_error_t readstat_parse_sav(readstat_parser_t *parser, const char *path,
     if ((retval = sav_handle_fweight(parser, ctx)) != READSTAT_OK)
         goto cleanup;
 
-    if (ctx->value_handler) {
+    if (parser->batch_handler) {
+        if ((ctx->batch = readstat_batch_init(parser->batch_handler, parser->batch_size,
+                        ctx->var_count, user_ctx)) == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+        if ((retval = sav_set_batch_columns(ctx)) != READSTAT_OK)
+            goto cleanup;
+    }
+
+    if (ctx->value_handler || ctx->batch) {
         retval = sav_read_data(ctx);
     }
     
@@ -21,6 +21,25 @@
 #define MAX_LABEL_SIZE              256
 #define MAX_VALUE_LABEL_SIZE        120
 
+#define SAV_COMPRESSED_BUFFER_SIZE  65536
+
+/* A run of adjacent 8-byte slots in the row that are all string data or
+ * all numeric data */
+typedef struct sav_column_run_s {
+    int         is_string;
+    size_t      slots;
+} sav_column_run_t;
+
+typedef struct sav_write_ctx_s {
+    sav_column_run_t   *runs;
+    long                runs_count;
+
+    unsigned char      *buffer;
+    size_t              buffer_used;
+    size_t              buffer_capacity;
+    size_t              row_capacity;
+} sav_write_ctx_t;
+
 static long readstat_label_set_number_short_variables(readstat_label_set_t *r_label_set) {
     long count = 0;
     int j;
@@ -59,8 +78,11 @@ static readstat_error_t sav_encode_variable_format(int32_t *out_code,
 
 static readstat_error_t sav_emit_header(readstat_writer_t *writer) {
     readstat_error_t retval = READSTAT_OK;
-    time_t now = writer->timestamp;
-    struct tm *time_s = localtime(&now);
+    struct tm local_time;
+    struct tm *time_s = &local_time;
+
+    if ((retval = readstat_writer_local_time(writer, &local_time)) != READSTAT_OK)
+        return retval;
 
     sav_file_header_record_t header;
     memset(&header, 0, sizeof(sav_file_header_record_t));
@@ -915,12 +937,84 @@ static size_t sav_variable_width(readstat_type_t type, size_t user_width) {
     return 8;
 }
 
+static void sav_write_ctx_free(sav_write_ctx_t *ctx) {
+    if (ctx == NULL)
+        return;
+    free(ctx->runs);
+    free(ctx->buffer);
+    free(ctx);
+}
+
+static void sav_module_ctx_free(void *module_ctx) {
+    sav_write_ctx_free((sav_write_ctx_t *)module_ctx);
+}
+
+/* Work out the string/numeric layout of the row once, so the compressor
+ * doesn't need to look at the variables again */
+static sav_write_ctx_t *sav_write_ctx_init(readstat_writer_t *writer) {
+    sav_write_ctx_t *ctx = NULL;
+    size_t row_len = 0;
+    int i;
+
+    if ((ctx = calloc(1, sizeof(sav_write_ctx_t))) == NULL)
+        goto error;
+
+    if (writer->variables_count &&
+            (ctx->runs = calloc(writer->variables_count, sizeof(sav_column_run_t))) == NULL)
+        goto error;
+
+    for (i=0; i<writer->variables_count; i++) {
+        readstat_variable_t *variable = readstat_get_variable(writer, i);
+        int is_string = (variable->type == READSTAT_TYPE_STRING);
+        size_t slots = is_string ? variable->storage_width / 8 : 1;
+        if (ctx->runs_count && ctx->runs[ctx->runs_count-1].is_string == is_string) {
+            ctx->runs[ctx->runs_count-1].slots += slots;
+        } else {
+            ctx->runs[ctx->runs_count].is_string = is_string;
+            ctx->runs[ctx->runs_count].slots = slots;
+            ctx->runs_count++;
+        }
+        row_len += variable->storage_width;
+    }
+
+    /* One control block per 8 slots, plus a trailing one */
+    ctx->row_capacity = row_len + (row_len/8 + 8)/8*8;
+    ctx->buffer_capacity = SAV_COMPRESSED_BUFFER_SIZE;
+    if (ctx->buffer_capacity < ctx->row_capacity)
+        ctx->buffer_capacity = ctx->row_capacity;
+
+    if ((ctx->buffer = malloc(ctx->buffer_capacity)) == NULL)
+        goto error;
+
+    return ctx;
+
+error:
+    sav_write_ctx_free(ctx);
+    return NULL;
+}
+
+static readstat_error_t sav_flush_compressed_rows(readstat_writer_t *writer, sav_write_ctx_t *ctx) {
+    readstat_error_t retval = READSTAT_OK;
+    if (ctx->buffer_used) {
+        retval = readstat_write_bytes(writer, ctx->buffer, ctx->buffer_used);
+        ctx->buffer_used = 0;
+    }
+    return retval;
+}
+
 static readstat_error_t sav_begin_data(void *writer_ctx) {
     readstat_writer_t *writer = (readstat_writer_t *)writer_ctx;
     readstat_error_t retval = READSTAT_OK;
     if (!writer->initialized)
         return READSTAT_ERROR_WRITER_NOT_INITIALIZED;
 
+    if (writer->compression == READSTAT_COMPRESS_ROWS) {
+        if ((writer->module_ctx = sav_write_ctx_init(writer)) == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+    }
+
     retval = sav_emit_header(writer);
     if (retval != READSTAT_OK)
         goto cleanup;
@@ -966,57 +1060,74 @@ static readstat_error_t sav_begin_data(void *writer_ctx) {
         goto cleanup;
 
 cleanup:
+    if (retval != READSTAT_OK && writer->module_ctx) {
+        sav_write_ctx_free(writer->module_ctx);
+        writer->module_ctx = NULL;
+    }
     return retval;
 }
 
+static readstat_error_t sav_end_data(void *writer_ctx) {
+    readstat_writer_t *writer = (readstat_writer_t *)writer_ctx;
+    sav_write_ctx_t *ctx = (sav_write_ctx_t *)writer->module_ctx;
+    readstat_error_t retval = READSTAT_OK;
+
+    if (ctx) {
+        retval = sav_flush_compressed_rows(writer, ctx);
+        sav_write_ctx_free(ctx);
+        writer->module_ctx = NULL;
+    }
+
+    return retval;
+}
+
+/* Compressed rows accumulate in the write context's buffer, which goes out
+ * to the data writer when the next row might not fit, and at the end */
 static readstat_error_t sav_write_compressed_row(void *writer_ctx, void *row, size_t len) {
     readstat_error_t retval = READSTAT_OK;
     readstat_writer_t *writer = (readstat_writer_t *)writer_ctx;
-    int i;
-    size_t output_len = len + (len/8 + 8)/8*8;
-    unsigned char *output = malloc(output_len);
-    char *input = (char *)row;
+    sav_write_ctx_t *ctx = (sav_write_ctx_t *)writer->module_ctx;
+    const unsigned char *input = (const unsigned char *)row;
+    unsigned char *output = NULL;
+    long i;
+    size_t j;
+
+    if (ctx->buffer_capacity - ctx->buffer_used < ctx->row_capacity) {
+        retval = sav_flush_compressed_rows(writer, ctx);
+        if (retval != READSTAT_OK)
+            goto cleanup;
+    }
 
-    off_t input_offset = 0;
+    output = &ctx->buffer[ctx->buffer_used];
 
-    off_t output_offset = 8;
-    off_t control_offset = 0;
+    size_t output_offset = 8;
+    size_t control_offset = 0;
 
     memset(&output[control_offset], 0, 8);
 
-    for (i=0; i<writer->variables_count; i++) {
-        readstat_variable_t *variable = readstat_get_variable(writer, i);
-        if (variable->type == READSTAT_TYPE_STRING) {
-            size_t width = variable->storage_width;
-            while (width > 0) {
-                if (memcmp(&input[input_offset], "        ", 8) == 0) {
+    for (i=0; i<ctx->runs_count; i++) {
+        sav_column_run_t *run = &ctx->runs[i];
+        for (j=0; j<run->slots; j++) {
+            if (run->is_string) {
+                if (memcmp(input, "        ", 8) == 0) {
                     output[control_offset++] = 254;
                 } else {
                     output[control_offset++] = 253;
-                    memcpy(&output[output_offset], &input[input_offset], 8);
+                    memcpy(&output[output_offset], input, 8);
                     output_offset += 8;
                 }
-                if (control_offset % 8 == 0) {
-                    control_offset = output_offset;
-                    memset(&output[control_offset], 0, 8);
-                    output_offset += 8;
-                }
-                input_offset += 8;
-                width -= 8;
-            }
-        } else {
-            uint64_t int_value;
-            memcpy(&int_value, &input[input_offset], 8);
-            if (int_value == SAV_MISSING_DOUBLE) {
-                output[control_offset++] = 255;
             } else {
+                uint64_t int_value;
                 double fp_value;
-                memcpy(&fp_value, &input[input_offset], 8);
-                if ((int)fp_value == fp_value && (int)fp_value > -100 && (int)fp_value < 152) {
+                memcpy(&int_value, input, 8);
+                memcpy(&fp_value, input, 8);
+                if (int_value == SAV_MISSING_DOUBLE) {
+                    output[control_offset++] = 255;
+                } else if (fp_value > -100 && fp_value < 152 && (int)fp_value == fp_value) {
                     output[control_offset++] = (int)fp_value + 100;
                 } else {
                     output[control_offset++] = 253;
-                    memcpy(&output[output_offset], &input[input_offset], 8);
+                    memcpy(&output[output_offset], input, 8);
                     output_offset += 8;
                 }
             }
@@ -1025,17 +1136,16 @@ static readstat_error_t sav_write_compressed_row(void *writer_ctx, void *row, si
                 memset(&output[control_offset], 0, 8);
                 output_offset += 8;
             }
-            input_offset += 8;
+            input += 8;
         }
     }
 
     if (writer->current_row + 1 == writer->row_count)
         output[control_offset] = 252;
 
-    retval = readstat_write_bytes(writer, output, output_offset);
-
-    free(output);
+    ctx->buffer_used += output_offset;
 
+cleanup:
     return retval;
 }
 
@@ -1051,6 +1161,8 @@ readstat_error_t readstat_begin_writing_sav(readstat_writer_t *writer, void *use
     writer->callbacks.write_missing_string = &sav_write_missing_string;
     writer->callbacks.write_missing_number = &sav_write_missing_number;
     writer->callbacks.begin_data = &sav_begin_data;
+    writer->callbacks.end_data = &sav_end_data;
+    writer->callbacks.module_ctx_free = &sav_module_ctx_free;
 
     if (writer->compression == READSTAT_COMPRESS_ROWS) {
         writer->callbacks.write_row = &sav_write_compressed_row;
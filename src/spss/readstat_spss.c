@@ -1,8 +1,10 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "../readstat.h"
+#include "../readstat_strings.h"
 #include "readstat_spss.h"
 #include "readstat_spss_parse.h"
 
@@ -100,31 +102,41 @@ uint64_t spss_64bit_value(readstat_value_t value) {
     return special_val;
 }
 
-readstat_missingness_t spss_missingness_for_info(spss_varinfo_t *info) {
-    readstat_missingness_t missingness;
-    memset(&missingness, 0, sizeof(readstat_missingness_t));
+static readstat_error_t spss_missingness_for_info(readstat_missingness_t *missingness,
+        spss_varinfo_t *info, readstat_string_pool_t *strings) {
+    long count = info->missing_range ? (info->n_missing_values == 3 ? 2 : 1) : info->n_missing_values;
+    memset(missingness, 0, sizeof(readstat_missingness_t));
+    if (count <= 0)
+        return READSTAT_OK;
+
+    readstat_value_t *ranges = readstat_string_pool_alloc(strings, 2 * count * sizeof(readstat_value_t));
+    if (ranges == NULL)
+        return READSTAT_ERROR_MALLOC;
 
     if (info->missing_range) {
-        missingness.missing_ranges_count++;
-        missingness.missing_ranges[0] = spss_boxed_value(info->missing_values[0]);
-        missingness.missing_ranges[1] = spss_boxed_value(info->missing_values[1]);
+        ranges[0] = spss_boxed_value(info->missing_values[0]);
+        ranges[1] = spss_boxed_value(info->missing_values[1]);
 
         if (info->n_missing_values == 3) {
-            missingness.missing_ranges_count++;
-            missingness.missing_ranges[2] = missingness.missing_ranges[3] = spss_boxed_value(info->missing_values[2]);
+            ranges[2] = ranges[3] = spss_boxed_value(info->missing_values[2]);
         }
-    } else if (info->n_missing_values > 0) {
-        missingness.missing_ranges_count = info->n_missing_values;
+    } else {
         int i=0;
         for (i=0; i<info->n_missing_values; i++) {
-            missingness.missing_ranges[2*i] = missingness.missing_ranges[2*i+1] = spss_boxed_value(info->missing_values[i]);
+            ranges[2*i] = ranges[2*i+1] = spss_boxed_value(info->missing_values[i]);
         }
     }
-    return missingness;
+    missingness->missing_ranges = ranges;
+    missingness->missing_ranges_count = count;
+    missingness->missing_ranges_capacity = count;
+    return READSTAT_OK;
 }
 
-readstat_variable_t *spss_init_variable_for_info(spss_varinfo_t *info) {
+readstat_variable_t *spss_init_variable_for_info(spss_varinfo_t *info, readstat_string_pool_t *strings) {
+    char format[READSTAT_VARIABLE_FORMAT_LEN];
     readstat_variable_t *variable = calloc(1, sizeof(readstat_variable_t));
+    if (variable == NULL)
+        return NULL;
 
     variable->index = info->index;
     variable->type = info->type;
@@ -133,19 +145,34 @@ readstat_variable_t *spss_init_variable_for_info(spss_varinfo_t *info) {
     } else {
         variable->storage_width = 8 * info->width;
     }
+    variable->strings = strings;
 
     if (info->longname[0]) {
-        snprintf(variable->name, sizeof(variable->name), "%s", info->longname);
+        variable->name = readstat_string_pool_intern(strings, info->longname, READSTAT_VARIABLE_NAME_LEN - 1);
     } else {
-        snprintf(variable->name, sizeof(variable->name), "%s", info->name);
+        variable->name = readstat_string_pool_intern(strings, info->name, READSTAT_VARIABLE_NAME_LEN - 1);
     }
     if (info->label) {
-        snprintf(variable->label, sizeof(variable->label), "%s", info->label);
+        variable->label = readstat_string_pool_intern(strings, info->label, READSTAT_VARIABLE_LABEL_LEN - 1);
+    } else {
+        variable->label = "";
+    }
+
+    if (spss_format(format, sizeof(format), &info->print_format)) {
+        variable->format = readstat_string_pool_intern(strings, format, sizeof(format));
+    } else {
+        variable->format = "";
     }
 
-    spss_format(variable->format, sizeof(variable->format), &info->print_format);
+    if (!variable->name || !variable->label || !variable->format) {
+        free(variable);
+        return NULL;
+    }
 
-    variable->missingness = spss_missingness_for_info(info);
+    if (spss_missingness_for_info(&variable->missingness, info, strings) != READSTAT_OK) {
+        free(variable);
+        return NULL;
+    }
     variable->measure = info->measure;
     variable->display_width = info->display_width;
 
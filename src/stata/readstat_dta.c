@@ -7,6 +7,8 @@
 #include "../readstat.h"
 #include "../readstat_iconv.h"
 #include "../readstat_bits.h"
+#include "../readstat_batch.h"
+#include "../readstat_pool.h"
 
 #include "readstat_dta.h"
 
@@ -150,11 +152,11 @@ readstat_error_t dta_ctx_init(dta_ctx_t *ctx, int16_t nvar, int32_t nobs,
 
     if (output_encoding) {
         if (input_encoding) {
-            ctx->converter = iconv_open(output_encoding, input_encoding);
+            ctx->converter = readstat_pool_converter(ctx->pool, output_encoding, input_encoding);
         } else if (ds_format < 118) {
-            ctx->converter = iconv_open(output_encoding, "WINDOWS-1252");
+            ctx->converter = readstat_pool_converter(ctx->pool, output_encoding, "WINDOWS-1252");
         } else if (strcmp(output_encoding, "UTF-8") != 0) {
-            ctx->converter = iconv_open(output_encoding, "UTF-8");
+            ctx->converter = readstat_pool_converter(ctx->pool, output_encoding, "UTF-8");
         }
         if (ctx->converter == (iconv_t)-1) {
             ctx->converter = NULL;
@@ -215,8 +217,6 @@ void dta_ctx_free(dta_ctx_t *ctx) {
         free(ctx->lbllist);
     if (ctx->variable_labels)
         free(ctx->variable_labels);
-    if (ctx->converter)
-        iconv_close(ctx->converter);
     if (ctx->data_label)
         free(ctx->data_label);
     if (ctx->variables) {
@@ -228,12 +228,17 @@ void dta_ctx_free(dta_ctx_t *ctx) {
         free(ctx->variables);
     }
     if (ctx->strls) {
-        int i;
-        for (i=0; i<ctx->strls_count; i++) {
-            free(ctx->strls[i]);
+        size_t i;
+        for (i=0; i<ctx->strls_capacity; i++) {
+            if (ctx->strls[i])
+                free(ctx->strls[i]);
         }
         free(ctx->strls);
     }
+    if (ctx->strl_buffer)
+        free(ctx->strl_buffer);
+    if (ctx->batch)
+        readstat_batch_free(ctx->batch);
     free(ctx);
 }
 
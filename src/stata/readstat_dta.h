@@ -27,11 +27,20 @@ typedef struct dta_118_strl_header_s {
 
 #pragma pack(pop)
 
+/* Default total size of the strL blobs kept in memory; beyond this, only the
+ * file offset of each blob is recorded and the blob is read when referenced */
+#define DTA_STRLS_MAX_RESIDENT_LEN  (64*1024*1024)
+
+/* Rows are read this many bytes at a time (or one row, if larger) */
+#define DTA_ROWS_BUFFER_LEN         (64*1024)
+
 typedef struct dta_strl_s {
     uint16_t        v;
     uint64_t        o;
     unsigned char   type;
     size_t          len;
+    readstat_off_t  data_offset;
+    int             is_resident;
     char            data[1]; // Flexible array; use [1] for C++98 compatibility
 } dta_strl_t;
 
@@ -77,6 +86,7 @@ typedef struct dta_ctx_s {
     int64_t        nobs;
     size_t         record_len;
     int64_t        row_limit;
+    int64_t        row_offset;
     int64_t        current_row;
 
     int            bswap;
@@ -90,19 +100,29 @@ typedef struct dta_ctx_s {
     int32_t        max_float;
     int64_t        max_double;
 
-    dta_strl_t   **strls;
+    dta_strl_t   **strls; // Open-addressed on (v,o); strls_capacity is a power of 2
     size_t         strls_count;
     size_t         strls_capacity;
+    size_t         strls_resident_len;
+    size_t         strls_max_resident_len;
+    char          *strl_buffer;
+    size_t         strl_buffer_len;
+    dta_strl_t    *strl_buffer_strl; // The strL last read into strl_buffer
+    int            strl_did_seek;    // Set when reading a strL moved off the data section
 
     readstat_variable_t     **variables;
 
     iconv_t        converter;
+    int            converter_preserves_ascii;
     readstat_error_handler error_handler;
     readstat_progress_handler progress_handler;
     readstat_note_handler note_handler;
     readstat_variable_handler variable_handler;
+    readstat_column_filter column_filter;
     readstat_value_handler value_handler;
     readstat_value_label_handler value_label_handler;
+    struct readstat_batch_s  *batch;
+    struct readstat_pool_s   *pool;
     size_t                    file_size;
     void                     *user_ctx;
     readstat_io_t            *io;
@@ -2,95 +2,42 @@
 #include <stdlib.h>
 #include <string.h>
 
-static inline int is_leap(int year) {
-    return ((year % 4 == 0 && year % 100 != 0) || year % 400 ==0);
-}
+#include "../readstat_calendar.h"
+#include "readstat_dta_days.h"
+
+#define DTA_EPOCH_DAYS  (-3653) // 1960-01-01, counted from 1970-01-01
 
 int readstat_dta_num_days(const char *s, char **dest) {
-    int daysPerMonth[] =     {31,28,31,30,31,30,31,31,30,31,30,31};
-    int daysPerMonthLeap[] = {31,29,31,30,31,30,31,31,30,31,30,31};
     int year, month, day;
-    if (strlen(s) == 0) {
-        *dest = (char*) s;
-        return 0;
-    }
-    int ret = sscanf(s, "%d-%d-%d", &year, &month, &day);
-    month--;
-    if (month < 0 || month > 11 || ret!=3) {
-        *dest = (char*)s;
+    const char *end = readstat_parse_iso_date(s, &year, &month, &day);
+    *dest = (char *)end;
+    if (end == s)
         return 0;
-    }
-    int maxdays = (is_leap(year) ? daysPerMonthLeap : daysPerMonth)[month]; 
-    if (day < 1 || day > maxdays) {
-        *dest = (char*)s;
-        return 0;
-    } else {
-        int days = 0;
 
-        for (int i=year; i<1960; i++) {
-            days -= is_leap(i) ? 366 : 365;
-        }
+    return readstat_days_from_civil(year, month, day) - DTA_EPOCH_DAYS;
+}
 
-        for (int i=1960; i<year; i++) {
-            days += is_leap(i) ? 366 : 365;
-        }
-       
-        for (int m=0; m<month; m++) {
-            days += is_leap(year) ? daysPerMonthLeap[m] : daysPerMonth[m];
-        }
+char* readstat_dta_days_string(int days, char* dest, int size) {
+    int year, month, day;
+    readstat_civil_from_days((long)days + DTA_EPOCH_DAYS, &year, &month, &day);
+    readstat_format_iso_date(dest, size, year, month, day);
+    return dest;
+}
 
-        days += day-1;
-        char buf[1024];
-        *dest = (char*)s + snprintf(buf, sizeof(buf), "%d-%d-%d", year, month+1, day); 
-        return days;
+size_t readstat_dta_num_days_batch(const char **strings, size_t count, int *days) {
+    size_t i;
+    for (i=0; i<count; i++) {
+        char *dest;
+        days[i] = readstat_dta_num_days(strings[i], &dest);
+        if (dest == strings[i])
+            break;
     }
+    return i;
 }
 
-char* readstat_dta_days_string(int days, char* dest, int size) {
-    // TODO: Candidate for clean up
-    int yr = 1960;
-    int month = 0;
-    int day = 1;
-    int daysPerMonth[] =     {31,28,31,30,31,30,31,31,30,31,30,31};
-    int daysPerMonthLeap[] = {31,29,31,30,31,30,31,31,30,31,30,31};
-    if (days < 0) {
-        yr = 1959;
-        month = 11;
-        days = - days;
-        while (days > 0) {
-            int days_in_year = is_leap(yr) ? 366 : 365;
-            if (days > days_in_year) {
-                yr-=1;
-                days-=days_in_year;
-                continue;
-            }
-            int days_in_month = is_leap(yr) ? daysPerMonthLeap[month] : daysPerMonth[month];
-            if (days > days_in_month) {
-                month-=1;
-                days-=days_in_month;
-                continue;
-            }
-            day = days_in_month-days + 1;
-            days = 0;
-        }
-    } else {
-        while (days > 0) {
-            int days_in_year = is_leap(yr) ? 366 : 365;
-            if (days >= days_in_year) {
-                yr+=1;
-                days-=days_in_year;
-                continue;
-            }
-            int days_in_month = is_leap(yr) ? daysPerMonthLeap[month] : daysPerMonth[month];
-            if (days >= days_in_month) {
-                month+=1;
-                days-=days_in_month;
-                continue;
-            }
-            day+= days;
-            days = 0;
-        }
+void readstat_dta_days_string_batch(const int *days, size_t count, char *dest, size_t stride) {
+    size_t i;
+    for (i=0; i<count; i++) {
+        readstat_dta_days_string(days[i], &dest[i*stride], stride);
     }
-    snprintf(dest, size, "%04d-%02d-%02d", yr, month+1, day);
-    return dest;
 }
@@ -4,4 +4,10 @@
 int readstat_dta_num_days(const char *s, char** dest);
 char* readstat_dta_days_string(int days, char* dest, int size);
 
+// Column versions of the above. Parsing stops at the first string that isn't
+// a date and returns the number parsed. Strings are written to dest every
+// stride bytes.
+size_t readstat_dta_num_days_batch(const char **strings, size_t count, int *days);
+void readstat_dta_days_string_batch(const int *days, size_t count, char *dest, size_t stride);
+
 #endif
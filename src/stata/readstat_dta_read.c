@@ -10,6 +10,9 @@
 #include "../readstat_bits.h"
 #include "../readstat_iconv.h"
 #include "../readstat_convert.h"
+#include "../readstat_batch.h"
+#include "../readstat_pool.h"
+#include "../readstat_strings.h"
 
 #include "readstat_dta.h"
 #include "readstat_dta_parse_timestamp.h"
@@ -30,42 +33,58 @@ static readstat_error_t dta_update_progress(dta_ctx_t *ctx) {
 }
 
 static readstat_variable_t *dta_init_variable(dta_ctx_t *ctx, int i, readstat_type_t type, size_t max_len) {
+    readstat_string_pool_t *strings = ctx->pool->strings;
+    char name[READSTAT_VARIABLE_NAME_LEN] = "";
+    char label[READSTAT_VARIABLE_LABEL_LEN] = "";
+    char format[READSTAT_VARIABLE_FORMAT_LEN] = "";
+
     readstat_variable_t *variable = calloc(1, sizeof(readstat_variable_t));
+    if (variable == NULL)
+        return NULL;
 
     variable->type = type;
     variable->index = i;
     variable->storage_width = max_len;
+    variable->strings = strings;
 
-    readstat_convert(variable->name, sizeof(variable->name), 
+    readstat_convert(name, sizeof(name), 
             &ctx->varlist[ctx->variable_name_len*i],
             ctx->variable_name_len, ctx->converter);
 
     if (ctx->variable_labels[ctx->variable_labels_entry_len*i]) {
-        readstat_convert(variable->label, sizeof(variable->label),
+        readstat_convert(label, sizeof(label),
                 &ctx->variable_labels[ctx->variable_labels_entry_len*i],
                 ctx->variable_labels_entry_len, ctx->converter);
     }
 
     if (ctx->fmtlist[ctx->fmtlist_entry_len*i]) {
-        readstat_convert(variable->format, sizeof(variable->format),
+        readstat_convert(format, sizeof(format),
                 &ctx->fmtlist[ctx->fmtlist_entry_len*i],
                 ctx->fmtlist_entry_len, ctx->converter);
-        if (variable->format[0] == '%') {
-            if (variable->format[1] == '-') {
+        if (format[0] == '%') {
+            if (format[1] == '-') {
                 variable->alignment = READSTAT_ALIGNMENT_LEFT;
-            } else if (variable->format[1] == '~') {
+            } else if (format[1] == '~') {
                 variable->alignment = READSTAT_ALIGNMENT_CENTER;
             } else {
                 variable->alignment = READSTAT_ALIGNMENT_RIGHT;
             }
         }
         int display_width;
-        if (sscanf(variable->format, "%%%ds", &display_width) == 1 ||
-                sscanf(variable->format, "%%-%ds", &display_width) == 1) {
+        if (sscanf(format, "%%%ds", &display_width) == 1 ||
+                sscanf(format, "%%-%ds", &display_width) == 1) {
             variable->display_width = display_width;
         }
     }
 
+    variable->name = readstat_string_pool_intern(strings, name, sizeof(name));
+    variable->label = readstat_string_pool_intern(strings, label, sizeof(label));
+    variable->format = readstat_string_pool_intern(strings, format, sizeof(format));
+    if (!variable->name || !variable->label || !variable->format) {
+        free(variable);
+        return NULL;
+    }
+
     return variable;
 }
 
@@ -296,13 +315,98 @@ cleanup:
     return retval;
 }
 
-static int dta_compare_strls(const void *elem1, const void *elem2) {
-    const dta_strl_t *key = (const dta_strl_t *)elem1;
-    const dta_strl_t *target = *(const dta_strl_t **)elem2;
-    if (key->v == target->v)
-        return key->o - target->o;
+static size_t dta_strl_hash(uint16_t v, uint64_t o, size_t capacity) {
+    uint64_t hash = (o * 0x9E3779B97F4A7C15ULL) ^ ((uint64_t)v * 0xC2B2AE3D27D4EB4FULL);
+    hash ^= (hash >> 32);
+    return hash & (capacity - 1);
+}
+
+static dta_strl_t *dta_find_strl(dta_ctx_t *ctx, uint16_t v, uint64_t o) {
+    if (ctx->strls_count == 0)
+        return NULL;
+
+    size_t i = dta_strl_hash(v, o, ctx->strls_capacity);
+    while (ctx->strls[i]) {
+        if (ctx->strls[i]->v == v && ctx->strls[i]->o == o)
+            return ctx->strls[i];
+        i = (i + 1) & (ctx->strls_capacity - 1);
+    }
+    return NULL;
+}
+
+static void dta_insert_strl(dta_strl_t **strls, size_t capacity, dta_strl_t *strl) {
+    size_t i = dta_strl_hash(strl->v, strl->o, capacity);
+    while (strls[i]) {
+        i = (i + 1) & (capacity - 1);
+    }
+    strls[i] = strl;
+}
+
+/* Keeps the table at most half full */
+static readstat_error_t dta_add_strl(dta_ctx_t *ctx, dta_strl_t *strl) {
+    if (2 * (ctx->strls_count + 1) > ctx->strls_capacity) {
+        size_t capacity = ctx->strls_capacity ? 2 * ctx->strls_capacity : 256;
+        dta_strl_t **strls = calloc(capacity, sizeof(dta_strl_t *));
+        if (strls == NULL)
+            return READSTAT_ERROR_MALLOC;
+
+        size_t i;
+        for (i=0; i<ctx->strls_capacity; i++) {
+            if (ctx->strls[i])
+                dta_insert_strl(strls, capacity, ctx->strls[i]);
+        }
+        free(ctx->strls);
+        ctx->strls = strls;
+        ctx->strls_capacity = capacity;
+    }
+    dta_insert_strl(ctx->strls, ctx->strls_capacity, strl);
+    ctx->strls_count++;
+    return READSTAT_OK;
+}
+
+/* Returns the contents of a strL, reading it from the file if it wasn't kept
+ * in memory. In that case strl_did_seek is set, and the caller must seek back
+ * to the data before reading more rows. */
+static readstat_error_t dta_strl_data(dta_ctx_t *ctx, dta_strl_t *strl, const char **data) {
+    readstat_error_t retval = READSTAT_OK;
+    readstat_io_t *io = ctx->io;
+
+    if (strl->is_resident) {
+        *data = strl->data;
+        goto cleanup;
+    }
+
+    if (ctx->strl_buffer_strl == strl) {
+        *data = ctx->strl_buffer;
+        goto cleanup;
+    }
+
+    if (strl->len + 1 > ctx->strl_buffer_len) {
+        char *buffer = realloc(ctx->strl_buffer, strl->len + 1);
+        if (buffer == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+        ctx->strl_buffer = buffer;
+        ctx->strl_buffer_len = strl->len + 1;
+    }
 
-    return key->v - target->v;
+    ctx->strl_buffer_strl = NULL;
+    ctx->strl_did_seek = 1;
+    if (io->seek(strl->data_offset, READSTAT_SEEK_SET, io->io_ctx) == -1) {
+        retval = READSTAT_ERROR_SEEK;
+        goto cleanup;
+    }
+    if (io->read(ctx->strl_buffer, strl->len, io->io_ctx) != strl->len) {
+        retval = READSTAT_ERROR_READ;
+        goto cleanup;
+    }
+    ctx->strl_buffer[strl->len] = '\0';
+    ctx->strl_buffer_strl = strl;
+    *data = ctx->strl_buffer;
+
+cleanup:
+    return retval;
 }
 
 static void dta_interpret_strl_vo_bytes(dta_ctx_t *ctx, unsigned char *vo_bytes, dta_strl_t *strl) {
@@ -386,6 +490,8 @@ static readstat_error_t dta_read_strls(dta_ctx_t *ctx) {
 
     readstat_error_t retval = READSTAT_OK;
     readstat_io_t *io = ctx->io;
+    readstat_off_t pos;
+    size_t header_len = (ctx->strl_o_len > 4) ? sizeof(dta_118_strl_header_t) : sizeof(dta_117_strl_header_t);
 
     if (io->seek(ctx->strls_offset, READSTAT_SEEK_SET, io->io_ctx) == -1) {
         if (ctx->error_handler) {
@@ -401,8 +507,7 @@ static readstat_error_t dta_read_strls(dta_ctx_t *ctx) {
     if (retval != READSTAT_OK)
         goto cleanup;
 
-    ctx->strls_capacity = 100;
-    ctx->strls = malloc(ctx->strls_capacity * sizeof(dta_strl_t *));
+    pos = ctx->strls_offset + sizeof("<strls>")-1;
 
     while (1) {
         char tag[3];
@@ -417,23 +522,39 @@ static readstat_error_t dta_read_strls(dta_ctx_t *ctx) {
             if (retval != READSTAT_OK)
                 goto cleanup;
 
-            if (strl.type != DTA_GSO_TYPE_ASCII)
-                continue;
+            pos += sizeof(tag) + header_len;
+            strl.data_offset = pos;
+            strl.is_resident = (ctx->strls_resident_len + strl.len <= ctx->strls_max_resident_len);
+            pos += strl.len;
 
-            if (ctx->strls_count == ctx->strls_capacity) {
-                ctx->strls_capacity *= 2;
-                ctx->strls = realloc(ctx->strls, sizeof(dta_strl_t *) * ctx->strls_capacity);
+            if (strl.type != DTA_GSO_TYPE_ASCII || !strl.is_resident) {
+                if (io->seek(strl.len, READSTAT_SEEK_CUR, io->io_ctx) == -1) {
+                    retval = READSTAT_ERROR_SEEK;
+                    goto cleanup;
+                }
+                if (strl.type != DTA_GSO_TYPE_ASCII)
+                    continue;
             }
 
-            dta_strl_t *strl_ptr = malloc(sizeof(dta_strl_t) + strl.len);
+            dta_strl_t *strl_ptr = malloc(sizeof(dta_strl_t) + (strl.is_resident ? strl.len : 0));
+            if (strl_ptr == NULL) {
+                retval = READSTAT_ERROR_MALLOC;
+                goto cleanup;
+            }
             memcpy(strl_ptr, &strl, sizeof(dta_strl_t));
 
-            ctx->strls[ctx->strls_count++] = strl_ptr;
-
-            if (io->read(&strl_ptr->data[0], strl_ptr->len, io->io_ctx) != strl_ptr->len) {
-                retval = READSTAT_ERROR_READ;
+            if ((retval = dta_add_strl(ctx, strl_ptr)) != READSTAT_OK) {
+                free(strl_ptr);
                 goto cleanup;
             }
+
+            if (strl.is_resident) {
+                ctx->strls_resident_len += strl.len;
+                if (io->read(&strl_ptr->data[0], strl_ptr->len, io->io_ctx) != strl_ptr->len) {
+                    retval = READSTAT_ERROR_READ;
+                    goto cleanup;
+                }
+            }
         } else if (memcmp(tag, "</s", sizeof(tag)) == 0) {
             retval = dta_read_tag(ctx, "trls>");
             if (retval != READSTAT_OK)
@@ -449,150 +570,328 @@ cleanup:
     return retval;
 }
 
+/* Decodes one numeric cell into value, which arrives zeroed with its type set */
+typedef void (*dta_decode_fn)(readstat_value_t *value, const char *data, dta_ctx_t *ctx);
+
+typedef struct dta_column_plan_s {
+    int              index;
+    readstat_type_t  type;
+    size_t           offset;
+    size_t           len;
+    dta_decode_fn    decode;
+} dta_column_plan_t;
+
+static void dta_tag_missing(readstat_value_t *value, int is_tagged, char tag) {
+    if (is_tagged) {
+        value->tag = tag;
+        value->is_tagged_missing = 1;
+    } else {
+        value->is_system_missing = 1;
+    }
+}
+
+static void dta_set_int8(readstat_value_t *value, int8_t byte, dta_ctx_t *ctx) {
+    if (byte > ctx->max_int8) {
+        dta_tag_missing(value, ctx->supports_tagged_missing && byte > DTA_113_MISSING_INT8,
+                'a' + (byte - DTA_113_MISSING_INT8_A));
+    }
+    value->v.i8_value = byte;
+}
+
+static void dta_set_int16(readstat_value_t *value, int16_t num, dta_ctx_t *ctx) {
+    if (num > ctx->max_int16) {
+        dta_tag_missing(value, ctx->supports_tagged_missing && num > DTA_113_MISSING_INT16,
+                'a' + (num - DTA_113_MISSING_INT16_A));
+    }
+    value->v.i16_value = num;
+}
+
+static void dta_set_int32(readstat_value_t *value, int32_t num, dta_ctx_t *ctx) {
+    if (num > ctx->max_int32) {
+        dta_tag_missing(value, ctx->supports_tagged_missing && num > DTA_113_MISSING_INT32,
+                'a' + (num - DTA_113_MISSING_INT32_A));
+    }
+    value->v.i32_value = num;
+}
+
+static void dta_set_float(readstat_value_t *value, int32_t num, dta_ctx_t *ctx) {
+    float f_num = NAN;
+    if (num > ctx->max_float) {
+        dta_tag_missing(value, ctx->supports_tagged_missing && num > DTA_113_MISSING_FLOAT,
+                'a' + ((num - DTA_113_MISSING_FLOAT_A) >> 11));
+    } else {
+        memcpy(&f_num, &num, sizeof(int32_t));
+    }
+    value->v.float_value = f_num;
+}
+
+static void dta_set_double(readstat_value_t *value, int64_t num, dta_ctx_t *ctx) {
+    double d_num = NAN;
+    if (num > ctx->max_double) {
+        dta_tag_missing(value, ctx->supports_tagged_missing && num > DTA_113_MISSING_DOUBLE,
+                'a' + ((num - DTA_113_MISSING_DOUBLE_A) >> 40));
+    } else {
+        memcpy(&d_num, &num, sizeof(int64_t));
+    }
+    value->v.double_value = d_num;
+}
+
+static void dta_decode_int8(readstat_value_t *value, const char *data, dta_ctx_t *ctx) {
+    dta_set_int8(value, data[0], ctx);
+}
+
+static void dta_decode_int8_ones(readstat_value_t *value, const char *data, dta_ctx_t *ctx) {
+    dta_set_int8(value, ones_to_twos_complement1(data[0]), ctx);
+}
+
+static void dta_decode_int16(readstat_value_t *value, const char *data, dta_ctx_t *ctx) {
+    int16_t num;
+    memcpy(&num, data, sizeof(int16_t));
+    dta_set_int16(value, num, ctx);
+}
+
+static void dta_decode_int16_bswap(readstat_value_t *value, const char *data, dta_ctx_t *ctx) {
+    int16_t num;
+    memcpy(&num, data, sizeof(int16_t));
+    dta_set_int16(value, byteswap2(num), ctx);
+}
+
+static void dta_decode_int16_ones(readstat_value_t *value, const char *data, dta_ctx_t *ctx) {
+    int16_t num;
+    memcpy(&num, data, sizeof(int16_t));
+    if (ctx->bswap) {
+        num = byteswap2(num);
+    }
+    dta_set_int16(value, ones_to_twos_complement2(num), ctx);
+}
+
+static void dta_decode_int32(readstat_value_t *value, const char *data, dta_ctx_t *ctx) {
+    int32_t num;
+    memcpy(&num, data, sizeof(int32_t));
+    dta_set_int32(value, num, ctx);
+}
+
+static void dta_decode_int32_bswap(readstat_value_t *value, const char *data, dta_ctx_t *ctx) {
+    int32_t num;
+    memcpy(&num, data, sizeof(int32_t));
+    dta_set_int32(value, byteswap4(num), ctx);
+}
+
+static void dta_decode_int32_ones(readstat_value_t *value, const char *data, dta_ctx_t *ctx) {
+    int32_t num;
+    memcpy(&num, data, sizeof(int32_t));
+    if (ctx->bswap) {
+        num = byteswap4(num);
+    }
+    dta_set_int32(value, ones_to_twos_complement4(num), ctx);
+}
+
+static void dta_decode_float(readstat_value_t *value, const char *data, dta_ctx_t *ctx) {
+    int32_t num;
+    memcpy(&num, data, sizeof(int32_t));
+    dta_set_float(value, num, ctx);
+}
+
+static void dta_decode_float_bswap(readstat_value_t *value, const char *data, dta_ctx_t *ctx) {
+    int32_t num;
+    memcpy(&num, data, sizeof(int32_t));
+    dta_set_float(value, byteswap4(num), ctx);
+}
+
+static void dta_decode_double(readstat_value_t *value, const char *data, dta_ctx_t *ctx) {
+    int64_t num;
+    memcpy(&num, data, sizeof(int64_t));
+    dta_set_double(value, num, ctx);
+}
+
+static void dta_decode_double_bswap(readstat_value_t *value, const char *data, dta_ctx_t *ctx) {
+    int64_t num;
+    memcpy(&num, data, sizeof(int64_t));
+    dta_set_double(value, byteswap8(num), ctx);
+}
+
+static dta_decode_fn dta_decoder(readstat_type_t type, dta_ctx_t *ctx) {
+    int ones = ctx->machine_is_twos_complement;
+    switch (type) {
+        case READSTAT_TYPE_INT8:
+            return ones ? &dta_decode_int8_ones : &dta_decode_int8;
+        case READSTAT_TYPE_INT16:
+            return ones ? &dta_decode_int16_ones :
+                ctx->bswap ? &dta_decode_int16_bswap : &dta_decode_int16;
+        case READSTAT_TYPE_INT32:
+            return ones ? &dta_decode_int32_ones :
+                ctx->bswap ? &dta_decode_int32_bswap : &dta_decode_int32;
+        case READSTAT_TYPE_FLOAT:
+            return ctx->bswap ? &dta_decode_float_bswap : &dta_decode_float;
+        case READSTAT_TYPE_DOUBLE:
+            return ctx->bswap ? &dta_decode_double_bswap : &dta_decode_double;
+        default:
+            return NULL;
+    }
+}
+
+/* Lays out the record once, so that the row loop only visits the columns
+ * it needs to decode. Columns rejected by the column filter are left out. */
+static dta_column_plan_t *dta_compile_plan(dta_ctx_t *ctx, int *plan_count) {
+    dta_column_plan_t *plan = NULL;
+    size_t offset = 0;
+    int i, count = 0;
+
+    if ((plan = calloc(ctx->nvar ? ctx->nvar : 1, sizeof(dta_column_plan_t))) == NULL)
+        return NULL;
+
+    for (i=0; i<ctx->nvar; i++) {
+        size_t max_len;
+        readstat_type_t type = dta_type_info(ctx->typlist[i], &max_len, ctx);
+
+        if (!ctx->variables[i] || !ctx->variables[i]->skip) {
+            dta_column_plan_t *column = &plan[count++];
+            column->index = i;
+            column->type = type;
+            column->offset = offset;
+            column->len = max_len;
+            column->decode = dta_decoder(type, ctx);
+        }
+
+        offset += max_len;
+    }
+
+    *plan_count = count;
+    return plan;
+}
+
 static readstat_error_t dta_handle_rows(dta_ctx_t *ctx) {
     readstat_io_t *io = ctx->io;
     char *buf = NULL;
     char  str_buf[2048];
+    dta_column_plan_t *plan = NULL;
+    int plan_count = 0;
+    long rows_per_read = 1;
+    readstat_off_t pos;
     int i;
     readstat_error_t retval = READSTAT_OK;
 
-    if ((buf = malloc(ctx->record_len)) == NULL) {
+    if (ctx->record_len && ctx->record_len < DTA_ROWS_BUFFER_LEN)
+        rows_per_read = DTA_ROWS_BUFFER_LEN / ctx->record_len;
+    if (rows_per_read > ctx->row_limit)
+        rows_per_read = ctx->row_limit ? ctx->row_limit : 1;
+
+    if ((buf = readstat_pool_get(ctx->pool, READSTAT_POOL_ROW, rows_per_read * ctx->record_len)) == NULL) {
         retval = READSTAT_ERROR_MALLOC;
         goto cleanup;
     }
 
-    for (i=0; i<ctx->row_limit; i++) {
-        if (io->read(buf, ctx->record_len, io->io_ctx) != ctx->record_len) {
-            retval = READSTAT_ERROR_READ;
+    if ((plan = dta_compile_plan(ctx, &plan_count)) == NULL) {
+        retval = READSTAT_ERROR_MALLOC;
+        goto cleanup;
+    }
+
+    for (i=0; ctx->batch && i<plan_count; i++) {
+        if ((retval = readstat_batch_set_column(ctx->batch, plan[i].index,
+                        ctx->variables[plan[i].index], plan[i].type)) != READSTAT_OK)
             goto cleanup;
+    }
+
+    ctx->converter_preserves_ascii = readstat_converter_preserves_ascii(ctx->converter);
+
+    if ((pos = io->seek(ctx->record_len * ctx->row_offset, READSTAT_SEEK_CUR, io->io_ctx)) == -1) {
+        retval = READSTAT_ERROR_SEEK;
+        goto cleanup;
+    }
+
+    /* Strings that didn't fit in memory are read while going through a
+     * block of rows, so the data position is restored once per block */
+    ctx->strl_did_seek = 0;
+    ctx->strl_buffer_strl = NULL;
+
+    for (i=0; i<ctx->row_limit; ) {
+        long rows_count = ctx->row_limit - i;
+        if (rows_count > rows_per_read)
+            rows_count = rows_per_read;
+
+        if (ctx->strl_did_seek) {
+            if (io->seek(pos, READSTAT_SEEK_SET, io->io_ctx) == -1) {
+                retval = READSTAT_ERROR_SEEK;
+                goto cleanup;
+            }
+            ctx->strl_did_seek = 0;
         }
-        int j;
-        readstat_off_t offset = 0;
-        for (j=0; j<ctx->nvar; j++) {
-            size_t max_len;
-            readstat_value_t value;
-            memset(&value, 0, sizeof(readstat_value_t));
-
-            value.type = dta_type_info(ctx->typlist[j], &max_len, ctx);
-
-            if (value.type == READSTAT_TYPE_STRING) {
-                readstat_convert(str_buf, sizeof(str_buf), &buf[offset], max_len, ctx->converter);
-                value.v.string_value = str_buf;
-            } else if (value.type == READSTAT_TYPE_STRING_REF) {
-                dta_strl_t key;
-                dta_interpret_strl_vo_bytes(ctx, (unsigned char *)&buf[offset], &key);
-
-                dta_strl_t **found = bsearch(&key, ctx->strls, ctx->strls_count, sizeof(dta_strl_t *), &dta_compare_strls);
-
-                if (found) {
-                    value.v.string_value = (*found)->data;
-                }
-                value.type = READSTAT_TYPE_STRING;
-            } else if (value.type == READSTAT_TYPE_INT8) {
-                int8_t byte = buf[offset];
-                if (ctx->machine_is_twos_complement) {
-                    byte = ones_to_twos_complement1(byte);
-                }
-                if (byte > ctx->max_int8) {
-                    if (ctx->supports_tagged_missing && byte > DTA_113_MISSING_INT8) {
-                        value.tag = 'a' + (byte - DTA_113_MISSING_INT8_A);
-                        value.is_tagged_missing = 1;
-                    } else {
-                        value.is_system_missing = 1;
-                    }
-                }
-                value.v.i8_value = byte;
-            } else if (value.type == READSTAT_TYPE_INT16) {
-                int16_t num = *((int16_t *)&buf[offset]);
-                if (ctx->bswap) {
-                    num = byteswap2(num);
-                }
-                if (ctx->machine_is_twos_complement) {
-                    num = ones_to_twos_complement2(num);
-                }
-                if (num > ctx->max_int16) {
-                    if (ctx->supports_tagged_missing && num > DTA_113_MISSING_INT16) {
-                        value.tag = 'a' + (num - DTA_113_MISSING_INT16_A);
-                        value.is_tagged_missing = 1;
-                    } else {
-                        value.is_system_missing = 1;
-                    }
-                }
-                value.v.i16_value = num;
-            } else if (value.type == READSTAT_TYPE_INT32) {
-                int32_t num = *((int32_t *)&buf[offset]);
-                if (ctx->bswap) {
-                    num = byteswap4(num);
-                }
-                if (ctx->machine_is_twos_complement) {
-                    num = ones_to_twos_complement4(num);
-                }
-                if (num > ctx->max_int32) {
-                    if (ctx->supports_tagged_missing && num > DTA_113_MISSING_INT32) {
-                        value.tag = 'a' + (num - DTA_113_MISSING_INT32_A);
-                        value.is_tagged_missing = 1;
-                    } else {
-                        value.is_system_missing = 1;
-                    }
-                }
-                value.v.i32_value = num;
-            } else if (value.type == READSTAT_TYPE_FLOAT) {
-                int32_t num = *((int32_t *)&buf[offset]);
-                float f_num = NAN;
-                if (ctx->bswap) {
-                    num = byteswap4(num);
-                }
-                if (num > ctx->max_float) {
-                    if (ctx->supports_tagged_missing && num > DTA_113_MISSING_FLOAT) {
-                        value.tag = 'a' + ((num - DTA_113_MISSING_FLOAT_A) >> 11);
-                        value.is_tagged_missing = 1;
-                    } else {
-                        value.is_system_missing = 1;
-                    }
-                } else {
-                    memcpy(&f_num, &num, sizeof(int32_t));
-                }
-                value.v.float_value = f_num;
-            } else if (value.type == READSTAT_TYPE_DOUBLE) {
-                int64_t num = *((int64_t *)&buf[offset]);
-                double d_num = NAN;
-                if (ctx->bswap) {
-                    num = byteswap8(num);
+
+        size_t len = rows_count * ctx->record_len;
+        ssize_t bytes_read = io->read(buf, len, io->io_ctx);
+        int short_read = (bytes_read != len);
+        if (short_read) {
+            /* Deliver the complete rows before reporting the error */
+            rows_count = (bytes_read > 0 && ctx->record_len) ? bytes_read / ctx->record_len : 0;
+        }
+        if (bytes_read > 0)
+            pos += bytes_read;
+
+        long k;
+        for (k=0; k<rows_count; k++, i++) {
+            const char *row = &buf[k * ctx->record_len];
+            int j;
+            for (j=0; j<plan_count; j++) {
+                dta_column_plan_t *column = &plan[j];
+                const char *data = &row[column->offset];
+                readstat_value_t value = { .type = column->type };
+
+                if (column->decode) {
+                    column->decode(&value, data, ctx);
+                } else if (column->type == READSTAT_TYPE_STRING) {
+                    readstat_convert_fast(str_buf, sizeof(str_buf), data, column->len,
+                            ctx->converter, ctx->converter_preserves_ascii);
+                    value.v.string_value = str_buf;
+                } else if (column->type == READSTAT_TYPE_STRING_REF) {
+                    dta_strl_t key = { 0 };
+                    dta_interpret_strl_vo_bytes(ctx, (unsigned char *)data, &key);
+
+                    dta_strl_t *found = dta_find_strl(ctx, key.v, key.o);
+
+                    if (found && (retval = dta_strl_data(ctx, found, &value.v.string_value)) != READSTAT_OK)
+                        goto cleanup;
+                    value.type = READSTAT_TYPE_STRING;
                 }
-                if (num > ctx->max_double) {
-                    if (ctx->supports_tagged_missing && num > DTA_113_MISSING_DOUBLE) {
-                        value.tag = 'a' + ((num - DTA_113_MISSING_DOUBLE_A) >> 40);
-                        value.is_tagged_missing = 1;
-                    } else {
-                        value.is_system_missing = 1;
-                    }
-                } else {
-                    memcpy(&d_num, &num, sizeof(int64_t));
+
+                if (ctx->batch) {
+                    if ((retval = readstat_batch_push_value(ctx->batch, column->index,
+                                    value)) != READSTAT_OK)
+                        goto cleanup;
+                } else if (ctx->value_handler(i, ctx->variables[column->index], value, ctx->user_ctx)) {
+                    retval = READSTAT_ERROR_USER_ABORT;
+                    goto cleanup;
                 }
-                value.v.double_value = d_num;
             }
-
-            if (ctx->value_handler(i, ctx->variables[j], value, ctx->user_ctx)) {
-                retval = READSTAT_ERROR_USER_ABORT;
+            if (ctx->batch && (retval = readstat_batch_end_row(ctx->batch)) != READSTAT_OK)
+                goto cleanup;
+            ctx->current_row++;
+            if ((retval = dta_update_progress(ctx)) != READSTAT_OK) {
                 goto cleanup;
             }
-
-            offset += max_len;
         }
-        ctx->current_row++;
-        if ((retval = dta_update_progress(ctx)) != READSTAT_OK) {
+        if (short_read) {
+            retval = READSTAT_ERROR_READ;
             goto cleanup;
         }
     }
 
-    if (ctx->row_limit < ctx->nobs) {
-        if (io->seek(ctx->record_len * (ctx->nobs - ctx->row_limit), READSTAT_SEEK_CUR, io->io_ctx) == -1)
+    if (ctx->strl_did_seek && io->seek(pos, READSTAT_SEEK_SET, io->io_ctx) == -1) {
+        retval = READSTAT_ERROR_SEEK;
+        goto cleanup;
+    }
+
+    if (ctx->batch && (retval = readstat_batch_flush(ctx->batch)) != READSTAT_OK)
+        goto cleanup;
+
+    if (ctx->row_offset + ctx->row_limit < ctx->nobs) {
+        if (io->seek(ctx->record_len * (ctx->nobs - ctx->row_offset - ctx->row_limit),
+                    READSTAT_SEEK_CUR, io->io_ctx) == -1)
             retval = READSTAT_ERROR_SEEK;
     }
 
 cleanup:
-    if (buf)
-        free(buf);
+    if (plan)
+        free(plan);
 
     return retval;
 }
@@ -601,7 +900,7 @@ static readstat_error_t dta_read_data(dta_ctx_t *ctx) {
     readstat_error_t retval = READSTAT_OK;
     readstat_io_t *io = ctx->io;
 
-    if (!ctx->value_handler) {
+    if (!ctx->value_handler && !ctx->batch) {
         return READSTAT_OK;
     }
 
@@ -812,7 +1111,7 @@ cleanup:
 }
 
 static readstat_error_t dta_handle_variables(dta_ctx_t *ctx) {
-    if (!ctx->variable_handler)
+    if (!ctx->variable_handler && !ctx->column_filter)
         return READSTAT_OK;
 
     readstat_error_t retval = READSTAT_OK;
@@ -829,7 +1128,16 @@ static readstat_error_t dta_handle_variables(dta_ctx_t *ctx) {
             max_len = 0;
         }
 
-        ctx->variables[i] = dta_init_variable(ctx, i, type, max_len);
+        if ((ctx->variables[i] = dta_init_variable(ctx, i, type, max_len)) == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+
+        if (ctx->column_filter)
+            ctx->variables[i]->skip = !ctx->column_filter(i, ctx->variables[i], ctx->user_ctx);
+
+        if (!ctx->variable_handler)
+            continue;
 
         const char *value_labels = NULL;
 
@@ -1038,6 +1346,8 @@ readstat_error_t readstat_parse_dta(readstat_parser_t *parser, const char *path,
         }
     }
 
+    ctx->pool = parser->pool;
+    readstat_string_pool_clear(ctx->pool->strings);
     retval = dta_ctx_init(ctx, header.nvar, header.nobs, header.byteorder, header.ds_format,
             parser->input_encoding, parser->output_encoding);
     if (retval != READSTAT_OK) {
@@ -1050,12 +1360,29 @@ readstat_error_t readstat_parse_dta(readstat_parser_t *parser, const char *path,
     ctx->progress_handler = parser->progress_handler;
     ctx->note_handler = parser->note_handler;
     ctx->variable_handler = parser->variable_handler;
+    ctx->column_filter = parser->column_filter;
     ctx->value_handler = parser->value_handler;
     ctx->value_label_handler = parser->value_label_handler;
-    ctx->row_limit = ctx->nobs;
-    if (parser->row_limit > 0 && parser->row_limit < ctx->nobs)
+    ctx->strls_max_resident_len = DTA_STRLS_MAX_RESIDENT_LEN;
+    if (parser->strl_memory_limit > 0)
+        ctx->strls_max_resident_len = parser->strl_memory_limit;
+    ctx->row_offset = parser->row_offset;
+    if (ctx->row_offset < 0)
+        ctx->row_offset = 0;
+    if (ctx->row_offset > ctx->nobs)
+        ctx->row_offset = ctx->nobs;
+    ctx->row_limit = ctx->nobs - ctx->row_offset;
+    if (parser->row_limit > 0 && parser->row_limit < ctx->row_limit)
         ctx->row_limit = parser->row_limit;
 
+    if (parser->batch_handler) {
+        if ((ctx->batch = readstat_batch_init(parser->batch_handler, parser->batch_size,
+                        ctx->nvar, user_ctx)) == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+    }
+
     retval = dta_update_progress(ctx);
     if (retval != READSTAT_OK)
         goto cleanup;
@@ -1102,8 +1429,10 @@ readstat_error_t readstat_parse_dta(readstat_parser_t *parser, const char *path,
         goto cleanup;
     }
 
-    if ((retval = dta_handle_variables(ctx)) != READSTAT_OK)
-        goto cleanup;
+    if (!parser->metadata_prefetch) {
+        if ((retval = dta_handle_variables(ctx)) != READSTAT_OK)
+            goto cleanup;
+    }
 
     if ((retval = dta_read_expansion_fields(ctx)) != READSTAT_OK)
         goto cleanup;
@@ -1117,14 +1446,26 @@ readstat_error_t readstat_parse_dta(readstat_parser_t *parser, const char *path,
         ctx->value_labels_offset = ctx->data_offset + ctx->record_len * ctx->nobs;
     }
 
+    /* The value labels live at the end of the file; jump ahead to them so
+     * they're delivered before the variables and data */
+    if (parser->metadata_prefetch) {
+        if ((retval = dta_handle_value_labels(ctx)) != READSTAT_OK)
+            goto cleanup;
+
+        if ((retval = dta_handle_variables(ctx)) != READSTAT_OK)
+            goto cleanup;
+    }
+
     if ((retval = dta_read_strls(ctx)) != READSTAT_OK)
         goto cleanup;
 
     if ((retval = dta_read_data(ctx)) != READSTAT_OK)
         goto cleanup;
 
-    if ((retval = dta_handle_value_labels(ctx)) != READSTAT_OK)
-        goto cleanup;
+    if (!parser->metadata_prefetch) {
+        if ((retval = dta_handle_value_labels(ctx)) != READSTAT_OK)
+            goto cleanup;
+    }
 
 cleanup:
     io->close(io->io_ctx);
@@ -96,8 +96,12 @@ static readstat_error_t dta_emit_header_time_stamp(readstat_writer_t *writer, dt
         return READSTAT_OK;
 
     readstat_error_t error = READSTAT_OK;
-    time_t now = writer->timestamp;
-    struct tm *time_s = localtime(&now);
+    struct tm local_time;
+    struct tm *time_s = &local_time;
+
+    if ((error = readstat_writer_local_time(writer, &local_time)) != READSTAT_OK)
+        return error;
+
     char *timestamp = calloc(1, ctx->timestamp_len);
     /* There are locale/portability issues with strftime so hack something up */
     char months[][4] = { 
@@ -1277,6 +1281,10 @@ static readstat_error_t dta_113_write_missing_tagged(void *row, const readstat_v
     return retval;
 }
 
+static void dta_module_ctx_free(void *module_ctx) {
+    dta_ctx_free((dta_ctx_t *)module_ctx);
+}
+
 static readstat_error_t dta_end_data(void *writer_ctx) {
     readstat_writer_t *writer = (readstat_writer_t *)writer_ctx;
     dta_ctx_t *ctx = writer->module_ctx;
@@ -1352,6 +1360,7 @@ readstat_error_t readstat_begin_writing_dta(readstat_writer_t *writer, void *use
 
     writer->callbacks.begin_data = &dta_begin_data;
     writer->callbacks.end_data = &dta_end_data;
+    writer->callbacks.module_ctx_free = &dta_module_ctx_free;
 
     return readstat_begin_writing_file(writer, user_ctx, row_count);
 }
@@ -15,6 +15,7 @@ rt_buffer_t *buffer_init() {
 
 void buffer_reset(rt_buffer_t *buffer) {
     buffer->used = 0;
+    buffer->pos = 0;
 }
 
 void buffer_free(rt_buffer_t *buffer) {
@@ -72,7 +72,82 @@ void test_dta_dates() {
     }
 }
 
+void test_dta_known_dates() {
+    struct {
+        const char *date;
+        int         days;
+    } dates[] = {
+        { "1960-01-01", 0 },
+        { "1959-12-31", -1 },
+        { "2000-02-29", 14669 },
+        { "2000-03-01", 14670 },
+        { "1582-10-15", -137774 },
+        { "0800-02-29", -423622 },
+        { "0001-01-01", -715509 },
+        { "9999-12-31", 2936549 }
+    };
+    char buf[1024];
+    for (int i=0; i<sizeof(dates)/sizeof(dates[0]); i++) {
+        char *dest;
+        int days = readstat_dta_num_days(dates[i].date, &dest);
+        if (dest == dates[i].date || days != dates[i].days) {
+            fprintf(stderr, "failure. Expected %s to be %d days, got %d\n", dates[i].date, dates[i].days, days);
+            exit(EXIT_FAILURE);
+        }
+        readstat_dta_days_string(dates[i].days, buf, sizeof(buf)-1);
+        if (0 != strcmp(buf, dates[i].date)) {
+            fprintf(stderr, "failure. Expected %s, got %s\n", dates[i].date, buf);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+void test_dta_dates_scanf_syntax() {
+    /* Whitespace and signs before each number, as sscanf's %d allows */
+    const char *dates[] = { " 2016-02-29", "2016- 2-29", "2016-02- 29", "+2016-+2-+29", "2016-2-29" };
+    for (int i=0; i<sizeof(dates)/sizeof(dates[0]); i++) {
+        char *dest;
+        int days = readstat_dta_num_days(dates[i], &dest);
+        if (dest == dates[i] || days != 20513) {
+            fprintf(stderr, "failure. Expected \"%s\" to be 20513 days, got %d\n", dates[i], days);
+            exit(EXIT_FAILURE);
+        }
+    }
+    const char *bad[] = { "2016 -02-29", "2016-02--29", "2016--02-29", "2016-02", "x2016-02-29" };
+    for (int i=0; i<sizeof(bad)/sizeof(bad[0]); i++) {
+        char *dest;
+        readstat_dta_num_days(bad[i], &dest);
+        if (dest != bad[i]) {
+            fprintf(stderr, "failure. Expected \"%s\" not to parse\n", bad[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+void test_dta_dates_batch() {
+    const char *strings[] = { "1960-01-01", "1999-12-31", "2016-02-29", "2016-02-30", "2017-01-01" };
+    int days[5];
+    char buf[3][16];
+
+    size_t count = readstat_dta_num_days_batch(strings, 5, days);
+    if (count != 3) {
+        fprintf(stderr, "failure. Expected to parse 3 dates, parsed %d\n", (int)count);
+        exit(EXIT_FAILURE);
+    }
+
+    readstat_dta_days_string_batch(days, count, &buf[0][0], sizeof(buf[0]));
+    for (int i=0; i<count; i++) {
+        if (0 != strcmp(buf[i], strings[i])) {
+            fprintf(stderr, "failure. Expected %s, got %s\n", strings[i], buf[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
 int main(int argc, char *argv[]) {
     test_dta_dates();
+    test_dta_known_dates();
+    test_dta_dates_scanf_syntax();
+    test_dta_dates_batch();
     return 0;
 }
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+#include "../bin/modules/format_number.h"
+
+static int check_round_trip(double value, int is_float) {
+    char buf[FORMAT_NUMBER_MAX_LEN+1];
+    int len = is_float ? format_number_float(buf, value) : format_number_double(buf, value);
+    buf[len] = '\0';
+    if (is_float ? strtof(buf, NULL) != (float)value : strtod(buf, NULL) != value) {
+        printf("%s:%d error %.17g was written as %s, which doesn't read back\n", __FILE__, __LINE__, value, buf);
+        return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    char buf[FORMAT_NUMBER_MAX_LEN+1];
+    int len;
+    long i;
+
+    #define EXPECT_FORMAT(function, v, expected) \
+        len = function(buf, v); \
+        buf[len] = '\0'; \
+        if (strcmp(buf, expected) != 0) { \
+            printf("%s:%d error got %s, expected %s\n", __FILE__, __LINE__, buf, expected); \
+            exit(EXIT_FAILURE); \
+        } else { \
+            printf("%s:%d OK got %s\n", __FILE__, __LINE__, expected); \
+        }
+
+    EXPECT_FORMAT(format_number_integer, 0, "0");
+    EXPECT_FORMAT(format_number_integer, -128, "-128");
+    EXPECT_FORMAT(format_number_integer, 2147483647, "2147483647");
+    EXPECT_FORMAT(format_number_integer, -2147483647-1, "-2147483648");
+
+    EXPECT_FORMAT(format_number_double, 0.0, "0");
+    EXPECT_FORMAT(format_number_double, -0.0, "-0");
+    EXPECT_FORMAT(format_number_double, 1.5, "1.5");
+    EXPECT_FORMAT(format_number_double, -123.123, "-123.123");
+    EXPECT_FORMAT(format_number_double, 1500.0, "1500");
+    EXPECT_FORMAT(format_number_double, 0.1, "0.1");
+    EXPECT_FORMAT(format_number_double, 0.1 + 0.2, "0.30000000000000004");
+    EXPECT_FORMAT(format_number_double, 123.12345678901234, "123.12345678901234");
+    EXPECT_FORMAT(format_number_double, 1.0/3, "0.3333333333333333");
+    EXPECT_FORMAT(format_number_double, 0.000001, "0.000001");
+    EXPECT_FORMAT(format_number_double, 1.5e-8, "1.5e-8");
+    EXPECT_FORMAT(format_number_double, 1e21, "1e+21");
+    EXPECT_FORMAT(format_number_double, 123456789012345680000.0, "123456789012345680000");
+    EXPECT_FORMAT(format_number_double, 1.7976931348623157e308, "1.7976931348623157e+308");
+    EXPECT_FORMAT(format_number_double, 5e-324, "5e-324");
+    EXPECT_FORMAT(format_number_double, NAN, "nan");
+    EXPECT_FORMAT(format_number_double, -INFINITY, "-inf");
+
+    EXPECT_FORMAT(format_number_float, 0.1f, "0.1");
+    EXPECT_FORMAT(format_number_float, -2.5f, "-2.5");
+    EXPECT_FORMAT(format_number_float, 16777216.0f, "16777216");
+    EXPECT_FORMAT(format_number_float, 3.4028235e38f, "3.4028235e+38");
+    EXPECT_FORMAT(format_number_float, 1.0f/3, "0.33333334");
+
+    srand(1);
+    for (i=0; i<1000000; i++) {
+        uint64_t bits = 0;
+        double value;
+        float float_value;
+        int j;
+        for (j=0; j<4; j++) {
+            bits = (bits << 16) | (rand() & 0xFFFF);
+        }
+        memcpy(&value, &bits, sizeof(double));
+        if (!isfinite(value))
+            continue;
+        if (!check_round_trip(value, 0))
+            exit(EXIT_FAILURE);
+        if (!check_round_trip(round(value * 1000) / 1000, 0))
+            exit(EXIT_FAILURE);
+
+        uint32_t float_bits = (uint32_t)bits;
+        memcpy(&float_value, &float_bits, sizeof(float));
+        if (isfinite(float_value) && !check_round_trip(float_value, 1))
+            exit(EXIT_FAILURE);
+    }
+    printf("%s:%d OK random values read back\n", __FILE__, __LINE__);
+
+    return 0;
+}
@@ -0,0 +1,260 @@
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "../readstat.h"
+#include "../readstat_io_unistd.h"
+
+#define ROWS      300
+
+typedef struct file_bytes_s {
+    const char     *path;
+    unsigned char  *bytes;
+    size_t          len;
+} file_bytes_t;
+
+static char tmp_dir[] = "/tmp/readstat_test_io.XXXXXX";
+static char data_path[sizeof(tmp_dir) + 16];
+static char empty_path[sizeof(tmp_dir) + 16];
+static char fifo_path[sizeof(tmp_dir) + 16];
+
+static ssize_t write_data(const void *bytes, size_t len, void *ctx) {
+    return write(*(int *)ctx, bytes, len);
+}
+
+static void write_file(const char *path) {
+    readstat_writer_t *writer = readstat_writer_init();
+    readstat_variable_t *id, *name;
+    readstat_error_t error = READSTAT_OK;
+    char string[32];
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    long i;
+
+    readstat_set_data_writer(writer, &write_data);
+
+    id = readstat_add_variable(writer, "id", READSTAT_TYPE_DOUBLE, 0);
+    name = readstat_add_variable(writer, "name", READSTAT_TYPE_STRING, 16);
+
+    if ((error = readstat_begin_writing_sav(writer, &fd, ROWS)) != READSTAT_OK)
+        goto cleanup;
+
+    for (i=0; i<ROWS; i++) {
+        snprintf(string, sizeof(string), "row %ld", i);
+        if ((error = readstat_begin_row(writer)) != READSTAT_OK)
+            goto cleanup;
+        if ((error = readstat_insert_double_value(writer, id, i * 1.5)) != READSTAT_OK)
+            goto cleanup;
+        if ((error = readstat_insert_string_value(writer, name, string)) != READSTAT_OK)
+            goto cleanup;
+        if ((error = readstat_end_row(writer)) != READSTAT_OK)
+            goto cleanup;
+    }
+
+    error = readstat_end_writing(writer);
+
+cleanup:
+    readstat_writer_free(writer);
+    if (fd == -1 || close(fd) == -1 || error != READSTAT_OK) {
+        fprintf(stderr, "Error writing %s: %s\n", path, readstat_error_message(error));
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void slurp_file(file_bytes_t *file) {
+    struct stat st;
+    int fd = open(file->path, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        fprintf(stderr, "Error opening %s\n", file->path);
+        exit(EXIT_FAILURE);
+    }
+    file->len = st.st_size;
+    file->bytes = malloc(file->len);
+    if (read(fd, file->bytes, file->len) != (ssize_t)file->len) {
+        fprintf(stderr, "Error reading %s\n", file->path);
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+}
+
+static int handle_variable(int index, readstat_variable_t *variable,
+        const char *val_labels, void *ctx) {
+    return 0;
+}
+
+static int handle_value(int obs_index, readstat_variable_t *variable, readstat_value_t value, void *ctx) {
+    uint64_t *hash = (uint64_t *)ctx;
+    char string[32];
+    const char *p;
+
+    if (readstat_value_type(value) == READSTAT_TYPE_STRING) {
+        p = readstat_string_value(value);
+    } else {
+        snprintf(string, sizeof(string), "%d:%.17g", obs_index, readstat_double_value(value));
+        p = string;
+    }
+    while (*p) {
+        *hash ^= (unsigned char)*p++;
+        *hash *= 1099511628211ULL;
+    }
+    *hash ^= readstat_variable_get_index(variable);
+    *hash *= 1099511628211ULL;
+    return 0;
+}
+
+static readstat_error_t parse_file(const char *path, int use_mmap, uint64_t *hash) {
+    readstat_parser_t *parser = readstat_parser_init();
+    readstat_error_t error = READSTAT_OK;
+
+    *hash = 14695981039346656037ULL;
+
+    if (use_mmap) {
+        /* Twice, to check that the first context is released */
+        if ((error = readstat_io_mmap_init(parser)) != READSTAT_OK)
+            goto cleanup;
+        if ((error = readstat_io_mmap_init(parser)) != READSTAT_OK)
+            goto cleanup;
+    }
+
+    readstat_set_variable_handler(parser, &handle_variable);
+    readstat_set_value_handler(parser, &handle_value);
+
+    error = readstat_parse_sav(parser, path, hash);
+
+cleanup:
+    readstat_parser_free(parser);
+    return error;
+}
+
+static int check_parse(const char *path) {
+    uint64_t expected_hash, hash;
+    readstat_error_t expected_error = parse_file(path, 0, &expected_hash);
+    readstat_error_t error = parse_file(path, 1, &hash);
+
+    if (error != expected_error) {
+        printf("%s:%d parsing %s with mmap returned \"%s\", expected \"%s\"\n",
+                __FILE__, __LINE__, path, readstat_error_message(error),
+                readstat_error_message(expected_error));
+        return 0;
+    }
+    if (hash != expected_hash) {
+        printf("%s:%d parsing %s with mmap returned different values\n", __FILE__, __LINE__, path);
+        return 0;
+    }
+    return 1;
+}
+
+static void *write_fifo(void *ctx) {
+    file_bytes_t *file = (file_bytes_t *)ctx;
+    int fd = open(fifo_path, O_WRONLY);
+    if (fd != -1) {
+        if (write(fd, file->bytes, file->len) != (ssize_t)file->len)
+            fprintf(stderr, "Error writing to %s\n", fifo_path);
+        close(fd);
+    }
+    return NULL;
+}
+
+/* Reads the whole file through the mmap handlers, in odd-sized pieces */
+static int check_handlers(const char *path, const file_bytes_t *expected, int seekable) {
+    mmap_io_ctx_t ctx = { .unistd_ctx = { .fd = -1 } };
+    unsigned char *bytes = malloc(expected->len + 1);
+    size_t len = 0;
+    ssize_t bytes_read;
+    int ok = 0;
+
+    if (mmap_open_handler(path, &ctx) == -1) {
+        printf("%s:%d unable to open %s\n", __FILE__, __LINE__, path);
+        goto cleanup;
+    }
+
+    if (seekable) {
+        if (mmap_seek_handler(0, READSTAT_SEEK_END, &ctx) != (readstat_off_t)expected->len) {
+            printf("%s:%d seeking to the end of %s failed\n", __FILE__, __LINE__, path);
+            goto cleanup;
+        }
+        if (mmap_seek_handler(0, READSTAT_SEEK_SET, &ctx) != 0) {
+            printf("%s:%d seeking to the start of %s failed\n", __FILE__, __LINE__, path);
+            goto cleanup;
+        }
+    }
+
+    while ((bytes_read = mmap_read_handler(&bytes[len], 37, &ctx)) > 0) {
+        len += bytes_read;
+        if (len > expected->len)
+            break;
+    }
+
+    if (bytes_read == -1) {
+        printf("%s:%d reading %s failed\n", __FILE__, __LINE__, path);
+    } else if (len != expected->len || (len && memcmp(bytes, expected->bytes, len) != 0)) {
+        printf("%s:%d read %zu bytes from %s, expected %zu\n", __FILE__, __LINE__,
+                len, path, expected->len);
+    } else {
+        ok = 1;
+    }
+
+cleanup:
+    if (mmap_close_handler(&ctx) == -1 || ctx.unistd_ctx.fd != -1) {
+        printf("%s:%d closing %s failed\n", __FILE__, __LINE__, path);
+        ok = 0;
+    }
+    free(bytes);
+    return ok;
+}
+
+static int check_fifo(const file_bytes_t *expected) {
+    pthread_t thread;
+    int ok;
+
+    if (mkfifo(fifo_path, 0600) == -1) {
+        printf("%s:%d unable to create %s\n", __FILE__, __LINE__, fifo_path);
+        return 0;
+    }
+    pthread_create(&thread, NULL, &write_fifo, (void *)expected);
+    ok = check_handlers(fifo_path, expected, 0);
+    pthread_join(thread, NULL);
+    unlink(fifo_path);
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    file_bytes_t data = { .path = data_path };
+    file_bytes_t empty = { .path = empty_path };
+    int ok = 1;
+    int fd;
+
+    if (mkdtemp(tmp_dir) == NULL) {
+        fprintf(stderr, "Unable to create a temporary directory\n");
+        return EXIT_FAILURE;
+    }
+    snprintf(data_path, sizeof(data_path), "%s/data.sav", tmp_dir);
+    snprintf(empty_path, sizeof(empty_path), "%s/empty.sav", tmp_dir);
+    snprintf(fifo_path, sizeof(fifo_path), "%s/fifo.sav", tmp_dir);
+
+    write_file(data_path);
+    slurp_file(&data);
+    if ((fd = open(empty_path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) != -1)
+        close(fd);
+
+    ok &= check_parse(data_path);
+    ok &= check_parse(empty_path);
+    ok &= check_parse("/dev/null");
+
+    ok &= check_handlers(data_path, &data, 1);
+    ok &= check_handlers(empty_path, &empty, 1);
+    ok &= check_fifo(&data);
+
+    unlink(data_path);
+    unlink(empty_path);
+    rmdir(tmp_dir);
+    free(data.bytes);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "../bin/modules/parse_number.h"
+
+static int check_matches_strtod(const char *s) {
+    char *expected_end, *end;
+    double expected = strtod(s, &expected_end);
+    double value = parse_number_double(s, &end);
+    if (memcmp(&value, &expected, sizeof(double)) != 0 || end != expected_end) {
+        printf("%s:%d error parsing \"%s\": got %.17g (%d chars), expected %.17g (%d chars)\n",
+                __FILE__, __LINE__, s, value, (int)(end - s), expected, (int)(expected_end - s));
+        return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    const char *cases[] = {
+        "0", "-0", "+1", "1.5", "-123.123", ".5", "5.", "0.1", "0.30000000000000004",
+        "123.12345678901234", "9007199254740993", "12345678901234567890", "1e22", "1e23",
+        "1.5e-8", "1E+5", "2.5e", "2.5e+", "1e-400", "1e400", "0x1A", "-0X10", "nan", "inf",
+        "-Infinity", " 42", "", "-", ".", "abc", "12abc", "1,5", "007", "0.000000000000000000000001",
+        "179769313486231570000000000000000000000000000000000000000000000000000000000000",
+        "4.9406564584124654e-324", "2.2250738585072011e-308"
+    };
+    char buf[64];
+    long i;
+
+    for (i=0; i<sizeof(cases)/sizeof(cases[0]); i++) {
+        if (!check_matches_strtod(cases[i]))
+            exit(EXIT_FAILURE);
+        printf("%s:%d OK \"%s\"\n", __FILE__, __LINE__, cases[i]);
+    }
+
+    srand(1);
+    for (i=0; i<1000000; i++) {
+        int64_t mantissa = ((int64_t)rand() << 31 | rand()) % 100000000000LL - 50000000000LL;
+        int decimals = rand() % 12;
+        int exponent = rand() % 60 - 30;
+        switch (i % 3) {
+            case 0:
+                snprintf(buf, sizeof(buf), "%.*f", decimals, mantissa / 1e6);
+                break;
+            case 1:
+                snprintf(buf, sizeof(buf), "%lld.%de%d", (long long)mantissa, decimals, exponent);
+                break;
+            default:
+                snprintf(buf, sizeof(buf), "%.17g", mantissa * 1e-9);
+        }
+        if (!check_matches_strtod(buf))
+            exit(EXIT_FAILURE);
+    }
+    printf("%s:%d OK random values match strtod\n", __FILE__, __LINE__);
+
+    return 0;
+}
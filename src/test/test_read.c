@@ -1,6 +1,8 @@
 #include <stdlib.h>
 
 #include "../readstat.h"
+#include "../readstat_iconv.h"
+#include "../readstat_pool.h"
 
 #include "test_types.h"
 #include "test_error.h"
@@ -39,10 +41,14 @@ char *file_extension(long format) {
         return "sas7bdat32";
     if (format == RT_FORMAT_SAS7BDAT_32BIT_COMP_ROWS)
         return "sas7bdat32row";
+    if (format == RT_FORMAT_SAS7BDAT_32BIT_COMP_BINARY)
+        return "sas7bdat32bin";
     if (format == RT_FORMAT_SAS7BDAT_64BIT_COMP_NONE)
         return "sas7bdat64";
     if (format == RT_FORMAT_SAS7BDAT_64BIT_COMP_ROWS)
         return "sas7bdat64row";
+    if (format == RT_FORMAT_SAS7BDAT_64BIT_COMP_BINARY)
+        return "sas7bdat64bin";
     if (format == RT_FORMAT_XPORT_5)
         return "xpt5";
     if (format == RT_FORMAT_XPORT_8)
@@ -87,6 +93,10 @@ void parse_ctx_reset(rt_parse_ctx_t *parse_ctx, long file_format) {
     }
     parse_ctx->var_index = -1;
     parse_ctx->obs_index = -1;
+    parse_ctx->row_offset = 0;
+    parse_ctx->row_count = parse_ctx->file->rows;
+    parse_ctx->pool = NULL;
+    parse_ctx->pool_allocations = -1;
     parse_ctx->notes_count = 0;
     parse_ctx->variables_count = 0;
     parse_ctx->value_labels_count = 0;
@@ -171,7 +181,7 @@ static int handle_info(int obs_count, int var_count, void *ctx) {
 
     if (obs_count != -1) {
         push_error_if_doubles_differ(rt_ctx, 
-                rt_ctx->file->rows, obs_count, 
+                rt_ctx->row_count, obs_count, 
                 "Number of observations");
     }
 
@@ -285,13 +295,38 @@ static int handle_value_label(const char *val_labels, readstat_value_t value, co
     return 0;
 }
 
-static int handle_value(int obs_index, readstat_variable_t *variable, readstat_value_t value, void *ctx) {
+static long file_value_labels_count(rt_test_file_t *file) {
+    long count = 0;
+    long i;
+    for (i=0; i<file->label_sets_count; i++) {
+        count += file->label_sets[i].value_labels_count;
+    }
+    return count;
+}
+
+/* With metadata prefetch, every value label comes before the first variable */
+static int handle_variable_after_labels(int index, readstat_variable_t *variable,
+        const char *val_labels, void *ctx) {
     rt_parse_ctx_t *rt_ctx = (rt_parse_ctx_t *)ctx;
-    rt_ctx->obs_index = obs_index;
-    rt_ctx->var_index = readstat_variable_get_index(variable);
 
+    if (rt_ctx->variables_count == 0) {
+        push_error_if_doubles_differ(rt_ctx, file_value_labels_count(rt_ctx->file),
+                rt_ctx->value_labels_count, "Value labels count before the first variable (prefetched)");
+    }
+
+    return handle_variable(index, variable, val_labels, ctx);
+}
+
+static void check_value(rt_parse_ctx_t *rt_ctx, int obs_index, readstat_value_t value) {
     rt_column_t *column = &rt_ctx->file->columns[rt_ctx->var_index];
 
+    obs_index += rt_ctx->row_offset;
+    if (obs_index >= rt_ctx->file->rows) {
+        push_error_if_doubles_differ(rt_ctx, rt_ctx->file->rows - 1,
+                obs_index, "Row index");
+        return;
+    }
+
     if (column->type == READSTAT_TYPE_STRING_REF) {
         push_error_if_strings_differ(rt_ctx,
                 rt_ctx->file->string_refs[readstat_int32_value(column->values[obs_index])],
@@ -301,35 +336,80 @@ static int handle_value(int obs_index, readstat_variable_t *variable, readstat_v
                 column->values[obs_index],
                 value, "Data values");
     }
+}
+
+static int handle_value(int obs_index, readstat_variable_t *variable, readstat_value_t value, void *ctx) {
+    rt_parse_ctx_t *rt_ctx = (rt_parse_ctx_t *)ctx;
+    rt_ctx->obs_index = obs_index;
+    rt_ctx->var_index = readstat_variable_get_index(variable);
+
+    /* Once the first row is through, decoding shouldn't need more memory */
+    if (obs_index == 1 && rt_ctx->pool_allocations == -1)
+        rt_ctx->pool_allocations = rt_ctx->pool->allocations;
+
+    check_value(rt_ctx, obs_index, value);
 
     return 0;
 }
 
+static int handle_batch(int obs_index, int obs_count, readstat_column_t *columns, int columns_count, void *ctx) {
+    rt_parse_ctx_t *rt_ctx = (rt_parse_ctx_t *)ctx;
+    char string[2048];
+    int i, j;
+
+    push_error_if_doubles_differ(rt_ctx, rt_ctx->file->columns_count,
+            columns_count, "Batch column count");
+
+    for (j=0; j<columns_count && j<rt_ctx->file->columns_count; j++) {
+        readstat_column_t *column = &columns[j];
+        rt_ctx->var_index = j;
+        if (j % 2) {
+            push_error_if_doubles_differ(rt_ctx, 0,
+                    column->variable != NULL, "Filtered column");
+            continue;
+        }
+        for (i=0; i<obs_count; i++) {
+            readstat_value_t value = { .type = column->type };
+            rt_ctx->obs_index = obs_index + i;
+
+            if (column->missing[i/8] & (1 << (i%8))) {
+                value.tag = column->tags[i];
+                value.is_tagged_missing = (value.tag != 0);
+                value.is_system_missing = (value.tag == 0);
+            }
+
+            if (column->type == READSTAT_TYPE_STRING) {
+                snprintf(string, sizeof(string), "%.*s", (int)column->string_lengths[i],
+                        &column->string_data[column->string_offsets[i]]);
+                value.v.string_value = string;
+            } else if (column->type == READSTAT_TYPE_FLOAT || column->type == READSTAT_TYPE_DOUBLE) {
+                value.type = READSTAT_TYPE_DOUBLE;
+                value.v.double_value = column->double_values[i];
+            } else {
+                value.type = READSTAT_TYPE_INT32;
+                value.v.i32_value = column->i32_values[i];
+            }
+
+            check_value(rt_ctx, obs_index + i, value);
+        }
+    }
+
+    rt_ctx->obs_index = obs_index + obs_count - 1;
+
+    return 0;
+}
+
+static int handle_column_filter(int index, readstat_variable_t *variable, void *ctx) {
+    return index % 2 == 0;
+}
+
 static void handle_error(const char *error_message, void *ctx) {
     printf("%s\n", error_message);
 }
 
-readstat_error_t read_file(rt_parse_ctx_t *parse_ctx, long format) {
+static readstat_error_t parse_file(readstat_parser_t *parser, rt_parse_ctx_t *parse_ctx, long format) {
     readstat_error_t error = READSTAT_OK;
 
-    readstat_parser_t *parser = readstat_parser_init();
-
-    readstat_set_open_handler(parser, rt_open_handler);
-    readstat_set_close_handler(parser, rt_close_handler);
-    readstat_set_seek_handler(parser, rt_seek_handler);
-    readstat_set_read_handler(parser, rt_read_handler);
-    readstat_set_update_handler(parser, rt_update_handler);
-    readstat_set_io_ctx(parser, parse_ctx->buffer_ctx);
-
-    readstat_set_info_handler(parser, &handle_info);
-    readstat_set_metadata_handler(parser, &handle_metadata);
-    readstat_set_note_handler(parser, &handle_note);
-    readstat_set_variable_handler(parser, &handle_variable);
-    readstat_set_fweight_handler(parser, &handle_fweight);
-    readstat_set_value_handler(parser, &handle_value);
-    readstat_set_value_label_handler(parser, &handle_value_label);
-    readstat_set_error_handler(parser, &handle_error);
-
     if ((format & RT_FORMAT_DTA)) {
         parse_ctx->file_format_version = dta_file_format_version(format);
         error = readstat_parse_dta(parser, NULL, parse_ctx);
@@ -348,9 +428,42 @@ readstat_error_t read_file(rt_parse_ctx_t *parse_ctx, long format) {
         parse_ctx->file_format_version = sas_file_format_version(format);
         error = readstat_parse_xport(parser, NULL, parse_ctx);
     }
+
+    return error;
+}
+
+readstat_error_t read_file(readstat_parser_t *parser, rt_parse_ctx_t *parse_ctx, long format) {
+    readstat_error_t error = READSTAT_OK;
+
+    readstat_parser_reset(parser);
+
+    readstat_set_open_handler(parser, rt_open_handler);
+    readstat_set_close_handler(parser, rt_close_handler);
+    readstat_set_seek_handler(parser, rt_seek_handler);
+    readstat_set_read_handler(parser, rt_read_handler);
+    readstat_set_update_handler(parser, rt_update_handler);
+    readstat_set_io_ctx(parser, parse_ctx->buffer_ctx);
+
+    readstat_set_info_handler(parser, &handle_info);
+    readstat_set_metadata_handler(parser, &handle_metadata);
+    readstat_set_note_handler(parser, &handle_note);
+    readstat_set_variable_handler(parser, &handle_variable);
+    readstat_set_fweight_handler(parser, &handle_fweight);
+    readstat_set_value_handler(parser, &handle_value);
+    readstat_set_value_label_handler(parser, &handle_value_label);
+    readstat_set_error_handler(parser, &handle_error);
+
+    parse_ctx->pool = parser->pool;
+
+    error = parse_file(parser, parse_ctx, format);
     if (error != READSTAT_OK)
         goto cleanup;
 
+    if (parse_ctx->pool_allocations != -1) {
+        push_error_if_doubles_differ(parse_ctx, parse_ctx->pool_allocations,
+                parser->pool->allocations, "Scratch buffer allocations after the first row");
+    }
+
     push_error_if_doubles_differ(parse_ctx, parse_ctx->file->notes_count,
             parse_ctx->notes_count, "Note count");
 
@@ -360,18 +473,210 @@ readstat_error_t read_file(rt_parse_ctx_t *parse_ctx, long format) {
     push_error_if_doubles_differ(parse_ctx, parse_ctx->file->rows,
             parse_ctx->obs_index + 1, "Row count");
 
-    long value_labels_count = 0;
-    long i;
-    for (i=0; i<parse_ctx->file->label_sets_count; i++) {
-        value_labels_count += parse_ctx->file->label_sets[i].value_labels_count;
+    push_error_if_doubles_differ(parse_ctx, file_value_labels_count(parse_ctx->file),
+            parse_ctx->value_labels_count, "Value labels count");
+
+cleanup:
+    return error;
+}
+
+readstat_error_t read_file_batched(readstat_parser_t *parser, rt_parse_ctx_t *parse_ctx, long format) {
+    readstat_error_t error = READSTAT_OK;
+
+    readstat_parser_reset(parser);
+
+    readstat_set_open_handler(parser, rt_open_handler);
+    readstat_set_close_handler(parser, rt_close_handler);
+    readstat_set_seek_handler(parser, rt_seek_handler);
+    readstat_set_read_handler(parser, rt_read_handler);
+    readstat_set_update_handler(parser, rt_update_handler);
+    readstat_set_io_ctx(parser, parse_ctx->buffer_ctx);
+
+    readstat_set_batch_handler(parser, &handle_batch);
+    readstat_set_batch_size(parser, 3);
+    readstat_set_column_filter(parser, &handle_column_filter);
+    readstat_set_thread_count(parser, 4);
+    readstat_set_error_handler(parser, &handle_error);
+
+    parse_ctx->buffer_ctx->pos = 0;
+    parse_ctx->var_index = -1;
+    parse_ctx->obs_index = -1;
+
+    error = parse_file(parser, parse_ctx, format);
+    if (error != READSTAT_OK)
+        goto cleanup;
+
+    if (!(format & RT_FORMAT_SAS7BCAT)) {
+        push_error_if_doubles_differ(parse_ctx, parse_ctx->file->rows,
+                parse_ctx->obs_index + 1, "Row count (batched)");
     }
 
-    push_error_if_doubles_differ(parse_ctx, value_labels_count,
-            parse_ctx->value_labels_count, "Value labels count");
+cleanup:
+    return error;
+}
+
+static readstat_error_t read_row_range(readstat_parser_t *parser, rt_parse_ctx_t *parse_ctx, long format,
+        long row_offset, long row_limit, int thread_count) {
+    readstat_error_t error = READSTAT_OK;
+
+    readstat_parser_reset(parser);
+
+    readstat_set_open_handler(parser, rt_open_handler);
+    readstat_set_close_handler(parser, rt_close_handler);
+    readstat_set_seek_handler(parser, rt_seek_handler);
+    readstat_set_read_handler(parser, rt_read_handler);
+    readstat_set_update_handler(parser, rt_update_handler);
+    readstat_set_io_ctx(parser, parse_ctx->buffer_ctx);
+
+    readstat_set_info_handler(parser, &handle_info);
+    readstat_set_variable_handler(parser, &handle_variable);
+    readstat_set_value_handler(parser, &handle_value);
+    readstat_set_error_handler(parser, &handle_error);
+    readstat_set_row_offset(parser, row_offset);
+    readstat_set_row_limit(parser, row_limit);
+    readstat_set_thread_count(parser, thread_count);
+
+    parse_ctx->buffer_ctx->pos = 0;
+    parse_ctx->var_index = -1;
+    parse_ctx->obs_index = -1;
+    parse_ctx->row_offset = row_offset;
+    parse_ctx->row_count = parse_ctx->file->rows - row_offset;
+    if (parse_ctx->row_count < 0)
+        parse_ctx->row_count = 0;
+    if (row_limit && row_limit < parse_ctx->row_count)
+        parse_ctx->row_count = row_limit;
+
+    error = parse_file(parser, parse_ctx, format);
+    if (error != READSTAT_OK)
+        goto cleanup;
+
+    push_error_if_doubles_differ(parse_ctx, parse_ctx->row_count,
+            parse_ctx->obs_index + 1, "Row count (with row offset)");
 
 cleanup:
-    readstat_parser_free(parser);
+    parse_ctx->row_offset = 0;
+    parse_ctx->row_count = parse_ctx->file->rows;
+    return error;
+}
+
+/* Reads windows of rows from the start, middle and end of the file, and
+ * past its end, on one thread and on several */
+readstat_error_t read_file_row_ranges(readstat_parser_t *parser, rt_parse_ctx_t *parse_ctx, long format) {
+    readstat_error_t error = READSTAT_OK;
+    long rows = parse_ctx->file->rows;
+    long ranges[][2] = {
+        { 0, 1 },
+        { 1, 0 },
+        { 1, 1 },
+        { rows / 2, 0 },
+        { rows - 1, 2 },
+        { rows, 0 },
+        { rows + 1, 1 }
+    };
+    int thread_counts[] = { 1, 4 };
+    int i, j;
+
+    if ((format & RT_FORMAT_SAS7BCAT) || rows == 0)
+        return READSTAT_OK;
+
+    for (i=0; i<sizeof(thread_counts)/sizeof(thread_counts[0]); i++) {
+        for (j=0; j<sizeof(ranges)/sizeof(ranges[0]); j++) {
+            error = read_row_range(parser, parse_ctx, format,
+                    ranges[j][0], ranges[j][1], thread_counts[i]);
+            if (error != READSTAT_OK)
+                return error;
+        }
+    }
+
+    return READSTAT_OK;
+}
+
+/* Keeps only the first few bytes of strLs in memory, so that the rest are
+ * read from the file as rows refer to them */
+readstat_error_t read_file_lazy_strls(readstat_parser_t *parser, rt_parse_ctx_t *parse_ctx, long format) {
+    readstat_error_t error = READSTAT_OK;
+
+    if (!(format & RT_FORMAT_DTA_117_AND_NEWER) || parse_ctx->file->string_refs_count == 0)
+        return READSTAT_OK;
+
+    readstat_parser_reset(parser);
+
+    readstat_set_open_handler(parser, rt_open_handler);
+    readstat_set_close_handler(parser, rt_close_handler);
+    readstat_set_seek_handler(parser, rt_seek_handler);
+    readstat_set_read_handler(parser, rt_read_handler);
+    readstat_set_update_handler(parser, rt_update_handler);
+    readstat_set_io_ctx(parser, parse_ctx->buffer_ctx);
 
+    readstat_set_info_handler(parser, &handle_info);
+    readstat_set_variable_handler(parser, &handle_variable);
+    readstat_set_value_handler(parser, &handle_value);
+    readstat_set_value_label_handler(parser, &handle_value_label);
+    readstat_set_error_handler(parser, &handle_error);
+    readstat_set_strl_memory_limit(parser, 6);
+
+    parse_ctx->buffer_ctx->pos = 0;
+    parse_ctx->var_index = -1;
+    parse_ctx->obs_index = -1;
+    parse_ctx->value_labels_count = 0;
+
+    error = parse_file(parser, parse_ctx, format);
+    if (error != READSTAT_OK)
+        goto cleanup;
+
+    push_error_if_doubles_differ(parse_ctx, parse_ctx->file->rows,
+            parse_ctx->obs_index + 1, "Row count (with strLs read from the file)");
+
+    push_error_if_doubles_differ(parse_ctx, file_value_labels_count(parse_ctx->file),
+            parse_ctx->value_labels_count, "Value labels count (with strLs read from the file)");
+
+cleanup:
     return error;
 }
 
+/* Reads DTA files in a single pass with the value labels fetched ahead of
+ * the variables and rows */
+readstat_error_t read_file_prefetched(readstat_parser_t *parser, rt_parse_ctx_t *parse_ctx, long format) {
+    readstat_error_t error = READSTAT_OK;
+
+    if (!(format & RT_FORMAT_DTA))
+        return READSTAT_OK;
+
+    readstat_parser_reset(parser);
+
+    readstat_set_open_handler(parser, rt_open_handler);
+    readstat_set_close_handler(parser, rt_close_handler);
+    readstat_set_seek_handler(parser, rt_seek_handler);
+    readstat_set_read_handler(parser, rt_read_handler);
+    readstat_set_update_handler(parser, rt_update_handler);
+    readstat_set_io_ctx(parser, parse_ctx->buffer_ctx);
+
+    readstat_set_info_handler(parser, &handle_info);
+    readstat_set_variable_handler(parser, &handle_variable_after_labels);
+    readstat_set_value_handler(parser, &handle_value);
+    readstat_set_value_label_handler(parser, &handle_value_label);
+    readstat_set_error_handler(parser, &handle_error);
+    readstat_set_metadata_prefetch(parser, 1);
+
+    parse_ctx->buffer_ctx->pos = 0;
+    parse_ctx->var_index = -1;
+    parse_ctx->obs_index = -1;
+    parse_ctx->variables_count = 0;
+    parse_ctx->value_labels_count = 0;
+
+    error = parse_file(parser, parse_ctx, format);
+    if (error != READSTAT_OK)
+        goto cleanup;
+
+    push_error_if_doubles_differ(parse_ctx, parse_ctx->file->columns_count,
+            parse_ctx->variables_count, "Column count (prefetched)");
+
+    push_error_if_doubles_differ(parse_ctx, parse_ctx->file->rows,
+            parse_ctx->obs_index + 1, "Row count (prefetched)");
+
+    push_error_if_doubles_differ(parse_ctx, file_value_labels_count(parse_ctx->file),
+            parse_ctx->value_labels_count, "Value labels count (prefetched)");
+
+cleanup:
+    return error;
+}
@@ -4,4 +4,8 @@ void parse_ctx_reset(rt_parse_ctx_t *parse_ctx, long file_format);
 void parse_ctx_free(rt_parse_ctx_t *parse_ctx);
 
 char *file_extension(long format);
-readstat_error_t read_file(rt_parse_ctx_t *parse_ctx, long format);
+readstat_error_t read_file(readstat_parser_t *parser, rt_parse_ctx_t *parse_ctx, long format);
+readstat_error_t read_file_batched(readstat_parser_t *parser, rt_parse_ctx_t *parse_ctx, long format);
+readstat_error_t read_file_row_ranges(readstat_parser_t *parser, rt_parse_ctx_t *parse_ctx, long format);
+readstat_error_t read_file_lazy_strls(readstat_parser_t *parser, rt_parse_ctx_t *parse_ctx, long format);
+readstat_error_t read_file_prefetched(readstat_parser_t *parser, rt_parse_ctx_t *parse_ctx, long format);
@@ -89,8 +89,8 @@ rt_test_group_t _test_groups[] = {
             },
 
             {
-                .label = "SAS7BDAT RLE compression",
-                .test_formats = RT_FORMAT_SAS7BDAT_COMP_ROWS,
+                .label = "SAS7BDAT RLE and RDC compression",
+                .test_formats = RT_FORMAT_SAS7BDAT_COMP_ROWS | RT_FORMAT_SAS7BDAT_COMP_BINARY,
                 .rows = 10,
                 .columns = {
                     {
@@ -1742,7 +1742,7 @@ int main(int argc, char *argv[]) {
     rt_buffer_t *buffer = buffer_init();
     readstat_error_t error = READSTAT_OK;
 
-    int g, t, f;
+    int g, t, f, use_seeker;
 
     for (g=0; g<sizeof(_test_groups)/sizeof(_test_groups[0]); g++) {
         for (t=0; t<MAX_TESTS_PER_GROUP && _test_groups[g].tests[t].label[0]; t++) {
@@ -1754,31 +1754,52 @@ int main(int argc, char *argv[]) {
                 file->columns_count++;
             }
             rt_parse_ctx_t *parse_ctx = parse_ctx_init(buffer, file);
+            readstat_parser_t *parser = readstat_parser_init();
 
             for (f=RT_FORMAT_DTA_104; f<RT_FORMAT_ALL; f*=2) {
                 if (!(file->test_formats & f))
                     continue;
 
-                int old_errors_count = parse_ctx->errors_count;
-                parse_ctx_reset(parse_ctx, f);
+                /* Writers may take a different path when they can't seek
+                 * back, e.g. buffering a compressed SAS7BDAT file */
+                for (use_seeker=1; use_seeker>=0; use_seeker--) {
+                    int old_errors_count = parse_ctx->errors_count;
+                    parse_ctx_reset(parse_ctx, f);
 
-                error = write_file_to_buffer(file, buffer, f);
-                if (error != file->write_error) {
-                    push_error_if_codes_differ(parse_ctx, file->write_error, error);
-                    error = READSTAT_OK;
-                    continue;
-                }
-                if (error != READSTAT_OK) {
-                    error = READSTAT_OK;
-                    continue;
-                }
+                    error = write_file_to_buffer(file, buffer, f, use_seeker);
+                    if (error != file->write_error) {
+                        push_error_if_codes_differ(parse_ctx, file->write_error, error);
+                        error = READSTAT_OK;
+                        continue;
+                    }
+                    if (error != READSTAT_OK) {
+                        error = READSTAT_OK;
+                        continue;
+                    }
 
-                error = read_file(parse_ctx, f);
-                if (error != READSTAT_OK)
-                    goto cleanup;
+                    error = read_file(parser, parse_ctx, f);
+                    if (error != READSTAT_OK)
+                        goto cleanup;
 
-                if (old_errors_count != parse_ctx->errors_count)
-                    dump_buffer(buffer, f);
+                    error = read_file_batched(parser, parse_ctx, f);
+                    if (error != READSTAT_OK)
+                        goto cleanup;
+
+                    error = read_file_row_ranges(parser, parse_ctx, f);
+                    if (error != READSTAT_OK)
+                        goto cleanup;
+
+                    error = read_file_lazy_strls(parser, parse_ctx, f);
+                    if (error != READSTAT_OK)
+                        goto cleanup;
+
+                    error = read_file_prefetched(parser, parse_ctx, f);
+                    if (error != READSTAT_OK)
+                        goto cleanup;
+
+                    if (old_errors_count != parse_ctx->errors_count)
+                        dump_buffer(buffer, f);
+                }
             }
 
             if (parse_ctx->errors_count) {
@@ -1789,16 +1810,18 @@ int main(int argc, char *argv[]) {
                 return 1;
             }
 
-            free(parse_ctx);
+            readstat_parser_free(parser);
+            parse_ctx_free(parse_ctx);
         }
     }
 
 cleanup:
     if (error != READSTAT_OK) {
         dump_buffer(buffer, f);
-        printf("Error running test \"%s\" (format=%s): %s\n", 
+        printf("Error running test \"%s\" (format=%s, %s seeker): %s\n", 
                 _test_groups[g].tests[t].label,
-                file_extension(f), readstat_error_message(error));
+                file_extension(f), use_seeker ? "with" : "without",
+                readstat_error_message(error));
         return 1;
     }
 
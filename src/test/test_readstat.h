@@ -35,14 +35,19 @@
 
 #define RT_FORMAT_SAS7BDAT_32BIT_COMP_NONE    0x001000
 #define RT_FORMAT_SAS7BDAT_32BIT_COMP_ROWS    0x002000
-#define RT_FORMAT_SAS7BDAT_32BIT (RT_FORMAT_SAS7BDAT_32BIT_COMP_NONE | RT_FORMAT_SAS7BDAT_32BIT_COMP_ROWS)
+#define RT_FORMAT_SAS7BDAT_32BIT_COMP_BINARY  0x040000
+#define RT_FORMAT_SAS7BDAT_32BIT (RT_FORMAT_SAS7BDAT_32BIT_COMP_NONE | RT_FORMAT_SAS7BDAT_32BIT_COMP_ROWS | \
+        RT_FORMAT_SAS7BDAT_32BIT_COMP_BINARY)
 
 #define RT_FORMAT_SAS7BDAT_64BIT_COMP_NONE    0x004000
 #define RT_FORMAT_SAS7BDAT_64BIT_COMP_ROWS    0x008000
-#define RT_FORMAT_SAS7BDAT_64BIT (RT_FORMAT_SAS7BDAT_64BIT_COMP_NONE | RT_FORMAT_SAS7BDAT_64BIT_COMP_ROWS)
+#define RT_FORMAT_SAS7BDAT_64BIT_COMP_BINARY  0x080000
+#define RT_FORMAT_SAS7BDAT_64BIT (RT_FORMAT_SAS7BDAT_64BIT_COMP_NONE | RT_FORMAT_SAS7BDAT_64BIT_COMP_ROWS | \
+        RT_FORMAT_SAS7BDAT_64BIT_COMP_BINARY)
 
 #define RT_FORMAT_SAS7BDAT_COMP_NONE (RT_FORMAT_SAS7BDAT_32BIT_COMP_NONE | RT_FORMAT_SAS7BDAT_64BIT_COMP_NONE)
 #define RT_FORMAT_SAS7BDAT_COMP_ROWS (RT_FORMAT_SAS7BDAT_32BIT_COMP_ROWS | RT_FORMAT_SAS7BDAT_64BIT_COMP_ROWS)
+#define RT_FORMAT_SAS7BDAT_COMP_BINARY (RT_FORMAT_SAS7BDAT_32BIT_COMP_BINARY | RT_FORMAT_SAS7BDAT_64BIT_COMP_BINARY)
 
 #define RT_FORMAT_SAS7BDAT  (RT_FORMAT_SAS7BDAT_32BIT | RT_FORMAT_SAS7BDAT_64BIT)
 
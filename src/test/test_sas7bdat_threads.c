@@ -0,0 +1,371 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "../readstat.h"
+
+/* Enough rows to fill dozens of 4 KiB pages, so the threaded reader decodes
+ * several chunks of pages and starts all of its workers */
+#define ROWS        5000
+#define COLUMNS        5
+#define NAME_LEN      40
+
+typedef struct buffer_s {
+    unsigned char  *bytes;
+    size_t          used;
+    size_t          size;
+    size_t          pos;
+} buffer_t;
+
+typedef struct read_ctx_s {
+    buffer_t       *buffer;
+    uint64_t       *digests;
+    long            rows_count;
+    long            obs_index;
+    pthread_t       thread;
+} read_ctx_t;
+
+static double row_double(long row, int col) {
+    if (col == 1 && row % 97 == 0)
+        return NAN;
+    if (col == 0)
+        return row;
+    if (col == 1)
+        return row * 0.5;
+    return (double)((row * 2654435761u) % 100003) / 7.0;
+}
+
+static void row_string(long row, int col, char *dest, size_t len) {
+    if (col == 2) {
+        if (row % 13 == 0) {
+            dest[0] = '\0';
+        } else {
+            snprintf(dest, len, "row %ld", row);
+        }
+    } else {
+        snprintf(dest, len, "%s%ld", (row / 100) % 2 ? "alpha" : "beta", row % 7);
+    }
+}
+
+static uint64_t digest_bytes(uint64_t hash, const void *bytes, size_t len) {
+    const unsigned char *p = (const unsigned char *)bytes;
+    size_t i;
+    for (i=0; i<len; i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static uint64_t digest_double(uint64_t hash, double value, int is_missing) {
+    if (is_missing)
+        return digest_bytes(hash, "M", 1);
+    return digest_bytes(hash, &value, sizeof(double));
+}
+
+static uint64_t digest_string(uint64_t hash, const char *value, size_t len) {
+    hash = digest_bytes(hash, &len, sizeof(size_t));
+    return digest_bytes(hash, value, len);
+}
+
+static uint64_t expected_digest(long row) {
+    uint64_t hash = 14695981039346656037ULL;
+    char string[NAME_LEN+1];
+    int j;
+    for (j=0; j<COLUMNS; j++) {
+        if (j == 2 || j == 4) {
+            row_string(row, j, string, sizeof(string));
+            hash = digest_string(hash, string, strlen(string));
+        } else {
+            double value = row_double(row, j);
+            hash = digest_double(hash, value, isnan(value));
+        }
+    }
+    return hash;
+}
+
+static ssize_t write_data(const void *bytes, size_t len, void *ctx) {
+    buffer_t *buffer = (buffer_t *)ctx;
+    if (buffer->pos + len > buffer->size) {
+        size_t size = buffer->size ? buffer->size : 4096;
+        while (buffer->pos + len > size)
+            size *= 2;
+        unsigned char *new_bytes = realloc(buffer->bytes, size);
+        if (new_bytes == NULL)
+            return -1;
+        buffer->bytes = new_bytes;
+        buffer->size = size;
+    }
+    memcpy(buffer->bytes + buffer->pos, bytes, len);
+    buffer->pos += len;
+    if (buffer->pos > buffer->used)
+        buffer->used = buffer->pos;
+    return len;
+}
+
+static readstat_off_t seek_data(readstat_off_t offset, readstat_io_flags_t whence, void *ctx) {
+    buffer_t *buffer = (buffer_t *)ctx;
+    readstat_off_t newpos = -1;
+    if (whence == READSTAT_SEEK_SET) {
+        newpos = offset;
+    } else if (whence == READSTAT_SEEK_CUR) {
+        newpos = buffer->pos + offset;
+    } else if (whence == READSTAT_SEEK_END) {
+        newpos = buffer->used + offset;
+    }
+    if (newpos < 0 || newpos > buffer->used)
+        return -1;
+    buffer->pos = newpos;
+    return newpos;
+}
+
+static int open_handler(const char *path, void *io_ctx) {
+    ((buffer_t *)io_ctx)->pos = 0;
+    return 0;
+}
+
+static int close_handler(void *io_ctx) {
+    return 0;
+}
+
+static ssize_t read_handler(void *buf, size_t nbytes, void *io_ctx) {
+    buffer_t *buffer = (buffer_t *)io_ctx;
+    size_t bytes_left = buffer->used - buffer->pos;
+    if (nbytes > bytes_left)
+        nbytes = bytes_left;
+    memcpy(buf, buffer->bytes + buffer->pos, nbytes);
+    buffer->pos += nbytes;
+    return nbytes;
+}
+
+static readstat_error_t update_handler(long file_size, readstat_progress_handler progress_handler,
+        void *user_ctx, void *io_ctx) {
+    return READSTAT_OK;
+}
+
+static void write_file(buffer_t *buffer, readstat_compress_t compression) {
+    readstat_writer_t *writer = readstat_writer_init();
+    readstat_variable_t *variables[COLUMNS];
+    readstat_error_t error = READSTAT_OK;
+    char string[NAME_LEN+1];
+    long i;
+    int j;
+
+    readstat_set_data_writer(writer, &write_data);
+    readstat_set_data_seeker(writer, &seek_data);
+    readstat_writer_set_compression(writer, compression);
+
+    variables[0] = readstat_add_variable(writer, "id", READSTAT_TYPE_DOUBLE, 0);
+    variables[1] = readstat_add_variable(writer, "half", READSTAT_TYPE_DOUBLE, 0);
+    variables[2] = readstat_add_variable(writer, "label", READSTAT_TYPE_STRING, 12);
+    variables[3] = readstat_add_variable(writer, "hash", READSTAT_TYPE_DOUBLE, 0);
+    variables[4] = readstat_add_variable(writer, "name", READSTAT_TYPE_STRING, NAME_LEN);
+
+    if ((error = readstat_begin_writing_sas7bdat(writer, buffer, ROWS)) != READSTAT_OK)
+        goto cleanup;
+
+    for (i=0; i<ROWS; i++) {
+        if ((error = readstat_begin_row(writer)) != READSTAT_OK)
+            goto cleanup;
+        for (j=0; j<COLUMNS; j++) {
+            if (j == 2 || j == 4) {
+                row_string(i, j, string, sizeof(string));
+                error = readstat_insert_string_value(writer, variables[j], string);
+            } else if (isnan(row_double(i, j))) {
+                error = readstat_insert_missing_value(writer, variables[j]);
+            } else {
+                error = readstat_insert_double_value(writer, variables[j], row_double(i, j));
+            }
+            if (error != READSTAT_OK)
+                goto cleanup;
+        }
+        if ((error = readstat_end_row(writer)) != READSTAT_OK)
+            goto cleanup;
+    }
+
+    error = readstat_end_writing(writer);
+
+cleanup:
+    readstat_writer_free(writer);
+    if (error != READSTAT_OK) {
+        fprintf(stderr, "Error writing SAS7BDAT file: %s\n", readstat_error_message(error));
+        exit(EXIT_FAILURE);
+    }
+}
+
+static int handle_value(int obs_index, readstat_variable_t *variable, readstat_value_t value, void *ctx) {
+    read_ctx_t *read_ctx = (read_ctx_t *)ctx;
+    int var_index = readstat_variable_get_index(variable);
+
+    if (!pthread_equal(pthread_self(), read_ctx->thread)) {
+        fprintf(stderr, "Row %d was delivered on a worker thread\n", obs_index);
+        exit(EXIT_FAILURE);
+    }
+    if (obs_index != read_ctx->obs_index + (var_index == 0)) {
+        fprintf(stderr, "Row %d was delivered out of order\n", obs_index);
+        exit(EXIT_FAILURE);
+    }
+    read_ctx->obs_index = obs_index;
+    if (obs_index >= read_ctx->rows_count) {
+        fprintf(stderr, "Row %d is past the end of the file\n", obs_index);
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t *digest = &read_ctx->digests[obs_index];
+    if (var_index == 0)
+        *digest = 14695981039346656037ULL;
+
+    if (readstat_value_type(value) == READSTAT_TYPE_STRING) {
+        const char *string = readstat_string_value(value);
+        *digest = digest_string(*digest, string, string ? strlen(string) : 0);
+    } else {
+        *digest = digest_double(*digest, readstat_double_value(value),
+                readstat_value_is_system_missing(value));
+    }
+
+    return 0;
+}
+
+static int handle_batch(int obs_index, int obs_count, readstat_column_t *columns, int columns_count, void *ctx) {
+    read_ctx_t *read_ctx = (read_ctx_t *)ctx;
+    int i, j;
+
+    if (obs_index != read_ctx->obs_index + 1 || obs_index + obs_count > read_ctx->rows_count) {
+        fprintf(stderr, "Batch of rows %d-%d was delivered out of order\n",
+                obs_index, obs_index + obs_count - 1);
+        exit(EXIT_FAILURE);
+    }
+    read_ctx->obs_index = obs_index + obs_count - 1;
+
+    for (i=0; i<obs_count; i++) {
+        uint64_t digest = 14695981039346656037ULL;
+        for (j=0; j<columns_count; j++) {
+            readstat_column_t *column = &columns[j];
+            if (column->type == READSTAT_TYPE_STRING) {
+                digest = digest_string(digest, &column->string_data[column->string_offsets[i]],
+                        column->string_lengths[i]);
+            } else {
+                digest = digest_double(digest, column->double_values[i],
+                        column->missing[i/8] & (1 << (i%8)));
+            }
+        }
+        read_ctx->digests[obs_index + i] = digest;
+    }
+
+    return 0;
+}
+
+static long read_file(buffer_t *buffer, uint64_t *digests, int thread_count, int batched,
+        long row_offset, long row_limit) {
+    readstat_parser_t *parser = readstat_parser_init();
+    read_ctx_t read_ctx = { .buffer = buffer, .digests = digests,
+        .rows_count = ROWS, .obs_index = -1, .thread = pthread_self() };
+    readstat_error_t error = READSTAT_OK;
+
+    readstat_set_open_handler(parser, &open_handler);
+    readstat_set_close_handler(parser, &close_handler);
+    readstat_set_seek_handler(parser, &seek_data);
+    readstat_set_read_handler(parser, &read_handler);
+    readstat_set_update_handler(parser, &update_handler);
+    readstat_set_io_ctx(parser, buffer);
+
+    if (batched) {
+        readstat_set_batch_handler(parser, &handle_batch);
+        readstat_set_batch_size(parser, 100);
+    } else {
+        readstat_set_value_handler(parser, &handle_value);
+    }
+    readstat_set_thread_count(parser, thread_count);
+    readstat_set_row_offset(parser, row_offset);
+    readstat_set_row_limit(parser, row_limit);
+
+    error = readstat_parse_sas7bdat(parser, NULL, &read_ctx);
+    readstat_parser_free(parser);
+
+    if (error != READSTAT_OK) {
+        fprintf(stderr, "Error reading SAS7BDAT file (%d threads): %s\n",
+                thread_count, readstat_error_message(error));
+        exit(EXIT_FAILURE);
+    }
+
+    return read_ctx.obs_index + 1;
+}
+
+static void compare_digests(const uint64_t *expected, const uint64_t *received, long count,
+        const char *compression, const char *what) {
+    long i;
+    for (i=0; i<count; i++) {
+        if (expected[i] != received[i]) {
+            fprintf(stderr, "%s: row %ld differs in the %s\n", compression, i, what);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void check_compression(readstat_compress_t compression, const char *name) {
+    buffer_t buffer = { NULL, 0, 0, 0 };
+    uint64_t *expected = calloc(ROWS, sizeof(uint64_t));
+    uint64_t *serial = calloc(ROWS, sizeof(uint64_t));
+    uint64_t *threaded = calloc(ROWS, sizeof(uint64_t));
+    long windows[][2] = {
+        { 0, 0 },
+        { 1, 0 },
+        { 1234, 0 },
+        { 2500, 777 },
+        { ROWS - 1, 0 },
+        { ROWS, 0 }
+    };
+    int thread_counts[] = { 2, 4, 7 };
+    long i, count;
+    int t;
+
+    for (i=0; i<ROWS; i++) {
+        expected[i] = expected_digest(i);
+    }
+
+    write_file(&buffer, compression);
+
+    if ((count = read_file(&buffer, serial, 1, 0, 0, 0)) != ROWS) {
+        fprintf(stderr, "%s: serial read returned %ld rows\n", name, count);
+        exit(EXIT_FAILURE);
+    }
+    compare_digests(expected, serial, ROWS, name, "serial read");
+
+    for (t=0; t<sizeof(thread_counts)/sizeof(thread_counts[0]); t++) {
+        for (i=0; i<sizeof(windows)/sizeof(windows[0]); i++) {
+            long row_offset = windows[i][0];
+            long row_limit = windows[i][1];
+            long rows = row_limit ? row_limit : ROWS - row_offset;
+
+            memset(threaded, 0, ROWS * sizeof(uint64_t));
+            if ((count = read_file(&buffer, threaded, thread_counts[t], 0, row_offset, row_limit)) != rows) {
+                fprintf(stderr, "%s: threaded read from row %ld returned %ld rows\n", name, row_offset, count);
+                exit(EXIT_FAILURE);
+            }
+            compare_digests(&serial[row_offset], threaded, rows, name, "threaded read");
+
+            memset(threaded, 0, ROWS * sizeof(uint64_t));
+            if ((count = read_file(&buffer, threaded, thread_counts[t], 1, row_offset, row_limit)) != rows) {
+                fprintf(stderr, "%s: threaded batch read from row %ld returned %ld rows\n", name, row_offset, count);
+                exit(EXIT_FAILURE);
+            }
+            compare_digests(&serial[row_offset], threaded, rows, name, "threaded batch read");
+        }
+    }
+
+    free(buffer.bytes);
+    free(expected);
+    free(serial);
+    free(threaded);
+}
+
+int main(int argc, char *argv[]) {
+    check_compression(READSTAT_COMPRESS_NONE, "uncompressed");
+    check_compression(READSTAT_COMPRESS_ROWS, "RLE");
+    check_compression(READSTAT_COMPRESS_BINARY, "RDC");
+
+    return EXIT_SUCCESS;
+}
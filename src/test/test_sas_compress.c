@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../sas/readstat_sas_rdc.h"
+#include "../sas/readstat_sas_rle.h"
+
+#define ROW_LEN     600
+#define GUARD_LEN    64
+#define GUARD_BYTE 0xA5
+
+static void fill_row(unsigned char *row, size_t len, unsigned int seed) {
+    size_t i = 0;
+    while (i < len) {
+        size_t run = 1 + (seed = seed * 1103515245 + 12345) % 80;
+        unsigned char kind = (seed >> 16) % 5;
+        if (run > len - i)
+            run = len - i;
+        if (kind == 0) {
+            memset(&row[i], ' ', run);
+        } else if (kind == 1) {
+            memset(&row[i], '\0', run);
+        } else if (kind == 2) {
+            memset(&row[i], '@', run);
+        } else if (kind == 3) {
+            memset(&row[i], (seed >> 8) & 0xFF, run);
+        } else {
+            size_t j;
+            for (j=0; j<run; j++) {
+                row[i+j] = (seed = seed * 1103515245 + 12345) >> 16;
+            }
+        }
+        i += run;
+    }
+}
+
+/* Decompress untrusted input into a buffer of exactly ROW_LEN bytes and make
+ * sure the decompressor reports a sensible length without writing past it */
+static void check_bounds(const unsigned char *input, size_t input_len,
+        size_t (*decompress)(void *, size_t, const void *, size_t)) {
+    unsigned char output[ROW_LEN + GUARD_LEN];
+    size_t i;
+    memset(output, GUARD_BYTE, sizeof(output));
+    size_t len = decompress(output, ROW_LEN, input, input_len);
+    if (len > ROW_LEN && len != SAS_RLE_ERROR && len != SAS_RDC_ERROR) {
+        fprintf(stderr, "decompressed %ld bytes into a %d-byte buffer\n", (long)len, ROW_LEN);
+        exit(EXIT_FAILURE);
+    }
+    for (i=ROW_LEN; i<sizeof(output); i++) {
+        if (output[i] != GUARD_BYTE) {
+            fprintf(stderr, "wrote past the end of the output buffer\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void check_rle(const unsigned char *row, unsigned int seed) {
+    unsigned char compressed[2*ROW_LEN];
+    unsigned char decompressed[ROW_LEN];
+
+    size_t compressed_len = sas_rle_compress(compressed, sizeof(compressed), row, ROW_LEN);
+    if (compressed_len != sas_rle_compressed_len(row, ROW_LEN)) {
+        fprintf(stderr, "RLE compressed length mismatch for seed %u\n", seed);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t len = sas_rle_decompress(decompressed, sizeof(decompressed), compressed, compressed_len);
+    if (len != ROW_LEN || memcmp(row, decompressed, ROW_LEN) != 0) {
+        fprintf(stderr, "RLE round trip failed for seed %u\n", seed);
+        exit(EXIT_FAILURE);
+    }
+
+    if (sas_rle_decompress(decompressed, sizeof(decompressed) - 1,
+                compressed, compressed_len) != SAS_RLE_ERROR) {
+        fprintf(stderr, "RLE overflow not detected for seed %u\n", seed);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t i;
+    for (i=0; i<compressed_len; i++) {
+        check_bounds(compressed, i, &sas_rle_decompress);
+
+        unsigned char saved = compressed[i];
+        compressed[i] = seed * 31 + i;
+        check_bounds(compressed, compressed_len, &sas_rle_decompress);
+        compressed[i] = saved;
+    }
+}
+
+static void check_rdc(const unsigned char *row, unsigned int seed) {
+    unsigned char compressed[2*ROW_LEN];
+    unsigned char decompressed[ROW_LEN];
+
+    size_t compressed_len = sas_rdc_compress(compressed, sizeof(compressed), row, ROW_LEN);
+    if (compressed_len == 0) {
+        fprintf(stderr, "RDC compression failed for seed %u\n", seed);
+        exit(EXIT_FAILURE);
+    }
+    if (sas_rdc_compress(compressed, compressed_len - 1, row, ROW_LEN) != 0) {
+        fprintf(stderr, "RDC output overflow not detected for seed %u\n", seed);
+        exit(EXIT_FAILURE);
+    }
+    sas_rdc_compress(compressed, compressed_len, row, ROW_LEN);
+
+    size_t len = sas_rdc_decompress(decompressed, sizeof(decompressed), compressed, compressed_len);
+    if (len != ROW_LEN || memcmp(row, decompressed, ROW_LEN) != 0) {
+        fprintf(stderr, "RDC round trip failed for seed %u\n", seed);
+        exit(EXIT_FAILURE);
+    }
+
+    if (sas_rdc_decompress(decompressed, sizeof(decompressed) - 1,
+                compressed, compressed_len) != SAS_RDC_ERROR) {
+        fprintf(stderr, "RDC overflow not detected for seed %u\n", seed);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t i;
+    for (i=0; i<compressed_len; i++) {
+        check_bounds(compressed, i, &sas_rdc_decompress);
+
+        unsigned char saved = compressed[i];
+        compressed[i] = seed * 31 + i;
+        check_bounds(compressed, compressed_len, &sas_rdc_decompress);
+        compressed[i] = saved;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    unsigned char row[ROW_LEN];
+    unsigned int seed;
+
+    for (seed=1; seed<=200; seed++) {
+        fill_row(row, sizeof(row), seed);
+        check_rle(row, seed);
+        check_rdc(row, seed);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -86,5 +86,44 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
+    {
+        char s[] = "1500-01-01";
+        double v = readstat_sav_date_parse(s, &dest);
+        if (s == dest || v != -2612390400.0) {
+            fprintf(stderr, "expected %s to be -2612390400, was %lf\n", s, v);
+            exit(EXIT_FAILURE);
+        }
+        readstat_sav_date_string(v, buf2, sizeof(buf2)-1);
+        if (0 != strcmp(buf2, s)) {
+            fprintf(stderr, "Expected %s, got %s\n", s, buf2);
+            exit(EXIT_FAILURE);
+        }
+    }
+    {
+        const char *strings[] = { "1582-10-14", "1582-10-15", "2016-02-29", "2016-02-30" };
+        double seconds[4];
+        char out[3][16];
+        size_t n = readstat_sav_date_parse_batch(strings, 4, seconds);
+        if (n != 3 || seconds[0] != 0 || seconds[1] != 86400) {
+            fprintf(stderr, "batch parse failed after %d dates\n", (int)n);
+            exit(EXIT_FAILURE);
+        }
+        if (readstat_sav_date_string_batch(seconds, n, &out[0][0], sizeof(out[0])) != n) {
+            fprintf(stderr, "batch string failed\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int i=0; i<n; i++) {
+            if (0 != strcmp(out[i], strings[i])) {
+                fprintf(stderr, "Expected %s, got %s\n", strings[i], out[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        seconds[1] = 0.5;
+        if (readstat_sav_date_string_batch(seconds, 3, &out[0][0], sizeof(out[0])) != 1) {
+            fprintf(stderr, "expected batch string to stop at a fractional day\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
     return 0;
 }
@@ -78,6 +78,7 @@ typedef struct rt_error_s {
 
 typedef struct rt_buffer_s {
     size_t      used;
+    size_t      pos;
     size_t      size;
     char       *bytes;
 } rt_buffer_t;
@@ -97,6 +98,10 @@ typedef struct rt_parse_ctx_s {
     long             var_index;
     long             obs_index;
 
+    /* The rows being read, when a row offset or limit is set */
+    long             row_offset;
+    long             row_count;
+
     long             variables_count;
     long             value_labels_count;
     long             notes_count;
@@ -108,5 +113,8 @@ typedef struct rt_parse_ctx_s {
 
     size_t           max_file_label_len;
 
+    struct readstat_pool_s *pool;
+    long             pool_allocations;
+
     rt_buffer_ctx_t *buffer_ctx;
 } rt_parse_ctx_t;
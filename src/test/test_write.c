@@ -15,25 +15,47 @@ static void handle_error(const char *error_message, void *ctx) {
 
 static ssize_t write_data(const void *bytes, size_t len, void *ctx) {
     rt_buffer_t *buffer = (rt_buffer_t *)ctx;
-    while (len > buffer->size - buffer->used) {
+    while (len > buffer->size - buffer->pos) {
         buffer->size *= 2;
     }
     buffer->bytes = realloc(buffer->bytes, buffer->size);
     if (buffer->bytes == NULL) {
         return -1;
     }
-    memcpy(buffer->bytes + buffer->used, bytes, len);
-    buffer->used += len;
+    memcpy(buffer->bytes + buffer->pos, bytes, len);
+    buffer->pos += len;
+    if (buffer->pos > buffer->used)
+        buffer->used = buffer->pos;
     return len;
 }
 
-readstat_error_t write_file_to_buffer(rt_test_file_t *file, rt_buffer_t *buffer, long format) {
+static readstat_off_t seek_data(readstat_off_t offset, readstat_io_flags_t whence, void *ctx) {
+    rt_buffer_t *buffer = (rt_buffer_t *)ctx;
+    readstat_off_t newpos = -1;
+    if (whence == READSTAT_SEEK_SET) {
+        newpos = offset;
+    } else if (whence == READSTAT_SEEK_CUR) {
+        newpos = buffer->pos + offset;
+    } else if (whence == READSTAT_SEEK_END) {
+        newpos = buffer->used + offset;
+    }
+
+    if (newpos < 0 || newpos > buffer->used)
+        return -1;
+
+    buffer->pos = newpos;
+    return newpos;
+}
+
+readstat_error_t write_file_to_buffer(rt_test_file_t *file, rt_buffer_t *buffer, long format, int use_seeker) {
     readstat_error_t error = READSTAT_OK;
 
     ck_hash_table_t *label_sets = ck_hash_table_init(100);
 
     readstat_writer_t *writer = readstat_writer_init();
     readstat_set_data_writer(writer, &write_data);
+    if (use_seeker)
+        readstat_set_data_seeker(writer, &seek_data);
     readstat_writer_set_file_label(writer, file->label);
     readstat_writer_set_error_handler(writer, &handle_error);
     if (file->timestamp.tm_year) {
@@ -53,6 +75,8 @@ readstat_error_t write_file_to_buffer(rt_test_file_t *file, rt_buffer_t *buffer,
     } else if ((format & RT_FORMAT_SAS7BDAT)) {
         if ((format & RT_FORMAT_SAS7BDAT_COMP_ROWS)) {
             readstat_writer_set_compression(writer, READSTAT_COMPRESS_ROWS);
+        } else if ((format & RT_FORMAT_SAS7BDAT_COMP_BINARY)) {
+            readstat_writer_set_compression(writer, READSTAT_COMPRESS_BINARY);
         }
         readstat_writer_set_file_format_version(writer, sas_file_format_version(format));
         readstat_writer_set_file_format_is_64bit(writer, !!(format & RT_FORMAT_SAS7BDAT_64BIT));
@@ -143,9 +167,11 @@ readstat_error_t write_file_to_buffer(rt_test_file_t *file, rt_buffer_t *buffer,
             readstat_variable_set_format(variable, column->format);
 
         for (i=0; i<column->missing_ranges_count; i++) {
-            readstat_variable_add_missing_double_range(variable,
+            error = readstat_variable_add_missing_double_range(variable,
                     readstat_double_value(column->missing_ranges[i].lo),
                     readstat_double_value(column->missing_ranges[i].hi));
+            if (error != READSTAT_OK)
+                goto cleanup;
         }
 
         if (strcmp(column->name, file->fweight) == 0) {